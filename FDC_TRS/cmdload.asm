@@ -0,0 +1,151 @@
+;
+; cmdload.asm -- M1 Floppy-80 program loader
+;
+; Loads a /CMD program with the Floppy-80 reading the file, instead of DOS
+; reading it a sector at a time through the disk controller.
+;
+;	CMDLOAD file.cmd		from the SD-Card
+;	CMDLOAD NAME/CMD :n		from the DOS disk in drive n
+;
+; The Floppy-80 places the parts of the program above 8000h straight into
+; its memory (MEM=1 in system.cfg) and hands over the rest a record at a time.
+; A short stub in the transfer window at 3000h copies those records into
+; place and jumps to the program, so the program can load over this one.
+;
+
+LOAD_CMD      equ 25
+LOADNEXT_CMD  equ 26
+
+REQUEST_ADDR  equ 3400h
+RESPONSE_ADDR equ 3510h
+WINDOW_ADDR   equ 3000h
+
+; response
+LD_STATUS     equ RESPONSE_ADDR
+LD_ADDR       equ RESPONSE_ADDR+2	; load or transfer address
+LD_LENGTH     equ RESPONSE_ADDR+4	; bytes of data
+LD_DATA       equ RESPONSE_ADDR+6
+
+; status codes
+LD_DATA_OK    equ 0		; a record below 8000h
+LD_DONE       equ 1		; transfer address in LD_ADDR
+LD_NOFILE     equ 2
+LD_FORMAT     equ 3		; not a load module, or a read error
+
+DOS_EXIT      equ 402Dh
+
+	org	$5200
+
+; hl - command line after the program name
+start:
+	ld	de,REQUEST_ADDR+2
+
+cpy1:	ld	a,(hl)		; the file name, up to the end of the line
+	cp	13
+	jr	z,cpy2
+	or	a
+	jr	z,cpy2
+	ld	(de),a
+	inc	hl
+	inc	de
+	jr	cpy1
+
+cpy2:	xor	a
+	ld	(de),a
+
+	ld	a,LOAD_CMD	; the command byte starts the request
+	ld	(REQUEST_ADDR),a
+
+	call	ldwait
+	jr	nz,tmo
+
+	ld	a,(LD_STATUS)
+	cp	LD_NOFILE
+	jr	z,nofile
+	cp	LD_FORMAT
+	jr	z,badfmt
+
+	; nothing below 8000h has been written yet, from here on the stub in
+	; the transfer window does the rest
+	ld	hl,stub
+	ld	de,WINDOW_ADDR
+	ld	bc,stubend-stub
+	ldir
+	jp	WINDOW_ADDR
+
+tmo:	ld	hl,TMOstr
+	jr	error
+
+nofile:	ld	hl,NFstr
+	jr	error
+
+badfmt:	ld	hl,FMTstr
+
+error:	call	print
+	jp	DOS_EXIT
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; copied to the transfer window and run there, so it only uses relative
+; jumps and fixed addresses
+stub:
+	ld	a,(LD_STATUS)
+	cp	LD_DATA_OK
+	jr	nz,stub2
+
+	ld	bc,(LD_LENGTH)
+	ld	de,(LD_ADDR)
+	ld	hl,LD_DATA
+	ldir
+
+	ld	a,LOADNEXT_CMD
+	ld	(REQUEST_ADDR),a
+
+stub1:	ld	a,(REQUEST_ADDR)
+	or	a
+	jr	nz,stub1
+	jr	stub
+
+stub2:	cp	LD_DONE
+	jp	nz,DOS_EXIT	; the program is only partly loaded
+
+	ld	hl,(LD_ADDR)
+	jp	(hl)
+stubend:
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; wait for the Floppy80-M1 request to complete (mem(REQUEST_ADDR) == 0)
+; returns z set if the request completed
+ldwait:
+	push	bc
+	ld	bc,0
+
+ldw1:	ld	a,(REQUEST_ADDR)
+	or	a
+	jr	z,ldw2
+
+	dec	bc
+	ld	a,b
+	or	c
+	jr	nz,ldw1
+
+	inc	a		; nz, timed out
+
+ldw2:	pop	bc
+	ret
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; hl - address of null terminated string to display
+print:	ld	a,(hl)
+	or	a
+	ret	z
+	push	de
+	call	$33
+	pop	de
+	inc	hl
+	jr	print
+
+TMOstr:	ascii	'NO ANSWER FROM THE FLOPPY-80',13,0
+NFstr:	ascii	'FILE NOT FOUND',13,0
+FMTstr:	ascii	'NOT A LOAD MODULE',13,0
+
+	end	start
@@ -18,6 +18,13 @@ CLOSEFILE_CMD equ 8
 SETTIME_CMD   equ 9
 GETTIME_CMD   equ 10
 FORMAT_CMD    equ 11
+APPLYINI_CMD  equ 12
+ROTATE_CMD    equ 13
+BUSSTAT_CMD   equ 14
+PVREAD_CMD    equ 15
+PVWRITE_CMD   equ 16
+READBLK_CMD   equ 17
+MBINTR_CMD    equ 18
 
 FINDINI_CMD   equ 80h
 FINDDMK_CMD   equ 81h
@@ -26,6 +33,8 @@ FINDFMT_CMD   equ 83h
 
 REQUEST_ADDR  equ 3400h
 RESPONSE_ADDR equ 3510h
+WINDOW_ADDR   equ 3000h
+WINDOW_SIZE   equ 400h
 
 ; to detect equality of a value in A
 ;	cp	<whatever>
@@ -42,6 +51,22 @@ start:
 	ld	(REQUEST_ADDR+1),a
 	ld	(hidefsel),a
 	ld	(hidedsel),a
+	ld	(mbintr),a
+
+	; have the Floppy-80 interrupt when a request completes, so the waits
+	; below can halt rather than poll.  finish turns it off again on the
+	; way back to DOS.
+	ld	hl,finish
+	push	hl
+	xor	a		; older firmware leaves the response as it is
+	ld	(RESPONSE_ADDR),a
+	ld	a,1
+	ld	(REQUEST_ADDR+2),a
+	ld	a,MBINTR_CMD
+	ld	(REQUEST_ADDR),a
+	call	wait_for_ready
+	ld	a,(RESPONSE_ADDR)	; 1 if the firmware knows the request
+	ld	(mbintr),a
 
 	call	getparms
 
@@ -127,7 +152,34 @@ gotid6:
 	ld	(hidedsel),a
 	jp	getlist
 
+	;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+	; test for NXT command line parmameter
 gotid7:
+	ld	hl,parm1
+	ld	de,NXTstr
+	call	striequ
+	jr	nz,gotid8
+	jp	rotate
+
+	;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+	; test for LAT command line parmameter
+gotid8:
+	ld	hl,parm1
+	ld	de,LATstr
+	call	striequ
+	jr	nz,gotid9
+	jp	latency
+
+	;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+	; test for EXP command line parmameter
+gotid9:
+	ld	hl,parm1
+	ld	de,EXPstr
+	call	striequ
+	jr	nz,gotid10
+	jp	export
+
+gotid10:
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ; display FDC usage (help)
@@ -154,20 +206,54 @@ getsta:
 	call	wait_for_ready
 
 	; display status response
+showresp:
 	ld	hl,RESPONSE_ADDR+2
 	call	print
+	jp	exit
 
-	ld	a,(opcode)	; if mounting an ini file then hang until reset pressed
-	cp	FINDINI_CMD
-	jr	nz,getsta_exit
-
-	ld	hl,prompt_reset
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; parm2 - points to command line option 2 (drive number)
+;
+; mounts the next image of the disk set in the drive
+rotate:
+	ld	a,(parm2)
+	cp	0
+	jr	nz,rotate1	; drive index was specified
+	ld	hl,error1
 	call	print
-getsta_loop:
-	jp	getsta_loop
+	jp	info
 
-getsta_exit:
-	jp	exit
+rotate1:
+	ld	hl,parm2
+	call	strlen
+	inc	b		; include the null terminator
+	call	writedata	; hl - points to the data to be written
+				; b  - contains the number of bytes to be written
+
+	ld	a,ROTATE_CMD	; rotate disk set command
+	ld	hl,REQUEST_ADDR
+	ld	(hl),a
+
+	call	wait_for_ready
+	jp	showresp
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; parm2 - points to command line option 2 (C to clear)
+;
+; displays the bus cycle latency statistics of the Floppy-80
+latency:
+	ld	hl,parm2
+	call	strlen
+	inc	b		; include the null terminator
+	call	writedata	; hl - points to the data to be written
+				; b  - contains the number of bytes to be written
+
+	ld	a,BUSSTAT_CMD	; bus statistics command
+	ld	hl,REQUEST_ADDR
+	ld	(hl),a
+
+	call	wait_for_ready
+	jp	showresp
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ; parm2 - points to command line option 2 (the file name)
@@ -252,12 +338,39 @@ imploop:
 	ld	a,'.'
 	call	putc
 
-	; request next block of data from file
-	ld	a,READFILE_CMD
-	ld	hl,REQUEST_ADDR
-	ld	(hl),a
+	; the rest of the file comes through the transfer window, the Floppy-80
+	; reads the next block from the SD-Card while this one is written out
+impblk:
+	ld	hl,WINDOW_ADDR
+	ld	(REQUEST_ADDR+2),hl
+	ld	hl,WINDOW_SIZE
+	ld	(REQUEST_ADDR+4),hl
+	ld	a,READBLK_CMD
+	ld	(REQUEST_ADDR),a
+
+	call	wait_for_ready
 
-	jp	imploop
+	; (RESPONSE_ADDR) is the status, (RESPONSE_ADDR+2) the number of bytes
+	; placed at WINDOW_ADDR and (RESPONSE_ADDR+4) their offset in the file
+	ld	a,(RESPONSE_ADDR)
+	or	a
+	jr	nz,impdone
+
+	ld	hl,(RESPONSE_ADDR+2)
+	ld	a,h
+	or	l
+	jr	z,impdone	; if byte count is zero then we are done
+
+	ld	b,h
+	ld	c,l
+	ld	hl,WINDOW_ADDR
+	ld	de,fcb
+	call	fwriteblk
+
+	ld	a,'.'
+	call	putc
+
+	jp	impblk
 
 impdone:
 	; close file on controller
@@ -270,6 +383,114 @@ impdone:
 	call	fclose
 	ret
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; parm2 - points to command line option 2 (the file name)
+export:
+	; replace . with / in the file specification
+	ld	hl,parm2
+	ld	b,'.'
+	ld	c,'/'
+	call	strchr_replace
+
+	; initialze FCB
+	ld	de,fcb
+	ld	hl,parm2
+	call	fspec
+
+	; check for an error
+	jr	z,export1
+	ld	hl,experr1
+	call	print
+	jp	exit
+
+export1:
+	; open the existing file
+	ld	hl,fcbbuf
+	ld	de,fcb
+	call	fopen
+
+	; check for an error
+	jr	z,export2
+	ld	hl,imperr2
+	call	print
+	ret
+
+export2:
+	; build and send create file request to Floppy-80
+	ld	de,xferbuf
+	ld	hl,parm2
+	call	strcpy		; HL - source; DE - destination;
+
+	ld	hl,openw	; append ', wc'
+	ld	de,xferbuf
+	call	strcat		; HL - source; DE - destination;
+
+	ld	hl,xferbuf
+	call	print
+	ld	a,13
+	call	putc
+
+	ld	hl,xferbuf
+	call	strlen
+	inc     b
+	call	writedata	; hl - points to the data to be written
+				; b  - contains the number of bytes to be written
+
+	ld	a,OPENFILE_CMD
+	ld	(REQUEST_ADDR),a
+	call	wait_for_ready
+
+exploop:
+	; fill the request buffer with up to 256 bytes of the file
+	ld	hl,REQUEST_ADDR+2
+	ld	bc,0		; b - bytes to go (256), c - bytes read
+	ld	de,fcb
+
+exp1:	call	fgetc
+	jr	nz,exp2		; end of file (or error)
+	ld	(hl),a
+	inc	hl
+	inc	c
+	djnz	exp1
+	jr	exp3		; a full buffer, c has wrapped to 0
+
+exp2:	ld	a,c
+	or	a
+	jr	z,expdone	; nothing left to send
+
+exp3:	ld	a,c
+	ld	(REQUEST_ADDR+1),a	; byte count, 0 => 256
+	ld	a,WRITEFILE_CMD
+	ld	(REQUEST_ADDR),a
+	call	wait_for_ready
+
+	ld	a,(RESPONSE_ADDR)
+	or	a
+	jr	nz,experr
+
+	push	bc
+	ld	a,'.'
+	call	putc
+	pop	bc
+
+	ld	a,c
+	or	a
+	jr	z,exploop	; a full buffer, there may be more
+
+expdone:
+	; close file on controller, this writes what is still buffered
+	ld	a,CLOSEFILE_CMD
+	ld	(REQUEST_ADDR),a
+	call	wait_for_ready
+
+	ld	de,fcb
+	call	fclose
+	ret
+
+experr:	ld	hl,experr2
+	call	print
+	jr	expdone
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ; de - address of the File Control Block (FCB) to be initialized
 ; hl - address of file specification
@@ -285,12 +506,61 @@ finit:
 	call	4420h
 	ret
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; de - address of the File Control Block (FCB) of an existing file to open
+; hl - address of buffer to be used when accessing the file
+fopen:
+	ld	b,1
+	call	4424h
+	ret
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; de - address of the File Control Block (FCB) of the file to read
+; returns the next byte in a, nz at the end of the file
+fgetc:
+	push	hl
+	push	bc
+	push	de
+	call	0013h
+	pop	de
+	pop	bc
+	pop	hl
+	ret
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ; de - address of File Control Block (FCB) of file to close.
 fclose:
 	call	4428h
 	ret
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; bc - contains the number of bytes to write (not 0)
+; de - contains the address of the fcb
+; hl - contains the address of the bytes to write
+fwriteblk:
+	push	bc
+	ld	b,c		; the odd bytes first, 0 => 256
+	ld	a,c
+	or	a
+	jr	nz,fwb1
+	pop	bc
+	dec	b		; c = 0, whole pages only
+	push	bc
+	ld	b,0
+
+fwb1:	call	fwrite
+	pop	bc
+	ld	a,b
+	or	a
+	ret	z
+
+fwb2:	push	bc
+	ld	b,0		; then 256 at a time
+	call	fwrite
+	pop	bc
+	djnz	fwb2
+	ret
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ; b  - contains the number of bytes to write
 ; de - contains the address of the fcb
@@ -321,20 +591,13 @@ getlist:
 	cp	0
 	jr	z,getlist10
 
-	; if ((opcode) == 0x80) then set parm3 = '0' and call mountfile
+	; if ((opcode) == 0x80) then switch to the ini file
 	ld	a,(opcode)
 	cp	FINDINI_CMD
 	jr	nz,getlist1
 
-	; parm3[0] = '0'
-	; parm3[1] = 0
-	ld	a,'0'
-	ld	(parm3),a
-	ld	a,0
-	ld	(parm3+1),a
-
-	call	mountfile
-	jp	getsta
+	call	applyini
+	jp	showresp
 
 getlist1:
 	; make sure drive index was specified
@@ -553,6 +816,14 @@ sel_item30:
 	cp	0
 	jr	nz,sel_item40
 
+	ld	a,(opcode)
+	cp	FINDINI_CMD
+	jr	nz,sel_item35
+
+	call	applyini
+	jp	showresp
+
+sel_item35:
 	; if here we assume it is a mount file request
 	call	mountfile
 	jp	getsta
@@ -691,6 +962,34 @@ mountfile:
 	pop	a
 	ret
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; sends the name of the ini file in parm2 to the Floppy-80, which
+; mounts the images it specifies without the need for a reset.
+;
+; the response buffer contains the new status on return.
+;
+applyini:
+	push	a
+	push	hl
+	push	de
+
+	ld	hl,parm2
+	call	strlen
+	inc	b		; include the null terminator
+	call	writedata	; hl - points to the data to be written
+				; b  - contains the number of bytes to be written
+
+	ld	a,APPLYINI_CMD	; apply ini command
+	ld	hl,REQUEST_ADDR
+	ld	(hl),a
+
+	call	wait_for_ready
+
+	pop	de
+	pop	hl
+	pop	a
+	ret
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ; return HL = DE * A
 Mul8:	push	b
@@ -1169,9 +1468,28 @@ dly2:	call	delay
 	pop	b
 	ret
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; turn the request interrupt off again, top level routines return here
+finish:
+	ld	a,(mbintr)
+	or	a
+	ret	z
+
+	xor	a
+	ld	(mbintr),a
+	ld	(REQUEST_ADDR+2),a
+	ld	a,MBINTR_CMD
+	ld	(REQUEST_ADDR),a
+	jp	wait_for_ready
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ; wait for the Floppy80-M1 request to complete (mem(REQUEST_ADDR) == 0)
 ; times out if mem(REQUEST_ADDR) != 0 after 256 times through loop
+;
+; With the request interrupt on the Z80 sleeps in halt between checks.  The
+; Floppy-80 raises INT with bit 5 of 37E0h clear as soon as a request is done,
+; and reading 37E0h (which the DOS interrupt handler does) acknowledges it.
+; The 40Hz clock interrupt wakes it otherwise, so the time out is about 6s.
 wait_for_ready:
 	push	a
 	push	b
@@ -1183,6 +1501,15 @@ wnb1:	ld	a,(REQUEST_ADDR)
 	cp	0
 	jr	z,wnb3
 
+	ld	a,(mbintr)
+	or	a
+	jr	z,wnb2
+
+	ei
+	halt			; until the next interrupt
+	djnz	wnb1
+	jr	wnb3
+
 wnb2:	call	delay2		; give Floppy-80 time to do its thing
 	djnz	wnb1		; time out after 256 loops
 
@@ -1237,6 +1564,7 @@ getchar3:
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 exit:
+	call	finish
 	ld	hl,0
 	call	402dh
 	ret
@@ -1249,12 +1577,14 @@ intro:
 ;		ascii	'SET - set FDC date and time to the TRS-80 date and time.',13
 ;		ascii	'GET - set TRS-80 date and time to the FDC date and time.',13
 		ascii	'DIR - get a directory listing of the FDC SD-Card root folder.',13
-		ascii	'INI - select the default ini file.    FDC INI filename.ext',13
+		ascii	'INI - switch to another ini file.     FDC INI filename.ext',13
 		ascii	'DMK - mount a DMK disk image.         FDC DMK filename.ext n',13
 		ascii	'FOR - format DMK disk image.',13
+		ascii	'NXT - next image of a disk set.       FDC NXT n',13
+		ascii	'LAT - bus cycle latency.              FDC LAT [C | id]',13
 ;		ascii	'HFE - mount a HFE disk image.         FDC HFE filename.ext n',13
 		ascii   'IMP - import a file from the SD-Card. FDC IMP filename.ext:n',13
-;		ascii	'EXP - export a file to the SD-card.   FDC EXP filename/ext:n',13
+		ascii	'EXP - export a file to the SD-Card.   FDC EXP filename.ext:n',13
 		ascii	' ',13
 		ascii	'      filename.ext - is the filename and extension.',13
 		ascii	'      n - is the drive number (0-2).',13,0
@@ -1267,11 +1597,18 @@ imperr1:	ascii	'Error: invalid file specification',13
 		ascii   '   the file to be imported from the SD-Card.',13
 		ascii   ' - n is the logical drive to save file on',13,13,0
 imperr2:	ascii	'Error: unable to open the specified file',13,13,0
+experr1:	ascii	'Error: invalid file specification',13
+		ascii	'Usage: FDC EXP filename.ext:n',13
+		ascii	'Where:',13
+		ascii   ' - filename.ext is the file name and extension of',13
+		ascii   '   the file to be exported to the SD-Card.',13
+		ascii   ' - n is the logical drive the file is on',13,13,0
+experr2:	ascii	13,'Error: unable to write to the SD-Card',13,0
 
 cscr:		ascii   ' ', 28, 31, 15, 0
 space:		ascii	' ', 0
 openr:		ascii	', r', 0
-openw:		ascii	', w', 0
+openw:		ascii	', wc', 0
 
 STAstr:		ascii	'STA',0
 INIstr:		ascii	'INI',0
@@ -1281,12 +1618,13 @@ DIRstr:		ascii	'DIR',0
 IMPstr:		ascii	'IMP',0
 EXPstr:		ascii	'EXP',0
 FORstr:		ascii	'FOR',0
+NXTstr:		ascii	'NXT',0
+LATstr:		ascii	'LAT',0
 
 prompt_part1:	ascii	'Press 1-',0
 prompt_part2:	ascii	' to select the desired file.',13
 		ascii	'Press any other key for next set of files.',13,0
 prompt_drive:	ascii	'Specify drive to mount to (0-2).',13,0
-prompt_reset:	ascii	'Power OFF and back ON to continue.',13,0
 
 prompt_next:	ascii	'Press any key for next set of files.',13,0
 
@@ -1296,6 +1634,7 @@ hidedsel:	defs	1		; if not zero hide drive select to mount prompt
 found:		defs	1
 select:		defs	1
 drive:		defs	1
+mbintr:		defs	1		; not zero if the request interrupt is on
 
 fcb:		defs	48		; 48 for Model III TRSDOS 1.3   
 fcbbuf:		defs	256
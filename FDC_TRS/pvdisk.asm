@@ -0,0 +1,186 @@
+;
+; pvdisk.asm -- M1 Floppy-80 paravirtual disk driver
+;
+; Reference routines for a DOS disk driver that moves whole sectors between a
+; mounted DMK image and memory above 8000h with one Floppy-80 request, instead
+; of reading the data register and polling the status for every byte.
+;
+; The upper 32K is the Floppy-80 memory (MEM=1 in system.cfg), buffers below
+; 8000h can not be used.  Only one request is in progress at a time, and none
+; while a controller command (37ECh) is running.
+;
+; Run on its own it reads track 0 of drive 0 to 8000h and reports the result.
+;
+
+PVREAD_CMD    equ 15
+PVWRITE_CMD   equ 16
+
+REQUEST_ADDR  equ 3400h
+RESPONSE_ADDR equ 3510h
+
+; request parameters (REQUEST_ADDR+2 ...)
+PV_DRIVE      equ REQUEST_ADDR+2
+PV_SIDE       equ REQUEST_ADDR+3
+PV_TRACK      equ REQUEST_ADDR+4
+PV_SECTOR     equ REQUEST_ADDR+5
+PV_COUNT      equ REQUEST_ADDR+6
+PV_ADDR       equ REQUEST_ADDR+7
+
+; response
+PV_STATUS     equ RESPONSE_ADDR
+PV_DONE       equ RESPONSE_ADDR+1
+PV_NEXTSIDE   equ RESPONSE_ADDR+2
+PV_NEXTTRACK  equ RESPONSE_ADDR+3
+PV_NEXTSECTOR equ RESPONSE_ADDR+4
+
+; status codes
+PV_OK         equ 0
+PV_NODRIVE    equ 1		; drive not mounted
+PV_ADDRESS    equ 2		; buffer not between 8000h and FFFFh
+PV_NOTFOUND   equ 3		; first sector not on the track
+PV_CRCERR     equ 4
+PV_PROTECTED  equ 5
+PV_BUSY       equ 6		; a controller command is running
+PV_FORMAT     equ 7		; HFE image or double recorded single density data
+PV_TIMEOUT    equ 0FFh	; no answer from the Floppy-80
+
+	org	$5200
+
+start:
+	ld	a,0		; drive 0
+	ld	c,0		; side 0
+	ld	d,0		; track 0
+	ld	e,0		; sector 0
+	ld	b,10		; one single density track
+	ld	hl,8000h
+	call	pvread
+
+	push	bc
+	push	af
+	ld	hl,STATstr
+	call	print
+	pop	af
+	call	puthex
+	ld	hl,CNTstr
+	call	print
+	pop	bc
+	ld	a,b
+	call	puthex
+	ld	a,13
+	call	putc
+	ret
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; read sectors into memory
+; a  - drive (0-3)
+; c  - side
+; d  - track
+; e  - first sector, carries on to the next side and track at the end of one
+; b  - number of sectors (0 = 256)
+; hl - address to read to (8000h-FFFFh)
+; returns a = status (z set if PV_OK), b = number of sectors read
+pvread:
+	push	af
+	ld	a,PVREAD_CMD
+	jr	pvreq
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; write sectors from memory, parameters and result as for pvread
+pvwrite:
+	push	af
+	ld	a,PVWRITE_CMD
+
+pvreq:
+	ld	(pvcmd),a
+	pop	af
+	ld	(PV_DRIVE),a
+	ld	a,c
+	ld	(PV_SIDE),a
+	ld	a,d
+	ld	(PV_TRACK),a
+	ld	a,e
+	ld	(PV_SECTOR),a
+	ld	a,b
+	ld	(PV_COUNT),a
+	ld	(PV_ADDR),hl
+
+	ld	a,(pvcmd)	; the command byte starts the request
+	ld	(REQUEST_ADDR),a
+
+	call	pvwait
+	jr	nz,pvtmo
+
+	ld	a,(PV_DONE)
+	ld	b,a
+	ld	a,(PV_STATUS)
+	or	a
+	ret
+
+pvtmo:	ld	b,0
+	ld	a,PV_TIMEOUT
+	or	a
+	ret
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; wait for the Floppy80-M1 request to complete (mem(REQUEST_ADDR) == 0)
+; a track takes a few milliseconds to come from the SD-Card so the time out
+; is about a second rather than the 256 loops of wait_for_ready in fdc.asm
+; returns z set if the request completed
+pvwait:
+	push	bc
+	ld	bc,0
+
+pvw1:	ld	a,(REQUEST_ADDR)
+	or	a
+	jr	z,pvw2
+
+	dec	bc
+	ld	a,b
+	or	c
+	jr	nz,pvw1
+
+	inc	a		; nz, timed out
+
+pvw2:	pop	bc
+	ret
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; hl - address of null terminated string to display
+print:	ld	a,(hl)
+	or	a
+	ret	z
+	call	putc
+	inc	hl
+	jr	print
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; A - value to display as two hex digits
+puthex:	push	af
+	rrca
+	rrca
+	rrca
+	rrca
+	call	puthx1
+	pop	af
+
+puthx1:	and	0Fh
+	add	a,'0'
+	cp	'9'+1
+	jr	c,puthx2
+	add	a,'A'-'9'-1
+
+puthx2:	jp	putc
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; A - character to display.
+putc:	push	de
+	call	$33
+	pop	de
+	ret
+
+STATstr:	ascii	'STATUS ',0
+CNTstr:		ascii	' SECTORS ',0
+
+pvcmd:		defs	1
+
+	end	start
@@ -0,0 +1,638 @@
+#include <stddef.h>
+#include <string.h>
+
+#ifndef MFC
+	#include "pico/stdlib.h"
+#endif
+
+#include "defines.h"
+#include "file.h"
+#include "fdc.h"
+#include "system.h"
+#include "flash.h"
+#include "cache.h"
+
+//-----------------------------------------------------------------------------
+// RAM cache of raw DMK tracks.
+//
+// Entries are tagged with the id the file layer assigns each time a file is
+// opened, so an image that is closed and reopened (or another image that gets
+// the same file slot) can never match stale data.  Slots are recycled least
+// recently used first.
+
+static TrackCacheType g_tcCache[TRACK_CACHE_SLOTS + TRACK_CACHE_SPARE_SLOTS];
+static BYTE           g_byCacheData[TRACK_CACHE_SLOTS][MAX_TRACK_SIZE];
+static uint32_t       g_dwCacheClock;
+
+int      g_nCacheSlots;
+uint32_t g_dwCacheHits;
+uint32_t g_dwCacheMisses;
+
+//-----------------------------------------------------------------------------
+// the fixed slots, and as many more as fit in the RAM disk banks not in use
+void CacheInit(void)
+{
+	uint32_t dwSpare;
+	BYTE*    pby = RamDiskSpare(&dwSpare);
+	int      i;
+
+	for (i = 0; i < TRACK_CACHE_SLOTS; ++i)
+	{
+		g_tcCache[i].pbyData = g_byCacheData[i];
+	}
+
+	g_nCacheSlots = TRACK_CACHE_SLOTS;
+
+	while ((dwSpare >= MAX_TRACK_SIZE) && (g_nCacheSlots < TRACK_CACHE_SLOTS + TRACK_CACHE_SPARE_SLOTS))
+	{
+		g_tcCache[g_nCacheSlots++].pbyData = pby;
+		pby     += MAX_TRACK_SIZE;
+		dwSpare -= MAX_TRACK_SIZE;
+	}
+
+	for (i = 0; i < g_nCacheSlots; ++i)
+	{
+		g_tcCache[i].dwFileId = 0;
+	}
+
+	g_dwCacheClock  = 0;
+	g_dwCacheHits   = 0;
+	g_dwCacheMisses = 0;
+}
+
+//-----------------------------------------------------------------------------
+static TrackCacheType* CacheFind(file* f, int nSide, int nTrack)
+{
+	int i;
+
+	if (f == NULL)
+	{
+		return NULL;
+	}
+
+	for (i = 0; i < g_nCacheSlots; ++i)
+	{
+		if ((g_tcCache[i].dwFileId == f->dwId) && (g_tcCache[i].nSide == nSide) && (g_tcCache[i].nTrack == nTrack))
+		{
+			return &g_tcCache[i];
+		}
+	}
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// copies the cached track to pby, returns TRUE on a hit
+int CacheRead(file* f, int nSide, int nTrack, BYTE* pby, int nSize)
+{
+	TrackCacheType* ptc = CacheFind(f, nSide, nTrack);
+
+	if ((ptc == NULL) || (ptc->nSize != nSize))
+	{
+		++g_dwCacheMisses;
+		return FALSE;
+	}
+
+	memcpy(pby, ptc->pbyData, nSize);
+	ptc->dwLastUsed = ++g_dwCacheClock;
+	++g_dwCacheHits;
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// adds the track to the cache, or replaces the cached copy (write through)
+void CacheStore(file* f, int nSide, int nTrack, BYTE* pby, int nSize)
+{
+	TrackCacheType* ptc;
+	int i;
+
+	if ((f == NULL) || (nSize <= 0) || (nSize > MAX_TRACK_SIZE))
+	{
+		return;
+	}
+
+	ptc = CacheFind(f, nSide, nTrack);
+
+	if (ptc == NULL)
+	{
+		ptc = &g_tcCache[0];
+
+		for (i = 1; i < g_nCacheSlots; ++i)
+		{
+			if (g_tcCache[i].dwFileId == 0)
+			{
+				ptc = &g_tcCache[i];
+				break;
+			}
+
+			if (g_tcCache[i].dwLastUsed < ptc->dwLastUsed)
+			{
+				ptc = &g_tcCache[i];
+			}
+		}
+	}
+
+	memcpy(ptc->pbyData, pby, nSize);
+	ptc->dwFileId   = f->dwId;
+	ptc->nSide      = nSide;
+	ptc->nTrack     = nTrack;
+	ptc->nSize      = nSize;
+	ptc->dwLastUsed = ++g_dwCacheClock;
+}
+
+//-----------------------------------------------------------------------------
+int CacheContains(file* f, int nSide, int nTrack)
+{
+	return (CacheFind(f, nSide, nTrack) != NULL);
+}
+
+//-----------------------------------------------------------------------------
+// drops every track of the image, used when it is rewritten as a whole
+void CacheInvalidate(file* f)
+{
+	int i;
+
+	if (f == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < g_nCacheSlots; ++i)
+	{
+		if (g_tcCache[i].dwFileId == f->dwId)
+		{
+			g_tcCache[i].dwFileId = 0;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Flash tier
+//
+// Tracks of the mounted images are copied to the onboard flash in idle time,
+// so they can be read back without going to the SD-Card, also after a reset or
+// power cycle.  Each drive has its own partition, the first sector holds the
+// header (image name, geometry, signature and one state byte per track), the
+// track slots follow, each a whole number of sectors.  Tracks that do not fit
+// in the partition are not cached.
+//
+// The partition is only used when the size and modification time of the image
+// match the last signature in the header.  The board has no clock, so an image
+// the firmware writes keeps its time (and mostly its size), the signature only
+// catches changes made elsewhere.  Everything the firmware does to an image is
+// therefore also recorded in flash straight away:
+//   - a write goes through to the SD-Card and the stale mark of the track is
+//     programmed at once (a page program only clears bits, no erase needed),
+//     once the disk is quiet the new signature of the image is appended
+//   - when the partition is to be rebuilt, or the image is changed in a way
+//     the partition can not follow, or recreated as a whole (format, copy),
+//     the magic of the header is cleared so no later mount can use it
+// When all the signature slots have been used the partition is rebuilt.
+//
+// Flash is never erased ahead of time, the header sector when the partition is
+// rebuilt and the sectors of a slot just before its track is programmed.
+
+byte     g_byEnableFlashCache;
+uint32_t g_dwFlashHits;
+
+static FlashPartType g_fpPart[MAX_DRIVES];
+static uint64_t      g_nFlashLastUse;
+static int           g_nFlashService;
+static BYTE          g_byFlashPage[FLASH_PAGE_SIZE];
+
+//-----------------------------------------------------------------------------
+static uint32_t FlashCachePartOffset(int nPart)
+{
+	return nPart * FLASH_CACHE_PART_SIZE;
+}
+
+//-----------------------------------------------------------------------------
+// programs one byte of the header of a partition, the rest of the page is
+// 0xFF so it stays as it is
+static void FlashCacheProgramByte(int nPart, int nOffset, BYTE by)
+{
+	memset(g_byFlashPage, 0xFF, sizeof(g_byFlashPage));
+	g_byFlashPage[nOffset & (FLASH_PAGE_SIZE-1)] = by;
+	FlashRegionProgram(FlashCachePartOffset(nPart) + (nOffset & ~(FLASH_PAGE_SIZE-1)), g_byFlashPage, sizeof(g_byFlashPage));
+}
+
+//-----------------------------------------------------------------------------
+// makes the header in flash unusable until the partition is rebuilt, pszFileName
+// NULL for any image
+static void FlashCacheClearMagic(int nPart, char* pszFileName)
+{
+	FlashHeaderType fh;
+
+	FlashRegionRead(FlashCachePartOffset(nPart), (byte*)&fh, sizeof(fh));
+
+	if (memcmp(fh.szMagic, "F80F", 4) != 0)
+	{
+		return;
+	}
+
+	if ((pszFileName != NULL) && (strncmp(fh.szName, pszFileName, sizeof(fh.szName)-1) != 0))
+	{
+		return;
+	}
+
+	FlashCacheProgramByte(nPart, 0, 0);
+}
+
+//-----------------------------------------------------------------------------
+// With FLASH=0 writes to the images are not followed, so the partitions left
+// from an earlier FLASH=1 are made unusable.
+void FlashCacheInit(void)
+{
+	int i;
+
+	memset(g_fpPart, 0, sizeof(g_fpPart));
+
+	g_dwFlashHits   = 0;
+	g_nFlashLastUse = 0;
+	g_nFlashService = 0;
+
+	FlashRegionInit();
+
+	if (!g_byEnableFlashCache)
+	{
+		for (i = 0; i < MAX_DRIVES; ++i)
+		{
+			FlashCacheClearMagic(i, NULL);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// The image is about to be recreated (format, copy), its size and time stamp
+// may well come out the same so the signature can not tell.  Every partition
+// holding it is made unusable, an attached one until the image is mounted
+// again.
+void FlashCacheForget(char* pszFileName)
+{
+	int i;
+
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		FlashCacheClearMagic(i, pszFileName);
+
+		if ((g_fpPart[i].nState != eFlashDetached) && (strcmp(g_fpPart[i].szFileName, pszFileName) == 0))
+		{
+			g_fpPart[i].nState = eFlashInvalid;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+static FlashPartType* FlashCacheFind(file* f)
+{
+	int i;
+
+	if (f == NULL)
+	{
+		return NULL;
+	}
+
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		if ((g_fpPart[i].nState != eFlashDetached) && (g_fpPart[i].dwFileId == f->dwId))
+		{
+			return &g_fpPart[i];
+		}
+	}
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// tracks are stored in the same order as in a DMK file, so the tracks read
+// first during a boot are filled first
+static int FlashCacheSlot(FlashPartType* pfp, int nSide, int nTrack)
+{
+	int nSlot;
+
+	if ((nSide < 0) || (nSide >= pfp->fh.byNumSides) || (nTrack < 0) || (nTrack >= pfp->fh.byNumTracks))
+	{
+		return -1;
+	}
+
+	nSlot = nTrack * pfp->fh.byNumSides + nSide;
+
+	if (nSlot >= pfp->nSlots)
+	{
+		return -1;
+	}
+
+	return nSlot;
+}
+
+//-----------------------------------------------------------------------------
+static void FlashCacheNewHeader(FlashPartType* pfp, int nTrackSize, int nSides, int nTracks, FlashSigType* psig)
+{
+	memset(pfp->byHeader, 0xFF, sizeof(pfp->byHeader));
+
+	memcpy(pfp->fh.szMagic, "F80F", 4);
+	pfp->fh.wTrackSize  = nTrackSize;
+	pfp->fh.byNumSides  = nSides;
+	pfp->fh.byNumTracks = nTracks;
+	CopyString(pfp->szFileName, pfp->fh.szName, sizeof(pfp->fh.szName)-1);
+	pfp->fh.sig[0]      = *psig;
+
+	pfp->nSig   = 0;
+	pfp->nState = eFlashRebuild;
+
+	// the old header stays in flash until the rebuild erases it
+	FlashCacheClearMagic(pfp - g_fpPart, NULL);
+}
+
+//-----------------------------------------------------------------------------
+void FlashCacheAttach(int nPart, file* f, char* pszFileName, int nTrackSize, int nSides, int nTracks)
+{
+	FlashPartType* pfp;
+	FlashSigType   sig;
+	int i;
+
+	if (!g_byEnableFlashCache || (nPart < 0) || (nPart >= MAX_DRIVES) || (f == NULL))
+	{
+		return;
+	}
+
+	pfp = &g_fpPart[nPart];
+	memset(pfp, 0, sizeof(FlashPartType));
+
+	if ((nTrackSize <= 0) || (nTrackSize > MAX_TRACK_SIZE) || !FileStat(pszFileName, &sig.dwSize, &sig.dwTime))
+	{
+		return;
+	}
+
+	pfp->f         = f;
+	pfp->dwFileId  = f->dwId;
+	pfp->nSlotSize = (nTrackSize + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE-1);
+	pfp->nSlots    = (FLASH_CACHE_PART_SIZE - FLASH_SECTOR_SIZE) / pfp->nSlotSize;
+
+	if (pfp->nSlots > FLASH_CACHE_SLOTS)
+	{
+		pfp->nSlots = FLASH_CACHE_SLOTS;
+	}
+
+	CopyString(pszFileName, pfp->szFileName, sizeof(pfp->szFileName)-1);
+
+	// writes are only followed in this partition, a copy of the image left in
+	// another one (mounted in a different drive before) would go out of date
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		if ((i != nPart) && (g_fpPart[i].nState == eFlashDetached))
+		{
+			FlashCacheClearMagic(i, pfp->szFileName);
+		}
+	}
+
+	FlashRegionRead(FlashCachePartOffset(nPart), pfp->byHeader, sizeof(pfp->byHeader));
+
+	if ((memcmp(pfp->fh.szMagic, "F80F", 4) != 0) || (pfp->fh.wTrackSize != nTrackSize) || (pfp->fh.byNumSides != nSides) ||
+	    (pfp->fh.byNumTracks != nTracks) || (strncmp(pfp->fh.szName, pfp->szFileName, sizeof(pfp->fh.szName)-1) != 0))
+	{
+		FlashCacheNewHeader(pfp, nTrackSize, nSides, nTracks, &sig);
+		return;
+	}
+
+	// the last signature written has to match the image
+	for (i = 0; (i < FLASH_CACHE_SIGS-1) && (pfp->fh.sig[i+1].dwSize != 0xFFFFFFFF); ++i)
+	{
+	}
+
+	if ((pfp->fh.sig[i].dwSize != sig.dwSize) || (pfp->fh.sig[i].dwTime != sig.dwTime))
+	{
+		FlashCacheNewHeader(pfp, nTrackSize, nSides, nTracks, &sig);
+		return;
+	}
+
+	pfp->nSig   = i;
+	pfp->nState = eFlashValid;
+}
+
+//-----------------------------------------------------------------------------
+// called when the image is closed, the flash contents remain for the next mount
+void FlashCacheDetach(int nPart)
+{
+	if ((nPart < 0) || (nPart >= MAX_DRIVES))
+	{
+		return;
+	}
+
+	g_fpPart[nPart].nState = eFlashDetached;
+	g_fpPart[nPart].f      = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// copies the track from flash to pby, returns TRUE on a hit
+int FlashCacheRead(file* f, int nSide, int nTrack, BYTE* pby, int nSize)
+{
+	FlashPartType* pfp = FlashCacheFind(f);
+	int nSlot;
+
+	g_nFlashLastUse = time_us_64();
+
+	if ((pfp == NULL) || (pfp->nState != eFlashValid) || (nSize != pfp->fh.wTrackSize))
+	{
+		return FALSE;
+	}
+
+	nSlot = FlashCacheSlot(pfp, nSide, nTrack);
+
+	if ((nSlot < 0) || (pfp->fh.byState[nSlot] != FLASH_SLOT_PRESENT))
+	{
+		return FALSE;
+	}
+
+	FlashRegionRead(FlashCachePartOffset(pfp - g_fpPart) + FLASH_SECTOR_SIZE + nSlot * pfp->nSlotSize, pby, nSize);
+	++g_dwFlashHits;
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// the track has been written to the SD-Card
+void FlashCacheInvalidate(file* f, int nSide, int nTrack)
+{
+	FlashPartType* pfp = FlashCacheFind(f);
+	int nSlot;
+
+	g_nFlashLastUse = time_us_64();
+
+	if (pfp == NULL)
+	{
+		return;
+	}
+
+	// the header gets the new signature even if the track was not cached
+	pfp->byHeaderDirty = TRUE;
+	nSlot = FlashCacheSlot(pfp, nSide, nTrack);
+
+	if ((nSlot < 0) || (pfp->fh.byState[nSlot] == FLASH_SLOT_EMPTY) || (pfp->fh.byState[nSlot] == FLASH_SLOT_STALE))
+	{
+		return;
+	}
+
+	pfp->fh.byState[nSlot] = FLASH_SLOT_STALE;
+
+	// programmed now, not once the disk is quiet, as the time stamp of the
+	// image does not change and a power loss before then would leave the old
+	// track in use.  A partition still to be rebuilt has nothing in flash.
+	if (pfp->nState == eFlashValid)
+	{
+		FlashCacheProgramByte(pfp - g_fpPart, offsetof(FlashHeaderType, byState) + nSlot, FLASH_SLOT_STALE);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the image has been changed in a way the partition can not follow (geometry),
+// it is rebuilt the next time the image is mounted
+void FlashCacheDiscard(file* f)
+{
+	FlashPartType* pfp = FlashCacheFind(f);
+
+	if (pfp != NULL)
+	{
+		pfp->nState = eFlashInvalid;
+		FlashCacheClearMagic(pfp - g_fpPart, NULL);
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void FlashCacheProgramHeader(FlashPartType* pfp)
+{
+	FlashRegionProgram(FlashCachePartOffset(pfp - g_fpPart), pfp->byHeader, sizeof(pfp->byHeader));
+}
+
+//-----------------------------------------------------------------------------
+// programs the stale marks and appends the current signature of the image
+static void FlashCacheUpdateSignature(FlashPartType* pfp)
+{
+	FlashSigType sig;
+
+	pfp->byHeaderDirty = FALSE;
+
+	FileFlush(pfp->f);
+
+	if (!FileStat(pfp->szFileName, &sig.dwSize, &sig.dwTime))
+	{
+		pfp->nState = eFlashInvalid;
+		return;
+	}
+
+	if ((sig.dwSize == pfp->fh.sig[pfp->nSig].dwSize) && (sig.dwTime == pfp->fh.sig[pfp->nSig].dwTime))
+	{
+		FlashCacheProgramHeader(pfp);
+		return;
+	}
+
+	if (pfp->nSig >= FLASH_CACHE_SIGS-1)
+	{
+		FlashCacheNewHeader(pfp, pfp->fh.wTrackSize, pfp->fh.byNumSides, pfp->fh.byNumTracks, &sig);
+		return;
+	}
+
+	// the stale marks have to be in flash before the new signature
+	FlashCacheProgramHeader(pfp);
+
+	++pfp->nSig;
+	pfp->fh.sig[pfp->nSig] = sig;
+	FlashCacheProgramHeader(pfp);
+}
+
+//-----------------------------------------------------------------------------
+// copies the next missing track to flash, returns FALSE when there are none
+static int FlashCacheFillSlot(FlashPartType* pfp, BYTE* pbyBuffer)
+{
+	uint32_t dwOffset;
+	int nSlot, nSize, i;
+
+	nSlot = pfp->nFill;
+
+	while ((nSlot < pfp->nSlots) && (nSlot < pfp->fh.byNumTracks * pfp->fh.byNumSides) && (pfp->fh.byState[nSlot] != FLASH_SLOT_EMPTY))
+	{
+		++nSlot;
+	}
+
+	pfp->nFill = nSlot + 1;
+
+	if ((nSlot >= pfp->nSlots) || (nSlot >= pfp->fh.byNumTracks * pfp->fh.byNumSides))
+	{
+		return FALSE;
+	}
+
+	FileSeek(pfp->f, DMK_HEADER_SIZE + nSlot * pfp->fh.wTrackSize);
+
+	if (FileRead(pfp->f, pbyBuffer, pfp->fh.wTrackSize) != pfp->fh.wTrackSize)
+	{
+		return TRUE;
+	}
+
+	dwOffset = FlashCachePartOffset(pfp - g_fpPart) + FLASH_SECTOR_SIZE + nSlot * pfp->nSlotSize;
+	FlashRegionErase(dwOffset, pfp->nSlotSize);
+
+	for (i = 0; i < pfp->fh.wTrackSize; i += FLASH_PAGE_SIZE)
+	{
+		nSize = pfp->fh.wTrackSize - i;
+
+		if (nSize > FLASH_PAGE_SIZE)
+		{
+			nSize = FLASH_PAGE_SIZE;
+		}
+
+		memset(g_byFlashPage, 0xFF, sizeof(g_byFlashPage));
+		memcpy(g_byFlashPage, pbyBuffer + i, nSize);
+		FlashRegionProgram(dwOffset + i, g_byFlashPage, sizeof(g_byFlashPage));
+	}
+
+	pfp->fh.byState[nSlot] = FLASH_SLOT_PRESENT;
+	FlashCacheProgramHeader(pfp);
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// idle time processing, one flash operation per call and only after the disks
+// have been quiet for a while as erasing a sector takes tens of milliseconds.
+// pbyBuffer is scratch space for a track.
+void FlashCacheService(BYTE* pbyBuffer)
+{
+	FlashPartType* pfp;
+	int i;
+
+	if (!g_byEnableFlashCache || ((time_us_64() - g_nFlashLastUse) < FLASH_CACHE_QUIET))
+	{
+		return;
+	}
+
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		pfp = &g_fpPart[g_nFlashService];
+		g_nFlashService = (g_nFlashService + 1) % MAX_DRIVES;
+
+		switch (pfp->nState)
+		{
+			case eFlashRebuild:
+				FlashRegionErase(FlashCachePartOffset(pfp - g_fpPart), FLASH_SECTOR_SIZE);
+				FlashCacheProgramHeader(pfp);
+				pfp->nFill  = 0;
+				pfp->nState = eFlashValid;
+				return;
+
+			case eFlashValid:
+				if (pfp->byHeaderDirty)
+				{
+					FlashCacheUpdateSignature(pfp);
+					return;
+				}
+
+				if (FlashCacheFillSlot(pfp, pbyBuffer))
+				{
+					return;
+				}
+
+				break;
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef _H_CACHE_
+#define _H_CACHE_
+
+#include "defines.h"
+#include "file.h"
+#include "fdc.h"
+#include "flash.h"
+#include "ramdisk.h"
+
+// Number of whole tracks kept in RAM, each slot holds up to MAX_TRACK_SIZE
+// bytes.  The large SRAM buffers are
+//
+//   upper memory (MEM=1)          32K
+//   snapshot copy                 32K
+//   track buffers (2) and load    48K
+//   track cache, fixed slots      64K
+//   RAM disk banks               128K, the banks RAMDISK= leaves unused
+//                                      are further track cache slots
+//
+// about 300K of the 520K, the rest is left to the stacks, FatFs and USB.
+#define TRACK_CACHE_SLOTS       4
+#define TRACK_CACHE_SPARE_SLOTS ((RAMDISK_MAX_BANKS * RAMDISK_BANK_SIZE) / MAX_TRACK_SIZE)
+
+typedef struct {
+	uint32_t dwFileId;		// file.dwId of the image, 0 => slot unused
+	int      nSide;
+	int      nTrack;
+	int      nSize;
+	uint32_t dwLastUsed;
+	BYTE*    pbyData;		// MAX_TRACK_SIZE bytes
+} TrackCacheType;
+
+// flash tier, one partition per drive in the flash region
+#define FLASH_CACHE_PART_SIZE ((FLASH_REGION_SIZE / MAX_DRIVES) & ~(FLASH_SECTOR_SIZE-1))
+#define FLASH_CACHE_SLOTS     128		// max tracks per partition
+#define FLASH_CACHE_SIGS      16		// image changes before the partition is rebuilt
+#define FLASH_CACHE_QUIET     1000000	// us without disk activity before flash is programmed
+
+// slot states, each change only clears bits so it can be programmed over the old state
+#define FLASH_SLOT_EMPTY   0xFF
+#define FLASH_SLOT_PRESENT 0x7F
+#define FLASH_SLOT_STALE   0x00
+
+enum {
+	eFlashDetached = 0,
+	eFlashInvalid,			// not usable until the image is mounted again
+	eFlashRebuild,			// partition has to be erased before it is used
+	eFlashValid,
+};
+
+typedef struct {
+	uint32_t dwSize;		// 0xFFFFFFFF => signature slot unused
+	uint32_t dwTime;
+} FlashSigType;
+
+// first sector of each partition, followed by the track slots
+typedef struct {
+	char         szMagic[4];
+	WORD         wTrackSize;
+	BYTE         byNumSides;
+	BYTE         byNumTracks;
+	char         szName[56];
+	FlashSigType sig[FLASH_CACHE_SIGS];		// appended each time the image is written
+	BYTE         byState[FLASH_CACHE_SLOTS];
+} FlashHeaderType;
+
+#define FLASH_HEADER_SIZE ((sizeof(FlashHeaderType) + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE-1))
+
+typedef struct {
+	int      nState;
+	file*    f;
+	uint32_t dwFileId;
+	char     szFileName[128];
+	int      nSlotSize;		// whole sectors per track
+	int      nSlots;		// slots used by the image
+	int      nSig;			// index of the current signature
+	int      nFill;			// next slot to fill
+	BYTE     byHeaderDirty;	// tracks have gone stale since the header was programmed
+	union {
+		FlashHeaderType fh;
+		BYTE            byHeader[FLASH_HEADER_SIZE];
+	};
+} FlashPartType;
+
+extern int      g_nCacheSlots;
+extern uint32_t g_dwCacheHits;
+extern uint32_t g_dwCacheMisses;
+extern byte     g_byEnableFlashCache;
+extern uint32_t g_dwFlashHits;
+
+void CacheInit(void);
+int  CacheRead(file* f, int nSide, int nTrack, BYTE* pby, int nSize);
+void CacheStore(file* f, int nSide, int nTrack, BYTE* pby, int nSize);
+int  CacheContains(file* f, int nSide, int nTrack);
+void CacheInvalidate(file* f);
+
+void FlashCacheInit(void);
+void FlashCacheAttach(int nPart, file* f, char* pszFileName, int nTrackSize, int nSides, int nTracks);
+void FlashCacheDetach(int nPart);
+int  FlashCacheRead(file* f, int nSide, int nTrack, BYTE* pby, int nSize);
+void FlashCacheInvalidate(file* f, int nSide, int nTrack);
+void FlashCacheDiscard(file* f);
+void FlashCacheForget(char* pszFileName);
+void FlashCacheService(BYTE* pbyBuffer);
+
+#endif
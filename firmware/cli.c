@@ -10,11 +10,14 @@
 #include "file.h"
 #include "fdc.h"
 #include "hdc.h"
-
-void ServiceFdcLog(void);
+#include "memory.h"
+#include "logging.h"
+#include "dos.h"
+#include "snapshot.h"
+#include "ramdisk.h"
 
 extern FdcDriveType g_dtDives[MAX_DRIVES];
-extern TrackType    g_tdTrack;
+extern DiskSetType  g_dsSets[MAX_DRIVES];
 
 static uint64_t g_nCdcPrevTime;
 static uint32_t g_nCdcConnectDuration;
@@ -36,12 +39,37 @@ static char szHelpText[] = {
                         "dir filter - returns a directory listing of the root folder of the SD-Card\n"
                         "             optionally include a filter.  For example dir .ini\n"
                         "boot file  - selects an ini file to be specified in the boot.cfg\n"
-                        "logon      - enable output of FDC interface logging output\n"
+                        "apply file - switches to an ini file without a reset, only the\n"
+                        "             drives that change are remounted\n"
+                        "logon      - enable output of FDC interface logging output, optionally\n"
+                        "             limited to the classes drv, fdc, data and hdc.  For example\n"
+                        "             logon fdc hdc\n"
                         "logoff     - disable output of FDC interface logging output\n"
                         "disks      - returns the stats to the mounted diskettes\n"
+                        "next drive - mounts the next image of the disk set in the drive\n"
+                        "profile    - returns the boot profile statistics, profile del\n"
+                        "             deletes the profile of the current ini file\n"
+                        "lat        - returns the bus cycle latency of each handler, in\n"
+                        "             cpu cycles, lat clr clears the statistics\n"
                         "dump drive - returns sectors of each track on the indicate drive (0 - 2)\n"
                         "hdc        - creates a new vitual hard disk. Usage:\n"
                         "             hdc file.ext heads cylinders sectors\n"
+                        "dosput     - copies an SD-Card file onto the DOS disk in a drive. Usage:\n"
+                        "             dosput drive file.ext [NAME/EXT]\n"
+                        "dosdir     - lists the files of the DOS disk in a drive. Usage:\n"
+                        "             dosdir drive [NAME/EXT], * and ? are wildcards\n"
+                        "dosget     - copies files of the DOS disk in a drive to the SD-Card.\n"
+                        "             Usage: dosget drive NAME/EXT, * and ? are wildcards\n"
+                        "dup        - copies the image in one drive over the image in another\n"
+                        "             in the background. Usage: dup src dst, dup alone shows\n"
+                        "             the progress\n"
+                        "memsave    - saves the upper 32K of memory to a file, compressed unless\n"
+                        "             raw is given. Usage: memsave file [raw]\n"
+                        "memload    - restores the upper 32K of memory from a file saved by\n"
+                        "             memsave. Usage: memload file\n"
+                        "ramsave    - writes the RAM disk to its image file (RAMIMG=)\n"
+                        "ramload    - reloads the RAM disk from its image file\n"
+                        "reboot     - restarts the Pico and reloads the configuration\n"
                     };
 
 void InitCli(void)
@@ -99,6 +127,12 @@ void ProcessDisksRequest(void)
     for (i = 0; i < MAX_DRIVES; ++i)
     {
         printf("File name  : %s\r\n", g_dtDives[i].szFileName);
+
+        if (g_dsSets[i].nImageCount > 0)
+        {
+            printf("Disk set   : %s (%d of %d)\r\n", g_dsSets[i].szSetName, g_dsSets[i].nCurImage+1, g_dsSets[i].nImageCount);
+        }
+
         printf("Density    : %s\r\n", pszDensity[g_dtDives[i].dmk.byDensity]);
         printf("Num sides  : %d\r\n", g_dtDives[i].dmk.byNumSides);
         printf("Track size : %d\r\n", g_dtDives[i].dmk.wTrackLength);
@@ -106,16 +140,120 @@ void ProcessDisksRequest(void)
     }
 }
 
+void ProcessProfileRequest(char* pszParm)
+{
+    char  szName[80];
+    char* pszMode[] = {"off", "recording", "replaying", "done"};
+    char* pszRun[]  = {"none", "recorded", "replayed", "-"};
+
+    FdcGetProfileName(szName, sizeof(szName));
+
+    if (stricmp(pszParm, "DEL") == 0)
+    {
+        printf("%s %s\r\n", szName, FileDelete(szName) ? "deleted" : "not found");
+        return;
+    }
+
+    printf("Profile    : %s (%s)\r\n", szName, g_byEnableBootProfile ? "enabled" : "disabled");
+    printf("State      : %s, last boot %s\r\n", pszMode[g_bpProfile.nMode], pszRun[g_bpProfile.nRecordedMode]);
+    printf("Entries    : %d\r\n", g_bpProfile.nCount);
+    printf("Track loads: %d, %d cache hits", g_bpProfile.nLoads, g_bpProfile.nHits);
+
+    if (g_bpProfile.nLoads > 0)
+    {
+        printf(" (%d%%)", g_bpProfile.nHits * 100 / g_bpProfile.nLoads);
+    }
+
+    printf("\r\n");
+
+    if (g_bpProfile.nMode == eProfileDone)
+    {
+        printf("Boot time  : %lu ms\r\n", g_bpProfile.dwBootTime / 1000);
+    }
+
+    printf("Recorded   : %lu ms (without profile)\r\n", g_bpProfile.dwRecordedTime / 1000);
+}
+
+// returns the LOG_CLASS_xxx mask of a list of class names, all for an empty list
+uint32_t GetLogClasses(char* psz)
+{
+    char* pszName[] = {"DRV", "FDC", "DATA", "HDC"};
+    char  szWord[16];
+    uint32_t dwClasses = 0;
+    int   i;
+
+    while (*psz != 0)
+    {
+        psz = GetWord(psz, szWord, sizeof(szWord)-2);
+
+        for (i = 0; i < SizeOfArray(pszName); ++i)
+        {
+            if (stricmp(szWord, pszName[i]) == 0)
+            {
+                dwClasses |= 1 << i;
+            }
+        }
+    }
+
+    if (dwClasses == 0)
+    {
+        return LOG_CLASS_ALL;
+    }
+
+    return dwClasses;
+}
+
+void ProcessLatencyRequest(char* pszParm)
+{
+    char szBuf[1024];
+    int  i, j;
+
+    BusFormatStats(szBuf, sizeof(szBuf), "\r\n");
+    printf("%s\r\n", szBuf);
+
+    // histogram, bucket n holds the cycles with a count of 2^n to 2^(n+1)-1
+    printf("HANDLER ");
+
+    for (j = 0; j < BUS_STAT_BUCKETS; ++j)
+    {
+        printf("%7d", 1 << j);
+    }
+
+    printf("\r\n");
+
+    for (i = 1; i < g_nHandlers; ++i)
+    {
+        if (g_bsStats[i].dwCount == 0)
+        {
+            continue;
+        }
+
+        printf("%-8s", g_pszHandler[i]);
+
+        for (j = 0; j < BUS_STAT_BUCKETS; ++j)
+        {
+            printf("%7lu", g_bsStats[i].dwHist[j]);
+        }
+
+        printf("\r\n");
+    }
+
+    if (stricmp(pszParm, "CLR") == 0)
+    {
+        BusClearStats();
+    }
+}
+
 void DumpSector(int nDrive, int nTrack, int nSector)
 {
-    int nOffset = g_tdTrack.nSectorIndexMarkOffset[nSector];
+    int nOffset = g_ptdTrack->nSectorIndexMarkOffset[nSector];
 
     if (nOffset < 0)
     {
         return;
     }
 
-    BYTE* pby = g_tdTrack.byTrackData + nOffset - 3;
+    BYTE* pby = g_ptdTrack->byTrackData + nOffset - 3;
     int   i = 1;
     int   state = 0;
     int   size = 512;
@@ -240,6 +378,77 @@ void CreateHdcFile(char* psz)
     HdcCreateVhd(szFileName, nHeads, nCylinders, nSectors);
 }
 
+void CopyDosFile(char* psz)
+{
+    char     szParm1[16] = {""};
+    char     szFileName[64];
+    char     szDosName[16];
+    uint32_t dwSize;
+    int      nDrive, nResult;
+
+    psz = GetWord(psz, szParm1, sizeof(szParm1)-2);
+    nDrive = atoi(szParm1);
+
+    psz = GetWord(psz, szFileName, sizeof(szFileName)-2);
+    psz = GetWord(psz, szDosName, sizeof(szDosName)-2);
+
+    nResult = DosImport(nDrive, szFileName, szDosName, &dwSize);
+
+    if (nResult != eDosOk)
+    {
+        printf("%s\r\n", DosErrorText(nResult));
+        return;
+    }
+
+    printf("Copied %s to drive %d (%u bytes)\r\n", szFileName, nDrive, (unsigned)dwSize);
+}
+
+void ListDosFiles(char* psz)
+{
+    char        szParm1[16] = {""};
+    DosFileType df;
+    int         nDrive, nFiles, nResult;
+    uint32_t    dwTotal;
+
+    psz = GetWord(psz, szParm1, sizeof(szParm1)-2);
+    nDrive = atoi(szParm1);
+
+    nResult = DosFindFirst(nDrive, psz, &df);
+
+    if (nResult != eDosOk)
+    {
+        printf("%s\r\n", DosErrorText(nResult));
+        return;
+    }
+
+    for (nFiles = 0, dwTotal = 0; nResult == eDosOk; ++nFiles)
+    {
+        printf("%-12s %7u\r\n", df.szName, (unsigned)df.dwSize);
+        dwTotal += df.dwSize;
+        nResult = DosFindNext(&df);
+    }
+
+    printf("%d file(s), %u bytes\r\n", nFiles, (unsigned)dwTotal);
+}
+
+void GetDosFiles(char* psz)
+{
+    char szParm1[16] = {""};
+    int  nDrive, nFiles, nResult;
+
+    psz = GetWord(psz, szParm1, sizeof(szParm1)-2);
+    nDrive = atoi(szParm1);
+
+    nResult = DosExport(nDrive, psz, &nFiles);
+
+    if (nResult != eDosOk)
+    {
+        printf("%s\r\n", DosErrorText(nResult));
+    }
+
+    printf("%d file(s) copied from drive %d\r\n", nFiles, nDrive);
+}
+
 void ProcessCommand(char* psz)
 {
     char szParm1[16] = {""};
@@ -268,6 +477,24 @@ void ProcessCommand(char* psz)
         return;
     }
 
+    if (stricmp(szCmd, "APPLY") == 0)
+    {
+        int nCount;
+
+        psz = GetWord(psz, szParm1, sizeof(szParm1)-2);
+        nCount = FdcApplyIni(szParm1);
+
+        if (nCount < 0)
+        {
+            printf("Unable to read %s\r\n", szParm1);
+            return;
+        }
+
+        printf("%d drive(s) remounted\r\n", nCount);
+        FdcProcessStatusRequest(true);
+        return;
+    }
+
     if (stricmp(szCmd, "STATUS") == 0)
     {
         FdcProcessStatusRequest(true);
@@ -277,12 +504,18 @@ void ProcessCommand(char* psz)
     if (stricmp(szCmd, "LOGON") == 0)
     {
         g_bOutputLog = true;
+#ifdef ENABLE_LOGGING
+        LogEnable(GetLogClasses(psz));
+#endif
         return;
     }
 
     if (stricmp(szCmd, "LOGOFF") == 0)
     {
         g_bOutputLog = false;
+#ifdef ENABLE_LOGGING
+        LogEnable(0);
+#endif
         return;
     }
 
@@ -292,6 +525,37 @@ void ProcessCommand(char* psz)
         return;
     }
 
+    if (stricmp(szCmd, "NEXT") == 0)
+    {
+        int nDrive;
+
+        psz = GetWord(psz, szParm1, sizeof(szParm1)-2);
+        nDrive = atoi(szParm1);
+
+        if (FdcRotateDiskSet(nDrive) < 0)
+        {
+            printf("Drive %d does not contain a disk set\r\n", nDrive);
+            return;
+        }
+
+        printf("Drive %d: %s (%d of %d)\r\n", nDrive, g_dtDives[nDrive].szFileName, g_dsSets[nDrive].nCurImage+1, g_dsSets[nDrive].nImageCount);
+        return;
+    }
+
+    if (stricmp(szCmd, "PROFILE") == 0)
+    {
+        psz = GetWord(psz, szParm1, sizeof(szParm1)-2);
+        ProcessProfileRequest(szParm1);
+        return;
+    }
+
+    if (stricmp(szCmd, "LAT") == 0)
+    {
+        psz = GetWord(psz, szParm1, sizeof(szParm1)-2);
+        ProcessLatencyRequest(szParm1);
+        return;
+    }
+
     if (stricmp(szCmd, "DUMP") == 0)
     {
         psz = GetWord(psz, szParm1, sizeof(szParm1)-2);
@@ -305,6 +569,107 @@ void ProcessCommand(char* psz)
         return;
     }
 
+    if (stricmp(szCmd, "DOSDIR") == 0)
+    {
+        ListDosFiles(psz);
+        return;
+    }
+
+    if (stricmp(szCmd, "DOSGET") == 0)
+    {
+        GetDosFiles(psz);
+        return;
+    }
+
+    if (stricmp(szCmd, "DOSPUT") == 0)
+    {
+        CopyDosFile(psz);
+        return;
+    }
+
+    if (stricmp(szCmd, "DUP") == 0)
+    {
+        char szBuf[80];
+        int  nSrc;
+
+        psz = GetWord(psz, szParm1, sizeof(szParm1)-2);
+
+        if (szParm1[0] != 0)
+        {
+            nSrc = atoi(szParm1);
+            psz  = GetWord(psz, szParm1, sizeof(szParm1)-2);
+            FdcStartDiskCopy(nSrc, atoi(szParm1));
+        }
+
+        FdcFormatDiskCopy(szBuf, sizeof(szBuf), "\r\n");
+        printf("%s", szBuf);
+        return;
+    }
+
+    if (stricmp(szCmd, "MEMSAVE") == 0)
+    {
+        char     szFileName[64];
+        uint32_t dwSize;
+        int      nResult;
+
+        psz = GetWord(psz, szFileName, sizeof(szFileName)-2);
+        psz = GetWord(psz, szParm1, sizeof(szParm1)-2);
+        nResult = SnapSave(szFileName, stricmp(szParm1, "RAW") != 0, &dwSize);
+
+        if (nResult != eSnapOk)
+        {
+            printf("%s\r\n", SnapErrorText(nResult));
+            return;
+        }
+
+        printf("Saved 8000-FFFF to %s (%u bytes)\r\n", szFileName, (unsigned)dwSize);
+        return;
+    }
+
+    if (stricmp(szCmd, "MEMLOAD") == 0)
+    {
+        char szFileName[64];
+        int  nResult;
+
+        psz = GetWord(psz, szFileName, sizeof(szFileName)-2);
+        nResult = SnapLoad(szFileName);
+
+        if (nResult != eSnapOk)
+        {
+            printf("%s\r\n", SnapErrorText(nResult));
+            return;
+        }
+
+        printf("Loaded 8000-FFFF from %s\r\n", szFileName);
+        return;
+    }
+
+    if ((stricmp(szCmd, "RAMSAVE") == 0) || (stricmp(szCmd, "RAMLOAD") == 0))
+    {
+        bool bSave = (stricmp(szCmd, "RAMSAVE") == 0);
+
+        if (g_byRamDiskBanks == 0)
+        {
+            puts("RAM disk not enabled (RAMDISK=)");
+            return;
+        }
+
+        if (!(bSave ? RamDiskSave() : RamDiskLoad()))
+        {
+            printf("Unable to %s %s\r\n", bSave ? "write" : "read", g_szRamDiskImage[0] ? g_szRamDiskImage : "(no RAMIMG=)");
+            return;
+        }
+
+        printf("RAM disk %s %s\r\n", bSave ? "written to" : "read from", g_szRamDiskImage);
+        return;
+    }
+
+    if (stricmp(szCmd, "REBOOT") == 0)
+    {
+        SysColdReset();
+        return;
+    }
+
     puts("Unknown command");
     puts(szHelpText);
 }
@@ -353,7 +718,7 @@ void ServiceCli(void)
     }
     else
     {
-        log_tail = log_head;
+        RingFlush(&g_rbLog);
     }
 #endif
 
@@ -5,6 +5,13 @@
 #define ENABLE_DOUBLER 1
 #define ENABLE_LOGGING 1
 
+// set to 1 to let a PIO state machine (bus.pio) do the Z80 bus handshake,
+// core1 then only decodes the events and supplies the data (the host bus test
+// builds memory.c with it set, see test/Makefile)
+#ifndef ENABLE_PIO_BUS
+#define ENABLE_PIO_BUS 0
+#endif
+
 //#pragma GCC optimize ("O0")
 #pragma GCC optimize ("O3")
 
@@ -12,6 +19,11 @@
 
 #define CDC_ITF     0           /* USB CDC interface no */
 
+// the host tests (test/) take the C library's types, on the Pico they are the
+// same as the ones below
+#ifdef HOST_TEST
+	#include <stdint.h>
+#else
 typedef signed char        	int8_t;
 typedef unsigned char		uint8_t;
 typedef short              	int16_t;
@@ -20,6 +32,7 @@ typedef long               	int32_t;
 typedef unsigned long      	uint32_t;
 typedef long long          	int64_t;
 typedef unsigned long long 	uint64_t;
+#endif
 
 typedef unsigned char		byte;
 typedef unsigned short     	word;
@@ -154,36 +167,6 @@ typedef unsigned long      	dword;
   #define MAX_PATH 64
 #endif
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-// FDC logging
-
-typedef struct {
-	uint8_t type;
-	uint8_t val;
-	uint8_t op1;
-} LogType;
-
-#define LOG_SIZE 4096
-
-extern LogType fdc_log[LOG_SIZE];
-extern int log_head;
-extern int log_tail;
-
-enum {
-	write_drive_select = 0,
-	write_data,
-	write_sector,
-	write_track,
-	write_cmd,
-	read_drive_select,
-	read_data,
-	read_sector,
-	read_track,
-	read_status,
-	port_out,
-	port_in
-};
-
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // typedefs
 
@@ -208,6 +191,16 @@ enum {
   opNop
 };
 
+// WAIT in system.cfg
+enum {
+	eWaitOff = 0,
+	eWaitAlways,		// every cycle decoded
+	eWaitDemand,		// only while core0 has not caught up with a command
+};
+
+// longest a demand wait may be held, the Z80 does not refresh DRAM while waiting
+#define WAIT_MAX_TIME 1000	// us
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // global variables
 
@@ -217,11 +210,15 @@ enum {
 extern volatile uint8_t  sd_byCardInialized;
 extern volatile byte     g_byFdcIntrActive;
 extern volatile byte     g_byRtcIntrActive;
+extern volatile byte     g_byMbIntrActive;
 extern volatile byte     g_byResetActive;
+extern volatile uint32_t g_dwResetRelease;
 extern volatile byte     g_byEnableIntr;
 extern volatile int32_t  g_nRotationCount;
 extern volatile byte     g_byEnableUpperMem;
 extern volatile byte     g_byEnableWaitStates;
+extern volatile uint32_t g_dwWaitCycles;
+extern volatile uint32_t g_dwWaitTime;
 extern volatile uint32_t g_dwLedCount;
 extern volatile byte     g_byEnableVhd;
 
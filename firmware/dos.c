@@ -0,0 +1,1036 @@
+#include <string.h>
+#include <ctype.h>
+
+#ifndef MFC
+	#include "pico/stdlib.h"
+#endif
+
+#include "defines.h"
+#include "file.h"
+#include "system.h"
+#include "fdc.h"
+#include "dos.h"
+
+//-----------------------------------------------------------------------------
+// TRS-80 DOS files on a mounted DMK image.
+//
+// The boot sector gives the directory track.  Its first sector is the GAT, one
+// byte per track with a bit per granule in use (and a lockout table at 60h),
+// the second the HIT, one byte per directory entry holding the hash of the
+// file name (0 => free).  The directory entry of HIT position p (the DEC) is
+// entry p >> 5 of directory sector (p & 1Fh) + 2.  A file's granules are
+// given by extents of two bytes: the track, then the first granule on it in
+// the top 3 bits and the number of contiguous granules less one in the low 5.
+// FFh ends the list, FEh links to an extended entry whose DEC follows.
+//
+// Sectors are read and written through FdcReadImageSector() and
+// FdcWriteImageSector(), so the directory and data of an image that is in use
+// come from (and go to) the track caches.
+
+extern FdcDriveType g_dtDives[MAX_DRIVES];
+
+// kept off the stack, only one DOS operation runs at a time
+static DosDiskType g_ddDisk;
+static BYTE        g_byDosSector[DOS_SECTOR_SIZE];
+static int         g_nDosGrans[DOS_MAX_GRANS];
+static BYTE        g_byDosPattern[DOS_NAME_SIZE];
+static int         g_nDosFindDec;
+
+// file open for reading, its granules are in g_nDosGrans
+static uint32_t    g_dwDosReadSize;
+static uint32_t    g_dwDosReadPos;
+static int         g_nDosReadSector = -1;	// of the file, in g_byDosSector
+
+//-----------------------------------------------------------------------------
+const char* DosErrorText(int nError)
+{
+	switch (nError)
+	{
+		case eDosOk:        return "OK";
+		case eDosNoDisk:    return "Drive not mounted, not a DMK image or busy";
+		case eDosFormat:    return "No DOS directory found";
+		case eDosNotFound:  return "File not found";
+		case eDosDirFull:   return "Directory full";
+		case eDosDiskFull:  return "Disk full";
+		case eDosIoError:   return "Disk read or write error";
+		case eDosProtected: return "Disk write protected";
+	}
+
+	return "?";
+}
+
+//-----------------------------------------------------------------------------
+// the HIT hash of a space padded name and extension
+BYTE DosHash(BYTE* pbyName)
+{
+	BYTE byHash = 0;
+	int  i;
+
+	for (i = 0; i < DOS_NAME_SIZE; ++i)
+	{
+		byHash ^= pbyName[i];
+		byHash  = (byHash << 1) | (byHash >> 7);
+	}
+
+	return (byHash == 0) ? 1 : byHash;
+}
+
+//-----------------------------------------------------------------------------
+// NAME/EXT, NAME.EXT or an SD-Card path into the space padded directory form
+void DosMakeName(char* psz, BYTE* pbyName)
+{
+	char* pszBase = psz;
+	int   i;
+
+	// only the file name of a path, and no drive specification
+	while (*psz != 0)
+	{
+		if ((*psz == '\\') || (*psz == ':'))
+		{
+			pszBase = psz + 1;
+		}
+
+		++psz;
+	}
+
+	memset(pbyName, ' ', DOS_NAME_SIZE);
+	psz = pszBase;
+
+	for (i = 0; (i < 8) && isalnum((unsigned char)*psz); ++i, ++psz)
+	{
+		pbyName[i] = toupper((unsigned char)*psz);
+	}
+
+	while ((*psz != 0) && (*psz != '/') && (*psz != '.'))
+	{
+		++psz;
+	}
+
+	if (*psz != 0)
+	{
+		++psz;
+	}
+
+	for (i = 8; (i < DOS_NAME_SIZE) && isalnum((unsigned char)*psz); ++i, ++psz)
+	{
+		pbyName[i] = toupper((unsigned char)*psz);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// only sectors of DOS_SECTOR_SIZE bytes are used, a larger one is not copied
+// past the end of the buffer
+static int DosReadSector(DosDiskType* pdd, int nTrack, int nSector, BYTE* pby)
+{
+	return (FdcReadImageSector(pdd->nDrive, 0, nTrack, nSector, pby, DOS_SECTOR_SIZE) == DOS_SECTOR_SIZE) ? eDosOk : eDosIoError;
+}
+
+//-----------------------------------------------------------------------------
+// the size is checked first, so a sector of another size is left as it was
+static int DosWriteSector(DosDiskType* pdd, int nTrack, int nSector, BYTE* pby)
+{
+	if (FdcReadImageSector(pdd->nDrive, 0, nTrack, nSector, NULL, 0) != DOS_SECTOR_SIZE)
+	{
+		return eDosIoError;
+	}
+
+	return (FdcWriteImageSector(pdd->nDrive, 0, nTrack, nSector, pby, DOS_SECTOR_SIZE) == DOS_SECTOR_SIZE) ? eDosOk : eDosIoError;
+}
+
+//-----------------------------------------------------------------------------
+static bool DosValidDec(DosDiskType* pdd, int nDec)
+{
+	return ((nDec & 0x1F) < pdd->nDirSectors) && ((nDec >> 5) < pdd->nEntriesSector);
+}
+
+//-----------------------------------------------------------------------------
+// reads the directory sector holding an entry, returns the entry's offset
+static int DosReadEntry(DosDiskType* pdd, int nDec, BYTE* pbySector)
+{
+	if (!DosValidDec(pdd, nDec) || (DosReadSector(pdd, pdd->nDirTrack, (nDec & 0x1F) + 2, pbySector) != eDosOk))
+	{
+		return -1;
+	}
+
+	return (nDec >> 5) * pdd->nEntrySize;
+}
+
+//-----------------------------------------------------------------------------
+// every name in the HIT has to be that of a directory entry in use, at the
+// place the DEC gives for the entry size, otherwise the directory is not the
+// kind it was taken for.  BOOT/SYS and DIR/SYS are always there.
+static bool DosCheckHit(DosDiskType* pdd)
+{
+	BYTE* bySector = g_byDosSector;
+	int   nDec, nOffset;
+	int   nUsed = 0;
+
+	for (nDec = 0; nDec < DOS_SECTOR_SIZE; ++nDec)
+	{
+		if (pdd->byHit[nDec] == 0)
+		{
+			continue;
+		}
+
+		if ((nOffset = DosReadEntry(pdd, nDec, bySector)) < 0)
+		{
+			return false;
+		}
+
+		if (!(bySector[nOffset+DOS_DIR_ATTRIB] & DOS_ATTRIB_USED))
+		{
+			return false;
+		}
+
+		if (!(bySector[nOffset+DOS_DIR_ATTRIB] & DOS_ATTRIB_FXDE) &&
+			(DosHash(bySector + nOffset + DOS_DIR_NAME) != pdd->byHit[nDec]))
+		{
+			return false;
+		}
+
+		++nUsed;
+	}
+
+	return nUsed > 0;
+}
+
+//-----------------------------------------------------------------------------
+// reads the boot sector, GAT and HIT of the disk in a drive and works out its
+// geometry
+int DosOpen(DosDiskType* pdd, int nDrive)
+{
+	BYTE* bySector = g_byDosSector;
+	int   i;
+
+	memset(pdd, 0, sizeof(DosDiskType));
+	pdd->nDrive      = nDrive;
+
+	// the disk is shared, a file open for reading is closed
+	g_dwDosReadSize  = 0;
+	g_nDosReadSector = -1;
+
+	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL) ||
+		(g_dtDives[nDrive].nDriveFormat != eDMK) || FdcIsBusy())
+	{
+		return eDosNoDisk;
+	}
+
+	// only side 0 is read, the directory and the granules of a double sided
+	// disk run across both sides
+	if (g_dtDives[nDrive].dmk.byNumSides != 1)
+	{
+		return eDosFormat;
+	}
+
+	// byte 2 of the boot sector is the directory track
+	if (DosReadSector(pdd, 0, 0, bySector) != eDosOk)
+	{
+		return eDosFormat;
+	}
+
+	pdd->nDirTrack = bySector[2];
+	pdd->nTracks   = g_dtDives[nDrive].byNumTracks;
+
+	if ((pdd->nDirTrack == 0) || (pdd->nDirTrack >= pdd->nTracks) || (pdd->nTracks > DOS_GAT_TRACKS))
+	{
+		return eDosFormat;
+	}
+
+	if ((DosReadSector(pdd, pdd->nDirTrack, 0, pdd->byGat) != eDosOk) ||
+		(DosReadSector(pdd, pdd->nDirTrack, 1, pdd->byHit) != eDosOk))
+	{
+		return eDosFormat;
+	}
+
+	// sectors on the directory track, all other tracks but 0 are the same
+	for (i = 2; i < 32; ++i)
+	{
+		if (DosReadSector(pdd, pdd->nDirTrack, i, bySector) != eDosOk)
+		{
+			break;
+		}
+	}
+
+	pdd->nSectors = i;
+
+	switch (pdd->nSectors)
+	{
+		case 10:
+			pdd->nGranSectors = 5;
+			break;
+
+		case 18:
+			pdd->nGranSectors = 6;
+			break;
+
+		default:
+			return eDosFormat;
+	}
+
+	pdd->nGransTrack = pdd->nSectors / pdd->nGranSectors;
+	pdd->nDirSectors = pdd->nSectors - 2;
+
+	// LDOS keeps its version (5xh) in the GAT.  TRSDOS 2.3 is single density
+	// only, other DOSes (NEWDOS/80, DOSPLUS, MULTIDOS) can look the same from
+	// the GAT, so its 48 byte entries are checked against the HIT as well
+	if ((pdd->byGat[0xCB] & 0xF0) == 0x50)
+	{
+		pdd->nType      = eDosLdos;
+		pdd->nEntrySize = 32;
+	}
+	else if ((pdd->nSectors == 10) && (g_dtDives[nDrive].dmk.byDensity == eSD))
+	{
+		pdd->nType      = eDosTrsdos23;
+		pdd->nEntrySize = 48;
+	}
+	else
+	{
+		return eDosFormat;
+	}
+
+	pdd->nEntriesSector = DOS_SECTOR_SIZE / pdd->nEntrySize;
+	pdd->nExtents       = (pdd->nEntrySize - DOS_DIR_EXTENTS) / 2 - 1;	// the last one is for the link
+
+	if (!DosCheckHit(pdd))
+	{
+		return eDosFormat;
+	}
+
+	return eDosOk;
+}
+
+//-----------------------------------------------------------------------------
+static int DosWriteEntry(DosDiskType* pdd, int nDec, BYTE* pbySector)
+{
+	return DosWriteSector(pdd, pdd->nDirTrack, (nDec & 0x1F) + 2, pbySector);
+}
+
+//-----------------------------------------------------------------------------
+// DEC of a file, -1 if there is none
+int DosFind(DosDiskType* pdd, BYTE* pbyName)
+{
+	BYTE bySector[DOS_SECTOR_SIZE];
+	BYTE byHash = DosHash(pbyName);
+	int  nDec, nOffset;
+
+	for (nDec = 0; nDec < DOS_SECTOR_SIZE; ++nDec)
+	{
+		if ((pdd->byHit[nDec] != byHash) || !DosValidDec(pdd, nDec))
+		{
+			continue;
+		}
+
+		nOffset = DosReadEntry(pdd, nDec, bySector);
+
+		if ((nOffset >= 0) && (bySector[nOffset+DOS_DIR_ATTRIB] & DOS_ATTRIB_USED) &&
+			!(bySector[nOffset+DOS_DIR_ATTRIB] & DOS_ATTRIB_FXDE) &&
+			(memcmp(bySector + nOffset + DOS_DIR_NAME, pbyName, DOS_NAME_SIZE) == 0))
+		{
+			return nDec;
+		}
+	}
+
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// granules of a file in order, as track * granules per track + granule.
+// Returns the number of granules, -1 if the extents are not valid.
+int DosGetGranules(DosDiskType* pdd, int nDec, int* pnGrans, int nMax)
+{
+	BYTE bySector[DOS_SECTOR_SIZE];
+	int  nCount = 0;
+	int  nLinks = 0;
+	int  nOffset, nGran, nRun, i, j;
+	BYTE byTrack, byRun;
+
+	while ((nOffset = DosReadEntry(pdd, nDec, bySector)) >= 0)
+	{
+		for (i = DOS_DIR_EXTENTS; i + 1 < pdd->nEntrySize; i += 2)
+		{
+			byTrack = bySector[nOffset+i];
+			byRun   = bySector[nOffset+i+1];
+
+			if (byTrack >= 0xFE)
+			{
+				break;
+			}
+
+			// a granule the track does not have would be one of the next track
+			if ((byRun >> 5) >= pdd->nGransTrack)
+			{
+				return -1;
+			}
+
+			nGran = byTrack * pdd->nGransTrack + (byRun >> 5);
+			nRun  = (byRun & 0x1F) + 1;
+
+			for (j = 0; j < nRun; ++j)
+			{
+				if ((nCount >= nMax) || (nGran + j >= pdd->nTracks * pdd->nGransTrack))
+				{
+					return -1;
+				}
+
+				pnGrans[nCount++] = nGran + j;
+			}
+		}
+
+		// an extended entry carries on the list
+		if ((i + 1 >= pdd->nEntrySize) || (byTrack != 0xFE) || (++nLinks > 8))
+		{
+			return nCount;
+		}
+
+		nDec = byRun;
+	}
+
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+static bool DosGranuleFree(DosDiskType* pdd, int nGran)
+{
+	int  nTrack = nGran / pdd->nGransTrack;
+	BYTE byBit  = 1 << (nGran % pdd->nGransTrack);
+
+	return !(pdd->byGat[nTrack] & byBit) && !(pdd->byGat[DOS_LOCKOUT+nTrack] & byBit);
+}
+
+//-----------------------------------------------------------------------------
+static void DosSetGranule(DosDiskType* pdd, int nGran, bool bUsed)
+{
+	int  nTrack = nGran / pdd->nGransTrack;
+	BYTE byBit  = 1 << (nGran % pdd->nGransTrack);
+
+	if (bUsed)
+	{
+		pdd->byGat[nTrack] |= byBit;
+	}
+	else
+	{
+		pdd->byGat[nTrack] &= ~byBit;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// frees the granules and HIT entries of a file in the copies of the GAT and
+// HIT, and returns the DECs of its directory entries to be cleared
+static int DosFreeFile(DosDiskType* pdd, int nDec, int* pnDecs, int nMax)
+{
+	BYTE bySector[DOS_SECTOR_SIZE];
+	int  nTotal = pdd->nTracks * pdd->nGransTrack;
+	int  nOffset, nDecs, nGran, i, j;
+
+	// the entry and any extended entries it links to
+	for (nDecs = 0; (nDecs < nMax) && ((nOffset = DosReadEntry(pdd, nDec, bySector)) >= 0); )
+	{
+		pnDecs[nDecs++]  = nDec;
+		pdd->byHit[nDec] = 0;
+
+		for (i = DOS_DIR_EXTENTS; (i + 1 < pdd->nEntrySize) && (bySector[nOffset+i] < 0xFE); i += 2)
+		{
+			nGran = bySector[nOffset+i] * pdd->nGransTrack + (bySector[nOffset+i+1] >> 5);
+
+			for (j = 0; (j <= (bySector[nOffset+i+1] & 0x1F)) && (nGran + j < nTotal); ++j)
+			{
+				DosSetGranule(pdd, nGran + j, false);
+			}
+		}
+
+		if ((i + 1 >= pdd->nEntrySize) || (bySector[nOffset+i] != 0xFE))
+		{
+			break;
+		}
+
+		nDec = bySector[nOffset+i+1];
+	}
+
+	return nDecs;
+}
+
+//-----------------------------------------------------------------------------
+// a free directory entry.  Entries 0 and 1 of the first 8 directory sectors
+// are kept for the system files.
+static int DosFreeDec(DosDiskType* pdd)
+{
+	int nDec;
+
+	for (nDec = 0x40; nDec < DOS_SECTOR_SIZE; ++nDec)
+	{
+		if ((pdd->byHit[nDec] == 0) && DosValidDec(pdd, nDec))
+		{
+			return nDec;
+		}
+	}
+
+	for (nDec = 0; nDec < 0x40; ++nDec)
+	{
+		if ((pdd->byHit[nDec] == 0) && DosValidDec(pdd, nDec) && ((nDec & 0x1F) >= 8))
+		{
+			return nDec;
+		}
+	}
+
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// allocates nCount granules in as few runs as possible, filling in the
+// extents.  Returns the number of extents, -1 if they do not fit.
+static int DosAllocate(DosDiskType* pdd, int nCount, BYTE* pbyExtents, int* pnGrans)
+{
+	int nTotal   = pdd->nTracks * pdd->nGransTrack;
+	int nExtents = 0;
+	int nDone    = 0;
+	int nGran, nRun;
+
+	for (nGran = pdd->nGransTrack; (nGran < nTotal) && (nDone < nCount); ++nGran)
+	{
+		if (!DosGranuleFree(pdd, nGran))
+		{
+			continue;
+		}
+
+		if (nExtents >= pdd->nExtents)
+		{
+			break;
+		}
+
+		// a run of up to 32 free granules
+		for (nRun = 0; (nRun < 32) && (nDone < nCount) && (nGran + nRun < nTotal) && DosGranuleFree(pdd, nGran + nRun); ++nRun)
+		{
+			DosSetGranule(pdd, nGran + nRun, true);
+			pnGrans[nDone++] = nGran + nRun;
+		}
+
+		pbyExtents[nExtents*2]   = nGran / pdd->nGransTrack;
+		pbyExtents[nExtents*2+1] = ((nGran % pdd->nGransTrack) << 5) | (nRun - 1);
+		++nExtents;
+
+		nGran += nRun - 1;
+	}
+
+	if (nDone < nCount)
+	{
+		while (nDone > 0)
+		{
+			DosSetGranule(pdd, pnGrans[--nDone], false);
+		}
+
+		return -1;
+	}
+
+	return nExtents;
+}
+
+//-----------------------------------------------------------------------------
+// NAME/EXT with * and ? into the directory form with ? for any character.
+// Without an extension any extension matches.
+static void DosMakePattern(char* psz, BYTE* pbyPattern)
+{
+	int i = 0;
+
+	memset(pbyPattern, ' ', DOS_NAME_SIZE);
+	psz = SkipBlanks(psz);
+
+	if (*psz == 0)
+	{
+		memset(pbyPattern, '?', DOS_NAME_SIZE);
+		return;
+	}
+
+	while ((*psz != 0) && (*psz != '/') && (*psz != '.') && (*psz != ' '))
+	{
+		if (*psz == '*')
+		{
+			while (i < 8)
+			{
+				pbyPattern[i++] = '?';
+			}
+		}
+		else if (i < 8)
+		{
+			pbyPattern[i++] = toupper((unsigned char)*psz);
+		}
+
+		++psz;
+	}
+
+	if ((*psz != '/') && (*psz != '.'))
+	{
+		memset(pbyPattern + 8, '?', DOS_NAME_SIZE - 8);
+		return;
+	}
+
+	for (i = 8, ++psz; (*psz != 0) && (*psz != ' '); ++psz)
+	{
+		if (*psz == '*')
+		{
+			while (i < DOS_NAME_SIZE)
+			{
+				pbyPattern[i++] = '?';
+			}
+		}
+		else if (i < DOS_NAME_SIZE)
+		{
+			pbyPattern[i++] = toupper((unsigned char)*psz);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+static bool DosMatch(BYTE* pbyName, BYTE* pbyPattern)
+{
+	int i;
+
+	for (i = 0; i < DOS_NAME_SIZE; ++i)
+	{
+		if ((pbyPattern[i] != '?') && (pbyPattern[i] != pbyName[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// file size from the end of file byte and ending record number of an entry
+static uint32_t DosFileSize(DosDiskType* pdd, BYTE* pbyEntry)
+{
+	uint32_t dwErn = pbyEntry[DOS_DIR_ERN] | (pbyEntry[DOS_DIR_ERN+1] << 8);
+	BYTE     byEof = pbyEntry[DOS_DIR_EOF];
+
+	// LDOS counts the whole sectors before the end of file, TRSDOS 2.3 the sectors
+	if ((pdd->nType == eDosLdos) || (byEof == 0) || (dwErn == 0))
+	{
+		return dwErn * DOS_SECTOR_SIZE + byEof;
+	}
+
+	return (dwErn - 1) * DOS_SECTOR_SIZE + byEof;
+}
+
+//-----------------------------------------------------------------------------
+// the next file in DEC order that matches the pattern of DosFindFirst()
+int DosFindNext(DosFileType* pdf)
+{
+	DosDiskType* pdd = &g_ddDisk;
+	BYTE  bySector[DOS_SECTOR_SIZE];
+	BYTE* pbyEntry;
+	char* psz;
+	int   nOffset, i;
+
+	for (; g_nDosFindDec < DOS_SECTOR_SIZE; ++g_nDosFindDec)
+	{
+		if ((pdd->byHit[g_nDosFindDec] == 0) || !DosValidDec(pdd, g_nDosFindDec))
+		{
+			continue;
+		}
+
+		nOffset = DosReadEntry(pdd, g_nDosFindDec, bySector);
+
+		if (nOffset < 0)
+		{
+			continue;
+		}
+
+		pbyEntry = bySector + nOffset;
+
+		if (!(pbyEntry[DOS_DIR_ATTRIB] & DOS_ATTRIB_USED) || (pbyEntry[DOS_DIR_ATTRIB] & DOS_ATTRIB_FXDE) ||
+			!DosMatch(pbyEntry + DOS_DIR_NAME, g_byDosPattern))
+		{
+			continue;
+		}
+
+		pdf->nDec     = g_nDosFindDec++;
+		pdf->byAttrib = pbyEntry[DOS_DIR_ATTRIB];
+		pdf->dwSize   = DosFileSize(pdd, pbyEntry);
+
+		psz = pdf->szName;
+
+		for (i = 0; (i < 8) && (pbyEntry[DOS_DIR_NAME+i] > ' '); ++i)
+		{
+			*psz++ = pbyEntry[DOS_DIR_NAME+i];
+		}
+
+		if (pbyEntry[DOS_DIR_NAME+8] > ' ')
+		{
+			*psz++ = '/';
+
+			for (i = 8; (i < DOS_NAME_SIZE) && (pbyEntry[DOS_DIR_NAME+i] > ' '); ++i)
+			{
+				*psz++ = pbyEntry[DOS_DIR_NAME+i];
+			}
+		}
+
+		*psz = 0;
+
+		return eDosOk;
+	}
+
+	return eDosNotFound;
+}
+
+//-----------------------------------------------------------------------------
+// the first file on the disk in a drive matching a NAME/EXT pattern with * and
+// ? wildcards, an empty pattern matches every file
+int DosFindFirst(int nDrive, char* pszPattern, DosFileType* pdf)
+{
+	int nResult = DosOpen(&g_ddDisk, nDrive);
+
+	g_nDosFindDec = DOS_SECTOR_SIZE;
+
+	if (nResult != eDosOk)
+	{
+		return nResult;
+	}
+
+	DosMakePattern(pszPattern, g_byDosPattern);
+	g_nDosFindDec = 0;
+
+	return DosFindNext(pdf);
+}
+
+//-----------------------------------------------------------------------------
+// copies one file to the root folder of the SD-Card as NAME.EXT
+static int DosExportFile(DosDiskType* pdd, DosFileType* pdf)
+{
+	char     szFile[DOS_NAME_SIZE+2];
+	char*    psz;
+	file*    f;
+	uint32_t dwLeft = pdf->dwSize;
+	int      nCount, nSector, nSize, nGran, i;
+
+	nCount = DosGetGranules(pdd, pdf->nDec, g_nDosGrans, SizeOfArray(g_nDosGrans));
+
+	if ((nCount < 0) || (dwLeft > (uint32_t)nCount * pdd->nGranSectors * DOS_SECTOR_SIZE))
+	{
+		return eDosFormat;
+	}
+
+	strcpy(szFile, pdf->szName);
+	psz = strchr(szFile, '/');
+
+	if (psz != NULL)
+	{
+		*psz = '.';
+	}
+
+	f = FileOpen(szFile, FA_WRITE | FA_CREATE_ALWAYS);
+
+	if (f == NULL)
+	{
+		return eDosIoError;
+	}
+
+	for (i = 0; dwLeft > 0; ++i)
+	{
+		nGran   = g_nDosGrans[i / pdd->nGranSectors];
+		nSector = (nGran % pdd->nGransTrack) * pdd->nGranSectors + i % pdd->nGranSectors;
+		nSize   = (dwLeft > DOS_SECTOR_SIZE) ? DOS_SECTOR_SIZE : dwLeft;
+
+		if ((DosReadSector(pdd, nGran / pdd->nGransTrack, nSector, g_byDosSector) != eDosOk) ||
+			(FileWrite(f, g_byDosSector, nSize) != nSize))
+		{
+			FileClose(f);
+			return eDosIoError;
+		}
+
+		dwLeft -= nSize;
+	}
+
+	FileClose(f);
+	return eDosOk;
+}
+
+//-----------------------------------------------------------------------------
+// copies the files on the disk in a drive that match a pattern to the root
+// folder of the SD-Card, replacing files of the same name.  *pnFiles is the
+// number copied.
+int DosExport(int nDrive, char* pszPattern, int* pnFiles)
+{
+	DosFileType df;
+	int nResult;
+
+	*pnFiles = 0;
+	nResult  = DosFindFirst(nDrive, pszPattern, &df);
+
+	while (nResult == eDosOk)
+	{
+		nResult = DosExportFile(&g_ddDisk, &df);
+
+		if (nResult != eDosOk)
+		{
+			return nResult;
+		}
+
+		++*pnFiles;
+		nResult = DosFindNext(&df);
+	}
+
+	return (*pnFiles > 0) ? eDosOk : nResult;
+}
+
+//-----------------------------------------------------------------------------
+// opens a file on the disk in a drive for DosRead(), *pdwSize is its size
+int DosOpenRead(int nDrive, char* pszName, uint32_t* pdwSize)
+{
+	DosDiskType* pdd = &g_ddDisk;
+	BYTE  byName[DOS_NAME_SIZE];
+	BYTE  bySector[DOS_SECTOR_SIZE];
+	int   nDec, nOffset, nCount;
+	int   nResult = DosOpen(pdd, nDrive);
+
+	g_dwDosReadSize  = 0;
+	g_dwDosReadPos   = 0;
+	g_nDosReadSector = -1;
+	*pdwSize         = 0;
+
+	if (nResult != eDosOk)
+	{
+		return nResult;
+	}
+
+	DosMakeName(pszName, byName);
+	nDec = DosFind(pdd, byName);
+
+	if (nDec < 0)
+	{
+		return eDosNotFound;
+	}
+
+	nOffset = DosReadEntry(pdd, nDec, bySector);
+	nCount  = DosGetGranules(pdd, nDec, g_nDosGrans, SizeOfArray(g_nDosGrans));
+
+	if ((nOffset < 0) || (nCount < 0))
+	{
+		return eDosIoError;
+	}
+
+	g_dwDosReadSize = DosFileSize(pdd, bySector + nOffset);
+
+	if (g_dwDosReadSize > (uint32_t)nCount * pdd->nGranSectors * DOS_SECTOR_SIZE)
+	{
+		g_dwDosReadSize = 0;
+		return eDosFormat;
+	}
+
+	*pdwSize = g_dwDosReadSize;
+	return eDosOk;
+}
+
+//-----------------------------------------------------------------------------
+// reads from the file opened by DosOpenRead(), returns the number of bytes
+// read, less than nSize at the end of the file or on an error
+int DosRead(BYTE* pby, int nSize)
+{
+	DosDiskType* pdd = &g_ddDisk;
+	int nDone = 0;
+	int nSector, nGran, nCopy;
+
+	while ((nDone < nSize) && (g_dwDosReadPos < g_dwDosReadSize))
+	{
+		nSector = g_dwDosReadPos / DOS_SECTOR_SIZE;
+
+		if (nSector != g_nDosReadSector)
+		{
+			nGran = g_nDosGrans[nSector / pdd->nGranSectors];
+
+			if (DosReadSector(pdd, nGran / pdd->nGransTrack, (nGran % pdd->nGransTrack) * pdd->nGranSectors + nSector % pdd->nGranSectors, g_byDosSector) != eDosOk)
+			{
+				g_dwDosReadSize = g_dwDosReadPos;
+				break;
+			}
+
+			g_nDosReadSector = nSector;
+		}
+
+		nCopy = DOS_SECTOR_SIZE - g_dwDosReadPos % DOS_SECTOR_SIZE;
+
+		if (nCopy > nSize - nDone)
+		{
+			nCopy = nSize - nDone;
+		}
+
+		if (nCopy > g_dwDosReadSize - g_dwDosReadPos)
+		{
+			nCopy = g_dwDosReadSize - g_dwDosReadPos;
+		}
+
+		memcpy(pby + nDone, g_byDosSector + g_dwDosReadPos % DOS_SECTOR_SIZE, nCopy);
+		g_dwDosReadPos += nCopy;
+		nDone          += nCopy;
+	}
+
+	return nDone;
+}
+
+//-----------------------------------------------------------------------------
+// copies a file from the SD-Card to the disk in a drive, replacing a file of
+// the same name.  pszDosName may be NULL to use the SD-Card file's name.
+int DosImport(int nDrive, char* pszSdFile, char* pszDosName, uint32_t* pdwSize)
+{
+	DosDiskType* pdd = &g_ddDisk;
+	BYTE*    bySector = g_byDosSector;
+	BYTE     byName[DOS_NAME_SIZE];
+	BYTE     byExtents[DOS_MAX_EXTENTS*2];
+	int      nOldDecs[8];
+	file*    f;
+	uint32_t dwSize, dwTime;
+	int      nSectors, nCount, nOld, nDec, nOffset, nResult, i;
+
+	*pdwSize = 0;
+	nResult  = DosOpen(pdd, nDrive);
+
+	if (nResult != eDosOk)
+	{
+		return nResult;
+	}
+
+	if (g_dtDives[nDrive].dmk.byWriteProtected)
+	{
+		return eDosProtected;
+	}
+
+	if (!FileStat(pszSdFile, &dwSize, &dwTime))
+	{
+		return eDosNotFound;
+	}
+
+	DosMakeName(((pszDosName != NULL) && (*pszDosName != 0)) ? pszDosName : pszSdFile, byName);
+
+	nSectors = (dwSize + DOS_SECTOR_SIZE - 1) / DOS_SECTOR_SIZE;
+	nCount   = (nSectors + pdd->nGranSectors - 1) / pdd->nGranSectors;
+
+	if (nCount > SizeOfArray(g_nDosGrans))
+	{
+		return eDosDiskFull;
+	}
+
+	// an existing file of the same name is only freed in the copies of the GAT
+	// and HIT, the disk does not change until the new file is in place.  Its
+	// granules are reused only when there is no room beside it.
+	nOld = 0;
+	nDec = DosFind(pdd, byName);
+	memset(byExtents, 0xFF, sizeof(byExtents));
+
+	// freeing extents that are not valid would free granules of other files
+	if ((nDec >= 0) && (DosGetGranules(pdd, nDec, g_nDosGrans, SizeOfArray(g_nDosGrans)) < 0))
+	{
+		return eDosFormat;
+	}
+
+	if (DosAllocate(pdd, nCount, byExtents, g_nDosGrans) >= 0)
+	{
+		if (nDec >= 0)
+		{
+			nOld = DosFreeFile(pdd, nDec, nOldDecs, SizeOfArray(nOldDecs));
+		}
+	}
+	else
+	{
+		if (nDec < 0)
+		{
+			return eDosDiskFull;
+		}
+
+		nOld = DosFreeFile(pdd, nDec, nOldDecs, SizeOfArray(nOldDecs));
+		memset(byExtents, 0xFF, sizeof(byExtents));
+
+		if (DosAllocate(pdd, nCount, byExtents, g_nDosGrans) < 0)
+		{
+			return eDosDiskFull;
+		}
+	}
+
+	nDec = DosFreeDec(pdd);
+
+	if (nDec < 0)
+	{
+		return eDosDirFull;
+	}
+
+	// data first, into granules that are free on the disk
+	f = FileOpen(pszSdFile, FA_READ);
+
+	if (f == NULL)
+	{
+		return eDosNotFound;
+	}
+
+	for (i = 0; i < nSectors; ++i)
+	{
+		int nGran = g_nDosGrans[i / pdd->nGranSectors];
+
+		memset(bySector, 0, DOS_SECTOR_SIZE);
+		FileRead(f, bySector, DOS_SECTOR_SIZE);
+
+		nResult = DosWriteSector(pdd, nGran / pdd->nGransTrack, (nGran % pdd->nGransTrack) * pdd->nGranSectors + i % pdd->nGranSectors, bySector);
+
+		if (nResult != eDosOk)
+		{
+			FileClose(f);
+			FdcFlushImageSectors();
+			return nResult;
+		}
+	}
+
+	FileClose(f);
+	nResult = eDosIoError;
+
+	// the old entries go, then the new one and the HIT and GAT
+	for (i = 0; i < nOld; ++i)
+	{
+		nOffset = DosReadEntry(pdd, nOldDecs[i], bySector);
+
+		if ((nOffset < 0) || (nOldDecs[i] == nDec))
+		{
+			continue;
+		}
+
+		bySector[nOffset+DOS_DIR_ATTRIB] = 0;
+
+		if (DosWriteEntry(pdd, nOldDecs[i], bySector) != eDosOk)
+		{
+			goto done;
+		}
+	}
+
+	nOffset = DosReadEntry(pdd, nDec, bySector);
+
+	if (nOffset < 0)
+	{
+		goto done;
+	}
+
+	memset(bySector + nOffset, 0, pdd->nEntrySize);
+	bySector[nOffset+DOS_DIR_ATTRIB]     = DOS_ATTRIB_USED;
+	bySector[nOffset+DOS_DIR_EOF]        = dwSize % DOS_SECTOR_SIZE;
+	bySector[nOffset+DOS_DIR_LRL]        = 0;		// 256
+	memcpy(bySector + nOffset + DOS_DIR_NAME, byName, DOS_NAME_SIZE);
+	bySector[nOffset+DOS_DIR_UPDATEPW]   = DOS_BLANK_PW & 0xFF;
+	bySector[nOffset+DOS_DIR_UPDATEPW+1] = DOS_BLANK_PW >> 8;
+	bySector[nOffset+DOS_DIR_ACCESSPW]   = DOS_BLANK_PW & 0xFF;
+	bySector[nOffset+DOS_DIR_ACCESSPW+1] = DOS_BLANK_PW >> 8;
+
+	// LDOS counts the whole sectors before the end of file, TRSDOS 2.3 the sectors
+	i = (pdd->nType == eDosLdos) ? (dwSize / DOS_SECTOR_SIZE) : nSectors;
+	bySector[nOffset+DOS_DIR_ERN]        = i & 0xFF;
+	bySector[nOffset+DOS_DIR_ERN+1]      = i >> 8;
+	memcpy(bySector + nOffset + DOS_DIR_EXTENTS, byExtents, pdd->nEntrySize - DOS_DIR_EXTENTS);
+
+	pdd->byHit[nDec] = DosHash(byName);
+
+	if ((DosWriteEntry(pdd, nDec, bySector) == eDosOk) &&
+		(DosWriteSector(pdd, pdd->nDirTrack, 1, pdd->byHit) == eDosOk) &&
+		(DosWriteSector(pdd, pdd->nDirTrack, 0, pdd->byGat) == eDosOk))
+	{
+		nResult  = eDosOk;
+		*pdwSize = dwSize;
+	}
+
+done:
+	FdcFlushImageSectors();
+	return nResult;
+}
@@ -0,0 +1,85 @@
+#ifndef _H_DOS_
+#define _H_DOS_
+
+#include "defines.h"
+
+// TRS-80 Model I DOS file system on a mounted, single sided DMK image.  LDOS 5
+// (32 byte directory entries, single or double density) and TRSDOS 2.3 (48
+// byte entries, single density) are handled, with granules of 5 sectors on
+// single density disks and 6 on double density ones.  Other DOSes (NEWDOS/80,
+// DOSPLUS, MULTIDOS) are not recognised and their disks are left alone.
+
+#define DOS_SECTOR_SIZE   256
+#define DOS_NAME_SIZE     11		// name and extension, space padded
+#define DOS_GAT_TRACKS    0x60		// tracks covered by the GAT
+#define DOS_LOCKOUT       0x60		// offset of the lockout table in the GAT
+#define DOS_MAX_EXTENTS   13		// per directory entry (TRSDOS 2.3)
+#define DOS_MAX_GRANS     (DOS_MAX_EXTENTS*32)
+
+// directory entry
+#define DOS_DIR_ATTRIB    0
+#define DOS_DIR_EOF       3
+#define DOS_DIR_LRL       4
+#define DOS_DIR_NAME      5
+#define DOS_DIR_UPDATEPW  16
+#define DOS_DIR_ACCESSPW  18
+#define DOS_DIR_ERN       20
+#define DOS_DIR_EXTENTS   22
+
+#define DOS_ATTRIB_USED   0x10
+#define DOS_ATTRIB_FXDE   0x80		// extended entry of another file
+#define DOS_BLANK_PW      0x4296	// hash of a blank password
+
+enum {
+	eDosLdos = 0,
+	eDosTrsdos23,
+};
+
+enum {
+	eDosOk = 0,
+	eDosNoDisk,			// drive not mounted, not a DMK or the controller is busy
+	eDosFormat,			// no DOS directory recognised
+	eDosNotFound,
+	eDosDirFull,
+	eDosDiskFull,
+	eDosIoError,
+	eDosProtected,
+};
+
+typedef struct {
+	int  nDrive;
+	int  nType;				// eDosLdos ...
+	int  nDirTrack;
+	int  nTracks;
+	int  nSectors;			// per track
+	int  nGranSectors;		// sectors per granule
+	int  nGransTrack;		// granules per track
+	int  nEntrySize;		// bytes per directory entry
+	int  nEntriesSector;	// directory entries per sector
+	int  nDirSectors;		// directory sectors after the GAT and HIT
+	int  nExtents;			// extents of an entry that can hold granules
+	BYTE byGat[DOS_SECTOR_SIZE];
+	BYTE byHit[DOS_SECTOR_SIZE];
+} DosDiskType;
+
+typedef struct {
+	int      nDec;
+	char     szName[DOS_NAME_SIZE+2];	// NAME/EXT
+	BYTE     byAttrib;
+	uint32_t dwSize;
+} DosFileType;
+
+int         DosOpen(DosDiskType* pdd, int nDrive);
+BYTE        DosHash(BYTE* pbyName);
+void        DosMakeName(char* psz, BYTE* pbyName);
+int         DosFind(DosDiskType* pdd, BYTE* pbyName);
+int         DosGetGranules(DosDiskType* pdd, int nDec, int* pnGrans, int nMax);
+int         DosFindFirst(int nDrive, char* pszPattern, DosFileType* pdf);
+int         DosFindNext(DosFileType* pdf);
+int         DosOpenRead(int nDrive, char* pszName, uint32_t* pdwSize);
+int         DosRead(BYTE* pby, int nSize);
+int         DosExport(int nDrive, char* pszPattern, int* pnFiles);
+int         DosImport(int nDrive, char* pszSdFile, char* pszDosName, uint32_t* pdwSize);
+const char* DosErrorText(int nError);
+
+#endif
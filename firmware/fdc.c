@@ -15,6 +15,11 @@
 #include "crc.h"
 #include "fdc.h"
 #include "hdc.h"
+#include "cache.h"
+#include "memory.h"
+#include "logging.h"
+#include "dos.h"
+#include "snapshot.h"
 
 // #pragma GCC optimize ("Og")
 
@@ -199,13 +204,33 @@ static char*   g_pszVersion = {(char*)"0.1.5"};
 static FdcType g_FDC;
 
 FdcDriveType g_dtDives[MAX_DRIVES];
-TrackType    g_tdTrack;
+DiskSetType  g_dsSets[MAX_DRIVES];
 SectorType   g_stSector;
 
+// two track buffers, g_ptdTrack is the one of the current transfer that core1
+// reads and writes through.  Core0 only loads into the other one and hands it
+// over with FdcSwapTrack(), which ends any transfer left in the old one first.
+// The old one is then the back buffer and the prefetch may load into it right
+// away; a core1 access that read g_ptdTrack just before the swap completes in
+// well under the time a track takes to come from the SD-Card.
+static TrackType g_tdTracks[2];
+TrackType* volatile g_ptdTrack = &g_tdTracks[0];
+uint32_t   g_dwTrackLoads;		// tracks loaded into a buffer
+uint32_t   g_dwTrackPrefetchHits;	// tracks found already loaded ahead
+
 static char        g_szBootConfig[80];
 
+typedef struct {
+	char szDrive[MAX_DRIVES][128];
+	char szHardDisk[MAX_VHD_DRIVES][128];
+	byte byEnableDoubler;
+} IniProfileType;
+
+static IniProfileType g_ipProfile;
+
 BufferType  g_bFdcRequest;
 BufferType  g_bFdcResponse;
+byte        g_byWindow[FDC_WINDOW_SIZE];
 
 #ifndef MFC
 	static DIR     g_dj;				// Directory object
@@ -230,6 +255,19 @@ static uint32_t g_dwIndexTime;
 static uint8_t  g_byTrackWritePerformed;
 
 static file*    g_fOpenFile;
+static byte     g_byMbIntrEnable;		// interrupt the Z80 when a mailbox request completes
+static BYTE     g_byOpenMode;
+
+// the next block of the open file, read ahead while the Z80 is busy with the last one
+static BYTE     g_byFileNext[FDC_XFER_MAX];
+static int      g_nFileNextSize = -1;		// -1 => not read yet
+static int      g_nFileNextPos;
+static uint32_t g_dwFileOffset;				// file offset of g_byFileNext[g_nFileNextPos]
+
+// bytes written to the open file, held until there is a whole block of them
+static BYTE     g_byFileStage[FDC_XFER_MAX];
+static int      g_nFileStaged;
+static BYTE     g_byFileError;
 
 static byte     byCommandTypes[] = {1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 4, 3, 3};
 
@@ -254,6 +292,27 @@ volatile BYTE	g_byIntrRequest;		// controls the INTRQ output pin.  Which simulat
 
 volatile uint8_t g_byBootConfigModified;
 
+byte            g_byEnableBootProfile;
+BootProfileType g_bpProfile;
+
+byte              g_byDrqTiming = eDrqFast;
+volatile uint32_t g_dwDrqByteTime;	// us per byte of the timed transfer, 0 => not timed
+volatile uint32_t g_dwDrqStart;		// time the first byte of the transfer was under the head
+volatile int      g_nDrqCount;		// bytes transferred by the host
+volatile uint32_t g_dwDrqLast;		// DRQ=0, time core1 last passed a byte to the host
+uint32_t          g_dwDrqLost;
+
+byte              g_byEnableStream = 1;
+volatile uint32_t g_dwMultiReadSectors;	// sectors sent by read multiple commands
+volatile uint32_t g_dwMultiReadStreamed;	// of which core1 continued with without a restart
+uint32_t          g_dwMultiReadTime;		// us from the start to the end of the commands
+uint32_t          g_dwMultiWriteSectors;	// sectors taken by write multiple commands
+uint32_t          g_dwMultiWriteStreamed;	// of which continued without an interrupt
+uint32_t          g_dwMultiWriteTime;
+uint32_t          g_dwMultiMark;			// start of the command, or the end of the last sector for a restart
+byte              g_byMultiTimed;			// eMultiRead or eMultiWrite while one runs
+uint32_t          g_dwParaSectors;		// sectors moved by paravirtual disk requests
+
 //-----------------------------------------------------------------------------
 int __not_in_flash_func(FdcGetDriveIndex)(int nDriveSel)
 {
@@ -309,320 +368,328 @@ int __not_in_flash_func(FdcGetSide)(byte byDriveSel)
 //       1 = DR is full on read operation or empty on write operation
 //  S0 - 1 = busy, command in progress
 //
-void __not_in_flash_func(FdcUpdateStatus)(void)
-{
-	BYTE byStatus = 0;
-	BYTE byCmd;
-	int  nDrive;
-
-	g_byDriveStatus = 0x3F;
+// The controller flags are held in one word (g_FDC.dwFlags, FF_xxx in fdc.h)
+// that both cores change with single atomic operations.  The status byte is
+// two table lookups on the flag word, one for each of its low two bytes, in
+// the tables of the status mode, so core1 always returns a status that matches
+// one state of the flags.
+//
+static byte g_byStatusLo[FF_MODES][256];
+static byte g_byStatusHi[FF_MODES][256];
 
-	if (g_byIntrRequest)
-	{
-		g_byDriveStatus |= 0x40;
-	}
+//-----------------------------------------------------------------------------
+// status byte of a mode for a set of flags, only used to fill the tables
+static byte FdcBuildStatus(int nMode, uint32_t dwFlags)
+{
+	byte byStatus = 0;
 
-	if (g_byRtcIntrActive)
+	switch (nMode)
 	{
-		g_byDriveStatus |= 0x80;
-	}
-
-	nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
+		case eStatusNotReady:
+			return F_NOTREADY;
 
-	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL))
-	{
-		byStatus = F_NOTREADY; // | F_HEADLOAD;
-	}
-	else if ((g_FDC.byCommandType == 1) || // Restore, Seek, Step, Step In, Step Out
-             (g_FDC.byCommandType == 4))   // Force Interrupt
-	{
-		byStatus = 0;
-		
-		// S0 (BUSY)
-		if (g_FDC.status.byBusy)
-		{
-			byStatus |= F_BUSY;
-		}
-		
-		// S1 (INDEX) default to 0
-		if (g_FDC.status.byIndex)
-		{
-			byStatus |= F_INDEX;
-		}
+		case eStatusTypeI:
+			if (dwFlags & FF_INDEX)
+			{
+				byStatus |= F_INDEX;
+			}
 
-		// S2 (TRACK 0) default to 0
-		if (g_FDC.byTrack == 0)
-		{
-			byStatus |= F_TRACK0; // set TRACK 0 status flag
-		}
+			if (dwFlags & FF_TRACK0)
+			{
+				byStatus |= F_TRACK0;
+			}
 
-		// S3 (CRC ERROR) default to 0
-		if (g_FDC.status.byCrcError)
-		{
-			byStatus |= F_CRCERR;
-		}
+			if (dwFlags & FF_SEEKERR)
+			{
+				byStatus |= F_SEEKERR;
+			}
 
-		// S4 (SEEK ERROR) default to 0
-		if (g_FDC.status.bySeekError)
-		{
-			byStatus |= F_SEEKERR;
-		}
-		
-		if (g_FDC.status.byHeadLoaded)
-		{
-			byStatus |= F_HEADLOAD;
-		}
+			if (dwFlags & FF_HEADLOADED)
+			{
+				byStatus |= F_HEADLOAD;
+			}
 
-		// S6 (PROTECTED) default to 0
-		if (g_FDC.status.byProtected || (g_dtDives[nDrive].nDriveFormat == eHFE))
-		{
-			byStatus |= 0x40;
-		}
-		
-		// S7 (NOT READY) default to 0
-		if (g_FDC.status.byNotReady)
-		{
-			byStatus |= F_NOTREADY;
-		}
-	}
-	else if ((g_FDC.byCommandType == 2) ||	// Read Sector, Write Sector
-			 (g_FDC.byCommandType == 3))	// Read Address, Read Track, Write Track
-	{
-		byStatus = 0;
-		
-		// S0 (BUSY)
-		if (g_FDC.status.byBusy)
-		{
-			byStatus |= F_BUSY;
-		}
-	
-		// S1 (DATA REQUEST)     default to 0
-		if (g_FDC.status.byDataRequest)
-		{
-			byStatus |= F_DRQ;
-		}
+			if (dwFlags & (FF_PROTECTED | FF_WRPROT))
+			{
+				byStatus |= F_PROTECTED;
+			}
 
-		// S2 (LOST DATA)        default to 0
-		if (g_FDC.status.byDataLost)
-		{
-			byStatus |= F_LOSTDATA;
-		}
-		
-		// S3 (CRC ERROR)        default to 0
-		if (g_FDC.status.byCrcError)
-		{
-			byStatus |= F_CRCERR;
-		}
-		
-		// S4 (RECORD NOT FOUND) default to 0
-		if (g_FDC.status.byNotFound)
-		{
-			byStatus |= F_NOTFOUND;
-		}
-	
-		byCmd = g_FDC.byCurCommand >> 4;
+			break;
 
-		// S5 and S6 based on latest command, not just command type
-		if ((byCmd == 8) || (byCmd == 9)) // read sector (8=single; 9=multiple)
-		{
-			switch (g_FDC.status.byRecordType)
+		case eStatusRead:
+			// S5 and S6 from the data address mark of the sector
+			switch (dwFlags & FF_RECORD)
 			{
-				case 0xFB: // Data Mark
-					// S5 = 0
-					// S6 = 0
-					break;
-
-				case 0xFA: // user defined
-					// S5 = 0
-					// S6 = 1
+				case FF_RECORD_FA: // user defined
+				case FF_RECORD_F9: // user defined
 					byStatus |= 0x20;
 					break;
 
-				case 0xF9: // user defined
-					// S5 = 1
-					byStatus |= 0x20;
-					// S6 = 0
+				case FF_RECORD_F8: // Deleted Data Mark
+					byStatus |= 0x60;
 					break;
+			}
+			// fall through
 
-				case 0xF8: // Deleted Data Mark
-					// S5 = 1
-					byStatus |= 0x20;
-					// S6 = 1
-					byStatus |= 0x40;
-					break;
+		case eStatusReadOther:
+		case eStatusWrite:
+			if (dwFlags & FF_DRQ)
+			{
+				byStatus |= F_DRQ;
 			}
-		}
-		else if (g_FDC.byCurCommand == 0xC4) // read address
-		{
-			// S5 = 0
-			// S6 = 0
-		}
-		else if ((g_FDC.byCurCommand == 0xE4) || (g_FDC.byCurCommand == 0xE6)) // read track
-		{
-			// S5 = 0
-			// S6 = 0
-		}
-		else if ((byCmd == 10) || (byCmd == 11)) // write sector  (8=single; 9=multiple)
-		{
-			// S5 = WRITE FAULT
-			// S6 (PROTECTED) default to 0
-			if (g_FDC.status.byProtected || (g_dtDives[nDrive].nDriveFormat == eHFE))
+
+			if (dwFlags & FF_DATALOST)
 			{
-				byStatus |= 0x40;
+				byStatus |= F_LOSTDATA;
 			}
-		}
-		else if (byCmd == 0xF4) // write track
-		{
-			// S5 = WRITE FAULT
-			// S6 (PROTECTED) default to 0
-			if (g_FDC.status.byProtected || (g_dtDives[nDrive].nDriveFormat == eHFE))
+
+			if (dwFlags & FF_NOTFOUND)
 			{
-				byStatus |= 0x40;
+				byStatus |= F_NOTFOUND;
 			}
-		}
 
-		// S7 (NOT READY) default to 0
-		if (g_FDC.status.byNotReady)
-		{
-			byStatus |= F_NOTREADY;
-		}
+			if ((nMode == eStatusWrite) && (dwFlags & (FF_PROTECTED | FF_WRPROT)))
+			{
+				byStatus |= F_PROTECTED;
+			}
+
+			break;
+
+		default:
+			return 0;
 	}
-	else // Force Interrupt
+
+	// bits common to all command types
+	if (dwFlags & FF_BUSY)
 	{
-		byStatus = 0;
+		byStatus |= F_BUSY;
 	}
-	
-	g_FDC.byStatus = byStatus;
+
+	if (dwFlags & FF_CRCERR)
+	{
+		byStatus |= F_CRCERR;
+	}
+
+	if (dwFlags & FF_NOTREADY)
+	{
+		byStatus |= F_NOTREADY;
+	}
+
+	return byStatus;
 }
 
 //-----------------------------------------------------------------------------
-void __not_in_flash_func(FdcSetFlag)(byte flag)
+// every status bit depends on the flags of one byte of the flag word only, so
+// the status is the OR of a lookup on each byte
+void FdcInitStatusTables(void)
 {
-	switch (flag)
+	int nMode, i;
+
+	for (nMode = 0; nMode < FF_MODES; ++nMode)
 	{
-		case eBusy:
-			g_FDC.status.byBusy = 1;
-			break;
+		for (i = 0; i < 256; ++i)
+		{
+			g_byStatusLo[nMode][i] = FdcBuildStatus(nMode, i);
+			g_byStatusHi[nMode][i] = FdcBuildStatus(nMode, i << 8);
+		}
 
-		case eIndex:
-			g_FDC.status.byIndex = 1;
-			break;
+		// the not ready mode does not depend on the flags
+		if (nMode == eStatusNotReady)
+		{
+			memset(g_byStatusHi[nMode], 0, sizeof(g_byStatusHi[nMode]));
+		}
+	}
+}
 
-		case eDataLost:
-			g_FDC.status.byDataLost = 1;
-			break;
+//-----------------------------------------------------------------------------
+byte __not_in_flash_func(FdcGetStatus)(void)
+{
+	uint32_t dwFlags = g_FDC.dwFlags;
+	uint32_t nMode   = (dwFlags & FF_MODE) >> FF_MODE_SHIFT;
 
-		case eCrcError:
-			g_FDC.status.byCrcError = 1;
-			break;
+	return g_byStatusLo[nMode][dwFlags & 0xFF] | g_byStatusHi[nMode][(dwFlags >> 8) & 0xFF];
+}
 
-		case eSeekError:
-			g_FDC.status.bySeekError = 1;
-			break;
+//-----------------------------------------------------------------------------
+// replaces the flags in dwMask with dwValue in one atomic update
+void __not_in_flash_func(FdcUpdateFlags)(uint32_t dwMask, uint32_t dwValue)
+{
+#ifdef MFC
+	g_FDC.dwFlags = (g_FDC.dwFlags & ~dwMask) | dwValue;
+#else
+	uint32_t dwOld = g_FDC.dwFlags;
 
-		case eNotFound:
-			g_FDC.status.byNotFound = 1;
-			break;
+	while (!__atomic_compare_exchange_n(&g_FDC.dwFlags, &dwOld, (dwOld & ~dwMask) | dwValue,
+										false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+#endif
+}
 
-		case eProtected:
-			g_FDC.status.byProtected = 1;
-			break;
+//-----------------------------------------------------------------------------
+// updates the flags that follow from the command and drive rather than from
+// the progress of the command (status mode, track 0 and write protected
+// media) and the drive status read from 37E0h.  Called by core0 every pass of
+// the state machine and once a command has been set up.
+void FdcUpdateStatus(void)
+{
+	uint32_t dwContext;
+	BYTE byCmd;
+	BYTE byDriveStatus;
+	int  nDrive;
+	int  nMode;
 
-		case eNotReady:
-			g_FDC.status.byNotReady = 1;
-			break;
+	// bit 5 stays 1 as before, core1 clears it while a request done interrupt
+	// is pending
+	byDriveStatus = 0x3F;
 
-		case eDataRequest:
-			g_FDC.status.byDataRequest = 1;
-			break;
+	if (g_byIntrRequest)
+	{
+		byDriveStatus |= 0x40;
+	}
 
-		case eHeadLoaded:
-			g_FDC.status.byHeadLoaded = 1;
-			break;
+	if (g_byRtcIntrActive)
+	{
+		byDriveStatus |= 0x80;
 	}
 
-	FdcUpdateStatus();
-}
+	g_byDriveStatus = byDriveStatus;
 
-//-----------------------------------------------------------------------------
-void __not_in_flash_func(FdcClrFlag)(byte flag)
-{
-	switch (flag)
+	nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
+	byCmd  = g_FDC.byCurCommand >> 4;
+
+	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL))
 	{
-		case eBusy:
-			g_FDC.status.byBusy = 0;
-			break;
+		nMode = eStatusNotReady;
+	}
+	else if ((g_FDC.byCommandType == 1) || // Restore, Seek, Step, Step In, Step Out
+             (g_FDC.byCommandType == 4))   // Force Interrupt
+	{
+		nMode = eStatusTypeI;
+	}
+	else if ((g_FDC.byCommandType == 2) ||	// Read Sector, Write Sector
+			 (g_FDC.byCommandType == 3))	// Read Address, Read Track, Write Track
+	{
+		// S5 and S6 based on latest command, not just command type
+		if ((byCmd == 8) || (byCmd == 9)) // read sector (8=single; 9=multiple)
+		{
+			nMode = eStatusRead;
+		}
+		else if ((byCmd == 10) || (byCmd == 11) || (byCmd == 15)) // write sector, write track
+		{
+			nMode = eStatusWrite;
+		}
+		else // read address, read track
+		{
+			nMode = eStatusReadOther;
+		}
+	}
+	else
+	{
+		nMode = eStatusNone;
+	}
 
-		case eIndex:
-			g_FDC.status.byIndex = 0;
-			break;
+	dwContext = nMode << FF_MODE_SHIFT;
 
-		case eDataLost:
-			g_FDC.status.byDataLost = 0;
-			break;
+	if (g_FDC.byTrack == 0)
+	{
+		dwContext |= FF_TRACK0;
+	}
 
-		case eCrcError:
-			g_FDC.status.byCrcError = 0;
-			break;
+	if ((nMode != eStatusNotReady) && (g_dtDives[nDrive].nDriveFormat == eHFE))
+	{
+		dwContext |= FF_WRPROT;
+	}
 
-		case eSeekError:
-			g_FDC.status.bySeekError = 0;
-			break;
+	if ((g_FDC.dwFlags & FF_CONTEXT) != dwContext)
+	{
+		FdcUpdateFlags(FF_CONTEXT, dwContext);
+	}
+}
 
-		case eNotFound:
-			g_FDC.status.byNotFound = 0;
-			break;
+//-----------------------------------------------------------------------------
+// read by core1, kept out of flash (the compiler would put it there as it is
+// never written)
+static uint32_t __not_in_flash("fdc") g_dwFlagBits[] = {
+	FF_BUSY,			// eBusy
+	FF_INDEX,			// eIndex
+	FF_DATALOST,		// eDataLost
+	FF_CRCERR,			// eCrcError
+	FF_SEEKERR,			// eSeekError
+	FF_NOTFOUND,		// eNotFound
+	FF_PROTECTED,		// eProtected
+	FF_NOTREADY,		// eNotReady
+	0,					// eRecordType, see FdcSetRecordType()
+	FF_DRQ,				// eDataRequest
+	FF_HEADLOADED,		// eHeadLoaded
+};
+
+//-----------------------------------------------------------------------------
+void __not_in_flash_func(FdcSetFlag)(byte flag)
+{
+	FdcFlagsSet(g_dwFlagBits[flag]);
+}
+
+//-----------------------------------------------------------------------------
+void __not_in_flash_func(FdcClrFlag)(byte flag)
+{
+	FdcFlagsClr(g_dwFlagBits[flag]);
+}
+
+//-----------------------------------------------------------------------------
+void FdcSetRecordType(byte byType)
+{
+	uint32_t dwRecord;
 
-		case eProtected:
-			g_FDC.status.byProtected = 0;
+	switch (byType)
+	{
+		case 0xFA:
+			dwRecord = FF_RECORD_FA;
 			break;
 
-		case eNotReady:
-			g_FDC.status.byNotReady = 0;
+		case 0xF9:
+			dwRecord = FF_RECORD_F9;
 			break;
 
-		case eDataRequest:
-			g_FDC.status.byDataRequest = 0;
+		case 0xF8:
+			dwRecord = FF_RECORD_F8;
 			break;
 
-		case eHeadLoaded:
-			g_FDC.status.byHeadLoaded = 0;
+		default: // 0xFB, Data Mark
+			dwRecord = 0;
 			break;
 	}
 
-	FdcUpdateStatus();
-}
-
-//-----------------------------------------------------------------------------
-void FdcSetRecordType(byte byType)
-{
-	g_FDC.status.byRecordType = byType;
-	FdcUpdateStatus();
+	FdcUpdateFlags(FF_RECORD, dwRecord);
 }
 
 //-----------------------------------------------------------------------------
-int FdcGetTrackOffset(int nDrive, int nSide, int nTrack)
+int FdcGetImageTrackOffset(FdcDriveType* pdt, int nSide, int nTrack)
 {
 	int nOffset;
 	
-	nOffset = (nTrack * g_dtDives[nDrive].dmk.byNumSides + nSide) * g_dtDives[nDrive].dmk.wTrackLength + 16;
+	nOffset = (nTrack * pdt->dmk.byNumSides + nSide) * pdt->dmk.wTrackLength + 16;
 
 	return nOffset;
 }	
 
+//-----------------------------------------------------------------------------
+int FdcGetTrackOffset(int nDrive, int nSide, int nTrack)
+{
+	return FdcGetImageTrackOffset(&g_dtDives[nDrive], nSide, nTrack);
+}	
+
 //-----------------------------------------------------------------------------
 // calculates the index of the ID Address Mark for the specified physical sector.
 //
 // returns the index of the 0xFE byte in the sector byte sequence 0xA1, 0xA1, 0xA1, 0xFE
-// in the g_tdTrack.byTrackData[] address
+// in the g_ptdTrack->byTrackData[] address
 //
-WORD FdcGetIDAM(int nSector)
+WORD FdcGetIDAM(TrackType* ptdTrack, int nSector)
 {
 	BYTE* pby;
 	WORD  wIDAM;
 
 	// get IDAM pointer for the specified track
-	pby = g_tdTrack.byTrackData + nSector * 2;
+	pby = ptdTrack->byTrackData + nSector * 2;
 
 	// get IDAM value for the specified track
 	wIDAM = (*(pby+1) << 8) + *pby;
@@ -632,7 +699,7 @@ WORD FdcGetIDAM(int nSector)
 
 //-----------------------------------------------------------------------------
 // determines the index of the Index Mark (0xFE) for the specified logical sector.
-int FdcGetSectorIndexOffset(int nSide, int nTrack, int nSector)
+int FdcGetSectorIndexOffset(TrackType* ptdTrack, int nSide, int nTrack, int nSector)
 {
 	BYTE* pby;
 	WORD  wIDAM;
@@ -640,7 +707,7 @@ int FdcGetSectorIndexOffset(int nSide, int nTrack, int nSector)
 
 	for (i = 0; i < 0x80; ++i)
 	{
-		wIDAM   = FdcGetIDAM(i);
+		wIDAM   = FdcGetIDAM(ptdTrack, i);
 		nOffset = wIDAM & 0x3FFF;
 
 		// bySectorData[nOffset]   should be 0xFE
@@ -649,7 +716,7 @@ int FdcGetSectorIndexOffset(int nSide, int nTrack, int nSector)
 		// bySectorData[nOffset+3] sector number    (should be the same as the nSector parameter)
 		// bySectorData[nOffset+4] byte length (log 2, minus seven), 0 => 128 bytes; 1 => 256 bytes; etc.
 
-		pby = g_tdTrack.byTrackData + nOffset;
+		pby = ptdTrack->byTrackData + nOffset;
 
 		if ((*pby == 0xFE) && (*(pby+1) == 0xFE)) // then double byte data
 		{
@@ -747,7 +814,7 @@ int FdcGetSectorDataOffset(TrackType* ptdTrack, int nSectorIndexMarkOffset, int
 		// locate the byte sequence 0xA1, 0xA1, 0xA1, 0xFB/0xF8
 		while (nSectorDataMarkOffset < ptdTrack->nTrackSize)
 		{
-			if (FdcIsDataStartPatern(g_tdTrack.byTrackData+nSectorDataMarkOffset))
+			if (FdcIsDataStartPatern(ptdTrack->byTrackData+nSectorDataMarkOffset))
 			{
 				return nSectorDataMarkOffset + 3;
 			}
@@ -761,7 +828,7 @@ int FdcGetSectorDataOffset(TrackType* ptdTrack, int nSectorIndexMarkOffset, int
 	{
 		while (nSectorDataMarkOffset < ptdTrack->nTrackSize)
 		{
-			pby = g_tdTrack.byTrackData+nSectorDataMarkOffset;
+			pby = ptdTrack->byTrackData+nSectorDataMarkOffset;
 
 			if ((*pby == 0xFA) || (*pby == 0xFB) || (*pby == 0xF8) || (*pby == 0xF9))
 			{
@@ -784,63 +851,384 @@ void FdcFillSectorOffset(TrackType* ptdTrack)
 	
 	for (i = 0; i < 0x80; ++i)
 	{
-		ptdTrack->nSectorIndexMarkOffset[i] = FdcGetSectorIndexOffset(ptdTrack->nSide, ptdTrack->nTrack, i);
+		ptdTrack->nSectorIndexMarkOffset[i] = FdcGetSectorIndexOffset(ptdTrack, ptdTrack->nSide, ptdTrack->nTrack, i);
 		ptdTrack->nDataSize[i]              = FdcGetDataSize(ptdTrack, ptdTrack->nSectorIndexMarkOffset[i]);
 		ptdTrack->nSectorDataMarkOffset[i]  = FdcGetSectorDataOffset(ptdTrack, ptdTrack->nSectorIndexMarkOffset[i], ptdTrack->nDataSize[i]);
 	}
 }
 
 //-----------------------------------------------------------------------------
-void FdcReadDmkTrack(int nDrive, int nSide, int nTrack)
+// Boot profile
+//
+// The first track loads after a reset are recorded per ini file (LD531.INI =>
+// LD531.PRF).  On the following resets the profile is replayed, the recorded
+// tracks are read into the track cache while the FDC is idle, ahead of the
+// Z80 asking for them.
+//
+// file layout: "F80P", recorded boot time (4 bytes), count (1 byte), entries
+//
+void FdcGetProfileName(char* pszName, int nMaxLen)
 {
-	int nTrackOffset;
-	
-	g_tdTrack.nType = eDMK;
+	char* psz;
 
-	// check if specified track is already in memory
-	if ((g_tdTrack.nDrive == nDrive) && (g_tdTrack.nSide == nSide) && (g_tdTrack.nTrack == nTrack))
+	CopyString(g_szBootConfig, pszName, nMaxLen-5);
+	psz = strrchr(pszName, '.');
+
+	if (psz != NULL)
 	{
-		return;
+		*psz = 0;
 	}
 
-	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL))
+	strcat(pszName, ".PRF");
+}
+
+//-----------------------------------------------------------------------------
+// called when the Z80 leaves reset
+void FdcBootStart(void)
+{
+	char  szName[80];
+	BYTE  byHeader[9];
+	file* f;
+
+	memset(&g_bpProfile, 0, sizeof(g_bpProfile));
+	g_bpProfile.nStartTime = time_us_64();
+
+	if (!g_byEnableBootProfile || (g_szBootConfig[0] == 0))
 	{
 		return;
 	}
 
-	nTrackOffset = FdcGetTrackOffset(nDrive, nSide, nTrack);
-
-	FileSeek(g_dtDives[nDrive].f, nTrackOffset);
-	FileRead(g_dtDives[nDrive].f, g_tdTrack.byTrackData, g_dtDives[nDrive].dmk.wTrackLength);
+	FdcGetProfileName(szName, sizeof(szName));
+	g_bpProfile.nMode = eProfileRecord;
 
-	g_tdTrack.byDensity  = g_dtDives[nDrive].dmk.byDensity;
-	g_tdTrack.nDrive     = nDrive;
-	g_tdTrack.nSide      = nSide;
-	g_tdTrack.nTrack     = nTrack;
-	g_tdTrack.nTrackSize = g_dtDives[nDrive].dmk.wTrackLength;
+	f = FileOpen(szName, FA_READ);
 
-	WORD  wIDAM   = FdcGetIDAM(0);
-	int   nOffset = wIDAM & 0x3FFF;
-	BYTE* pby = g_tdTrack.byTrackData + nOffset;
-
-	if (*(pby-1) == 0xA1)
+	if (f == NULL)
 	{
-		g_tdTrack.byDensity = eDD;
+		return;
 	}
-	else
+
+	if ((FileRead(f, byHeader, sizeof(byHeader)) == sizeof(byHeader)) && (memcmp(byHeader, "F80P", 4) == 0) &&
+	    (byHeader[8] > 0) && (byHeader[8] <= BOOT_PROFILE_SIZE))
 	{
-		g_tdTrack.byDensity = eSD;
+		g_bpProfile.dwRecordedTime = byHeader[4] + (byHeader[5] << 8) + (byHeader[6] << 16) + (byHeader[7] << 24);
+		g_bpProfile.nCount = FileRead(f, (BYTE*)g_bpProfile.baLoad, byHeader[8] * sizeof(BootAccessType)) / sizeof(BootAccessType);
+		g_bpProfile.nMode  = eProfileReplay;
 	}
 
-	FdcFillSectorOffset(&g_tdTrack);
+	FileClose(f);
+}
 
-	// For Double denisty
-	// 	bySectorData[SectorOffset-3] should be 0xA1
-	// 	bySectorData[SectorOffset-2] should be 0xA1
-	// 	bySectorData[SectorOffset-1] should be 0xA1
-	// 	bySectorData[SectorOffset]   should be 0xFE
-	// 	bySectorData[SectorOffset+1] is track address (should be the same as the nTrack parameter)
-	// 	bySectorData[SectorOffset+2] side number      (should be the same as the nSide parameter)
+//-----------------------------------------------------------------------------
+void FdcBootEnd(void)
+{
+	char  szName[80];
+	BYTE  byHeader[9];
+	file* f;
+
+	g_bpProfile.dwBootTime    = (uint32_t)(g_bpProfile.nLastLoad - g_bpProfile.nStartTime);
+	g_bpProfile.nRecordedMode = g_bpProfile.nMode;
+	g_bpProfile.nMode         = eProfileDone;
+
+	if ((g_bpProfile.nRecordedMode != eProfileRecord) || (g_bpProfile.nCount == 0))
+	{
+		return;
+	}
+
+	g_bpProfile.dwRecordedTime = g_bpProfile.dwBootTime;
+
+	FdcGetProfileName(szName, sizeof(szName));
+	f = FileOpen(szName, FA_WRITE | FA_CREATE_ALWAYS);
+
+	if (f == NULL)
+	{
+		return;
+	}
+
+	memcpy(byHeader, "F80P", 4);
+	byHeader[4] = g_bpProfile.dwBootTime & 0xFF;
+	byHeader[5] = (g_bpProfile.dwBootTime >> 8) & 0xFF;
+	byHeader[6] = (g_bpProfile.dwBootTime >> 16) & 0xFF;
+	byHeader[7] = (g_bpProfile.dwBootTime >> 24) & 0xFF;
+	byHeader[8] = g_bpProfile.nCount;
+
+	FileWrite(f, byHeader, sizeof(byHeader));
+	FileWrite(f, (BYTE*)g_bpProfile.baLoad, g_bpProfile.nCount * sizeof(BootAccessType));
+	FileClose(f);
+}
+
+//-----------------------------------------------------------------------------
+// called for each track that has to be loaded into the track buffer
+void FdcProfileTrackLoad(int nDrive, int nSide, int nTrack)
+{
+	BootAccessType* pba;
+	int i, nEnd;
+
+	if ((g_bpProfile.nMode != eProfileRecord) && (g_bpProfile.nMode != eProfileReplay))
+	{
+		return;
+	}
+
+	g_bpProfile.nLastLoad = time_us_64();
+	++g_bpProfile.nLoads;
+
+	if (CacheContains(g_dtDives[nDrive].f, nSide, nTrack))
+	{
+		++g_bpProfile.nHits;
+	}
+
+	if (g_bpProfile.nMode == eProfileRecord)
+	{
+		pba = &g_bpProfile.baLoad[g_bpProfile.nCount];
+		pba->byDrive = nDrive;
+		pba->bySide  = nSide;
+		pba->byTrack = nTrack;
+
+		if (++g_bpProfile.nCount >= BOOT_PROFILE_SIZE)
+		{
+			FdcBootEnd();
+		}
+
+		return;
+	}
+
+	// replay, follow the Z80 through the profile allowing for small deviations
+	nEnd = g_bpProfile.nPos + 8;
+
+	if (nEnd > g_bpProfile.nCount)
+	{
+		nEnd = g_bpProfile.nCount;
+	}
+
+	for (i = g_bpProfile.nPos; i < nEnd; ++i)
+	{
+		pba = &g_bpProfile.baLoad[i];
+
+		if ((pba->byDrive == nDrive) && (pba->bySide == nSide) && (pba->byTrack == nTrack))
+		{
+			g_bpProfile.nPos = i + 1;
+			break;
+		}
+	}
+
+	if (g_bpProfile.nPrefetch < g_bpProfile.nPos)
+	{
+		g_bpProfile.nPrefetch = g_bpProfile.nPos;
+	}
+
+	if ((g_bpProfile.nPos >= g_bpProfile.nCount) || (g_bpProfile.nLoads >= BOOT_PROFILE_SIZE))
+	{
+		FdcBootEnd();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// idle time processing, ends the boot after a period without track loads and
+// prefetches the next tracks of the profile (one per call)
+void FdcServiceBootProfile(void)
+{
+	BootAccessType* pba;
+	FdcDriveType*   pdt;
+
+	if ((g_bpProfile.nMode != eProfileRecord) && (g_bpProfile.nMode != eProfileReplay))
+	{
+		return;
+	}
+
+	if ((g_bpProfile.nLoads > 0) && ((time_us_64() - g_bpProfile.nLastLoad) > BOOT_PROFILE_IDLE))
+	{
+		FdcBootEnd();
+		return;
+	}
+
+	if (g_bpProfile.nMode != eProfileReplay)
+	{
+		return;
+	}
+
+	// stay far enough ahead of the Z80 to be useful, but not so far that the
+	// prefetched tracks push the ones still to be used out of the cache
+	while ((g_bpProfile.nPrefetch < g_bpProfile.nCount) && (g_bpProfile.nPrefetch < g_bpProfile.nPos + g_nCacheSlots - 2))
+	{
+		pba = &g_bpProfile.baLoad[g_bpProfile.nPrefetch++];
+
+		if (pba->byDrive >= MAX_DRIVES)
+		{
+			continue;
+		}
+
+		pdt = &g_dtDives[pba->byDrive];
+
+		if ((pdt->f == NULL) || (pdt->nDriveFormat != eDMK) || (pba->byTrack >= pdt->byNumTracks) ||
+		    (pba->bySide >= pdt->dmk.byNumSides) || CacheContains(pdt->f, pba->bySide, pba->byTrack))
+		{
+			continue;
+		}
+
+		FileSeek(pdt->f, FdcGetImageTrackOffset(pdt, pba->bySide, pba->byTrack));
+		FileRead(pdt->f, g_byTrackBuffer, pdt->dmk.wTrackLength);
+		CacheStore(pdt->f, pba->bySide, pba->byTrack, g_byTrackBuffer, pdt->dmk.wTrackLength);
+		return;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// returns the track buffer that is not in use by the current transfer
+TrackType* FdcBackTrack(void)
+{
+	return (g_ptdTrack == &g_tdTracks[0]) ? &g_tdTracks[1] : &g_tdTracks[0];
+}
+
+//-----------------------------------------------------------------------------
+// hands the back buffer over to core1.  The transfer from the old buffer is
+// ended before the switch, core1 finishing an access to it only sees the
+// old data as it is not loaded again until after the next switch.
+void FdcSwapTrack(void)
+{
+	TrackType* ptdOld = g_ptdTrack;
+
+	ptdOld->nReadCount  = 0;
+	ptdOld->nWriteCount = 0;
+	__dmb();
+	g_ptdTrack = FdcBackTrack();
+	__dmb();
+}
+
+//-----------------------------------------------------------------------------
+// nDrive < 0 => all drives
+void FdcInvalidateTracks(int nDrive)
+{
+	int i;
+
+	for (i = 0; i < 2; ++i)
+	{
+		if ((nDrive < 0) || (g_tdTracks[i].nDrive == nDrive))
+		{
+			g_tdTracks[i].nDrive = -1;
+			g_tdTracks[i].nSide  = -1;
+			g_tdTracks[i].nTrack = -1;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+bool FdcTrackLoaded(TrackType* ptd, int nDrive, int nSide, int nTrack)
+{
+	return (ptd->nDrive == nDrive) && (ptd->nSide == nSide) && (ptd->nTrack == nTrack) &&
+		   (ptd->dwFileId == g_dtDives[nDrive].f->dwId);
+}
+
+//-----------------------------------------------------------------------------
+void FdcLoadDmkTrack(TrackType* ptd, int nDrive, int nSide, int nTrack)
+{
+	int nTrackOffset;
+
+	ptd->nType = eDMK;
+
+	if (!CacheRead(g_dtDives[nDrive].f, nSide, nTrack, ptd->byTrackData, g_dtDives[nDrive].dmk.wTrackLength))
+	{
+		nTrackOffset = FdcGetTrackOffset(nDrive, nSide, nTrack);
+
+		if (!FlashCacheRead(g_dtDives[nDrive].f, nSide, nTrack, ptd->byTrackData, g_dtDives[nDrive].dmk.wTrackLength))
+		{
+			FileSeek(g_dtDives[nDrive].f, nTrackOffset);
+			FileRead(g_dtDives[nDrive].f, ptd->byTrackData, g_dtDives[nDrive].dmk.wTrackLength);
+		}
+
+		CacheStore(g_dtDives[nDrive].f, nSide, nTrack, ptd->byTrackData, g_dtDives[nDrive].dmk.wTrackLength);
+	}
+
+	ptd->dwFileId   = g_dtDives[nDrive].f->dwId;
+	ptd->nDrive     = nDrive;
+	ptd->nSide      = nSide;
+	ptd->nTrack     = nTrack;
+	ptd->nTrackSize = g_dtDives[nDrive].dmk.wTrackLength;
+
+	WORD  wIDAM   = (ptd->byTrackData[1] << 8) + ptd->byTrackData[0];
+	int   nOffset = wIDAM & 0x3FFF;
+	BYTE* pby = ptd->byTrackData + nOffset;
+
+	if (*(pby-1) == 0xA1)
+	{
+		ptd->byDensity = eDD;
+	}
+	else
+	{
+		ptd->byDensity = eSD;
+	}
+
+	FdcFillSectorOffset(ptd);
+	++g_dwTrackLoads;
+}
+
+//-----------------------------------------------------------------------------
+// loads the next track of the current drive into the back buffer, unless it
+// holds a track of another drive (copying between drives)
+void FdcServicePrefetch(void)
+{
+	TrackType* ptd    = FdcBackTrack();
+	int        nDrive = g_ptdTrack->nDrive;
+	int        nSide  = g_ptdTrack->nSide;
+	int        nTrack = g_ptdTrack->nTrack + 1;
+
+	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL) ||
+		(g_dtDives[nDrive].nDriveFormat != eDMK) || (g_ptdTrack->nType != eDMK))
+	{
+		return;
+	}
+
+	if ((nTrack >= g_dtDives[nDrive].byNumTracks) || ((ptd->nDrive >= 0) && (ptd->nDrive != nDrive)))
+	{
+		return;
+	}
+
+	if (FdcTrackLoaded(ptd, nDrive, nSide, nTrack))
+	{
+		return;
+	}
+
+	FdcLoadDmkTrack(ptd, nDrive, nSide, nTrack);
+}
+
+//-----------------------------------------------------------------------------
+void FdcReadDmkTrack(int nDrive, int nSide, int nTrack)
+{
+	TrackType* ptd;
+
+	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL))
+	{
+		return;
+	}
+
+	// check if specified track is already in memory
+	if (FdcTrackLoaded(g_ptdTrack, nDrive, nSide, nTrack))
+	{
+		g_ptdTrack->nType = eDMK;
+		return;
+	}
+
+	FdcProfileTrackLoad(nDrive, nSide, nTrack);
+
+	ptd = FdcBackTrack();
+
+	if (FdcTrackLoaded(ptd, nDrive, nSide, nTrack))
+	{
+		++g_dwTrackPrefetchHits;
+	}
+	else
+	{
+		FdcLoadDmkTrack(ptd, nDrive, nSide, nTrack);
+	}
+
+	FdcSwapTrack();
+
+	// For Double denisty
+	// 	bySectorData[SectorOffset-3] should be 0xA1
+	// 	bySectorData[SectorOffset-2] should be 0xA1
+	// 	bySectorData[SectorOffset-1] should be 0xA1
+	// 	bySectorData[SectorOffset]   should be 0xFE
+	// 	bySectorData[SectorOffset+1] is track address (should be the same as the nTrack parameter)
+	// 	bySectorData[SectorOffset+2] side number      (should be the same as the nSide parameter)
 	// 	bySectorData[SectorOffset+3] sector number    (should be the same as the nSector parameter)
 	// 	bySectorData[SectorOffset+4] byte length (log 2, minus seven), 0 => 128 bytes; 1 => 256 bytes; etc.
 
@@ -856,10 +1244,10 @@ void FdcReadDmkTrack(int nDrive, int nSide, int nTrack)
 //-----------------------------------------------------------------------------
 void FdcReadHfeTrack(int nDrive, int nSide, int nTrack)
 {
-	g_tdTrack.nType = eHFE;
+	g_ptdTrack->nType = eHFE;
 
 	// check if specified track is already in memory
-	if ((g_tdTrack.nDrive == nDrive) && (g_tdTrack.nSide == nSide) && (g_tdTrack.nTrack == nTrack))
+	if ((g_ptdTrack->nDrive == nDrive) && (g_ptdTrack->nSide == nSide) && (g_ptdTrack->nTrack == nTrack))
 	{
 		return;
 	}
@@ -869,11 +1257,11 @@ void FdcReadHfeTrack(int nDrive, int nSide, int nTrack)
 		return;
 	}
 
-	LoadHfeTrack(g_dtDives[nDrive].f, nTrack, nSide, &g_dtDives[nDrive].hfe, &g_tdTrack, g_tdTrack.byTrackData, sizeof(g_tdTrack.byTrackData));
+	LoadHfeTrack(g_dtDives[nDrive].f, nTrack, nSide, &g_dtDives[nDrive].hfe, g_ptdTrack, g_ptdTrack->byTrackData, sizeof(g_ptdTrack->byTrackData));
 
-	g_tdTrack.nDrive = nDrive;
-	g_tdTrack.nSide  = nSide;
-	g_tdTrack.nTrack = nTrack;
+	g_ptdTrack->nDrive = nDrive;
+	g_ptdTrack->nSide  = nSide;
+	g_ptdTrack->nTrack = nTrack;
 }
 */
 //-----------------------------------------------------------------------------
@@ -942,7 +1330,7 @@ int FdcReadDmkSector1771(int nDriveSel, int nSide, int nTrack, int nSector)
 	FdcReadTrack(nDrive, nSide, nTrack);
 
 	// get pointer to (0xFE byte) start of sector address data (IDAM)
-	pby = g_tdTrack.byTrackData + g_tdTrack.nSectorIndexMarkOffset[nSector];
+	pby = g_ptdTrack->byTrackData + g_ptdTrack->nSectorIndexMarkOffset[nSector];
 
 	if ((*pby == 0xFE) && (*(pby+1) == 0xFE))
 	{
@@ -974,7 +1362,7 @@ int FdcReadDmkSector1771(int nDriveSel, int nSide, int nTrack, int nSector)
 	// g_FDC.byTrackData[g_FDC.nSectorOffset+5..6] CRC (calculation starts with the three 0xA1/0xF5 bytes preceeding the 0xFE)
 	FdcClrFlag(eCrcError);
 
-	if (g_tdTrack.nSectorIndexMarkOffset[nSector] <= 0)
+	if (g_ptdTrack->nSectorIndexMarkOffset[nSector] <= 0)
 	{
 		FdcSetFlag(eNotFound);
 		return FDC_SECTOR_NOT_FOUND;
@@ -985,7 +1373,7 @@ int FdcReadDmkSector1771(int nDriveSel, int nSide, int nTrack, int nSector)
 		nDensityAdjust = 0;
 		wCalcCRC16 = Calculate_CRC_CCITT(pby, 5, nDataSize);
 	}
-	else if (g_tdTrack.byDensity == eDD) // double density
+	else if (g_ptdTrack->byDensity == eDD) // double density
 	{
 		nDensityAdjust = 3;
 		wCalcCRC16 = Calculate_CRC_CCITT(pby-3, 8, nDataSize);
@@ -997,12 +1385,12 @@ int FdcReadDmkSector1771(int nDriveSel, int nSide, int nTrack, int nSector)
 	}
 
 	WORD wCRC16  = 0;
-	int  nIndex1 = g_tdTrack.nSectorIndexMarkOffset[nSector]+5*nDataSize;
-	int  nIndex2 = g_tdTrack.nSectorIndexMarkOffset[nSector]+6*nDataSize;
+	int  nIndex1 = g_ptdTrack->nSectorIndexMarkOffset[nSector]+5*nDataSize;
+	int  nIndex2 = g_ptdTrack->nSectorIndexMarkOffset[nSector]+6*nDataSize;
 
-	if ((nIndex1 < sizeof(g_tdTrack.byTrackData)) && (nIndex2 < sizeof(g_tdTrack.byTrackData)))
+	if ((nIndex1 < sizeof(g_ptdTrack->byTrackData)) && (nIndex2 < sizeof(g_ptdTrack->byTrackData)))
 	{
-		wCRC16 = (g_tdTrack.byTrackData[nIndex1] << 8) + g_tdTrack.byTrackData[nIndex2];
+		wCRC16 = (g_ptdTrack->byTrackData[nIndex1] << 8) + g_ptdTrack->byTrackData[nIndex2];
 	}
 
 	if (wCalcCRC16 != wCRC16)
@@ -1013,7 +1401,7 @@ int FdcReadDmkSector1771(int nDriveSel, int nSide, int nTrack, int nSector)
 
 	// offset to the 0xFB/0xF8 byte of the sector data mark sequence (0xA1, 0xA1, 0xA1, 0xFB/0xF8)
 	// CRC starts at first 0xA1 byte
-	nSectorDataMarkOffset = g_tdTrack.nSectorDataMarkOffset[nSector];
+	nSectorDataMarkOffset = g_ptdTrack->nSectorDataMarkOffset[nSector];
 
 	if (nSectorDataMarkOffset < 0)
 	{
@@ -1023,28 +1411,28 @@ int FdcReadDmkSector1771(int nDriveSel, int nSide, int nTrack, int nSector)
 
 	// for single density 0xA1, 0xA1 and 0xA1 are not present, CRC starts at the data mark (0xFB/0xF8)
 
-	g_FDC.byRecordMark = g_tdTrack.byTrackData[nSectorDataMarkOffset+nDensityAdjust*nDataSize];
+	g_FDC.byRecordMark = g_ptdTrack->byTrackData[nSectorDataMarkOffset+nDensityAdjust*nDataSize];
 	FdcClrFlag(eNotFound);
 	FdcSetRecordType(0xFB);	// will get set to g_FDC.byRecordMark after a few status reads
 
 	// perform a CRC on the sector data (including preceeding 4 bytes) and validate
-	wCalcCRC16 = Calculate_CRC_CCITT(&g_tdTrack.byTrackData[nSectorDataMarkOffset], g_dtDives[nDrive].dmk.nSectorSize+nDensityAdjust+1, nDataSize);
+	wCalcCRC16 = Calculate_CRC_CCITT(&g_ptdTrack->byTrackData[nSectorDataMarkOffset], g_dtDives[nDrive].dmk.nSectorSize+nDensityAdjust+1, nDataSize);
 
 	if (nDataSize == 2)
 	{
 		int nCrcOffset = g_dtDives[nDrive].dmk.nSectorSize * nDataSize;
-		wCRC16  = g_tdTrack.byTrackData[nSectorDataMarkOffset+nCrcOffset+2] << 8;
-		wCRC16 += g_tdTrack.byTrackData[nSectorDataMarkOffset+nCrcOffset+4];
+		wCRC16  = g_ptdTrack->byTrackData[nSectorDataMarkOffset+nCrcOffset+2] << 8;
+		wCRC16 += g_ptdTrack->byTrackData[nSectorDataMarkOffset+nCrcOffset+4];
 	}
-	else if (g_tdTrack.byDensity == eDD) // double density
+	else if (g_ptdTrack->byDensity == eDD) // double density
 	{
-		wCRC16  = g_tdTrack.byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+nDensityAdjust+1] << 8;
-		wCRC16 += g_tdTrack.byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+nDensityAdjust+2];
+		wCRC16  = g_ptdTrack->byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+nDensityAdjust+1] << 8;
+		wCRC16 += g_ptdTrack->byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+nDensityAdjust+2];
 	}
 	else
 	{
-		wCRC16  = g_tdTrack.byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+1] << 8;
-		wCRC16 += g_tdTrack.byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+2];
+		wCRC16  = g_ptdTrack->byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+1] << 8;
+		wCRC16 += g_ptdTrack->byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+2];
 	}
 
 	if (wCalcCRC16 != wCRC16)
@@ -1075,9 +1463,9 @@ void FdcReadDmkSector1791(int nDriveSel, int nSide, int nTrack, int nSector)
 	FdcReadTrack(nDrive, nSide, nTrack);
 
 	// get pointer to start of sector data
-	int nOffset = g_tdTrack.nSectorIndexMarkOffset[nSector];
+	int nOffset = g_ptdTrack->nSectorIndexMarkOffset[nSector];
 
-	pby = g_tdTrack.byTrackData + nOffset;
+	pby = g_ptdTrack->byTrackData + nOffset;
 
 	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset-3] should be 0xA1 or 0xF5
 	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset-2] should be 0xA1 or 0xF5
@@ -1094,7 +1482,7 @@ void FdcReadDmkSector1791(int nDriveSel, int nSide, int nTrack, int nSector)
 	// g_FDC.byTrackData[g_FDC.nSectorOffset+5..6] CRC (calculation starts with the three 0xA1/0xF5 bytes preceeding the 0xFE)
 	FdcClrFlag(eCrcError);
 
-	if (g_tdTrack.nSectorIndexMarkOffset[nSector] <= 0)
+	if (g_ptdTrack->nSectorIndexMarkOffset[nSector] <= 0)
 	{
 		FdcSetFlag(eNotFound);
 		return;
@@ -1103,12 +1491,12 @@ void FdcReadDmkSector1791(int nDriveSel, int nSide, int nTrack, int nSector)
 	wCalcCRC16 = Calculate_CRC_CCITT(pby-3, 8, 1);
 	
 	WORD wCRC16  = 0;
-	int  nIndex1 = g_tdTrack.nSectorIndexMarkOffset[nSector]+5;
-	int  nIndex2 = g_tdTrack.nSectorIndexMarkOffset[nSector]+6;
+	int  nIndex1 = g_ptdTrack->nSectorIndexMarkOffset[nSector]+5;
+	int  nIndex2 = g_ptdTrack->nSectorIndexMarkOffset[nSector]+6;
 
-	if ((nIndex1 < sizeof(g_tdTrack.byTrackData)) && (nIndex2 < sizeof(g_tdTrack.byTrackData)))
+	if ((nIndex1 < sizeof(g_ptdTrack->byTrackData)) && (nIndex2 < sizeof(g_ptdTrack->byTrackData)))
 	{
-		wCRC16 = (g_tdTrack.byTrackData[nIndex1] << 8) + g_tdTrack.byTrackData[nIndex2];
+		wCRC16 = (g_ptdTrack->byTrackData[nIndex1] << 8) + g_ptdTrack->byTrackData[nIndex2];
 	}
 
 	if (wCalcCRC16 != wCRC16)
@@ -1118,7 +1506,7 @@ void FdcReadDmkSector1791(int nDriveSel, int nSide, int nTrack, int nSector)
 	
 	// offset to the 0xFB/0xF8 byte of the sector data mark sequence (0xA1, 0xA1, 0xA1, 0xFB/0xF8)
 	// CRC starts at first 0xA1 byte
-	nSectorDataMarkOffset = g_tdTrack.nSectorDataMarkOffset[nSector];
+	nSectorDataMarkOffset = g_ptdTrack->nSectorDataMarkOffset[nSector];
 
 	if (nSectorDataMarkOffset < 0)
 	{
@@ -1126,15 +1514,15 @@ void FdcReadDmkSector1791(int nDriveSel, int nSide, int nTrack, int nSector)
 		return;
 	}
 
-	g_FDC.byRecordMark = g_tdTrack.byTrackData[nSectorDataMarkOffset];
+	g_FDC.byRecordMark = g_ptdTrack->byTrackData[nSectorDataMarkOffset];
 	FdcClrFlag(eNotFound);
 	FdcSetRecordType(0xFB);	// will get set to g_FDC.byRecordMark after a few status reads
 
 	// perform a CRC on the sector data (including preceeding 3 bytes) and validate
-	wCalcCRC16 = Calculate_CRC_CCITT(&g_tdTrack.byTrackData[nSectorDataMarkOffset-3], g_dtDives[nDrive].dmk.nSectorSize+4, 1);
+	wCalcCRC16 = Calculate_CRC_CCITT(&g_ptdTrack->byTrackData[nSectorDataMarkOffset-3], g_dtDives[nDrive].dmk.nSectorSize+4, 1);
 
-	wCRC16  = g_tdTrack.byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+1] << 8;
-	wCRC16 += g_tdTrack.byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+2];
+	wCRC16  = g_ptdTrack->byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+1] << 8;
+	wCRC16 += g_ptdTrack->byTrackData[nSectorDataMarkOffset+g_dtDives[nDrive].dmk.nSectorSize+2];
 
 	if (wCalcCRC16 != wCRC16)
 	{
@@ -1167,17 +1555,17 @@ void FdcReadHfeSector(int nDriveSel, int nSide, int nTrack, int nSector)
 	// g_FDC.byTrackData[nSide][g_FDC.nSectorOffset+5..6] CRC (calculation starts with the three 0xA1/0xF5 bytes preceeding the 0xFE)
 	FdcClrFlag(eCrcError);
 
-	i = FindSectorIndex(nSector, &g_tdTrack);
+	i = FindSectorIndex(nSector, g_ptdTrack);
 
 	// offset to the 0xFB/0xF8 byte of the sector data mark sequence (0xA1, 0xA1, 0xA1, 0xFB/0xF8)
 	// CRC starts at first 0xA1 byte
-	g_FDC.byRecordMark = g_tdTrack.byTrackData[g_tdTrack.nSectorDataMarkOffset[i] + 3]; // 0xFB/0xF8
+	g_FDC.byRecordMark = g_ptdTrack->byTrackData[g_ptdTrack->nSectorDataMarkOffset[i] + 3]; // 0xFB/0xF8
 	
-	int nOffset = g_tdTrack.nSectorIndexMarkOffset[i] + 4;
+	int nOffset = g_ptdTrack->nSectorIndexMarkOffset[i] + 4;
 
-	if (nOffset < sizeof(g_tdTrack.byTrackData))
+	if (nOffset < sizeof(g_ptdTrack->byTrackData))
 	{
-		g_stSector.nSectorSize = 128 << g_tdTrack.byTrackData[nOffset];
+		g_stSector.nSectorSize = 128 << g_ptdTrack->byTrackData[nOffset];
 	}
 	else
 	{
@@ -1205,7 +1593,7 @@ void FdcReadSector(int nDriveSel, int nSide, int nTrack, int nSector)
 	switch (g_dtDives[nDrive].nDriveFormat)
 	{
 		case eDMK:
-			if (g_tdTrack.byDensity == eDD)
+			if (g_ptdTrack->byDensity == eDD)
 			{
 				FdcReadDmkSector1791(nDriveSel, nSide, nTrack, nSector);
 			}
@@ -1223,57 +1611,151 @@ void FdcReadSector(int nDriveSel, int nSide, int nTrack, int nSector)
 }
 
 //-----------------------------------------------------------------------------
-void FdcMountDmkDrive(int nDrive)
+// checks the ID and data CRC of a sector of a loaded track without changing the
+// controller state and returns where its data is.  Only IBM format sectors are
+// handled (byIbm for single density), anything else is left to FdcReadSector().
+int FdcCheckDmkSector(TrackType* ptd, int nSector, byte byIbm, NextSectorType* pns)
 {
-	if (nDrive >= MAX_DRIVES)
+	BYTE* pby;
+	WORD  wCalcCRC16, wCRC16;
+	int   nIdam, nDam, nDataSize, nSize;
+
+	if ((nSector >= 0x80) || (ptd->nSectorIndexMarkOffset[nSector] <= 0) || (ptd->nSectorDataMarkOffset[nSector] < 0))
+	{
+		return FDC_SECTOR_NOT_FOUND;
+	}
+
+	nIdam     = ptd->nSectorIndexMarkOffset[nSector];
+	nDam      = ptd->nSectorDataMarkOffset[nSector];
+	nDataSize = ptd->nDataSize[nSector];
+	pby       = ptd->byTrackData + nIdam;
+
+	if ((ptd->byDensity == eDD) && (nDataSize == 1))
+	{
+		nSize      = 128 << (*(pby+4) & 0x03);
+		wCalcCRC16 = Calculate_CRC_CCITT(pby-3, 8, 1);
+		wCRC16     = (*(pby+5) << 8) + *(pby+6);
+
+		if ((wCalcCRC16 != wCRC16) || (nDam + nSize + 2 >= (int)sizeof(ptd->byTrackData)))
+		{
+			return FDC_CRC_ERROR;
+		}
+
+		wCalcCRC16 = Calculate_CRC_CCITT(&ptd->byTrackData[nDam-3], nSize+4, 1);
+		wCRC16     = (ptd->byTrackData[nDam+nSize+1] << 8) + ptd->byTrackData[nDam+nSize+2];
+		pns->pbyData = ptd->byTrackData + nDam + 1;
+	}
+	else if (!byIbm) // Non-IBM format
+	{
+		return FDC_CRC_ERROR;
+	}
+	else
+	{
+		nSize      = 128 << (*(pby+4*nDataSize) & 0x03);
+		wCalcCRC16 = Calculate_CRC_CCITT(pby, 5, nDataSize);
+		wCRC16     = (*(pby+5*nDataSize) << 8) + *(pby+6*nDataSize);
+
+		if ((wCalcCRC16 != wCRC16) || (nDam + (nSize+3) * nDataSize >= (int)sizeof(ptd->byTrackData)))
+		{
+			return FDC_CRC_ERROR;
+		}
+
+		wCalcCRC16 = Calculate_CRC_CCITT(&ptd->byTrackData[nDam], nSize+1, nDataSize);
+		wCRC16     = (ptd->byTrackData[nDam+(nSize+1)*nDataSize] << 8) + ptd->byTrackData[nDam+(nSize+2)*nDataSize];
+		pns->pbyData = ptd->byTrackData + nDam + nDataSize;
+	}
+
+	if (wCalcCRC16 != wCRC16)
+	{
+		return FDC_CRC_ERROR;
+	}
+
+	pns->nSize        = nSize;
+	pns->nDataSize    = nDataSize;
+	pns->byRecordMark = ptd->byTrackData[nDam];
+
+	return FDC_READ_SECTOR_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+// read multiple, resolves the sector after the one core1 is sending so core1
+// can continue with it as soon as the last byte has been read
+void FdcPrepareNextSector(void)
+{
+	int nSector = g_FDC.bySector + 1;
+
+	if (!g_byEnableStream || (g_FDC.byNextState != eNextNone) || (g_FDC.nNextSector == nSector))
 	{
 		return;
 	}
 
-	g_dtDives[nDrive].f = FileOpen(g_dtDives[nDrive].szFileName, FA_READ | FA_WRITE);
+	g_FDC.nNextSector = nSector;
 
-	if (g_dtDives[nDrive].f == NULL)
+	switch (FdcCheckDmkSector(g_ptdTrack, nSector, (g_FDC.byCurCommand & 0x08) != 0, &g_FDC.nsNext))
+	{
+		case FDC_READ_SECTOR_SUCCESS:
+			__dmb();
+			g_FDC.byNextState = eNextReady;
+			break;
+
+		case FDC_SECTOR_NOT_FOUND:
+			__dmb();
+			g_FDC.byNextState = eNextEnd;
+			break;
+
+		default: // a CRC error is reported by the restarted command
+			break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// opens the DMK image named in pdt->szFileName and parses its header
+void FdcOpenDmkImage(FdcDriveType* pdt)
+{
+	pdt->f = FileOpen(pdt->szFileName, FA_READ | FA_WRITE);
+
+	if (pdt->f == NULL)
 	{
 		return;
 	}
 
-	g_dtDives[nDrive].nDriveFormat = eDMK;
+	pdt->nDriveFormat = eDMK;
 
-	FileRead(g_dtDives[nDrive].f, g_dtDives[nDrive].dmk.byDmkDiskHeader, sizeof(g_dtDives[nDrive].dmk.byDmkDiskHeader));
+	FileRead(pdt->f, pdt->dmk.byDmkDiskHeader, sizeof(pdt->dmk.byDmkDiskHeader));
 
-	g_dtDives[nDrive].dmk.byWriteProtected = g_dtDives[nDrive].dmk.byDmkDiskHeader[0];
-	g_dtDives[nDrive].byNumTracks          = g_dtDives[nDrive].dmk.byDmkDiskHeader[1];
-	g_dtDives[nDrive].dmk.wTrackLength     = (g_dtDives[nDrive].dmk.byDmkDiskHeader[3] << 8) + g_dtDives[nDrive].dmk.byDmkDiskHeader[2];
+	pdt->dmk.byWriteProtected = pdt->dmk.byDmkDiskHeader[0];
+	pdt->byNumTracks          = pdt->dmk.byDmkDiskHeader[1];
+	pdt->dmk.wTrackLength     = (pdt->dmk.byDmkDiskHeader[3] << 8) + pdt->dmk.byDmkDiskHeader[2];
 
-	if (g_dtDives[nDrive].dmk.wTrackLength > MAX_TRACK_SIZE) // error (TODO: handle this gracefully)
+	if (pdt->dmk.wTrackLength > MAX_TRACK_SIZE) // error (TODO: handle this gracefully)
 	{
-		g_dtDives[nDrive].dmk.wTrackLength = MAX_TRACK_SIZE - 1;
+		pdt->dmk.wTrackLength = MAX_TRACK_SIZE - 1;
 		return;
 	}
 	
 	// determine number of sides for disk
-	if ((g_dtDives[nDrive].dmk.byDmkDiskHeader[4] & 0x10) != 0)
+	if ((pdt->dmk.byDmkDiskHeader[4] & 0x10) != 0)
 	{
-		g_dtDives[nDrive].dmk.byNumSides = 1;
+		pdt->dmk.byNumSides = 1;
 	}
 	else
 	{
-		g_dtDives[nDrive].dmk.byNumSides = 2;
+		pdt->dmk.byNumSides = 2;
 	}
 
 	// determine disk density
-	if ((g_dtDives[nDrive].dmk.byDmkDiskHeader[4] & 0x40) != 0)
+	if ((pdt->dmk.byDmkDiskHeader[4] & 0x40) != 0)
 	{
-		g_dtDives[nDrive].dmk.byDensity = eSD; // Single Density
+		pdt->dmk.byDensity = eSD; // Single Density
 	}
 	else
 	{
-		g_dtDives[nDrive].dmk.byDensity = eDD; // Double Density
+		pdt->dmk.byDensity = eDD; // Double Density
 	}
 
-	if ((g_dtDives[nDrive].dmk.byDmkDiskHeader[4] & 0x80) != 0) // then ignore denity setting and just use SD
+	if ((pdt->dmk.byDmkDiskHeader[4] & 0x80) != 0) // then ignore denity setting and just use SD
 	{
-		g_dtDives[nDrive].dmk.byDensity = eSD; // Single Density
+		pdt->dmk.byDensity = eSD; // Single Density
 	}
 	
 	// bytes 0x05 - 0x0B are reserved
@@ -1282,6 +1764,29 @@ void FdcMountDmkDrive(int nDrive)
 
 }
 
+//-----------------------------------------------------------------------------
+void FdcAttachFlashCache(int nDrive)
+{
+	FdcDriveType* pdt = &g_dtDives[nDrive];
+
+	if ((pdt->f != NULL) && (pdt->nDriveFormat == eDMK))
+	{
+		FlashCacheAttach(nDrive, pdt->f, pdt->szFileName, pdt->dmk.wTrackLength, pdt->dmk.byNumSides, pdt->byNumTracks);
+	}
+}
+
+//-----------------------------------------------------------------------------
+void FdcMountDmkDrive(int nDrive)
+{
+	if (nDrive >= MAX_DRIVES)
+	{
+		return;
+	}
+
+	FdcOpenDmkImage(&g_dtDives[nDrive]);
+	FdcAttachFlashCache(nDrive);
+}
+
 //-----------------------------------------------------------------------------
 void FdcMountHfeDrive(int nDrive)
 {
@@ -1307,83 +1812,181 @@ void FdcMountHfeDrive(int nDrive)
 }
 
 //-----------------------------------------------------------------------------
-void FdcMountDrive(int nDrive)
+// closes the image of the set that was opened ahead of a rotate
+void FdcCloseWarmImage(DiskSetType* pds)
 {
-	g_dtDives[nDrive].nDriveFormat = eUnknown;
-
-	if (stristr(g_dtDives[nDrive].szFileName, (char*)".dmk") != NULL)
-	{
-		FdcMountDmkDrive(nDrive);
-	}
-	else if (stristr(g_dtDives[nDrive].szFileName, (char*)".hfe") != NULL)
+	if (pds->dtNext.f != NULL)
 	{
-		FdcMountHfeDrive(nDrive);
+		FileClose(pds->dtNext.f);
+	}
+
+	memset(&pds->dtNext, 0, sizeof(FdcDriveType));
+	pds->nWarmState = eWarmIdle;
+}
+
+//-----------------------------------------------------------------------------
+void FdcCloseDiskSet(int nDrive)
+{
+	FdcCloseWarmImage(&g_dsSets[nDrive]);
+	memset(&g_dsSets[nDrive], 0, sizeof(DiskSetType));
+}
+
+//-----------------------------------------------------------------------------
+// schedules the next image of the set to be opened and its first tracks to
+// be cached while the FDC is idle
+void FdcStartWarm(int nDrive)
+{
+	DiskSetType* pds = &g_dsSets[nDrive];
+
+	if (pds->nImageCount < 2)
+	{
+		return;
+	}
+
+	FdcCloseWarmImage(pds);
+
+	pds->nNextImage = (pds->nCurImage + 1) % pds->nImageCount;
+	pds->nWarmState = eWarmOpen;
+}
+
+//-----------------------------------------------------------------------------
+// a disk set is a text file listing related images, one per line.  Blank
+// lines and lines starting with ; are ignored.  The first image is mounted.
+//
+// e.g.
+//	; LDOS 5.3.1 distribution
+//	LD531-0.DMK
+//	LD531-1.DMK
+//	LD531-2.DMK
+//
+void FdcMountDiskSet(int nDrive)
+{
+	DiskSetType* pds = &g_dsSets[nDrive];
+	file* f;
+	char  szLine[64];
+	char* psz;
+	int   nLen;
+
+	FdcCloseDiskSet(nDrive);
+	CopyString(g_dtDives[nDrive].szFileName, pds->szSetName, sizeof(pds->szSetName)-2);
+
+	f = FileOpen(pds->szSetName, FA_READ);
+
+	if (f == NULL)
+	{
+		return;
+	}
+
+	nLen = FileReadLine(f, (BYTE*)szLine, sizeof(szLine)-2);
+
+	while ((nLen >= 0) && (pds->nImageCount < MAX_SET_IMAGES))
+	{
+		psz = SkipBlanks(szLine);
+		
+		// blank line, a comment line or a nested set
+		if ((*psz != 0) && (*psz != ';') && (stristr(psz, (char*)".set") == NULL))
+		{
+			CopyString(psz, pds->szImage[pds->nImageCount], sizeof(pds->szImage[0])-2);
+			++pds->nImageCount;
+		}
+
+		nLen = FileReadLine(f, (BYTE*)szLine, sizeof(szLine)-2);
+	}
+
+	FileClose(f);
+
+	if (pds->nImageCount == 0)
+	{
+		return;
+	}
+
+	pds->nCurImage = 0;
+	strcpy(g_dtDives[nDrive].szFileName, pds->szImage[0]);
+	FdcMountDrive(nDrive);
+	FdcStartWarm(nDrive);
+}
+
+//-----------------------------------------------------------------------------
+// returns the name the drive was mounted with (the set or the image)
+char* FdcGetMountName(int nDrive)
+{
+	if (g_dsSets[nDrive].nImageCount > 0)
+	{
+		return g_dsSets[nDrive].szSetName;
+	}
+
+	return g_dtDives[nDrive].szFileName;
+}
+
+//-----------------------------------------------------------------------------
+void FdcMountDrive(int nDrive)
+{
+	g_dtDives[nDrive].nDriveFormat = eUnknown;
+
+	if (stristr(g_dtDives[nDrive].szFileName, (char*)".set") != NULL)
+	{
+		FdcMountDiskSet(nDrive);
+	}
+	else if (stristr(g_dtDives[nDrive].szFileName, (char*)".dmk") != NULL)
+	{
+		FdcMountDmkDrive(nDrive);
+	}
+	else if (stristr(g_dtDives[nDrive].szFileName, (char*)".hfe") != NULL)
+	{
+		FdcMountHfeDrive(nDrive);
 	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
-void FdcProcessConfigEntry(char szLabel[], char* psz)
+void FdcProcessConfigEntry(IniProfileType* pip, char szLabel[], char* psz)
 {
 	if ((strcmp(szLabel, "DRIVE0") == 0) && (MAX_DRIVES > 0))
 	{
-		CopyString(psz, g_dtDives[0].szFileName, sizeof(g_dtDives[0].szFileName)-2);
+		CopyString(psz, pip->szDrive[0], sizeof(pip->szDrive[0])-2);
 	}
 	else if ((strcmp(szLabel, "DRIVE1") == 0) && (MAX_DRIVES > 1))
 	{
-		CopyString(psz, g_dtDives[1].szFileName, sizeof(g_dtDives[1].szFileName)-2);
+		CopyString(psz, pip->szDrive[1], sizeof(pip->szDrive[1])-2);
 	}
 	else if ((strcmp(szLabel, "DRIVE2") == 0) && (MAX_DRIVES > 2))
 	{
-		CopyString(psz, g_dtDives[2].szFileName, sizeof(g_dtDives[2].szFileName)-2);
+		CopyString(psz, pip->szDrive[2], sizeof(pip->szDrive[2])-2);
 	}
 	else if ((strcmp(szLabel, "DRIVE3") == 0) && (MAX_DRIVES > 3))
 	{
-		CopyString(psz, g_dtDives[3].szFileName, sizeof(g_dtDives[3].szFileName)-2);
+		CopyString(psz, pip->szDrive[3], sizeof(pip->szDrive[3])-2);
 	}
 	else if ((strcmp(szLabel, "HD0") == 0) && (MAX_VHD_DRIVES > 0))
 	{
-		HdcInitFileName(0, psz);
+		CopyString(psz, pip->szHardDisk[0], sizeof(pip->szHardDisk[0])-2);
 	}
 	else if ((strcmp(szLabel, "HD1") == 0) && (MAX_VHD_DRIVES > 1))
 	{
-		HdcInitFileName(1, psz);
+		CopyString(psz, pip->szHardDisk[1], sizeof(pip->szHardDisk[1])-2);
 	}
 	else if (strcmp(szLabel, "DOUBLER") == 0)
 	{
-		g_FDC.byEnableDoubler = atoi(psz);
+		pip->byEnableDoubler = atoi(psz);
 	}
 }
 
 //-----------------------------------------------------------------------------
-void FdcLoadIni(void)
+// reads the drive, hard disk and doubler settings of an ini file into pip
+int FdcReadIniFile(char* pszIniFile, IniProfileType* pip)
 {
 	file* f;
 	char  szLine[64];
-	char  szSection[16];
 	char  szLabel[32];
 	char* psz;
 	int   nLen;
 
-	g_byBootConfigModified = FALSE;
-    g_szBootConfig[0] = 0;
-
-	// read the default ini file to load on init
-	f = FileOpen("boot.cfg", FA_READ);
-	
-	if (f == NULL)
-	{
-		return;
-	}
-
-	// open the ini file specified in boot.cfg
-	nLen = FileReadLine(f, (BYTE*)g_szBootConfig, sizeof(g_szBootConfig)-2);
-	FileClose(f);
+	memset(pip, 0, sizeof(IniProfileType));
 
-	f = FileOpen(g_szBootConfig, FA_READ);
+	f = FileOpen(pszIniFile, FA_READ);
 	
 	if (f == NULL)
 	{
-		return;
+		return FALSE;
 	}
 	
 	nLen = FileReadLine(f, (BYTE*)szLine, sizeof(szLine)-2);
@@ -1396,36 +1999,112 @@ void FdcLoadIni(void)
 		{
 			StrToUpper(psz);
 			psz = CopyLabelName(psz, szLabel, sizeof(szLabel)-2);
-			FdcProcessConfigEntry(szLabel, psz);
+			FdcProcessConfigEntry(pip, szLabel, psz);
 		}
 
 		nLen = FileReadLine(f, (BYTE*)szLine, 126);
 	}
 	
 	FileClose(f);
+
+	return TRUE;
 }
 
 //-----------------------------------------------------------------------------
-void FdcInit(void)
+void FdcLoadIni(void)
 {
-	int i;
+	file* f;
+	int   i;
+
+	g_byBootConfigModified = FALSE;
+    g_szBootConfig[0] = 0;
+
+	// read the default ini file to load on init
+	f = FileOpen("boot.cfg", FA_READ);
+	
+	if (f == NULL)
+	{
+		return;
+	}
+
+	// open the ini file specified in boot.cfg
+	FileReadLine(f, (BYTE*)g_szBootConfig, sizeof(g_szBootConfig)-2);
+	FileClose(f);
+
+	if (!FdcReadIniFile(g_szBootConfig, &g_ipProfile))
+	{
+		return;
+	}
+
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		strcpy(g_dtDives[i].szFileName, g_ipProfile.szDrive[i]);
+	}
+
+	for (i = 0; i < MAX_VHD_DRIVES; ++i)
+	{
+		HdcInitFileName(i, g_ipProfile.szHardDisk[i]);
+	}
+
+	g_FDC.byEnableDoubler = g_ipProfile.byEnableDoubler;
+}
+
+//-----------------------------------------------------------------------------
+// returns the controller registers to their power on state.  The mounted
+// images, the track buffer and the doubler setting are left untouched.
+void FdcResetController(void)
+{
+	byte byEnableDoubler = g_FDC.byEnableDoubler;
 
     memset(&g_bFdcRequest, 0, sizeof(g_bFdcRequest));
     memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
 	memset(&g_FDC, 0, sizeof(g_FDC));
 
+	g_FDC.byEnableDoubler = byEnableDoubler;
+
 	FdcSetFlag(eBusy);
 
-	g_tdTrack.nDrive = -1;
-	g_tdTrack.nSide  = -1;
-	g_tdTrack.nTrack = -1;
+	g_ptdTrack->pbyReadPtr  = NULL;
+	g_ptdTrack->nReadCount  = 0;
+	g_ptdTrack->pbyWritePtr = NULL;
+	g_ptdTrack->nWriteCount = 0;
+	g_dwDrqByteTime       = 0;
+
+	g_FDC.byCommandReceived = 0;
+	ReleaseWait();
+	g_FDC.byCommandReg  = 255;
+	g_FDC.byCurCommand  = 255;
+	g_FDC.byDriveSel    = 0x01;
+	g_FDC.byCommandType = 1;
+
+	g_nTimeNow       = time_us_64();
+	g_nPrevTime      = g_nTimeNow;
+	g_byMotorWasOn   = 0;
+	g_nMotorOnTimer  = 0;
+	g_dwRotationTime = 200000;	// 200ms
+	g_dwIndexTime    = 2800;	// 2.8ms
+	g_nRotationCount = 0;
+}
+
+//-----------------------------------------------------------------------------
+void FdcInit(void)
+{
+	int i;
+
+	memset(&g_FDC, 0, sizeof(g_FDC));
+	FdcInitStatusTables();
+
+	FdcInvalidateTracks(-1);
 
 	for (i = 0; i < MAX_DRIVES; ++i)
 	{
 		memset(&g_dtDives[i], 0, sizeof(FdcDriveType));
+		memset(&g_dsSets[i], 0, sizeof(DiskSetType));
 	}
 
 	FileCloseAll();
+	CacheInit();
+	FlashCacheInit();
 	FdcLoadIni();
 
 	for (i = 0; i < MAX_DRIVES; ++i)
@@ -1437,22 +2116,32 @@ void FdcInit(void)
 	}
 
 	g_fOpenFile = NULL;
+	g_byTrackWritePerformed = 0;
 
-	g_FDC.byCommandReceived = 0;
-	g_FDC.byCommandReg  = 255;
-	g_FDC.byCurCommand  = 255;
-	g_FDC.byDriveSel    = 0x01;
-	g_FDC.byCommandType = 1;
+	FdcResetController();
+}
 
-	g_nTimeNow       = time_us_64();
-	g_nPrevTime      = g_nTimeNow;
-	g_byMotorWasOn   = 0;
-	g_nMotorOnTimer  = 0;
-	g_dwRotationTime = 200000;	// 200ms
-	g_dwIndexTime    = 2800;	// 2.8ms
-	g_nRotationCount = 0;
+//-----------------------------------------------------------------------------
+// Z80 reset without a reboot of the Pico.  Anything written to the images is
+// flushed to the SD-Card but the images remain mounted.  A command that was in
+// progress is abandoned, as it would be on a real WD1771/1791.
+void FdcWarmReset(void)
+{
+	int i;
 
-	g_byTrackWritePerformed = 0;
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		if (g_dtDives[i].f != NULL)
+		{
+			FileFlush(g_dtDives[i].f);
+		}
+	}
+
+	// a file opened through the mailbox belongs to the program that was running
+	FdcProcessCloseFile();
+	g_byMbIntrEnable = false;
+
+	FdcResetController();
 }
 
 //-----------------------------------------------------------------------------	
@@ -1469,6 +2158,74 @@ void __not_in_flash_func(FdcGenerateDRQ)(void)
 	FdcSetFlag(eDataRequest);
 }	
 
+//-----------------------------------------------------------------------------
+// starts the byte clock of a sector transfer and raises DRQ for the first byte.
+// With DRQ=1 the bytes pass under the head at the rate of the track density
+// and core1 derives DRQ and lost data from the clock on each register access,
+// with DRQ=0 the transfer is paced by the host alone.
+void FdcStartDrq(void)
+{
+	g_nDrqCount = 0;
+	g_dwDrqLast = time_us_32();
+
+	if (g_byDrqTiming == eDrqAuthentic)
+	{
+		g_dwDrqStart    = time_us_32();
+		g_dwDrqByteTime = (g_ptdTrack->byDensity == eDD) ? DRQ_BYTE_TIME_DD : DRQ_BYTE_TIME_SD;
+	}
+	else
+	{
+		g_dwDrqByteTime = 0;
+	}
+
+	FdcGenerateDRQ();
+}
+
+//-----------------------------------------------------------------------------
+// number of bytes that have been under the head since the transfer started,
+// the caller passes the byte time it tested as core0 may clear it at any time
+int __not_in_flash_func(FdcDrqBytesDue)(uint32_t dwByteTime)
+{
+	return (time_us_32() - g_dwDrqStart) / dwByteTime + 1;
+}
+
+//-----------------------------------------------------------------------------
+// DRQ=0, the host has not taken a byte for DRQ_FAST_TIMEOUT.  The time is from
+// the last byte core1 passed on, so a stall of core0 can not cause it.
+byte FdcDrqHostStopped(void)
+{
+	uint32_t dwLast = g_dwDrqLast;	// before the time, core1 may update it
+
+	return (time_us_32() - dwLast) > DRQ_FAST_TIMEOUT;
+}
+
+//-----------------------------------------------------------------------------
+// the host has transferred a byte, a byte that went by before it was taken is
+// lost.  Returns TRUE when the next byte is already due (DRQ stays set).
+byte __not_in_flash_func(FdcDrqTransfer)(void)
+{
+	uint32_t dwByteTime = g_dwDrqByteTime;
+	int      nDue;
+
+	if (dwByteTime == 0)
+	{
+		g_dwDrqLast = time_us_32();
+		return TRUE;
+	}
+
+	nDue = FdcDrqBytesDue(dwByteTime);
+
+	if (nDue > g_nDrqCount + 1)
+	{
+		FdcFlagsSet(FF_DATALOST);
+		++g_dwDrqLost;
+	}
+
+	++g_nDrqCount;
+
+	return nDue > g_nDrqCount;
+}
+
 //-----------------------------------------------------------------------------
 void FdcCloseAllFiles(void)
 {
@@ -1483,13 +2240,10 @@ void FdcCloseAllFiles(void)
 		}
 
 		memset(&g_dtDives[i], 0, sizeof(FdcDriveType));
+		FdcCloseDiskSet(i);
 	}
 
-	if (g_fOpenFile != NULL)
-	{
-		FileClose(g_fOpenFile);
-		g_fOpenFile = NULL;
-	}
+	FdcProcessCloseFile();
 }
 
 //-----------------------------------------------------------------------------
@@ -1607,9 +2361,9 @@ void FdcProcessSeekCommand(void)
 		return;
 	}
 	
-	if (nDrive != g_tdTrack.nDrive)
+	if (nDrive != g_ptdTrack->nDrive)
 	{
-		g_tdTrack.nDrive = -1;
+		g_ptdTrack->nDrive = -1;
 	}
 
 	if (g_FDC.byData >= g_dtDives[nDrive].byNumTracks)
@@ -1751,9 +2505,9 @@ void FdcProcessStepInCommand(void)
 		return;
 	}
 
-	if (nDrive != g_tdTrack.nDrive)
+	if (nDrive != g_ptdTrack->nDrive)
 	{
-		g_tdTrack.nDrive = -1;
+		g_ptdTrack->nDrive = -1;
 	}
 
 	nStepRate   = GetStepRate(g_FDC.byCommandReg);
@@ -1819,9 +2573,9 @@ void FdcProcessStepOutCommand(void)
 		return;
 	}
 
-	if (nDrive != g_tdTrack.nDrive)
+	if (nDrive != g_ptdTrack->nDrive)
 	{
-		g_tdTrack.nDrive = -1;
+		g_ptdTrack->nDrive = -1;
 	}
 
 	nStepRate = GetStepRate(g_FDC.byCommandReg);
@@ -1831,6 +2585,39 @@ void FdcProcessStepOutCommand(void)
 	FdcGenerateIntr();
 }
 
+//-----------------------------------------------------------------------------
+// a read or write multiple command begins, bNew is false when it is restarted
+// for the next sector and the time carries on from the end of the last one
+void FdcStartMultiTime(byte byMulti, byte bNew)
+{
+	if (bNew)
+	{
+		g_dwMultiMark = time_us_32();
+	}
+
+	g_byMultiTimed = byMulti;
+}
+
+//-----------------------------------------------------------------------------
+// called for every end of a command, the time since the start (or the last
+// end) goes to the read or write figures
+void FdcEndMultiTime(void)
+{
+	uint32_t dwNow = time_us_32();
+
+	if (g_byMultiTimed == eMultiRead)
+	{
+		g_dwMultiReadTime += dwNow - g_dwMultiMark;
+	}
+	else if (g_byMultiTimed == eMultiWrite)
+	{
+		g_dwMultiWriteTime += dwNow - g_dwMultiMark;
+	}
+
+	g_dwMultiMark  = dwNow;
+	g_byMultiTimed = eMultiNone;
+}
+
 //-----------------------------------------------------------------------------
 // WD1771 Command code 1 0 0 m b E 0 0
 //
@@ -1857,10 +2644,19 @@ void FdcProcessReadSectorCommand(void)
 		return;
 	}
 
+	// a restart carries on from the end of the last sector
+	if (g_FDC.byCurCommand & 0x10)
+	{
+		FdcStartMultiTime(eMultiRead, !g_FDC.byMultipleRestart);
+	}
+
+	g_FDC.byMultipleRestart = 0;
+
 	FdcReadSector(g_FDC.byDriveSel, nSide, g_FDC.byTrack, g_FDC.bySector);
 
-	if (g_FDC.status.byNotFound)
+	if (g_FDC.dwFlags & FF_NOTFOUND)
 	{
+		FdcEndMultiTime();
 		FdcClrFlag(eBusy);
 		return;
 	}		
@@ -1870,20 +2666,15 @@ void FdcProcessReadSectorCommand(void)
 	FdcClrFlag(eDataRequest);
 	FdcSetFlag(eHeadLoaded);
 
-	if (g_FDC.byCurCommand & 0x10) // read multiple
-	{
-		g_FDC.byMultipleRecords = 1;
-	}
-	else
-	{
-		g_FDC.byMultipleRecords = 0;
-	}
+	g_FDC.byMultipleRecords = (g_FDC.byCurCommand & 0x10) ? 1 : 0; // read multiple
+	g_FDC.byNextState       = eNextNone;
+	g_FDC.nNextSector       = -1;
 
 	// number of byte to be transfered to the computer before
 	// setting the Data Address Mark status bit (1 if Deleted Data)
-	g_tdTrack.nReadSize     = g_stSector.nSectorSize;
-	g_tdTrack.pbyReadPtr    = g_tdTrack.byTrackData + g_tdTrack.nSectorDataMarkOffset[g_FDC.bySector] + g_tdTrack.nDataSize[g_FDC.bySector];
-	g_tdTrack.nReadCount    = g_tdTrack.nReadSize;
+	g_ptdTrack->nReadSize     = g_stSector.nSectorSize;
+	g_ptdTrack->pbyReadPtr    = g_ptdTrack->byTrackData + g_ptdTrack->nSectorDataMarkOffset[g_FDC.bySector] + g_ptdTrack->nDataSize[g_FDC.bySector];
+	g_ptdTrack->nReadCount    = g_ptdTrack->nReadSize;
 	g_FDC.nServiceState     = 0;
 	g_FDC.nProcessFunction  = psReadSector;
 	
@@ -1935,7 +2726,7 @@ void FdcProcessWriteSectorCommand(void)
 		return;
 	}
 
-	if (g_tdTrack.byDensity == eDD)
+	if (g_ptdTrack->byDensity == eDD)
 	{
 		FdcSetRecordType(address_mark_dd[g_FDC.byCurCommand & 0x01]);
 		g_stSector.bySectorDataAddressMark = address_mark_dd[g_FDC.byCurCommand & 0x01];
@@ -1946,35 +2737,47 @@ void FdcProcessWriteSectorCommand(void)
 		g_stSector.bySectorDataAddressMark = address_mark_sd[g_FDC.byCurCommand & 0x03];
 	}
 
+	if (g_FDC.byCurCommand & 0x10)
+	{
+		FdcStartMultiTime(eMultiWrite, true);
+	}
+
 	// read specified sector so that it can be modified
 	FdcReadSector(g_FDC.byDriveSel, nSide, g_FDC.byTrack, g_FDC.bySector);
 
 	FdcClrFlag(eDataRequest);
 	FdcSetFlag(eHeadLoaded);
+	FdcStartWriteSector(nDrive);
+
+	// Note: computer now writes the data register for each of the sector data bytes.
+	//
+	//       Actual data transfer is handled in the FdcServiceWrite() function.
+}
 
+//-----------------------------------------------------------------------------
+// points the transfer at the data of the sector in g_FDC.bySector, which
+// FdcReadSector() has just located
+void FdcStartWriteSector(int nDrive)
+{
 	g_stSector.nSector     = g_FDC.bySector;
 	g_stSector.nSectorSize = g_dtDives[nDrive].dmk.nSectorSize;
 
-	if (g_tdTrack.byDensity == eDD)
+	if (g_ptdTrack->byDensity == eDD)
 	{
-		g_tdTrack.pbyWritePtr = g_tdTrack.byTrackData + g_tdTrack.nSectorDataMarkOffset[g_FDC.bySector] + 1;
+		g_ptdTrack->pbyWritePtr = g_ptdTrack->byTrackData + g_ptdTrack->nSectorDataMarkOffset[g_FDC.bySector] + 1;
 	}
 	else
 	{
-		g_tdTrack.pbyWritePtr = g_tdTrack.byTrackData +
-								g_tdTrack.nSectorDataMarkOffset[g_FDC.bySector] +
-								g_tdTrack.nDataSize[g_FDC.bySector];
+		g_ptdTrack->pbyWritePtr = g_ptdTrack->byTrackData +
+								g_ptdTrack->nSectorDataMarkOffset[g_FDC.bySector] +
+								g_ptdTrack->nDataSize[g_FDC.bySector];
 	}
 
-	g_tdTrack.nWriteCount  = g_stSector.nSectorSize;
-	g_tdTrack.nWriteSize   = g_stSector.nSectorSize;	// number of byte to be transfered to the computer before
+	g_ptdTrack->nWriteCount  = g_stSector.nSectorSize;
+	g_ptdTrack->nWriteSize   = g_stSector.nSectorSize;	// number of byte to be transfered to the computer before
 														// setting the Data Address Mark status bit (1 if Deleted Data)
 	g_FDC.nServiceState    = 0;
 	g_FDC.nProcessFunction = psWriteSector;
-
-	// Note: computer now writes the data register for each of the sector data bytes.
-	//
-	//       Actual data transfer is handled in the FdcServiceWrite() function.
 }
 
 //-----------------------------------------------------------------------------
@@ -1993,9 +2796,9 @@ void FdcProcessReadAddressCommand(void)
 	// Byte 5 : CRC1
 	// Byte 6 : CRC2
 
-	g_tdTrack.pbyReadPtr = &g_tdTrack.byTrackData[(FdcGetIDAM(0) & 0x3FFF) + 1];
-	g_tdTrack.nReadSize  = 6;
-	g_tdTrack.nReadCount = 6;
+	g_ptdTrack->pbyReadPtr = &g_ptdTrack->byTrackData[(FdcGetIDAM(g_ptdTrack, 0) & 0x3FFF) + 1];
+	g_ptdTrack->nReadSize  = 6;
+	g_ptdTrack->nReadCount = 6;
 
 	g_FDC.nStateTimer = 0;
 	FdcClrFlag(eDataRequest);
@@ -2023,11 +2826,12 @@ void FdcProcessReadAddressCommand(void)
 void FdcProcessForceInterruptCommand(void)
 {
 	g_FDC.byCommandType  = 4;
-	g_tdTrack.nReadSize  = 0;
-	g_tdTrack.nReadCount = 0;
-	g_tdTrack.nWriteSize = 0;
+	FdcEndMultiTime();
+	g_ptdTrack->nReadSize  = 0;
+	g_ptdTrack->nReadCount = 0;
+	g_ptdTrack->nWriteSize = 0;
 	g_FDC.byIntrEnable   = g_FDC.byCurCommand & 0x0F;
-	memset(&g_FDC.status, 0, sizeof(g_FDC.status));
+	FdcUpdateFlags(~FF_CONTEXT, 0);
 
     g_FDC.byCurCommand      = g_FDC.byCommandReg;
     g_FDC.byCommandReceived = 0;
@@ -2052,16 +2856,16 @@ void FdcProcessReadTrackCommand(void)
 
 	FdcSetFlag(eHeadLoaded);
 
-	g_tdTrack.nTrack = 255;
+	g_ptdTrack->nTrack = 255;
 
 	FdcReadTrack(nDrive, nSide, g_FDC.byTrack);
 
-	g_tdTrack.nDrive       = nDrive;
-	g_tdTrack.nSide        = nSide;
-	g_tdTrack.nTrack       = g_FDC.byTrack;
-	g_tdTrack.pbyReadPtr   = g_tdTrack.byTrackData + 0x80;
-	g_tdTrack.nReadSize    = g_dtDives[g_tdTrack.nDrive].dmk.wTrackLength;
-	g_tdTrack.nReadCount   = g_tdTrack.nReadSize;
+	g_ptdTrack->nDrive       = nDrive;
+	g_ptdTrack->nSide        = nSide;
+	g_ptdTrack->nTrack       = g_FDC.byTrack;
+	g_ptdTrack->pbyReadPtr   = g_ptdTrack->byTrackData + 0x80;
+	g_ptdTrack->nReadSize    = g_dtDives[g_ptdTrack->nDrive].dmk.wTrackLength;
+	g_ptdTrack->nReadCount   = g_ptdTrack->nReadSize;
 	g_FDC.nDataSize        = 1;
 	g_FDC.nServiceState    = 0;
 
@@ -2102,24 +2906,24 @@ void FdcProcessWriteTrackCommand(void)
 	g_FDC.byCommandType = 3;
 	FdcSetFlag(eHeadLoaded);
 
-	memset(g_tdTrack.byTrackData+0x80, 0, sizeof(g_tdTrack.byTrackData)-0x80);
+	memset(g_ptdTrack->byTrackData+0x80, 0, sizeof(g_ptdTrack->byTrackData)-0x80);
 
 	if (g_FDC.byDoublerDensity)
 	{
-		g_tdTrack.byDensity = eDD;
+		g_ptdTrack->byDensity = eDD;
 		nWriteSize = DD_TRACK_LENGTH; // Tandy doubler track size
 	}
 	else
 	{
-		g_tdTrack.byDensity = eSD;
+		g_ptdTrack->byDensity = eSD;
 		nWriteSize = SD_TRACK_LENGTH;
 	}
 
-	// nWriteSize = g_tdTrack.nTrackSize;
+	// nWriteSize = g_ptdTrack->nTrackSize;
 
-	g_tdTrack.nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
+	g_ptdTrack->nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
 
-	if ((g_tdTrack.nDrive < 0) || (g_tdTrack.nDrive >= MAX_DRIVES))
+	if ((g_ptdTrack->nDrive < 0) || (g_ptdTrack->nDrive >= MAX_DRIVES))
 	{
 		return;
 	}
@@ -2129,11 +2933,11 @@ void FdcProcessWriteTrackCommand(void)
 		InitDmkDiskHeader();
 	}
 
-	g_tdTrack.nSide        = nSide;
-	g_tdTrack.nTrack       = g_FDC.byTrack;
-	g_tdTrack.pbyWritePtr  = g_tdTrack.byTrackData + 0x80;
-	g_tdTrack.nWriteSize   = nWriteSize;
-	g_tdTrack.nWriteCount  = g_tdTrack.nWriteSize;
+	g_ptdTrack->nSide        = nSide;
+	g_ptdTrack->nTrack       = g_FDC.byTrack;
+	g_ptdTrack->pbyWritePtr  = g_ptdTrack->byTrackData + 0x80;
+	g_ptdTrack->nWriteSize   = nWriteSize;
+	g_ptdTrack->nWriteCount  = g_ptdTrack->nWriteSize;
 	g_FDC.nServiceState    = 0;
 	g_FDC.nProcessFunction = psWriteTrack;
 	g_byTrackWritePerformed = 1;
@@ -2196,6 +3000,10 @@ void FdcProcessOpenFile(void)
 		{
 			byMode |= FA_WRITE;
 		}
+		else if (*psz == 'c') // create, replacing an existing file
+		{
+			byMode |= FA_CREATE_ALWAYS;
+		}
 
 		++psz;
 	}
@@ -2205,7 +3013,12 @@ void FdcProcessOpenFile(void)
 		FileClose(g_fOpenFile);
 	}
 	
-	g_fOpenFile = FileOpen(g_bFdcRequest.buf, byMode);
+	g_fOpenFile     = FileOpen(g_bFdcRequest.buf, byMode);
+	g_byOpenMode    = byMode;
+	g_nFileNextSize = -1;
+	g_dwFileOffset  = 0;
+	g_nFileStaged   = 0;
+	g_byFileError   = 0;
 
 	if (g_fOpenFile == NULL)
 	{
@@ -2213,23 +3026,209 @@ void FdcProcessOpenFile(void)
 		return;
 	}
 
-	g_bFdcResponse.cmd[0] = FileRead(g_fOpenFile, g_bFdcResponse.buf, 250);
+	g_bFdcResponse.cmd[0] = FdcReadOpenFile(g_bFdcResponse.buf, 250);
 }
 
 //-----------------------------------------------------------------------------
 void FdcProcessReadFile(void)
 {
-	g_bFdcResponse.cmd[0] = FileRead(g_fOpenFile, g_bFdcResponse.buf, 250);
+	g_bFdcResponse.cmd[0] = FdcReadOpenFile(g_bFdcResponse.buf, 250);
 }
 
 //-----------------------------------------------------------------------------
-void FdcProcessCloseFile(void)
+// reads the next block of the open file ahead, so it is ready when the Z80
+// asks for it
+void FdcServiceFilePrefetch(void)
 {
-	if (g_fOpenFile == NULL)
+	if ((g_fOpenFile == NULL) || !(g_byOpenMode & FA_READ) || (g_nFileNextSize >= 0) || (g_nFileStaged > 0))
 	{
 		return;
 	}
 
+	g_nFileNextSize = FileRead(g_fOpenFile, g_byFileNext, sizeof(g_byFileNext));
+	g_nFileNextPos  = 0;
+}
+
+//-----------------------------------------------------------------------------
+// copies up to nSize bytes of the open file, from the block read ahead, and
+// returns the number copied (0 at the end of the file)
+int FdcReadOpenFile(BYTE* pby, int nSize)
+{
+	int nCount;
+
+	if ((g_fOpenFile == NULL) || !(g_byOpenMode & FA_READ))
+	{
+		return 0;
+	}
+
+	FdcFlushOpenFile();
+	FdcServiceFilePrefetch();
+
+	nCount = g_nFileNextSize - g_nFileNextPos;
+
+	if (nCount > nSize)
+	{
+		nCount = nSize;
+	}
+
+	memcpy(pby, g_byFileNext + g_nFileNextPos, nCount);
+	g_nFileNextPos += nCount;
+	g_dwFileOffset += nCount;
+
+	// read the next block once the host has gone, unless this was the end of the file
+	if ((g_nFileNextPos >= g_nFileNextSize) && (g_nFileNextSize == sizeof(g_byFileNext)))
+	{
+		g_nFileNextSize = -1;
+	}
+
+	return nCount;
+}
+
+//-----------------------------------------------------------------------------
+// Read block
+//
+// Like read file but into a window of up to FDC_XFER_MAX bytes named by the
+// Z80, either the FDC_WINDOW_ADDR_START window or a buffer in the upper 32K.
+//   request  buf[0] buf[1] window address, low byte first
+//            buf[2] buf[3] bytes wanted
+//   response cmd[0]        status (eXferOk ...)
+//            buf[0] buf[1] bytes placed in the window, 0 at the end of the file
+//            buf[2]-buf[5] file offset of the first of them
+// The next block is read ahead from the SD-Card while the Z80 writes this one
+// out, so it is a copy when it is asked for.
+
+//-----------------------------------------------------------------------------
+// address of nSize bytes at Z80 address wAddr, NULL if they are not all in one
+// of the windows
+BYTE* FdcGetWindow(word wAddr, int nSize)
+{
+	if ((wAddr >= FDC_WINDOW_ADDR_START) && ((int)wAddr + nSize <= FDC_WINDOW_ADDR_STOP + 1))
+	{
+		return g_byWindow + (wAddr - FDC_WINDOW_ADDR_START);
+	}
+
+	return BusGetHighMemory(wAddr, nSize);
+}
+
+//-----------------------------------------------------------------------------
+void FdcServiceReadBlock(void)
+{
+	word     wAddr    = g_bFdcRequest.buf[0] | (g_bFdcRequest.buf[1] << 8);
+	int      nSize    = g_bFdcRequest.buf[2] | (g_bFdcRequest.buf[3] << 8);
+	uint32_t dwOffset = g_dwFileOffset;
+	BYTE*    pby;
+	int      nCount   = 0;
+
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+
+	if (nSize > FDC_XFER_MAX)
+	{
+		nSize = FDC_XFER_MAX;
+	}
+
+	pby = FdcGetWindow(wAddr, nSize);
+
+	if ((g_fOpenFile == NULL) || !(g_byOpenMode & FA_READ))
+	{
+		g_bFdcResponse.cmd[0] = eXferNoFile;
+	}
+	else if (pby == NULL)
+	{
+		g_bFdcResponse.cmd[0] = eXferWindow;
+	}
+	else
+	{
+		// a block read ahead may be split over two windows
+		while (nCount < nSize)
+		{
+			int nRead = FdcReadOpenFile(pby + nCount, nSize - nCount);
+
+			if (nRead == 0)
+			{
+				break;
+			}
+
+			nCount += nRead;
+		}
+
+		g_bFdcResponse.cmd[0] = eXferOk;
+	}
+
+	g_bFdcResponse.buf[0] = nCount & 0xFF;
+	g_bFdcResponse.buf[1] = nCount >> 8;
+	g_bFdcResponse.buf[2] = dwOffset & 0xFF;
+	g_bFdcResponse.buf[3] = (dwOffset >> 8) & 0xFF;
+	g_bFdcResponse.buf[4] = (dwOffset >> 16) & 0xFF;
+	g_bFdcResponse.buf[5] = dwOffset >> 24;
+}
+
+//-----------------------------------------------------------------------------
+// writes the staged bytes to the open file
+void FdcFlushOpenFile(void)
+{
+	if ((g_fOpenFile == NULL) || (g_nFileStaged == 0))
+	{
+		return;
+	}
+
+	if (FileWrite(g_fOpenFile, g_byFileStage, g_nFileStaged) != g_nFileStaged)
+	{
+		g_byFileError = 1;
+	}
+
+	g_nFileStaged = 0;
+}
+
+//-----------------------------------------------------------------------------
+// appends cmd[1] bytes (0 => 256) of the request buffer to the open file.  They
+// are staged and written FDC_XFER_MAX at a time, a multiple of the SD-Card
+// sector and of the usual cluster sizes.  Response cmd[0] is 0 if the file is
+// open for writing and nothing has failed to write so far.
+void FdcProcessWriteFile(void)
+{
+	int nSize = g_bFdcRequest.cmd[1] ? g_bFdcRequest.cmd[1] : 256;
+
+	if ((g_fOpenFile == NULL) || !(g_byOpenMode & FA_WRITE))
+	{
+		g_bFdcResponse.cmd[0] = 1;
+		return;
+	}
+
+	// bytes read ahead are past where this write goes
+	if (g_nFileNextSize >= 0)
+	{
+		FileSeek(g_fOpenFile, g_dwFileOffset);
+		g_nFileNextSize = -1;
+	}
+
+	if (g_nFileStaged + nSize > sizeof(g_byFileStage))
+	{
+		FdcFlushOpenFile();
+	}
+
+	memcpy(g_byFileStage + g_nFileStaged, g_bFdcRequest.buf, nSize);
+	g_nFileStaged  += nSize;
+	g_dwFileOffset += nSize;
+
+	if (g_nFileStaged == sizeof(g_byFileStage))
+	{
+		FdcFlushOpenFile();
+	}
+
+	g_bFdcResponse.cmd[0] = g_byFileError;
+}
+
+//-----------------------------------------------------------------------------
+void FdcProcessCloseFile(void)
+{
+	if (g_fOpenFile == NULL)
+	{
+		return;
+	}
+
+	FdcFlushOpenFile();
+	g_bFdcResponse.cmd[0] = g_byFileError;
+
 	FileClose(g_fOpenFile);
 	g_fOpenFile = NULL;
 }
@@ -2237,7 +3236,7 @@ void FdcProcessCloseFile(void)
 //-----------------------------------------------------------------------------
 void FdcProcessCommand(void)
 {
-	memset(&g_FDC.status, 0, sizeof(g_FDC.status));
+	FdcUpdateFlags(~FF_CONTEXT, 0);
 	FdcSetFlag(eBusy);
 	g_FDC.nServiceState     = 0;
 	g_FDC.nProcessFunction  = psIdle;
@@ -2308,18 +3307,18 @@ void FdcProcessCommand(void)
 			break;
 
 		default:
-			memset(&g_FDC.status, 0, sizeof(g_FDC.status));
+			FdcUpdateFlags(~FF_CONTEXT, 0);
 			break;
 	}
 
+	FdcUpdateStatus();
 	g_FDC.byCommandReceived = 0;
+	ReleaseWait();
 }
 
 //-----------------------------------------------------------------------------
 void FdcServiceReadSector(void)
 {
-	static uint64_t drq_time;
-
 	switch (g_FDC.nServiceState)
 	{
 		case 0:
@@ -2333,36 +3332,48 @@ void FdcServiceReadSector(void)
 				break;
 			}
 
-			drq_time = time_us_64();
-			g_FDC.byReadData = 1;
-
-			FdcGenerateDRQ();
+			FdcStartDrq();
 			g_FDC.nStateTimer = 0;
 			++g_FDC.nServiceState;
 			break;
 
 		case 2:
-			if (g_FDC.byReadData)
+			if (g_ptdTrack->nReadCount > 0)
 			{
-				if ((time_us_64() - drq_time) > 1000)
+				// the sector and its CRC have gone by without the host taking all of it,
+				// the time is measured from the start so a stall here can not cause it.
+				// With DRQ=0 the host has stopped reading part way through.
+				if ((g_dwDrqByteTime != 0) ? (FdcDrqBytesDue(g_dwDrqByteTime) > g_ptdTrack->nReadSize + 2) : FdcDrqHostStopped())
 				{
+					if (g_dwDrqByteTime == 0)
+					{
+						++g_dwDrqLost;
+					}
+
+					g_dwDrqByteTime = 0;
+					FdcEndMultiTime();
+					FdcClrFlag(eDataRequest);
 					FdcClrFlag(eBusy);
 					FdcSetFlag(eDataLost);
+					FdcGenerateIntr();
 					g_FDC.nProcessFunction = psIdle;
 					break;
 				}
-			}
-			else
-			{
-				drq_time = time_us_64();
-				g_FDC.byReadData = 1;
-			}
 
-			if (g_tdTrack.nReadCount > 0)
-			{
+				// core1 is sending the sector from the current buffer
+				if (g_FDC.byMultipleRecords && (g_ptdTrack->nType == eDMK))
+				{
+					FdcPrepareNextSector();
+				}
+
+				FdcServicePrefetch();
 				break;
 			}
 
+			// also when core1 has ended a streamed read with record not found
+			FdcEndMultiTime();
+
+			g_dwDrqByteTime = 0;
 			++g_FDC.nServiceState;
 			FdcSetRecordType(g_FDC.byRecordMark);
 			FdcClrFlag(eBusy);
@@ -2394,7 +3405,7 @@ void FdcServiceReadTrack(void)
 			break;
 
 		case 2:
-			if (g_tdTrack.nReadCount > 0)
+			if (g_ptdTrack->nReadCount > 0)
 			{
 				break;
 			}
@@ -2415,26 +3426,26 @@ void FdcGenerateSectorCRC(int nSector, int nSectorSize)
 	WORD wCRC16;
 	int  nSectorDataIndexOffset;
 
-	nSectorDataIndexOffset = g_tdTrack.nSectorDataMarkOffset[nSector];
+	nSectorDataIndexOffset = g_ptdTrack->nSectorDataMarkOffset[nSector];
 	
 	if (nSectorDataIndexOffset < 0)
 	{
 		return;
 	}
 
-	if (g_tdTrack.byDensity == eDD) // double density
+	if (g_ptdTrack->byDensity == eDD) // double density
 	{
 		// CRC consists of the 0xA1, 0xA1, 0xA1, 0xFB sequence and the sector data
-		wCRC16 = Calculate_CRC_CCITT(&g_tdTrack.byTrackData[nSectorDataIndexOffset-3], nSectorSize+4, 1);
-		g_tdTrack.byTrackData[nSectorDataIndexOffset+nSectorSize+1] = wCRC16 >> 8;
-		g_tdTrack.byTrackData[nSectorDataIndexOffset+nSectorSize+2] = wCRC16 & 0xFF;
+		wCRC16 = Calculate_CRC_CCITT(&g_ptdTrack->byTrackData[nSectorDataIndexOffset-3], nSectorSize+4, 1);
+		g_ptdTrack->byTrackData[nSectorDataIndexOffset+nSectorSize+1] = wCRC16 >> 8;
+		g_ptdTrack->byTrackData[nSectorDataIndexOffset+nSectorSize+2] = wCRC16 & 0xFF;
 	}
 	else // single density
 	{
 		// CRC consists of the 0xFB/0xF8 and the sector data
-		wCRC16 = Calculate_CRC_CCITT(&g_tdTrack.byTrackData[nSectorDataIndexOffset], nSectorSize+1, 1);
-		g_tdTrack.byTrackData[nSectorDataIndexOffset+nSectorSize+1] = wCRC16 >> 8;
-		g_tdTrack.byTrackData[nSectorDataIndexOffset+nSectorSize+2] = wCRC16 & 0xFF;
+		wCRC16 = Calculate_CRC_CCITT(&g_ptdTrack->byTrackData[nSectorDataIndexOffset], nSectorSize+1, 1);
+		g_ptdTrack->byTrackData[nSectorDataIndexOffset+nSectorSize+1] = wCRC16 >> 8;
+		g_ptdTrack->byTrackData[nSectorDataIndexOffset+nSectorSize+2] = wCRC16 & 0xFF;
 	}
 }
 
@@ -2444,7 +3455,7 @@ void FdcUpdateDataAddressMark(int nSector, int nSectorSize)
 	int nSectorDataMarkOffset, i;
 
 	// get offset of the 0xFb/0xF8 byte in the 0xA1, 0xA1, 0xA1, 0xFB/0xF8 sequence that marks the start of sector data
-	nSectorDataMarkOffset = g_tdTrack.nSectorDataMarkOffset[nSector];
+	nSectorDataMarkOffset = g_ptdTrack->nSectorDataMarkOffset[nSector];
 
 	if (nSectorDataMarkOffset < 0)
 	{
@@ -2453,13 +3464,13 @@ void FdcUpdateDataAddressMark(int nSector, int nSectorSize)
 
 	// update sector data mark (0xFB/0xF8)
 
-	if (g_tdTrack.byDensity == eDD) // double density
+	if (g_ptdTrack->byDensity == eDD) // double density
 	{
-		g_tdTrack.byTrackData[nSectorDataMarkOffset] = g_stSector.bySectorDataAddressMark;
+		g_ptdTrack->byTrackData[nSectorDataMarkOffset] = g_stSector.bySectorDataAddressMark;
 	}
 	else // single density
 	{
-		g_tdTrack.byTrackData[nSectorDataMarkOffset] = g_stSector.bySectorDataAddressMark;
+		g_ptdTrack->byTrackData[nSectorDataMarkOffset] = g_stSector.bySectorDataAddressMark;
 	}
 }
 
@@ -2703,6 +3714,7 @@ void FdcWriteDmkTrack(TrackType* ptdTrack)
 	// check if the disk header (number of sides) needs to be updated
 	if (ptdTrack->nSide >= g_dtDives[ptdTrack->nDrive].dmk.byNumSides)
 	{
+		FlashCacheDiscard(g_dtDives[ptdTrack->nDrive].f);
 		g_dtDives[ptdTrack->nDrive].dmk.byNumSides = ptdTrack->nSide + 1;
 		g_dtDives[ptdTrack->nDrive].dmk.byDmkDiskHeader[4] &= 0xEF;
 		FileSeek(g_dtDives[ptdTrack->nDrive].f, 0);
@@ -2712,6 +3724,7 @@ void FdcWriteDmkTrack(TrackType* ptdTrack)
 	// check if the disk header (number of tracks) needs to be updated
 	if (ptdTrack->nTrack >= g_dtDives[ptdTrack->nDrive].dmk.byDmkDiskHeader[1])
 	{
+		FlashCacheDiscard(g_dtDives[ptdTrack->nDrive].f);
 		g_dtDives[ptdTrack->nDrive].byNumTracks = ptdTrack->nTrack + 1;
 		g_dtDives[ptdTrack->nDrive].dmk.byDmkDiskHeader[1] = ptdTrack->nTrack + 1;
 		FileSeek(g_dtDives[ptdTrack->nDrive].f, 0);
@@ -2744,20 +3757,46 @@ void FdcWriteDmkTrack(TrackType* ptdTrack)
 	FileSeek(g_dtDives[ptdTrack->nDrive].f, nFileOffset);
 	FileWrite(g_dtDives[ptdTrack->nDrive].f, ptdTrack->byTrackData, ptdTrack->nTrackSize);
 	FileFlush(g_dtDives[ptdTrack->nDrive].f);
+
+	if (ptdTrack->nTrackSize == g_dtDives[ptdTrack->nDrive].dmk.wTrackLength)
+	{
+		CacheStore(g_dtDives[ptdTrack->nDrive].f, ptdTrack->nSide, ptdTrack->nTrack, ptdTrack->byTrackData, ptdTrack->nTrackSize);
+		FlashCacheInvalidate(g_dtDives[ptdTrack->nDrive].f, ptdTrack->nSide, ptdTrack->nTrack);
+	}
+	else
+	{
+		CacheInvalidate(g_dtDives[ptdTrack->nDrive].f);
+		FlashCacheDiscard(g_dtDives[ptdTrack->nDrive].f);
+	}
 }
 
 //-----------------------------------------------------------------------------
 void FdcWriteTrack(TrackType* ptdTrack)
 {
+	TrackType* ptdBack = FdcBackTrack();
+	int        nSides  = 0;
+
+	if ((ptdTrack->nDrive >= 0) && (ptdTrack->nDrive < MAX_DRIVES))
+	{
+		nSides = g_dtDives[ptdTrack->nDrive].dmk.byNumSides;
+	}
+
 	switch (ptdTrack->nType)
 	{
 		case eDMK:
 			FdcWriteDmkTrack(ptdTrack);
+			FdcCopyTrackWritten(ptdTrack, nSides);
 			break;
 
 		case eHFE:
 			break;
 	}
+
+	// a track loaded ahead is out of date once the same track has been written
+	if ((ptdBack->nDrive == ptdTrack->nDrive) && (ptdBack->nSide == ptdTrack->nSide) && (ptdBack->nTrack == ptdTrack->nTrack))
+	{
+		ptdBack->nDrive = -1;
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -2767,23 +3806,46 @@ void FdcServiceWriteSector(void)
 	{
 		case 0:
 			// indicate to the Z80 that we are ready for the first data byte
-			FdcGenerateDRQ();
+			FdcStartDrq();
 			++g_FDC.nServiceState;
 			break;
 
 		case 1:
-			if (g_tdTrack.nWriteCount > 0)
+			if (g_ptdTrack->nWriteCount > 0)
 			{
 				break;
 			}
 
+			g_dwDrqByteTime = 0;
 			FdcUpdateDataAddressMark(g_stSector.nSector, g_stSector.nSectorSize);
 			
 			// perform a CRC on the sector data (including preceeding 4 bytes) and update sector CRC value
 			FdcGenerateSectorCRC(g_stSector.nSector, g_stSector.nSectorSize);
 			
 			// flush track to SD-Card
-			FdcWriteTrack(&g_tdTrack);
+			FdcWriteTrack(g_ptdTrack);
+
+			if (g_FDC.byCurCommand & 0x10)
+			{
+				++g_dwMultiWriteSectors;
+			}
+
+			// write multiple, carry on with the next sector of the track without
+			// an interrupt, a sector past the last one ends it with record not found
+			if ((g_FDC.byCurCommand & 0x10) && g_byEnableStream)
+			{
+				++g_FDC.bySector;
+				FdcReadSector(g_FDC.byDriveSel, FdcGetSide(g_FDC.byDriveSel), g_FDC.byTrack, g_FDC.bySector);
+
+				if (!(g_FDC.dwFlags & FF_NOTFOUND))
+				{
+					FdcStartWriteSector(FdcGetDriveIndex(g_FDC.byDriveSel));
+					++g_dwMultiWriteStreamed;
+					break;
+				}
+			}
+
+			FdcEndMultiTime();
 		
 			++g_FDC.nServiceState;
 			g_FDC.nStateTimer = 0;
@@ -2820,27 +3882,27 @@ void FdcServiceWriteTrack(void)
 			break;
 		
 		case 1:
-			if (g_tdTrack.nWriteCount > 0)
+			if (g_ptdTrack->nWriteCount > 0)
 			{
 				break;
 			}
 
 			if (g_FDC.byDoublerDensity)
 			{
-				FdcProcessTrackData1791(&g_tdTrack);	// scan track data to generate CRC values
-				FdcBuildIdamTable1791(&g_tdTrack);		// scan track data to build the IDAM table
+				FdcProcessTrackData1791(g_ptdTrack);	// scan track data to generate CRC values
+				FdcBuildIdamTable1791(g_ptdTrack);		// scan track data to build the IDAM table
 			}
 			else
 			{
-				FdcProcessTrackData1771(&g_tdTrack);	// scan track data to generate CRC values
-				FdcBuildIdamTable1771(&g_tdTrack);		// scan track data to build the IDAM table
+				FdcProcessTrackData1771(g_ptdTrack);	// scan track data to generate CRC values
+				FdcBuildIdamTable1771(g_ptdTrack);		// scan track data to build the IDAM table
 			}
 
-			FdcBuildDataSizeTable(&g_tdTrack);
-			FdcBuildDamTable(&g_tdTrack);
+			FdcBuildDataSizeTable(g_ptdTrack);
+			FdcBuildDamTable(g_ptdTrack);
 
 			// flush track to SD-Card
-			FdcWriteTrack(&g_tdTrack);
+			FdcWriteTrack(g_ptdTrack);
 		
 			g_FDC.nStateTimer = 0;
 			++g_FDC.nServiceState;
@@ -2936,7 +3998,32 @@ void FdcProcessStatusRequest(byte print)
 	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szBuf);
 	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szLineEnd);
 
-	sprintf(szBuf, "WAIT=%d", g_byEnableWaitStates);
+	sprintf(szBuf, "WAIT=%d (%lu waits, %luus)", g_byEnableWaitStates, g_dwWaitCycles, g_dwWaitTime);
+	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szBuf);
+	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szLineEnd);
+
+	sprintf(szBuf, "DRQ=%d (%lu lost data)", g_byDrqTiming, g_dwDrqLost);
+	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szBuf);
+	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szLineEnd);
+
+	sprintf(szBuf, "TRACKS=%lu loaded (%lu read ahead, %lu PV sectors)", g_dwTrackLoads, g_dwTrackPrefetchHits, g_dwParaSectors);
+	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szBuf);
+	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szLineEnd);
+
+	// streamed of all sectors and the sectors per second, reads then writes
+	snprintf(szBuf, sizeof(szBuf), "STREAM=%d (R %lu/%lu %lu/s, W %lu/%lu %lu/s)", g_byEnableStream,
+			 g_dwMultiReadStreamed, g_dwMultiReadSectors,
+			 (g_dwMultiReadTime > 0) ? (uint32_t)((uint64_t)g_dwMultiReadSectors * 1000000 / g_dwMultiReadTime) : 0,
+			 g_dwMultiWriteStreamed, g_dwMultiWriteSectors,
+			 (g_dwMultiWriteTime > 0) ? (uint32_t)((uint64_t)g_dwMultiWriteSectors * 1000000 / g_dwMultiWriteTime) : 0);
+	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szBuf);
+	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szLineEnd);
+
+	sprintf(szBuf, "RESET=%d (%lu warm, %luus)", g_byResetMode, g_dwWarmResetCount, g_dwResetLatency);
+	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szBuf);
+	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szLineEnd);
+
+	sprintf(szBuf, "FLASH=%d (%lu hits, %lu ram hits)", g_byEnableFlashCache, g_dwFlashHits, g_dwCacheHits);
 	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szBuf);
 	strcat_s((char*)(g_bFdcResponse.buf),  sizeof(g_bFdcResponse.buf)-1, szLineEnd);
 
@@ -3090,141 +4177,1266 @@ void FdcSaveBootCfg(char* pszIniFile)
 }
 
 //-----------------------------------------------------------------------------
-void FdcServiceMountImage(void)
+// closes the image in the drive.  A command in progress on the drive is
+// terminated and the track buffer is discarded if it holds one of its tracks.
+void FdcReleaseDrive(int nDrive)
+{
+	if ((nDrive == FdcGetDriveIndex(g_FDC.byDriveSel)) && (g_FDC.nProcessFunction != psIdle))
+	{
+		g_ptdTrack->nReadCount   = 0;
+		g_ptdTrack->nWriteCount  = 0;
+		g_FDC.nProcessFunction = psIdle;
+		FdcClrFlag(eBusy);
+		FdcGenerateIntr();
+	}
+
+	FdcInvalidateTracks(nDrive);
+	FlashCacheDetach(nDrive);
+
+	if (g_dtDives[nDrive].f != NULL)
+	{
+		FileClose(g_dtDives[nDrive].f);
+	}
+
+	memset(&g_dtDives[nDrive], 0, sizeof(FdcDriveType));
+}
+
+//-----------------------------------------------------------------------------
+void FdcUnmountDrive(int nDrive)
+{
+	FdcReleaseDrive(nDrive);
+	FdcCloseDiskSet(nDrive);
+}
+
+//-----------------------------------------------------------------------------
+// mounts the next image of the disk set in the drive, wrapping around after
+// the last one.  If the image was opened in idle time its file handle (and so
+// its cached tracks) is taken over.  Returns the index of the new image in the
+// set or -1 if the drive does not contain a set.
+int FdcRotateDiskSet(int nDrive)
+{
+	DiskSetType* pds;
+	int nNext;
+
+	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dsSets[nDrive].nImageCount == 0))
+	{
+		return -1;
+	}
+
+	pds   = &g_dsSets[nDrive];
+	nNext = (pds->nCurImage + 1) % pds->nImageCount;
+
+	FdcReleaseDrive(nDrive);
+
+	if ((pds->dtNext.f != NULL) && (pds->nNextImage == nNext))
+	{
+		g_dtDives[nDrive] = pds->dtNext;
+		memset(&pds->dtNext, 0, sizeof(FdcDriveType));
+		FdcAttachFlashCache(nDrive);
+	}
+	else
+	{
+		FdcCloseWarmImage(pds);
+		strcpy(g_dtDives[nDrive].szFileName, pds->szImage[nNext]);
+		FdcMountDrive(nDrive);
+	}
+
+	pds->nCurImage = nNext;
+	FdcStartWarm(nDrive);
+
+	return nNext;
+}
+
+//-----------------------------------------------------------------------------
+// buf "C" clears the statistics after they have been returned, buf "n" returns
+// the histogram of handler n
+void FdcServiceBusStats(void)
+{
+	char* psz     = SkipBlanks((char*)g_bFdcRequest.buf);
+	byte  byClear = (toupper(*psz) == 'C');
+
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+
+	// a handler id returns its histogram rather than the summary
+	if (isdigit(*psz))
+	{
+		BusFormatHistogram(atoi(psz), (char*)(g_bFdcResponse.buf), sizeof(g_bFdcResponse.buf)-1, "\r");
+	}
+	else
+	{
+		BusFormatStats((char*)(g_bFdcResponse.buf), sizeof(g_bFdcResponse.buf)-1, "\r");
+	}
+
+	SetResponseLength(&g_bFdcResponse);
+
+	if (byClear)
+	{
+		BusClearStats();
+	}
+}
+
+//-----------------------------------------------------------------------------
+void FdcServiceRotateDiskSet(void)
+{
+	int nDrive = atoi(SkipBlanks((char*)g_bFdcRequest.buf));
+	int nImage = FdcRotateDiskSet(nDrive);
+
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+
+	if (nImage < 0)
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "Drive %d does not contain a disk set\r", nDrive);
+	}
+	else
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "Drive %d: %s (%d of %d)\r", nDrive, g_dtDives[nDrive].szFileName, nImage+1, g_dsSets[nDrive].nImageCount);
+	}
+
+	SetResponseLength(&g_bFdcResponse);
+}
+
+//-----------------------------------------------------------------------------
+// buf "n sdfile [NAME/EXT]" copies an SD-Card file onto the DOS disk in drive n
+void FdcServiceDosImport(void)
+{
+	char     szFile[64];
+	char     szName[16];
+	char*    psz;
+	uint32_t dwSize;
+	int      nDrive, nResult;
+
+	psz    = SkipBlanks((char*)g_bFdcRequest.buf);
+	nDrive = atoi(psz);
+	psz    = GetWord(SkipToBlank(psz), szFile, sizeof(szFile)-1);
+	GetWord(psz, szName, sizeof(szName)-1);
+
+	nResult = DosImport(nDrive, szFile, szName, &dwSize);
+
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+
+	if (nResult == eDosOk)
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "Copied %s to drive %d (%u bytes)\r", szFile, nDrive, (unsigned)dwSize);
+	}
+	else
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "%s\r", DosErrorText(nResult));
+	}
+
+	SetResponseLength(&g_bFdcResponse);
+}
+
+//-----------------------------------------------------------------------------
+// buf "n [NAME/EXT]" lists the first file of the DOS disk in drive n, with *
+// and ? wildcards.  Each following request 21 gives the next one, and an empty
+// response the end of the list.
+void FdcServiceDosFind(byte byFirst)
+{
+	DosFileType df;
+	char* psz;
+	int   nDrive, nResult;
+
+	if (byFirst)
+	{
+		psz     = SkipBlanks((char*)g_bFdcRequest.buf);
+		nDrive  = atoi(psz);
+		nResult = DosFindFirst(nDrive, SkipToBlank(psz), &df);
+	}
+	else if (FdcIsBusy())
+	{
+		nResult = eDosNoDisk;
+	}
+	else
+	{
+		nResult = DosFindNext(&df);
+	}
+
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+
+	if (nResult == eDosOk)
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "%-12s %7u", df.szName, (unsigned)df.dwSize);
+	}
+	else if (byFirst || (nResult != eDosNotFound))
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "%s", DosErrorText(nResult));
+	}
+
+	SetResponseLength(&g_bFdcResponse);
+}
+
+//-----------------------------------------------------------------------------
+// buf "n NAME/EXT" copies the matching files of the DOS disk in drive n to the
+// root folder of the SD-Card
+void FdcServiceDosExport(void)
+{
+	char* psz;
+	int   nDrive, nFiles, nResult;
+
+	psz     = SkipBlanks((char*)g_bFdcRequest.buf);
+	nDrive  = atoi(psz);
+	nResult = DosExport(nDrive, SkipToBlank(psz), &nFiles);
+
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+
+	if (nResult == eDosOk)
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "%d file(s) copied from drive %d\r", nFiles, nDrive);
+	}
+	else
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "%s (%d file(s) copied)\r", DosErrorText(nResult), nFiles);
+	}
+
+	SetResponseLength(&g_bFdcResponse);
+}
+
+//-----------------------------------------------------------------------------
+// buf "src dst" starts copying the image in drive src over the image in drive
+// dst, an empty buf (or request 24) returns the progress of the copy
+void FdcServiceDiskCopyRequest(byte byStart)
+{
+	char* psz = SkipBlanks((char*)g_bFdcRequest.buf);
+	int   nSrc;
+
+	if (byStart && (*psz != 0))
+	{
+		nSrc = atoi(psz);
+		FdcStartDiskCopy(nSrc, atoi(SkipToBlank(psz)));
+	}
+
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+
+	FdcFormatDiskCopy((char*)(g_bFdcResponse.buf), sizeof(g_bFdcResponse.buf)-1, "\r");
+	SetResponseLength(&g_bFdcResponse);
+}
+
+//-----------------------------------------------------------------------------
+// buf "file [R]" saves the upper 32K to a file, R without compression
+void FdcServiceSnapSave(void)
+{
+	char     szFile[64];
+	char     szParm[4];
+	char*    psz;
+	uint32_t dwSize;
+	int      nResult;
+
+	psz = GetWord((char*)g_bFdcRequest.buf, szFile, sizeof(szFile)-1);
+	GetWord(psz, szParm, sizeof(szParm)-1);
+
+	nResult = SnapSave(szFile, toupper(szParm[0]) != 'R', &dwSize);
+
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+
+	if (nResult == eSnapOk)
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "Saved 8000-FFFF to %s (%u bytes)\r", szFile, (unsigned)dwSize);
+	}
+	else
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "%s\r", SnapErrorText(nResult));
+	}
+
+	SetResponseLength(&g_bFdcResponse);
+}
+
+//-----------------------------------------------------------------------------
+// buf "file" restores the upper 32K from a file
+void FdcServiceSnapLoad(void)
+{
+	char szFile[64];
+	int  nResult;
+
+	GetWord((char*)g_bFdcRequest.buf, szFile, sizeof(szFile)-1);
+
+	nResult = SnapLoad(szFile);
+
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+
+	if (nResult == eSnapOk)
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "Loaded 8000-FFFF from %s\r", szFile);
+	}
+	else
+	{
+		sprintf((char*)(g_bFdcResponse.buf), "%s\r", SnapErrorText(nResult));
+	}
+
+	SetResponseLength(&g_bFdcResponse);
+}
+
+//-----------------------------------------------------------------------------
+// performs one step of opening/caching the next image of a disk set, so the
+// FDC is never held up for more than a single track read
+void FdcServiceDiskSets(void)
+{
+	DiskSetType* pds;
+	int nSide, nTrack, i;
+
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		pds = &g_dsSets[i];
+
+		switch (pds->nWarmState)
+		{
+			case eWarmOpen:
+				// the warm image is only an extra, it must not take the last
+				// file buffers from a mount or a transfer
+				if (FileFreeCount() <= SET_SPARE_FILES)
+				{
+					break;
+				}
+
+				memset(&pds->dtNext, 0, sizeof(FdcDriveType));
+				strcpy(pds->dtNext.szFileName, pds->szImage[pds->nNextImage]);
+
+				if (stristr(pds->dtNext.szFileName, (char*)".dmk") != NULL)
+				{
+					FdcOpenDmkImage(&pds->dtNext);
+				}
+
+				// a rejected image (track too long) is left with no sides
+				if ((pds->dtNext.f == NULL) || (pds->dtNext.dmk.byNumSides == 0))
+				{
+					FdcCloseWarmImage(pds);
+					return;
+				}
+
+				pds->nWarmTrack = 0;
+				pds->nWarmState = eWarmTracks;
+				return;
+
+			case eWarmTracks:
+				nSide  = pds->nWarmTrack % pds->dtNext.dmk.byNumSides;
+				nTrack = pds->nWarmTrack / pds->dtNext.dmk.byNumSides;
+
+				if ((nTrack >= SET_WARM_TRACKS) || (nTrack >= pds->dtNext.byNumTracks))
+				{
+					pds->nWarmState = eWarmIdle;
+					break;
+				}
+
+				if (!CacheContains(pds->dtNext.f, nSide, nTrack))
+				{
+					FileSeek(pds->dtNext.f, FdcGetImageTrackOffset(&pds->dtNext, nSide, nTrack));
+					FileRead(pds->dtNext.f, g_byTrackBuffer, pds->dtNext.dmk.wTrackLength);
+					CacheStore(pds->dtNext.f, nSide, nTrack, g_byTrackBuffer, pds->dtNext.dmk.wTrackLength);
+				}
+
+				++pds->nWarmTrack;
+				return;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// switches to a new ini file without a reset.  Only the drives whose image
+// differs from the new ini file are flushed, closed and remounted, the others
+// stay open and keep their track buffer.  Returns the number of drives
+// (floppy and hard disk) that were remounted, or -1 if the ini file could not
+// be read.
+int FdcApplyIni(char* pszIniFile)
+{
+	char szNewIniFile[30];
+	int  nCount, i;
+
+	strncpy(szNewIniFile, pszIniFile, sizeof(szNewIniFile)-5);
+	szNewIniFile[sizeof(szNewIniFile)-5] = 0;
+
+	StrToUpper(szNewIniFile);
+
+	if (strstr(szNewIniFile, ".INI") == NULL)
+	{
+		strcat(szNewIniFile, ".INI");
+	}
+
+	if (!FdcReadIniFile(szNewIniFile, &g_ipProfile))
+	{
+		return -1;
+	}
+
+	nCount = 0;
+
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		if ((stricmp(FdcGetMountName(i), g_ipProfile.szDrive[i]) == 0) &&
+		    ((g_dtDives[i].szFileName[0] == 0) || (g_dtDives[i].f != NULL)))
+		{
+			continue;
+		}
+
+		FdcUnmountDrive(i);
+		strcpy(g_dtDives[i].szFileName, g_ipProfile.szDrive[i]);
+
+		if (g_dtDives[i].szFileName[0] != 0)
+		{
+			FdcMountDrive(i);
+		}
+
+		++nCount;
+	}
+
+	for (i = 0; i < MAX_VHD_DRIVES; ++i)
+	{
+		if ((stricmp(Vhd[i].szFileName, g_ipProfile.szHardDisk[i]) == 0) &&
+		    ((Vhd[i].szFileName[0] == 0) || (Vhd[i].f != NULL)))
+		{
+			continue;
+		}
+
+		HdcUnmountDrive(i);
+		HdcInitFileName(i, g_ipProfile.szHardDisk[i]);
+		HdcMountDrive(i);
+		++nCount;
+	}
+
+	g_FDC.byEnableDoubler = g_ipProfile.byEnableDoubler;
+
+	// remember the selection, the mounted images already reflect it so a
+	// later reset does not need to reboot to pick it up
+	FdcSaveBootCfg(szNewIniFile);
+	g_byBootConfigModified = FALSE;
+
+	return nCount;
+}
+
+//-----------------------------------------------------------------------------
+void FdcServiceApplyIni(void)
+{
+	char* psz = SkipBlanks((char*)g_bFdcRequest.buf);
+
+	if (FdcApplyIni(psz) < 0)
+	{
+	    memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+		sprintf((char*)(g_bFdcResponse.buf), "Unable to read %s\r", psz);
+		SetResponseLength(&g_bFdcResponse);
+		return;
+	}
+
+    FdcProcessStatusRequest(false);
+}
+
+//-----------------------------------------------------------------------------
+void FdcServiceMountImage(void)
+{
+	char* psz;
+	int   nDrive;
+
+	// locate the drive number
+	psz = SkipBlanks((char*)g_bFdcRequest.buf);
+	nDrive = atoi(psz);
+
+	psz = SkipToBlank((char*)psz);
+
+	if (*psz != ' ')
+	{
+		return;
+	}
+
+	psz = SkipBlanks((char*)psz);
+
+	if ((nDrive < 0) || (nDrive >= MAX_DRIVES))
+	{
+		return;
+	}
+
+	// if test if it is an ini file
+	if (stristr(g_bFdcRequest.buf, ".ini"))
+	{
+		FdcSaveBootCfg((char*)psz);
+	}
+	else if (FileExists((char*)psz))
+	{
+		FdcUnmountDrive(nDrive);
+		strcpy(g_dtDives[nDrive].szFileName, (char*)psz);
+		FdcMountDrive(nDrive);
+	}
+
+    FdcProcessStatusRequest(false);
+}
+
+//-----------------------------------------------------------------------------
+void FdcFormatDrive(void)
+{
+	file* f;
+	char* psz;
+	char  buf[256];
+	int   drive = atoi(g_bFdcRequest.buf);
+	int   size, read;
+
+	if (!isdigit((char)g_bFdcRequest.buf[0]))
+	{
+		strcpy((char*)(g_bFdcResponse.buf), "Drive number not specified\n");
+		SetResponseLength(&g_bFdcResponse);
+		return;
+	}
+
+	if ((drive < 0) || (drive > (sizeof(g_dtDives)/sizeof(g_dtDives[0]))))
+	{
+		sprintf(buf, "Invalid drive number %d\n", drive);
+		strcpy((char*)(g_bFdcResponse.buf), buf);
+		SetResponseLength(&g_bFdcResponse);
+		return;
+	}
+
+	if (g_dtDives[drive].f == NULL)
+	{
+		sprintf(buf, "Drive must be mounted to be formated\n");
+		strcpy((char*)(g_bFdcResponse.buf), buf);
+		SetResponseLength(&g_bFdcResponse);
+		return;
+	}
+
+	psz = g_bFdcRequest.buf;
+	psz = SkipBlanks(psz);
+	psz = SkipToBlank(psz);
+	psz = SkipBlanks(psz);
+
+	strcpy(buf, "0:\\FMT\\");
+	strcat(buf, psz);
+
+	if (FR_OK != f_stat(buf, &g_fno))
+	{
+		strcpy((char*)(g_bFdcResponse.buf), "Unable to formatted disk image: ");
+		strcat((char*)(g_bFdcResponse.buf), buf);
+		strcat((char*)(g_bFdcResponse.buf), "\n");
+		SetResponseLength(&g_bFdcResponse);
+		return;
+	}
+
+	f = FileOpen(buf, FA_READ);
+
+	if (f == NULL)
+	{
+		strcpy((char*)(g_bFdcResponse.buf), "Unable to open file: ");
+		strcat((char*)(g_bFdcResponse.buf), buf);
+		strcat((char*)(g_bFdcResponse.buf), "\n");
+		SetResponseLength(&g_bFdcResponse);
+		return;
+	}
+
+	FileClose(g_dtDives[drive].f);
+	g_dtDives[drive].f = NULL;
+
+	// the new image may have the same size and time stamp as the old one
+	FlashCacheDetach(drive);
+	FlashCacheForget(g_dtDives[drive].szFileName);
+
+	g_dtDives[drive].f = FileOpen(g_dtDives[drive].szFileName, FA_WRITE | FA_CREATE_ALWAYS);
+
+	if (g_dtDives[drive].f == NULL)
+	{
+		strcpy((char*)(g_bFdcResponse.buf), "Unable to create new DMK disk image.\n");
+		SetResponseLength(&g_bFdcResponse);
+		return;
+	}
+
+	size = g_fno.fsize;
+
+	while (size > 0)
+	{
+		read = sizeof(g_byTrackBuffer);
+
+		if (read > size)
+		{
+			read = size;
+		}
+
+		FileRead(f, g_byTrackBuffer, read);
+		FileWrite(g_dtDives[drive].f, g_byTrackBuffer, read);
+		size -= read;
+	}
+
+	FileClose(f);
+	FileClose(g_dtDives[drive].f);
+	g_dtDives[drive].f = NULL;
+
+	FdcMountDrive(drive);
+
+	sprintf((char*)(g_bFdcResponse.buf), "Formatting drive %d (%s), complete.\n", drive, g_dtDives[drive].szFileName);
+	SetResponseLength(&g_bFdcResponse);
+}
+
+//-----------------------------------------------------------------------------
+// Whole disk copy.
+//
+// The image in one drive is copied over the image file of another, a track
+// buffer at a time in idle time, so the other drives keep working while it
+// runs.  The destination drive is empty (not ready) until the copy is mounted.
+// A track of the source written during the copy is copied again.
+
+static int      g_nCopyState = eCopyIdle;
+static int      g_nCopySrc;
+static int      g_nCopyDst;
+static uint32_t g_dwCopySrcId;		// file.dwId of the source image
+static uint32_t g_dwCopyDone;		// bytes copied
+static uint32_t g_dwCopySize;		// of the source when the copy started
+static file*    g_fCopy;
+static char     g_szCopyFile[128];	// destination image
+static char     g_szCopyError[48];
+
+//-----------------------------------------------------------------------------
+static void FdcEndDiskCopy(char* pszError)
+{
+	if (g_fCopy != NULL)
+	{
+		FileClose(g_fCopy);
+		g_fCopy = NULL;
+	}
+
+	if (pszError != NULL)
+	{
+		CopyString(pszError, g_szCopyError, sizeof(g_szCopyError)-1);
+		g_nCopyState = eCopyFailed;
+	}
+	else
+	{
+		g_nCopyState = eCopyDone;
+	}
+
+	// the destination takes up its image again, copied or not, unless another
+	// image has been mounted in the meantime
+	if (g_dtDives[g_nCopyDst].f == NULL)
+	{
+		strcpy(g_dtDives[g_nCopyDst].szFileName, g_szCopyFile);
+		FdcMountDrive(g_nCopyDst);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// rewinds the copy when a track of the source that has already been copied is
+// written.  A new side moves every track so the copy starts over.
+void FdcCopyTrackWritten(TrackType* ptdTrack, int nSides)
+{
+	uint32_t dwOffset;
+
+	if ((g_nCopyState != eCopyRunning) || (ptdTrack->nDrive != g_nCopySrc))
+	{
+		return;
+	}
+
+	if (nSides != g_dtDives[g_nCopySrc].dmk.byNumSides)
+	{
+		g_dwCopyDone = 0;
+		return;
+	}
+
+	dwOffset = FdcGetTrackOffset(g_nCopySrc, ptdTrack->nSide, ptdTrack->nTrack);
+
+	if (dwOffset < g_dwCopyDone)
+	{
+		g_dwCopyDone = dwOffset;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// starts copying the image in drive nSrc over the image in drive nDst.
+// Returns eCopyRunning, or eCopyFailed with the reason in the copy status.
+int FdcStartDiskCopy(int nSrc, int nDst)
+{
+	char*    pszError = NULL;
+	uint32_t dwTime;
+
+	if (g_nCopyState == eCopyRunning)
+	{
+		return eCopyRunning;
+	}
+
+	if ((nSrc < 0) || (nSrc >= MAX_DRIVES) || (nDst < 0) || (nDst >= MAX_DRIVES) || (nSrc == nDst))
+	{
+		pszError = "Invalid drive number";
+	}
+	else if ((g_dtDives[nSrc].f == NULL) || (g_dtDives[nDst].f == NULL))
+	{
+		pszError = "Both drives must be mounted";
+	}
+	else if (g_dtDives[nSrc].nDriveFormat != g_dtDives[nDst].nDriveFormat)
+	{
+		pszError = "Images are not of the same type";
+	}
+	else if (FdcIsBusy())
+	{
+		pszError = "Controller busy";
+	}
+
+	if (pszError != NULL)
+	{
+		CopyString(pszError, g_szCopyError, sizeof(g_szCopyError)-1);
+		g_nCopyState = eCopyFailed;
+		return g_nCopyState;
+	}
+
+	FdcFlushImageSectors();
+
+	g_nCopySrc    = nSrc;
+	g_nCopyDst    = nDst;
+	g_dwCopySrcId = g_dtDives[nSrc].f->dwId;
+	g_dwCopyDone  = 0;
+
+	if (!FileStat(g_dtDives[nSrc].szFileName, &g_dwCopySize, &dwTime))
+	{
+		g_dwCopySize = 0;
+	}
+
+	// the destination is released, keeping its file name to mount it again
+	strcpy(g_szCopyFile, g_dtDives[nDst].szFileName);
+	FdcReleaseDrive(nDst);
+	FlashCacheForget(g_szCopyFile);
+
+	g_nCopyState = eCopyRunning;
+	g_fCopy      = FileOpen(g_szCopyFile, FA_WRITE | FA_CREATE_ALWAYS);
+
+	if (g_fCopy == NULL)
+	{
+		FdcEndDiskCopy("Unable to create the destination image");
+	}
+
+	return g_nCopyState;
+}
+
+//-----------------------------------------------------------------------------
+// copies the next track buffer of the image, called in idle time
+void FdcServiceDiskCopy(void)
+{
+	FdcDriveType* pdt = &g_dtDives[g_nCopySrc];
+	uint32_t      dwRead;
+
+	if (g_nCopyState != eCopyRunning)
+	{
+		return;
+	}
+
+	if ((pdt->f == NULL) || (pdt->f->dwId != g_dwCopySrcId))
+	{
+		FdcEndDiskCopy("Source image dismounted");
+		return;
+	}
+
+	if (g_dtDives[g_nCopyDst].f != NULL)
+	{
+		FdcEndDiskCopy("Destination drive mounted");
+		return;
+	}
+
+	FileSeek(pdt->f, g_dwCopyDone);
+	dwRead = FileRead(pdt->f, g_byTrackBuffer, sizeof(g_byTrackBuffer));
+
+	FileSeek(g_fCopy, g_dwCopyDone);
+
+	if (FileWrite(g_fCopy, g_byTrackBuffer, dwRead) != dwRead)
+	{
+		FdcEndDiskCopy("Write to the destination image failed");
+		return;
+	}
+
+	g_dwCopyDone += dwRead;
+
+	if (dwRead < sizeof(g_byTrackBuffer))
+	{
+		FdcEndDiskCopy(NULL);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the progress of the last copy, returns its state
+int FdcFormatDiskCopy(char* psz, int nMaxLen, char* pszLineEnd)
+{
+	switch (g_nCopyState)
+	{
+		case eCopyIdle:
+			snprintf(psz, nMaxLen, "No disk copy started%s", pszLineEnd);
+			break;
+
+		case eCopyRunning:
+			snprintf(psz, nMaxLen, "Copying drive %d to %d, %u of %u bytes%s", g_nCopySrc, g_nCopyDst,
+					 (unsigned)g_dwCopyDone, (unsigned)g_dwCopySize, pszLineEnd);
+			break;
+
+		case eCopyDone:
+			snprintf(psz, nMaxLen, "Copied drive %d to %d (%u bytes)%s", g_nCopySrc, g_nCopyDst, (unsigned)g_dwCopyDone, pszLineEnd);
+			break;
+
+		default:
+			snprintf(psz, nMaxLen, "Disk copy failed: %s%s", g_szCopyError, pszLineEnd);
+			break;
+	}
+
+	return g_nCopyState;
+}
+
+//-----------------------------------------------------------------------------
+// Program loader.
+//
+// Reads a /CMD load module, from the SD-Card or from a DOS disk in a drive.
+// Load records for the upper 32K (MEM=1) are copied straight to its memory,
+// the ones below 8000h are handed to a Z80 stub in the response buffer a
+// record (at most 256 bytes) per request.  The stub runs from the transfer
+// window, so the program can load over the code that started it.
+
+static file*    g_fLoad;			// NULL for a DOS file (DosRead())
+static byte     g_byLoadOpen;
+static int      g_nLoadLeft;		// bytes of the current load record
+static word     g_wLoadAddr;
+static uint32_t g_dwLoadHigh;		// bytes placed in the upper 32K
+
+//-----------------------------------------------------------------------------
+static int FdcLoadRead(BYTE* pby, int nSize)
+{
+	if (g_fLoad != NULL)
+	{
+		return FileRead(g_fLoad, pby, nSize);
+	}
+
+	return DosRead(pby, nSize);
+}
+
+//-----------------------------------------------------------------------------
+static void FdcLoadEnd(int nStatus, word wAddr)
+{
+	if (g_fLoad != NULL)
+	{
+		FileClose(g_fLoad);
+		g_fLoad = NULL;
+	}
+
+	g_byLoadOpen = false;
+
+	g_bFdcResponse.cmd[0] = nStatus;
+	g_bFdcResponse.buf[0] = wAddr & 0xFF;
+	g_bFdcResponse.buf[1] = wAddr >> 8;
+	g_bFdcResponse.buf[2] = (g_dwLoadHigh > 0xFFFF) ? 0xFF : (g_dwLoadHigh & 0xFF);
+	g_bFdcResponse.buf[3] = (g_dwLoadHigh > 0xFFFF) ? 0xFF : (g_dwLoadHigh >> 8);
+}
+
+//-----------------------------------------------------------------------------
+// opens the load module, buf "file.cmd" for a file on the SD-Card or
+// "NAME/CMD :n" for one on the DOS disk in drive n
+static byte FdcLoadOpen(void)
+{
+	char     szName[64];
+	char*    psz;
+	uint32_t dwSize;
+
+	psz = GetWord((char*)g_bFdcRequest.buf, szName, sizeof(szName)-1);
+	psz = SkipBlanks(psz);
+
+	g_fLoad       = NULL;
+	g_nLoadLeft   = 0;
+	g_dwLoadHigh  = 0;
+
+	if (*psz == ':')
+	{
+		g_byLoadOpen = (DosOpenRead(atoi(psz+1), szName, &dwSize) == eDosOk);
+	}
+	else
+	{
+		g_fLoad      = FileOpen(szName, FA_READ);
+		g_byLoadOpen = (g_fLoad != NULL);
+	}
+
+	return g_byLoadOpen;
+}
+
+//-----------------------------------------------------------------------------
+// request 25 opens the load module and request 26 continues with it, each
+// returning the next load record below 8000h or the transfer address
+void FdcServiceLoadProgram(byte byFirst)
+{
+	BYTE  byHeader[2];
+	BYTE* pby;
+	int   nSize;
+
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+
+	if (byFirst && !FdcLoadOpen())
+	{
+		FdcLoadEnd(eLoadNoFile, 0);
+		return;
+	}
+
+	if (!g_byLoadOpen)
+	{
+		FdcLoadEnd(eLoadFormat, 0);
+		return;
+	}
+
+	while (true)
+	{
+		if (g_nLoadLeft == 0)
+		{
+			// record type and length, 0 => 256
+			if (FdcLoadRead(byHeader, 2) != 2)
+			{
+				FdcLoadEnd(eLoadFormat, 0);
+				return;
+			}
+
+			nSize = (byHeader[1] == 0) ? 256 : byHeader[1];
+
+			switch (byHeader[0])
+			{
+				case 0x01: // load, the address then the data, 1 and 2 => 257 and 258
+					if (byHeader[1] <= 2)
+					{
+						nSize += 256;
+					}
+
+					if (FdcLoadRead(byHeader, 2) != 2)
+					{
+						FdcLoadEnd(eLoadFormat, 0);
+						return;
+					}
+
+					g_wLoadAddr = byHeader[0] | (byHeader[1] << 8);
+					g_nLoadLeft = nSize - 2;
+					continue;
+
+				case 0x02: // transfer address
+					if ((nSize < 2) || (FdcLoadRead(byHeader, 2) != 2))
+					{
+						FdcLoadEnd(eLoadFormat, 0);
+						return;
+					}
+
+					FdcLoadEnd(eLoadDone, byHeader[0] | (byHeader[1] << 8));
+					return;
+
+				default: // module header, copyright and the like
+					if (FdcLoadRead(g_bFdcResponse.buf, nSize) != nSize)
+					{
+						FdcLoadEnd(eLoadFormat, 0);
+						return;
+					}
+
+					continue;
+			}
+		}
+
+		// a record is split where it crosses into the upper 32K
+		nSize = g_nLoadLeft;
+
+		if ((g_wLoadAddr < 0x8000) && (g_wLoadAddr + nSize > 0x8000))
+		{
+			nSize = 0x8000 - g_wLoadAddr;
+		}
+
+		pby = BusGetHighMemory(g_wLoadAddr, nSize);
+
+		if (pby == NULL)
+		{
+			break;
+		}
+
+		if (FdcLoadRead(pby, nSize) != nSize)
+		{
+			FdcLoadEnd(eLoadFormat, 0);
+			return;
+		}
+
+		g_wLoadAddr  += nSize;
+		g_nLoadLeft  -= nSize;
+		g_dwLoadHigh += nSize;
+	}
+
+	// memory the Z80 has to write itself
+	if (FdcLoadRead(g_bFdcResponse.buf + 4, nSize) != nSize)
+	{
+		FdcLoadEnd(eLoadFormat, 0);
+		return;
+	}
+
+	g_bFdcResponse.cmd[0] = eLoadData;
+	g_bFdcResponse.buf[0] = g_wLoadAddr & 0xFF;
+	g_bFdcResponse.buf[1] = g_wLoadAddr >> 8;
+	g_bFdcResponse.buf[2] = nSize & 0xFF;
+	g_bFdcResponse.buf[3] = nSize >> 8;
+
+	g_wLoadAddr += nSize;
+	g_nLoadLeft -= nSize;
+}
+
+//-----------------------------------------------------------------------------
+// Sector access for the firmware's own use (DOS files on an image).
+//
+// Works on IBM format sectors of a mounted DMK image through the track buffer,
+// and so through the track caches.  Sectors written are only flushed to the
+// SD-Card, a track at a time, when another track is needed or on
+// FdcFlushImageSectors().  Like the paravirtual disk it must not be used while
+// a controller command is running.
+
+static byte g_byImageDirty;
+
+//-----------------------------------------------------------------------------
+byte FdcIsBusy(void)
+{
+	return (g_FDC.dwFlags & FF_BUSY) != 0;
+}
+
+//-----------------------------------------------------------------------------
+void FdcFlushImageSectors(void)
+{
+	if (g_byImageDirty)
+	{
+		FdcWriteTrack(g_ptdTrack);
+		g_byImageDirty = false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+static int FdcLocateImageSector(int nDrive, int nSide, int nTrack, int nSector, NextSectorType* pns)
+{
+	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL) || (g_dtDives[nDrive].nDriveFormat != eDMK) ||
+		(nTrack < 0) || (nTrack >= g_dtDives[nDrive].byNumTracks) || (nSide >= g_dtDives[nDrive].dmk.byNumSides))
+	{
+		return FDC_SECTOR_NOT_FOUND;
+	}
+
+	if (!FdcTrackLoaded(g_ptdTrack, nDrive, nSide, nTrack))
+	{
+		FdcFlushImageSectors();
+		FdcReadDmkTrack(nDrive, nSide, nTrack);
+	}
+
+	return FdcCheckDmkSector(g_ptdTrack, nSector, true, pns);
+}
+
+//-----------------------------------------------------------------------------
+// copies up to nMaxSize bytes of a sector to pby, returns the sector size
+// (which may be more) or -FDC_SECTOR_NOT_FOUND / -FDC_CRC_ERROR
+int FdcReadImageSector(int nDrive, int nSide, int nTrack, int nSector, BYTE* pby, int nMaxSize)
 {
-	char* psz;
-	int   nDrive;
+	NextSectorType ns;
+	int i, nResult;
 
-	// locate the drive number
-	psz = SkipBlanks((char*)g_bFdcRequest.buf);
-	nDrive = atoi(psz);
+	nResult = FdcLocateImageSector(nDrive, nSide, nTrack, nSector, &ns);
 
-	psz = SkipToBlank((char*)psz);
+	if (nResult != FDC_READ_SECTOR_SUCCESS)
+	{
+		return -nResult;
+	}
 
-	if (*psz != ' ')
+	for (i = 0; (i < ns.nSize) && (i < nMaxSize); ++i)
 	{
-		return;
+		pby[i] = ns.pbyData[i*ns.nDataSize];
 	}
 
-	psz = SkipBlanks((char*)psz);
+	return ns.nSize;
+}
 
-	if ((nDrive < 0) || (nDrive >= MAX_DRIVES))
+//-----------------------------------------------------------------------------
+// replaces the data of a sector (nSize bytes, the rest is left as it was),
+// returns the sector size or -FDC_SECTOR_NOT_FOUND / -FDC_CRC_ERROR
+int FdcWriteImageSector(int nDrive, int nSide, int nTrack, int nSector, BYTE* pby, int nSize)
+{
+	NextSectorType ns;
+	int nResult;
+
+	nResult = FdcLocateImageSector(nDrive, nSide, nTrack, nSector, &ns);
+
+	if (nResult != FDC_READ_SECTOR_SUCCESS)
 	{
-		return;
+		return -nResult;
 	}
 
-	// if test if it is an ini file
-	if (stristr(g_bFdcRequest.buf, ".ini"))
+	// the data CRC is only generated for single byte data
+	if ((ns.nDataSize != 1) || g_dtDives[nDrive].dmk.byWriteProtected)
 	{
-		FdcSaveBootCfg((char*)psz);
+		return -FDC_CRC_ERROR;
 	}
-	else if (FileExists((char*)psz))
+
+	memcpy(ns.pbyData, pby, (nSize < ns.nSize) ? nSize : ns.nSize);
+	FdcGenerateSectorCRC(nSector, ns.nSize);
+	g_byImageDirty = true;
+
+	return ns.nSize;
+}
+
+//-----------------------------------------------------------------------------
+// Paravirtual disk
+//
+// Moves whole sectors between a mounted DMK image and the upper 32K of the
+// Z80 memory in one mailbox request, without going through the data register.
+// The request buffer holds
+//   buf[0] drive (0-3)
+//   buf[1] side
+//   buf[2] track
+//   buf[3] first sector
+//   buf[4] number of sectors (0 = 256)
+//   buf[5] buf[6] Z80 address, low byte first, 8000h-FFFFh
+// and the sectors follow on from the first one to the end of the track and
+// then on to the next side and track.  The response holds
+//   cmd[0] status (ePvOk ...)
+//   cmd[1] number of sectors transferred
+//   buf[0] buf[1] buf[2] side, track and sector after the last one transferred
+// Only one request is handled at a time and none while a controller command is
+// running, so the track buffer can be borrowed without saving it.
+
+//-----------------------------------------------------------------------------
+// lowest sector number on the loaded track, -1 if it has none
+int FdcFirstSector(TrackType* ptd)
+{
+	int i;
+
+	for (i = 0; i < 0x80; ++i)
 	{
-		strcpy(g_dtDives[nDrive].szFileName, (char*)psz);
-		FileClose(g_dtDives[nDrive].f);
-		g_dtDives[nDrive].f = NULL;
-		FdcMountDrive(nDrive);
+		if (ptd->nSectorIndexMarkOffset[i] > 0)
+		{
+			return i;
+		}
 	}
 
-    FdcProcessStatusRequest(false);
+	return -1;
 }
 
 //-----------------------------------------------------------------------------
-void FdcFormatDrive(void)
+void FdcServiceParaDisk(byte byWrite)
 {
-	file* f;
-	char* psz;
-	char  buf[256];
-	int   drive = atoi(g_bFdcRequest.buf);
-	int   size, read;
+	NextSectorType ns;
+	BYTE* pbyMem;
+	int   nDrive  = g_bFdcRequest.buf[0];
+	int   nSide   = g_bFdcRequest.buf[1];
+	int   nTrack  = g_bFdcRequest.buf[2];
+	int   nSector = g_bFdcRequest.buf[3];
+	int   nCount  = g_bFdcRequest.buf[4] ? g_bFdcRequest.buf[4] : 256;
+	word  wAddr   = g_bFdcRequest.buf[5] | (g_bFdcRequest.buf[6] << 8);
+	int   nDone   = 0;
+	int   nStatus = ePvOk;
+	byte  byDirty = false;
 
-	if (!isdigit((char)g_bFdcRequest.buf[0]))
+	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL))
 	{
-		strcpy((char*)(g_bFdcResponse.buf), "Drive number not specified\n");
-		SetResponseLength(&g_bFdcResponse);
-		return;
+		nStatus = ePvNoDrive;
 	}
-
-	if ((drive < 0) || (drive > (sizeof(g_dtDives)/sizeof(g_dtDives[0]))))
+	else if (g_dtDives[nDrive].nDriveFormat != eDMK)
 	{
-		sprintf(buf, "Invalid drive number %d\n", drive);
-		strcpy((char*)(g_bFdcResponse.buf), buf);
-		SetResponseLength(&g_bFdcResponse);
-		return;
+		nStatus = ePvFormat;
 	}
-
-	if (g_dtDives[drive].f == NULL)
+	else if (g_FDC.dwFlags & FF_BUSY)
 	{
-		sprintf(buf, "Drive must be mounted to be formated\n");
-		strcpy((char*)(g_bFdcResponse.buf), buf);
-		SetResponseLength(&g_bFdcResponse);
-		return;
+		nStatus = ePvBusy;
+	}
+	else if (byWrite && g_dtDives[nDrive].dmk.byWriteProtected)
+	{
+		nStatus = ePvProtected;
 	}
 
-	psz = g_bFdcRequest.buf;
-	psz = SkipBlanks(psz);
-	psz = SkipToBlank(psz);
-	psz = SkipBlanks(psz);
+	while ((nStatus == ePvOk) && (nDone < nCount))
+	{
+		if ((nTrack >= g_dtDives[nDrive].byNumTracks) || (nSide >= g_dtDives[nDrive].dmk.byNumSides))
+		{
+			break;	// end of the disk, a short count tells the caller
+		}
 
-	strcpy(buf, "0:\\FMT\\");
-	strcat(buf, psz);
+		FdcReadDmkTrack(nDrive, nSide, nTrack);
 
-	if (FR_OK != f_stat(buf, &g_fno))
-	{
-		strcpy((char*)(g_bFdcResponse.buf), "Unable to formatted disk image: ");
-		strcat((char*)(g_bFdcResponse.buf), buf);
-		strcat((char*)(g_bFdcResponse.buf), "\n");
-		SetResponseLength(&g_bFdcResponse);
-		return;
-	}
+		// past the last sector of the track, carry on at the first one of the next
+		if ((nSector >= 0x80) || (g_ptdTrack->nSectorIndexMarkOffset[nSector] <= 0))
+		{
+			if (nDone == 0)
+			{
+				nStatus = ePvNotFound;
+				break;
+			}
 
-	f = FileOpen(buf, FA_READ);
+			if (byDirty)
+			{
+				FdcWriteTrack(g_ptdTrack);
+				byDirty = false;
+			}
 
-	if (f == NULL)
-	{
-		strcpy((char*)(g_bFdcResponse.buf), "Unable to open file: ");
-		strcat((char*)(g_bFdcResponse.buf), buf);
-		strcat((char*)(g_bFdcResponse.buf), "\n");
-		SetResponseLength(&g_bFdcResponse);
-		return;
-	}
+			if (++nSide >= g_dtDives[nDrive].dmk.byNumSides)
+			{
+				nSide = 0;
+				++nTrack;
+			}
 
-	FileClose(g_dtDives[drive].f);
-	g_dtDives[drive].f = NULL;
+			nSector = -1;
 
-	g_dtDives[drive].f = FileOpen(g_dtDives[drive].szFileName, FA_WRITE | FA_CREATE_ALWAYS);
+			if (nTrack < g_dtDives[nDrive].byNumTracks)
+			{
+				FdcReadDmkTrack(nDrive, nSide, nTrack);
+				nSector = FdcFirstSector(g_ptdTrack);
+			}
 
-	if (g_dtDives[drive].f == NULL)
-	{
-		strcpy((char*)(g_bFdcResponse.buf), "Unable to create new DMK disk image.\n");
-		SetResponseLength(&g_bFdcResponse);
-		return;
-	}
+			if (nSector < 0)
+			{
+				break;
+			}
 
-	size = g_fno.fsize;
+			continue;
+		}
 
-	while (size > 0)
-	{
-		read = sizeof(g_byTrackBuffer);
+		switch (FdcCheckDmkSector(g_ptdTrack, nSector, true, &ns))
+		{
+			case FDC_READ_SECTOR_SUCCESS:
+				break;
 
-		if (read > size)
+			case FDC_SECTOR_NOT_FOUND:
+				nStatus = ePvNotFound;
+				break;
+
+			default:
+				nStatus = ePvCrcError;
+				break;
+		}
+
+		if (nStatus != ePvOk)
 		{
-			read = size;
+			break;
 		}
 
-		FileRead(f, g_byTrackBuffer, read);
-		FileWrite(g_dtDives[drive].f, g_byTrackBuffer, read);
-		size -= read;
+		pbyMem = BusGetHighMemory(wAddr, ns.nSize);
+
+		if (pbyMem == NULL)
+		{
+			nStatus = ePvAddress;
+			break;
+		}
+
+		if (!byWrite)
+		{
+			if (ns.nDataSize == 1)
+			{
+				memcpy(pbyMem, ns.pbyData, ns.nSize);
+			}
+			else
+			{
+				for (int i = 0; i < ns.nSize; ++i)
+				{
+					pbyMem[i] = ns.pbyData[i*ns.nDataSize];
+				}
+			}
+		}
+		else if (ns.nDataSize != 1)	// the data CRC is only generated for single byte data
+		{
+			nStatus = ePvFormat;
+			break;
+		}
+		else
+		{
+			memcpy(ns.pbyData, pbyMem, ns.nSize);
+			FdcGenerateSectorCRC(nSector, ns.nSize);
+			byDirty = true;
+		}
+
+		wAddr += ns.nSize;
+		++nSector;
+		++nDone;
 	}
 
-	FileClose(f);
-	FileClose(g_dtDives[drive].f);
-	g_dtDives[drive].f = NULL;
+	if (byDirty)
+	{
+		FdcWriteTrack(g_ptdTrack);
+	}
 
-	FdcMountDrive(drive);
+	g_dwParaSectors += nDone;
 
-	sprintf((char*)(g_bFdcResponse.buf), "Formatting drive %d (%s), complete.\n", drive, g_dtDives[drive].szFileName);
-	SetResponseLength(&g_bFdcResponse);
+	memset(&g_bFdcResponse, 0, sizeof(g_bFdcResponse));
+	g_bFdcResponse.cmd[0] = nStatus;
+	g_bFdcResponse.cmd[1] = nDone;
+	g_bFdcResponse.buf[0] = nSide;
+	g_bFdcResponse.buf[1] = nTrack;
+	g_bFdcResponse.buf[2] = nSector;
 }
 
 //-----------------------------------------------------------------------------
@@ -3259,6 +5471,10 @@ void FdcProcessRequest(void)
 			FdcProcessReadFile();
 			break;
 
+		case 7: // write file
+			FdcProcessWriteFile();
+			break;
+
 		case 8: // close file
 			FdcProcessCloseFile();
 			break;
@@ -3267,6 +5483,76 @@ void FdcProcessRequest(void)
 			FdcFormatDrive();
 			break;
 
+		case 12: // switch to a new ini file without a reset
+			FdcServiceApplyIni();
+			break;
+
+		case 13: // mount the next image of a disk set
+			FdcServiceRotateDiskSet();
+			break;
+
+		case 14: // bus cycle latency statistics
+			FdcServiceBusStats();
+			break;
+
+		case 15: // read sectors into the upper 32K
+			FdcServiceParaDisk(false);
+			break;
+
+		case 16: // write sectors from the upper 32K
+			FdcServiceParaDisk(true);
+			break;
+
+		case 17: // read the open file into a transfer window
+			FdcServiceReadBlock();
+			break;
+
+		case 18: // interrupt on request completion, buf[0] = 1 on, 0 off
+			g_byMbIntrEnable = (g_bFdcRequest.buf[0] != 0);
+			g_byMbIntrActive = false;
+			g_bFdcResponse.cmd[0] = 1;
+			break;
+
+		case 19: // copy an SD-Card file onto the DOS disk in a drive
+			FdcServiceDosImport();
+			break;
+
+		case 20: // list the files of the DOS disk in a drive
+			FdcServiceDosFind(true);
+			break;
+
+		case 21: // next file of the list
+			FdcServiceDosFind(false);
+			break;
+
+		case 22: // copy files of the DOS disk in a drive to the SD-Card
+			FdcServiceDosExport();
+			break;
+
+		case 23: // copy the image in one drive over the image in another
+			FdcServiceDiskCopyRequest(true);
+			break;
+
+		case 24: // progress of the disk copy
+			FdcServiceDiskCopyRequest(false);
+			break;
+
+		case 25: // load a /CMD program, first record
+			FdcServiceLoadProgram(true);
+			break;
+
+		case 26: // next record of the program
+			FdcServiceLoadProgram(false);
+			break;
+
+		case 27: // save the upper 32K to a file
+			FdcServiceSnapSave();
+			break;
+
+		case 28: // restore the upper 32K from a file
+			FdcServiceSnapLoad();
+			break;
+
         case 0x80:
 			FdcProcessFindFirst(".INI", "0:");
             break;
@@ -3359,12 +5645,21 @@ void FdcRestore()
 void FdcServiceStateMachine(void)
 {
 	FdcUpdateCounters();
+	FdcUpdateStatus();
 	TestSdCardInsertion();
 
     if (g_bFdcRequest.cmd[0] != 0)
     {
         FdcProcessRequest();
         g_bFdcRequest.cmd[0] = 0;
+
+		if (g_byMbIntrEnable)
+		{
+			__dmb();	// request seen as done before the interrupt
+			g_byMbIntrActive = true;
+			g_byEnableIntr   = true;
+		}
+
         return;
     }
 
@@ -3379,6 +5674,12 @@ void FdcServiceStateMachine(void)
 	switch (g_FDC.nProcessFunction)
 	{
 		case psIdle:
+			FdcServiceBootProfile();
+			FdcServiceDiskSets();
+			FdcServiceDiskCopy();
+			FlashCacheService(g_byTrackBuffer);
+			FdcServicePrefetch();
+			FdcServiceFilePrefetch();
 			break;
 
 		case psReadSector:
@@ -3410,12 +5711,7 @@ void FdcServiceStateMachine(void)
 //-----------------------------------------------------------------------------
 void __not_in_flash_func(fdc_write_cmd)(byte byData)
 {
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = write_cmd;
-	fdc_log[log_head].val = byData;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	LogEvent(LOG_CLASS_FDC, write_cmd, byData, 0);
 
 #ifdef ENABLE_DOUBLER
 	if (g_FDC.byEnableDoubler)
@@ -3451,24 +5747,21 @@ void __not_in_flash_func(fdc_write_cmd)(byte byData)
 		g_byFdcIntrActive = false;
 	}
 
-	g_FDC.status.byBusy = 1;
-	g_FDC.byStatus      = F_BUSY;
-	g_FDC.byCommandReceived = 1;
-
-	if ((byData & 0xF0) == 0) // Restore command
+	if (((byData & 0xF0) == 0) && (byData & 0x08)) // Restore command, load head now
 	{
-		if (byData & 0x08) // load head now
-		{
-			g_FDC.byStatus |= F_HEADLOAD;
-			g_FDC.status.byHeadLoaded = 1;
-		}
+		FdcUpdateFlags(~FF_CONTEXT, FF_BUSY | FF_HEADLOADED);
+	}
+	else
+	{
+		FdcUpdateFlags(~FF_CONTEXT, FF_BUSY);
 	}
-	else if (byData == 0xF4)
+
+	if (byData == 0xF4)
 	{
 		g_nRotationCount = g_dwIndexTime + 1;
-		g_FDC.status.byIndex = 0;
-		g_FDC.byStatus  &= ~F_INDEX;
 	}
+
+	g_FDC.byCommandReceived = 1;
 }
 
 //-----------------------------------------------------------------------------
@@ -3476,12 +5769,7 @@ void __not_in_flash_func(fdc_write_track)(byte byData)
 {
 	g_FDC.byTrack = byData;
 
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = write_track;
-	fdc_log[log_head].val = byData;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	LogEvent(LOG_CLASS_FDC, write_track, byData, 0);
 }
 
 //-----------------------------------------------------------------------------
@@ -3524,29 +5812,30 @@ void __not_in_flash_func(fdc_write_sector)(byte byData)
 	}
 #endif
 
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = write_sector;
-	fdc_log[log_head].val = byData;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	LogEvent(LOG_CLASS_FDC, write_sector, byData, 0);
 }
 
 //-----------------------------------------------------------------------------
 void __not_in_flash_func(fdc_write_data)(byte byData)
 {
+	TrackType* ptd = g_ptdTrack;	// once, core0 may swap buffers meanwhile
+
 	g_FDC.byData = byData;
 
-	if (g_tdTrack.nWriteCount > 0)
+	if (ptd->nWriteCount > 0)
 	{
-		*g_tdTrack.pbyWritePtr = byData;
-		++g_tdTrack.pbyWritePtr;
-		--g_tdTrack.nWriteCount;
+		*ptd->pbyWritePtr = byData;
+		++ptd->pbyWritePtr;
+		--ptd->nWriteCount;
 
-		if (g_tdTrack.nWriteCount > 0)
+		if (!FdcDrqTransfer() && (ptd->nWriteCount > 0))
 		{
-			g_FDC.status.byDataRequest = 1;
-			g_FDC.byStatus |= F_DRQ;
+			// DRQ=1, the next byte is not under the head yet
+			FdcFlagsClr(FF_DRQ);
+		}
+		else if (ptd->nWriteCount > 0)
+		{
+			FdcFlagsSet(FF_DRQ);
 		}
 		else
 		{
@@ -3556,25 +5845,15 @@ void __not_in_flash_func(fdc_write_data)(byte byData)
 			g_byEnableIntr    = true;
 
 			// FdcClrFlag(eBusy);
-			g_FDC.status.byBusy = 0;
-			g_FDC.byStatus &= ~F_BUSY;
-
-			g_FDC.status.byDataRequest = 0;
-			g_FDC.byStatus &= ~F_DRQ;
+			FdcFlagsClr(FF_BUSY | FF_DRQ);
 		}
 	}
 	else
 	{
-		g_FDC.status.byDataRequest = 0;
-		g_FDC.byStatus &= ~F_DRQ;
+		FdcFlagsClr(FF_DRQ);
 	}
 
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = write_data;
-	fdc_log[log_head].val = byData;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	LogEvent(LOG_CLASS_DATA, write_data, byData, 0);
 }
 
 //-----------------------------------------------------------------------------
@@ -3600,15 +5879,31 @@ void __not_in_flash_func(fdc_write)(word addr, byte data)
     }
 }
 
+//-----------------------------------------------------------------------------
+// a command has been written that core0 has not processed yet
+byte __not_in_flash_func(FdcCommandPending)(void)
+{
+	return g_FDC.byCommandReceived;
+}
+
 //-----------------------------------------------------------------------------
 byte __not_in_flash_func(fdc_read_status)(void)
 {
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = read_status;
-	fdc_log[log_head].val = g_FDC.byStatus;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	uint32_t   dwByteTime = g_dwDrqByteTime;
+	byte       byStatus;
+	TrackType* ptd = g_ptdTrack;
+
+	// DRQ=1, raise DRQ once the next byte of the transfer is under the head
+	if ((dwByteTime != 0) && !(g_FDC.dwFlags & FF_DRQ) &&
+		((ptd->nReadCount > 0) || (ptd->nWriteCount > 0)) &&
+		(FdcDrqBytesDue(dwByteTime) > g_nDrqCount))
+	{
+		FdcFlagsSet(FF_DRQ);
+	}
+
+	byStatus = FdcGetStatus();
+
+	LogEvent(LOG_CLASS_FDC, read_status, byStatus, 0);
 
 	if (g_byIntrRequest)
 	{
@@ -3616,18 +5911,13 @@ byte __not_in_flash_func(fdc_read_status)(void)
 		g_byFdcIntrActive = false;
 	}
 
-	return g_FDC.byStatus;
+	return byStatus;
 }
 
 //-----------------------------------------------------------------------------
 byte __not_in_flash_func(fdc_read_track)(void)
 {
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = read_track;
-	fdc_log[log_head].val = g_FDC.byTrack;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	LogEvent(LOG_CLASS_FDC, read_track, g_FDC.byTrack, 0);
 
 	return g_FDC.byTrack;
 }
@@ -3635,37 +5925,82 @@ byte __not_in_flash_func(fdc_read_track)(void)
 //-----------------------------------------------------------------------------
 byte __not_in_flash_func(fdc_read_sector)(void)
 {
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = read_sector;
-	fdc_log[log_head].val = g_FDC.byData;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	LogEvent(LOG_CLASS_FDC, read_sector, g_FDC.byData, 0);
 
 	return g_FDC.bySector;
 }
 
+//-----------------------------------------------------------------------------
+// read multiple, switches the transfer over to the sector resolved by
+// FdcPrepareNextSector().  nReadCount is set one higher as the caller still
+// counts the last byte of the current sector.
+void __not_in_flash_func(FdcStartNextSector)(TrackType* ptd)
+{
+	++g_FDC.bySector;
+	g_FDC.nDataSize    = g_FDC.nsNext.nDataSize;
+	g_FDC.byRecordMark = g_FDC.nsNext.byRecordMark;
+
+	ptd->pbyReadPtr = g_FDC.nsNext.pbyData;
+	ptd->nReadSize  = g_FDC.nsNext.nSize;
+	ptd->nReadCount = g_FDC.nsNext.nSize + 1;
+
+	if (g_dwDrqByteTime != 0)
+	{
+		g_dwDrqStart = time_us_32();
+		g_nDrqCount  = 0;
+	}
+
+	__dmb();
+	g_FDC.byNextState = eNextNone;
+	++g_dwMultiReadStreamed;
+}
+
 //-----------------------------------------------------------------------------
 byte __not_in_flash_func(fdc_read_data)(void)
 {
-	g_FDC.byReadData = 0;
+	TrackType* ptd = g_ptdTrack;	// once, core0 may swap buffers meanwhile
+	byte       byNext;
 
-	if (g_tdTrack.nReadCount > 0)
+	if (ptd->nReadCount > 0)
 	{
-		g_FDC.byData = *g_tdTrack.pbyReadPtr;
+		g_FDC.byData = *ptd->pbyReadPtr;
 		
-		g_tdTrack.pbyReadPtr += g_FDC.nDataSize;
-		--g_tdTrack.nReadCount;
+		ptd->pbyReadPtr += g_FDC.nDataSize;
+		byNext = FdcDrqTransfer();
+
+		if ((ptd->nReadCount == 1) && g_FDC.byMultipleRecords)
+		{
+			++g_dwMultiReadSectors;
+
+			if (g_FDC.byNextState == eNextReady)
+			{
+				// continue with the sector core0 has resolved ahead, the
+				// count never reaches 0 so core0 does not end the command
+				FdcStartNextSector(ptd);
+				byNext = TRUE;
+			}
+			else if (g_FDC.byNextState == eNextEnd)
+			{
+				// past the last sector of the track, as a WD179x
+				FdcFlagsSet(FF_NOTFOUND);
+				g_FDC.byMultipleRecords = 0;
+			}
+		}
+
+		if (ptd->nReadCount > 0)
+		{
+			--ptd->nReadCount;
+		}
 
-		if (g_tdTrack.nReadCount == 0)
+		if (ptd->nReadCount == 0)
 		{
-			g_FDC.status.byDataRequest = 0;
-			g_FDC.byStatus &= ~F_DRQ;
+			FdcFlagsClr(FF_DRQ);
 
 			if (g_FDC.byMultipleRecords)
 			{
 				++g_FDC.bySector;
 				g_FDC.byCommandReg = 0x98;
+				g_FDC.byMultipleRestart = 1;
 
 				if (g_byIntrRequest)
 				{
@@ -3676,24 +6011,22 @@ byte __not_in_flash_func(fdc_read_data)(void)
 				g_FDC.byCommandReceived = 1;
 			}
 		}
+		else if (byNext)
+		{
+			FdcFlagsSet(FF_DRQ);
+		}
 		else
 		{
-			g_FDC.status.byDataRequest = 1;
-			g_FDC.byStatus |= F_DRQ;
+			// DRQ=1, the next byte is not under the head yet
+			FdcFlagsClr(FF_DRQ);
 		}
 	}
 	else
 	{
-		g_FDC.status.byDataRequest = 0;
-		g_FDC.byStatus &= ~F_DRQ;
+		FdcFlagsClr(FF_DRQ);
 	}
 
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = read_data;
-	fdc_log[log_head].val = g_FDC.byData;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	LogEvent(LOG_CLASS_DATA, read_data, g_FDC.byData, 0);
 
 	return g_FDC.byData;
 }
@@ -3727,13 +6060,7 @@ byte __not_in_flash_func(fdc_read)(uint16_t addr)
 // B4 - B7 Unused on Model 1
 void __not_in_flash_func(fdc_write_drive_select)(byte byData)
 {
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = write_drive_select;
-	fdc_log[log_head].val = byData;
-	fdc_log[log_head].op1 = g_FDC.byDriveSel;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	LogEvent(LOG_CLASS_DRVSEL, write_drive_select, byData, g_FDC.byDriveSel);
 
 	g_FDC.byDriveSel = byData;
 	g_nMotorOnTimer  = 2000000;
@@ -175,26 +175,51 @@ enum {
 	ePcDoubler,
 };
 
-typedef struct {
-	BYTE byBusy;
-	BYTE byIndex;
-	BYTE byDataLost;
-	BYTE byCrcError;
-	BYTE bySeekError;
-	BYTE byHeadLoaded;
-	BYTE byNotFound;
-	BYTE byProtected;
-	BYTE byNotReady;
-	BYTE byRecordType;		// 0xFB => regular data; or 0xF8 => deleted data;
-	
-	BYTE byDataRequest;		// controls the DRQ output pin. Which simulates an open drain output that indicates that the DR (Data Register)
-							// contains assembled data in read operations, or the DR is empty in write operation.  This signal is reset when
-							// serviced by the computer through reading or writing the DR in Read and Write operations, respectively.
-							// basically indicates that a byte can be read from the DR or written to the DR.
-							//
-							// when 1 => data can be read/written;
-							//      0 => data is not available to be read/written;
-} FDC_StatusType;
+// controller flags, packed into one word (FdcType.dwFlags) so they can be
+// changed by either core with a single atomic operation.  Bits 0-7 and 8-15
+// each index one of the two status tables of the mode in bits 16-18.
+#define FF_BUSY         0x00000001
+#define FF_INDEX        0x00000002
+#define FF_DATALOST     0x00000004
+#define FF_CRCERR       0x00000008
+#define FF_SEEKERR      0x00000010
+#define FF_NOTFOUND     0x00000020
+#define FF_PROTECTED    0x00000040
+#define FF_NOTREADY     0x00000080
+
+#define FF_DRQ          0x00000100	// DR is full on read or empty on write
+#define FF_HEADLOADED   0x00000200
+#define FF_TRACK0       0x00000400
+#define FF_WRPROT       0x00000800	// media can not be written (HFE)
+#define FF_RECORD       0x00003000	// data address mark of the last sector read
+#define FF_RECORD_FA    0x00001000
+#define FF_RECORD_F9    0x00002000
+#define FF_RECORD_F8    0x00003000	// deleted data, 0 => 0xFB
+
+#define FF_MODE         0x00070000
+#define FF_MODE_SHIFT   16
+#define FF_MODES        8
+
+// flags kept by FdcUpdateStatus(), all others are cleared when a command starts
+#define FF_CONTEXT      (FF_MODE | FF_TRACK0 | FF_WRPROT)
+
+// status modes, selects how the flags map onto the status byte
+enum {
+	eStatusNone = 0,
+	eStatusNotReady,
+	eStatusTypeI,		// Restore, Seek, Step, Force Interrupt
+	eStatusRead,		// Read Sector
+	eStatusReadOther,	// Read Address, Read Track
+	eStatusWrite,		// Write Sector, Write Track
+};
+
+#ifdef MFC
+	#define FdcFlagsSet(f) (g_FDC.dwFlags |= (f))
+	#define FdcFlagsClr(f) (g_FDC.dwFlags &= ~(f))
+#else
+	#define FdcFlagsSet(f) __atomic_fetch_or(&g_FDC.dwFlags, (f), __ATOMIC_SEQ_CST)
+	#define FdcFlagsClr(f) __atomic_fetch_and(&g_FDC.dwFlags, ~(uint32_t)(f), __ATOMIC_SEQ_CST)
+#endif
 
 typedef struct {
 	picfileformatheader header;
@@ -230,6 +255,8 @@ typedef struct {
 	int  nType;
 	byte byDensity;
 
+	uint32_t dwFileId;		// file.dwId of the image the track was read from
+
 	int nDrive;
 	int nSide;
 	int nTrack;
@@ -253,12 +280,90 @@ typedef struct {
 
 #define MAX_SECTOR_SIZE 256
 
+#define MAX_SET_IMAGES  16
+#define SET_WARM_TRACKS 2	// tracks (per side) of the next image to cache ahead of a rotate
+#define SET_SPARE_FILES 2	// file buffers left for mounts and transfers while warming
+
+enum {
+	eWarmIdle = 0,
+	eWarmOpen,
+	eWarmTracks,
+};
+
+typedef struct {
+	char szSetName[64];
+	int  nImageCount;
+	int  nCurImage;
+	char szImage[MAX_SET_IMAGES][64];
+
+	FdcDriveType dtNext;	// the next image of the set, opened in idle time
+	int  nNextImage;
+	int  nWarmState;
+	int  nWarmTrack;
+} DiskSetType;
+
 typedef struct {
 	int   nSector;
 	int   nSectorSize;
 	BYTE  bySectorDataAddressMark;
 } SectorType;
 
+// read multiple, state of the sector after the one being sent
+enum {
+	eNextNone = 0,		// not resolved (yet), the command is restarted for it
+	eNextReady,			// core1 continues with it without a command restart
+	eNextEnd,			// no such sector on the track, record not found
+};
+
+// read or write multiple being timed for the sectors per second figures
+enum {
+	eMultiNone = 0,
+	eMultiRead,
+	eMultiWrite,
+};
+
+// paravirtual disk request status (response cmd[0])
+enum {
+	ePvOk = 0,
+	ePvNoDrive,			// drive not mounted
+	ePvAddress,			// Z80 address not in the upper 32K (or MEM=0)
+	ePvNotFound,		// first sector not on the track
+	ePvCrcError,
+	ePvProtected,
+	ePvBusy,			// a controller command is running
+	ePvFormat,			// HFE image, or a write to single density data recorded twice
+};
+
+// read block request status (response cmd[0])
+enum {
+	eXferOk = 0,
+	eXferNoFile,		// no file open for reading
+	eXferWindow,		// window not at 3000h-33FFh or in the upper 32K
+};
+
+// program load request status (response cmd[0])
+enum {
+	eLoadData = 0,		// buf[0..1] address, buf[2..3] length, buf[4..] data below 8000h
+	eLoadDone,			// buf[0..1] transfer address, buf[2..3] bytes placed in the upper 32K
+	eLoadNoFile,		// file not found
+	eLoadFormat,		// not a load module, or a read error
+};
+
+// whole disk copy between drives
+enum {
+	eCopyIdle = 0,
+	eCopyRunning,
+	eCopyDone,
+	eCopyFailed,
+};
+
+typedef struct {
+	BYTE* pbyData;		// first data byte
+	int   nSize;		// bytes of data
+	int   nDataSize;	// 2 => each byte is recorded twice
+	BYTE  byRecordMark;	// data address mark
+} NextSectorType;
+
 typedef struct {
 	// RD when DISK_IN is low
 	// WR when DISK_OUT is low
@@ -269,13 +374,17 @@ typedef struct {
 	BYTE  bySector;					// RD/WR address 2
 	BYTE  byData;					// RD/WR address 3
 
-	FDC_StatusType status;
-	BYTE  byStatus;
+	volatile uint32_t dwFlags;		// FF_xxx, status is FdcGetStatus()
 
 	BYTE  byCommandReceived;		// contains the value of the last received command
 	BYTE  byCurCommand;
 	BYTE  byCommandType;			// 1, 2, 3 or 4
 	BYTE  byMultipleRecords;
+	BYTE  byMultipleRestart;		// core1 restarted a read multiple for its next sector
+
+	volatile BYTE  byNextState;		// eNextXxx, resolved by core0 and taken by core1
+	int            nNextSector;		// sector resolved last, -1 => none
+	NextSectorType nsNext;
 
 	short nStepDir;					// 1 = increase track reg on each step; -1 = decrease track reg on each step;
 	
@@ -320,7 +429,6 @@ typedef struct {
 	BYTE  byDoublerDensity;
 
 	BYTE  byCrcError;
-	BYTE  byReadData;
 
 	BYTE  byEnableDoubler;
 } FdcType;
@@ -333,6 +441,13 @@ typedef struct {
 #define FDC_RESPONSE_ADDR_START (FDC_REQUEST_ADDR_START+FDC_REQUEST_SIZE)
 #define FDC_RESPONSE_ADDR_STOP  (FDC_RESPONSE_ADDR_START+FDC_RESPONSE_SIZE-1)
 
+// bulk transfer window below the request buffer, free on the Model I
+#define FDC_WINDOW_SIZE 0x400
+#define FDC_WINDOW_ADDR_START 0x3000
+#define FDC_WINDOW_ADDR_STOP  (FDC_WINDOW_ADDR_START+FDC_WINDOW_SIZE-1)
+
+#define FDC_XFER_MAX 0x1000		// largest block of a read block request (upper 32K window)
+
 #pragma pack(push)  /* push current alignment to stack */
 #pragma pack(1)     /* set alignment to 1-byte boundary */
 
@@ -345,10 +460,57 @@ typedef struct {
 
 #pragma pack(pop)   /* restore original alignment from stack */
 
+// DRQ timing (DRQ= in system.cfg)
+enum {
+	eDrqFast = 0,		// a byte is ready as soon as the host has taken the last one
+	eDrqAuthentic,		// bytes arrive at the WD1771/WD1791 data rate, late ones are lost
+};
+
+#define DRQ_BYTE_TIME_SD 64		// us per byte, FM 125 kbit/s
+#define DRQ_BYTE_TIME_DD 32		// us per byte, MFM 250 kbit/s
+#define DRQ_FAST_TIMEOUT 100000	// us, DRQ=0 read ends with lost data when the host stops taking bytes
+
+#define BOOT_PROFILE_SIZE 64		// track loads recorded after a reset
+#define BOOT_PROFILE_IDLE 3000000	// us without a track load that ends the boot
+
+enum {
+	eProfileOff = 0,
+	eProfileRecord,
+	eProfileReplay,
+	eProfileDone,
+};
+
+typedef struct {
+	byte byDrive;
+	byte bySide;
+	byte byTrack;
+} BootAccessType;
+
+typedef struct {
+	int      nMode;
+	int      nRecordedMode;		// mode the last boot was run in
+	int      nCount;			// entries recorded or loaded from the profile
+	int      nPos;				// replay, next entry expected from the Z80
+	int      nPrefetch;			// replay, next entry to be prefetched
+	int      nLoads;			// track loads during the boot
+	int      nHits;				// track loads served by the cache
+	uint64_t nStartTime;
+	uint64_t nLastLoad;
+	uint32_t dwBootTime;		// us from reset release to the last track load of the boot
+	uint32_t dwRecordedTime;	// boot time when the profile was recorded (no prefetch)
+	BootAccessType baLoad[BOOT_PROFILE_SIZE];
+} BootProfileType;
+
 /* ==============================================================*/
 
 extern volatile byte  g_byDriveStatus;
 extern volatile BYTE  g_byIntrRequest;
+extern volatile uint8_t g_byBootConfigModified;
+extern byte             g_byEnableBootProfile;
+extern byte             g_byDrqTiming;
+extern byte             g_byEnableStream;
+extern BootProfileType  g_bpProfile;
+extern TrackType* volatile g_ptdTrack;
 
 /* function prototypes ==========================================*/
 
@@ -359,16 +521,51 @@ int  FdcGetSide(byte byDriveSel);
 
 void LoadHfeTrack(file* pFile, int nTrack, int nSide, HfeDriveType* pdisk, TrackType* ptrack, BYTE* pbyTrackData, int nMaxLen);
 void FdcReadTrack(int nDrive, int nSide, int nTrack);
-
+TrackType* FdcBackTrack(void);
+void FdcSwapTrack(void);
+void FdcInvalidateTracks(int nDrive);
+void FdcServicePrefetch(void);
+void FdcStartWriteSector(int nDrive);
+int  FdcCheckDmkSector(TrackType* ptd, int nSector, byte byIbm, NextSectorType* pns);
+void FdcServiceParaDisk(byte byWrite);
+int  FdcReadImageSector(int nDrive, int nSide, int nTrack, int nSector, BYTE* pby, int nMaxSize);
+int  FdcWriteImageSector(int nDrive, int nSide, int nTrack, int nSector, BYTE* pby, int nSize);
+void FdcFlushImageSectors(void);
+byte FdcIsBusy(void);
+int  FdcStartDiskCopy(int nSrc, int nDst);
+int  FdcFormatDiskCopy(char* psz, int nMaxLen, char* pszLineEnd);
+void FdcServiceDiskCopy(void);
+void FdcCopyTrackWritten(TrackType* ptdTrack, int nSides);
+void FdcServiceLoadProgram(byte byFirst);
+void FdcServiceReadBlock(void);
+int  FdcReadOpenFile(BYTE* pby, int nSize);
+BYTE* FdcGetWindow(word wAddr, int nSize);
+void FdcServiceFilePrefetch(void);
+void FdcFlushOpenFile(void);
+void FdcProcessWriteFile(void);
+void FdcProcessCloseFile(void);
+void FdcPrepareNextSector(void);
+
+void FdcInitStatusTables(void);
+void FdcUpdateStatus(void);
+void FdcUpdateFlags(uint32_t dwMask, uint32_t dwValue);
+byte FdcGetStatus(void);
 void FdcSetFlag(byte flag);
 void FdcClrFlag(byte flag);
 void FdcGenerateIntr(void);
 void FdcStartCapture(void);
 void FdcInit(void);
 void FdcReset(void);
+void FdcResetController(void);
+void FdcWarmReset(void);
 void FdcProcessCommand(void);
 void FdcServiceStateMachine(void);
-void FdcProcessConfigEntry(char szLabel[], char* psz);
+int  FdcApplyIni(char* pszIniFile);
+int  FdcRotateDiskSet(int nDrive);
+void FdcMountDrive(int nDrive);
+char* FdcGetMountName(int nDrive);
+void FdcBootStart(void);
+void FdcGetProfileName(char* pszName, int nMaxLen);
 void FdcCloseAllFiles(void);
 
 void fdc_write_cmd(byte byData);
@@ -377,6 +574,7 @@ void fdc_write_sector(byte byData);
 void fdc_write_data(byte byData);
 
 byte fdc_read_status(void);
+byte FdcCommandPending(void);
 byte fdc_read_track(void);
 byte fdc_read_sector(void);
 byte fdc_read_data(void);
@@ -10,6 +10,8 @@ static FRESULT fr;  /* Return value */
 static DIR     dj;  /* Directory object */
 static FILINFO fno; /* File information */
 
+static uint32_t g_dwNextFileId = 1;
+
 //-----------------------------------------------------------------------------
 file* FileOpen(char* pszFileName, BYTE byMode)
 {
@@ -67,6 +69,7 @@ file* FileOpen(char* pszFileName, BYTE byMode)
 	if (fr == FR_OK)
 	{
 		g_fFiles[i].byIsOpen = TRUE;
+		g_fFiles[i].dwId     = g_dwNextFileId++;
 		return &g_fFiles[i];
 	}
 	
@@ -182,6 +185,23 @@ void FileCloseAll(void)
 	}
 }
 
+//-----------------------------------------------------------------------------
+// number of file buffers not in use
+int FileFreeCount(void)
+{
+	int i, n = 0;
+
+	for (i = 0; i < MAX_FILES; ++i)
+	{
+		if (!g_fFiles[i].byIsOpen)
+		{
+			++n;
+		}
+	}
+
+	return n;
+}
+
 //-----------------------------------------------------------------------------
 void FileSystemInit(void)
 {
@@ -323,3 +343,62 @@ BYTE FileExists(char* pszFileName)
 	return FALSE;
 #endif
 }
+
+//-----------------------------------------------------------------------------
+BYTE FileDelete(char* pszFileName)
+{
+#ifdef MFC
+	CString str;
+
+	str = pszFileName;
+
+	TRY
+	{
+		CFile::Remove(str);
+	}
+	CATCH(CFileException, e)
+	{
+		return FALSE;
+	}
+	END_CATCH
+
+	return TRUE;
+#else
+	return (f_unlink(pszFileName) == FR_OK);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// returns the size and the modification time of the file, used to detect
+// that an image has been changed since data was cached from it
+BYTE FileStat(char* pszFileName, uint32_t* pdwSize, uint32_t* pdwTime)
+{
+#ifdef MFC
+	CFileStatus status;
+	CString str;
+
+	str = pszFileName;
+
+	if (!CFile::GetStatus(str, status))
+	{
+		return FALSE;
+	}
+
+	*pdwSize = (uint32_t)status.m_size;
+	*pdwTime = (uint32_t)status.m_mtime.GetTime();
+
+	return TRUE;
+#else
+	FILINFO fi;
+
+	if (f_stat(pszFileName, &fi) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	*pdwSize = (uint32_t)fi.fsize;
+	*pdwTime = ((uint32_t)fi.fdate << 16) | fi.ftime;
+
+	return TRUE;
+#endif
+}
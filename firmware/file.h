@@ -21,8 +21,9 @@ extern "C" {
 #endif
 
 typedef struct {
-	byte byIsOpen;
-	FIL  f;
+	byte     byIsOpen;
+	uint32_t dwId;		// unique for each open, used to tag cached data
+	FIL      f;
 } file;
 
 /* File function return code (FRESULT) */
@@ -64,8 +65,11 @@ void     FileTruncate(file* fp);
 void     FileFlush(file* fp);
 void     FileCloseAll(void);
 void     FileSystemInit(void);
+int      FileFreeCount(void);
 int      FileReadLine(file* fp, char szLine[], int nMaxLen);
 BYTE     FileExists(char* pszFileName);
+BYTE     FileDelete(char* pszFileName);
+BYTE     FileStat(char* pszFileName, uint32_t* pdwSize, uint32_t* pdwTime);
 
 #ifdef __cplusplus
 }
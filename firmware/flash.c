@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "flash.h"
+
+#ifndef FLASH_FILE_BACKEND
+	#include "pico/stdlib.h"
+	#include "hardware/flash.h"
+	#include "hardware/sync.h"
+#endif
+
+//-----------------------------------------------------------------------------
+// Access to the flash region used by the flash track cache.
+//
+// Erase works on whole sectors (FLASH_SECTOR_SIZE) and program on whole pages
+// (FLASH_PAGE_SIZE).  As with any NOR flash programming can only clear bits,
+// so a page may be programmed again as long as no bit has to go from 0 to 1.
+//
+// On the Pico the region is read through the XIP window.  While a sector is
+// erased or a page programmed XIP is not available, interrupts on core0 are
+// disabled for the duration.  core1 is not stopped, parking it would leave the
+// bus (upper memory, the RTC interrupt) unserviced for the length of a sector
+// erase.  Instead everything core1 runs is in RAM: its code is marked
+// __not_in_flash_func, it calls no library functions, and the tables it reads
+// that the compiler would otherwise place in flash as read only data are
+// marked __not_in_flash.
+//
+// Host builds keep the region in flash.bin using standard C file functions,
+// with MFC or with FLASH_FILE defined (for a Linux build of the cache logic).
+
+#ifdef FLASH_FILE_BACKEND
+
+static FILE* g_fpFlash;
+
+//-----------------------------------------------------------------------------
+void FlashRegionInit(void)
+{
+	byte byBuf[FLASH_SECTOR_SIZE];
+	int  i;
+
+	if (g_fpFlash != NULL)
+	{
+		return;
+	}
+
+	g_fpFlash = fopen("flash.bin", "r+b");
+
+	if (g_fpFlash != NULL)
+	{
+		return;
+	}
+
+	g_fpFlash = fopen("flash.bin", "w+b");
+
+	if (g_fpFlash == NULL)
+	{
+		return;
+	}
+
+	memset(byBuf, 0xFF, sizeof(byBuf));
+
+	for (i = 0; i < FLASH_REGION_SIZE / FLASH_SECTOR_SIZE; ++i)
+	{
+		fwrite(byBuf, 1, sizeof(byBuf), g_fpFlash);
+	}
+
+	fflush(g_fpFlash);
+}
+
+//-----------------------------------------------------------------------------
+void FlashRegionRead(uint32_t dwOffset, byte* pby, uint32_t nSize)
+{
+	memset(pby, 0xFF, nSize);
+
+	if ((g_fpFlash == NULL) || (dwOffset + nSize > FLASH_REGION_SIZE))
+	{
+		return;
+	}
+
+	fseek(g_fpFlash, dwOffset, SEEK_SET);
+	fread(pby, 1, nSize, g_fpFlash);
+}
+
+//-----------------------------------------------------------------------------
+void FlashRegionErase(uint32_t dwOffset, uint32_t nSize)
+{
+	byte byBuf[FLASH_SECTOR_SIZE];
+
+	if ((g_fpFlash == NULL) || (dwOffset % FLASH_SECTOR_SIZE) || (nSize % FLASH_SECTOR_SIZE) || (dwOffset + nSize > FLASH_REGION_SIZE))
+	{
+		return;
+	}
+
+	memset(byBuf, 0xFF, sizeof(byBuf));
+	fseek(g_fpFlash, dwOffset, SEEK_SET);
+
+	while (nSize > 0)
+	{
+		fwrite(byBuf, 1, sizeof(byBuf), g_fpFlash);
+		nSize -= sizeof(byBuf);
+	}
+
+	fflush(g_fpFlash);
+}
+
+//-----------------------------------------------------------------------------
+void FlashRegionProgram(uint32_t dwOffset, byte* pby, uint32_t nSize)
+{
+	byte     byBuf[FLASH_PAGE_SIZE];
+	uint32_t i;
+
+	if ((g_fpFlash == NULL) || (dwOffset % FLASH_PAGE_SIZE) || (nSize % FLASH_PAGE_SIZE) || (dwOffset + nSize > FLASH_REGION_SIZE))
+	{
+		return;
+	}
+
+	while (nSize > 0)
+	{
+		// programming can only clear bits
+		FlashRegionRead(dwOffset, byBuf, sizeof(byBuf));
+
+		for (i = 0; i < sizeof(byBuf); ++i)
+		{
+			byBuf[i] &= pby[i];
+		}
+
+		fseek(g_fpFlash, dwOffset, SEEK_SET);
+		fwrite(byBuf, 1, sizeof(byBuf), g_fpFlash);
+
+		dwOffset += sizeof(byBuf);
+		pby      += sizeof(byBuf);
+		nSize    -= sizeof(byBuf);
+	}
+
+	fflush(g_fpFlash);
+}
+
+#else
+
+#define FLASH_REGION_START (PICO_FLASH_SIZE_BYTES - FLASH_REGION_SIZE)
+
+//-----------------------------------------------------------------------------
+void FlashRegionInit(void)
+{
+}
+
+//-----------------------------------------------------------------------------
+void FlashRegionRead(uint32_t dwOffset, byte* pby, uint32_t nSize)
+{
+	memcpy(pby, (byte*)(XIP_BASE + FLASH_REGION_START + dwOffset), nSize);
+}
+
+//-----------------------------------------------------------------------------
+void FlashRegionErase(uint32_t dwOffset, uint32_t nSize)
+{
+	uint32_t dwInts;
+
+	if ((dwOffset % FLASH_SECTOR_SIZE) || (nSize % FLASH_SECTOR_SIZE) || (dwOffset + nSize > FLASH_REGION_SIZE))
+	{
+		return;
+	}
+
+	dwInts = save_and_disable_interrupts();
+	flash_range_erase(FLASH_REGION_START + dwOffset, nSize);
+	restore_interrupts(dwInts);
+}
+
+//-----------------------------------------------------------------------------
+void FlashRegionProgram(uint32_t dwOffset, byte* pby, uint32_t nSize)
+{
+	uint32_t dwInts;
+
+	if ((dwOffset % FLASH_PAGE_SIZE) || (nSize % FLASH_PAGE_SIZE) || (dwOffset + nSize > FLASH_REGION_SIZE))
+	{
+		return;
+	}
+
+	dwInts = save_and_disable_interrupts();
+	flash_range_program(FLASH_REGION_START + dwOffset, pby, nSize);
+	restore_interrupts(dwInts);
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _H_FLASH_
+#define _H_FLASH_
+
+#include "defines.h"
+
+// host builds (MFC, or FLASH_FILE defined on other platforms) keep the flash
+// region in a file
+#if defined(MFC) || defined(FLASH_FILE)
+	#define FLASH_FILE_BACKEND
+#endif
+
+#ifndef FLASH_FILE_BACKEND
+	#include "hardware/flash.h"
+#else
+	#define FLASH_PAGE_SIZE   256
+	#define FLASH_SECTOR_SIZE 4096
+#endif
+
+// size of the flash region reserved at the end of the flash for the track
+// cache, offsets passed to the functions below are relative to its start
+#define FLASH_REGION_SIZE (1536*1024)
+
+void FlashRegionInit(void);
+void FlashRegionRead(uint32_t dwOffset, byte* pby, uint32_t nSize);
+void FlashRegionErase(uint32_t dwOffset, uint32_t nSize);
+void FlashRegionProgram(uint32_t dwOffset, byte* pby, uint32_t nSize);
+
+#endif
@@ -16,6 +16,7 @@
 #include "system.h"
 #include "crc.h"
 #include "hdc.h"
+#include "logging.h"
 
 // Model I ports
 // 0xC0 - Write Protection.
@@ -79,11 +80,25 @@
 //			Bit 7: Busy
 //
 //		  Write = Command Register.
+//
+// FreHD extension ports, a command channel to the SD-Card beside the WD1010:
+//
+// 0xC2 - Data.  Write: the parameters of a command.  Read: its result, each
+//        access steps to the next byte.
+// 0xC3 - Size.  Write: the number of parameter bytes that follow (0 = 256).
+//        Read: the number of result bytes, 0 = 256 for READ_FILE.
+// 0xC4 - Command (write).  Starts a command, the ones without parameters run
+//        at once, the others when their last parameter byte is written.
+// 0xC5 - Error (read).  The FatFs result of the last command, 0 = success,
+//        FREHD_EOF when READ_FILE or READ_DIR has nothing left to return.
+//
+// Bit 7 (busy) of 0xCF is set until the command completes, and bit 0 (error)
+// when it failed.
 
 HdcType Hdc;
 VhdType Vhd[MAX_VHD_DRIVES];
 
-static int g_nSectorSizes[] = {256, 512, 1024, 128};
+static int __not_in_flash("hdc") g_nSectorSizes[] = {256, 512, 1024, 128};	// read by core1
 
 //-----------------------------------------------------------------------------
 void HdcInitFileName(int nDrive, char* pszFileName)
@@ -95,46 +110,94 @@ void HdcInitFileName(int nDrive, char* pszFileName)
 }
 
 //-----------------------------------------------------------------------------
-void HdcInit(void)
+// returns the WD1010 registers to their power on state, the virtual hard
+// disks are flushed but stay open
+void HdcReset(void)
 {
-	int nSectors, i;
+	int i;
+
+	for (i = 0; i < MAX_VHD_DRIVES; ++i)
+	{
+		if (Vhd[i].f != NULL)
+		{
+			FileFlush(Vhd[i].f);
+		}
+	}
 
 	memset(&Hdc, 0, sizeof(Hdc));
 	Hdc.byStatusRegister |= STATUS_MASK_DRIVE_READY;
 
-	for (i = 0; i < MAX_VHD_DRIVES; ++i)
+	HdcResetFreHd();
+}
+
+//-----------------------------------------------------------------------------
+void HdcMountDrive(int nDrive)
+{
+	int nSectors;
+
+	if ((nDrive < 0) || (nDrive >= MAX_VHD_DRIVES) || (Vhd[nDrive].szFileName[0] == 0))
 	{
-		if (Vhd[i].szFileName[0] != 0)
-		{
-			Vhd[i].f = FileOpen(Vhd[i].szFileName, FA_OPEN_EXISTING | FA_READ | FA_WRITE);
+		return;
+	}
 
-			memset(Vhd[i].byHeader, 0, sizeof(Vhd[i].byHeader));
+	Vhd[nDrive].f = FileOpen(Vhd[nDrive].szFileName, FA_OPEN_EXISTING | FA_READ | FA_WRITE);
 
-			if (Vhd[i].f != NULL)
-			{
-				FileRead(Vhd[i].f, Vhd[i].byHeader, sizeof(Vhd[i].byHeader));
+	memset(Vhd[nDrive].byHeader, 0, sizeof(Vhd[nDrive].byHeader));
 
-				Vhd[i].nHeads     = Vhd[i].byHeader[26];
-				Vhd[i].nCylinders = ((Vhd[i].byHeader[27] & 0x07) << 8) + Vhd[i].byHeader[28];
+	if (Vhd[nDrive].f == NULL)
+	{
+		return;
+	}
 
-				nSectors = Vhd[i].byHeader[29];
+	FileRead(Vhd[nDrive].f, Vhd[nDrive].byHeader, sizeof(Vhd[nDrive].byHeader));
 
-				if (nSectors == 0)
-				{
-					nSectors = 256;
-				}
+	Vhd[nDrive].nHeads     = Vhd[nDrive].byHeader[26];
+	Vhd[nDrive].nCylinders = ((Vhd[nDrive].byHeader[27] & 0x07) << 8) + Vhd[nDrive].byHeader[28];
 
-				if (Vhd[i].nHeads == 0)
-				{
-					Vhd[i].nSectors = VHD_DEFAULT_SECTORS;
-					Vhd[i].nHeads   = nSectors / Vhd[i].nSectors;
-				}
-				else
-				{
-					Vhd[i].nSectors = nSectors / Vhd[i].nHeads;
-				}
-			}
-		}
+	nSectors = Vhd[nDrive].byHeader[29];
+
+	if (nSectors == 0)
+	{
+		nSectors = 256;
+	}
+
+	if (Vhd[nDrive].nHeads == 0)
+	{
+		Vhd[nDrive].nSectors = VHD_DEFAULT_SECTORS;
+		Vhd[nDrive].nHeads   = nSectors / Vhd[nDrive].nSectors;
+	}
+	else
+	{
+		Vhd[nDrive].nSectors = nSectors / Vhd[nDrive].nHeads;
+	}
+}
+
+//-----------------------------------------------------------------------------
+void HdcUnmountDrive(int nDrive)
+{
+	if ((nDrive < 0) || (nDrive >= MAX_VHD_DRIVES))
+	{
+		return;
+	}
+
+	if (Vhd[nDrive].f != NULL)
+	{
+		FileClose(Vhd[nDrive].f);
+	}
+
+	memset(&Vhd[nDrive], 0, sizeof(VhdType));
+}
+
+//-----------------------------------------------------------------------------
+void HdcInit(void)
+{
+	int i;
+
+	HdcReset();
+
+	for (i = 0; i < MAX_VHD_DRIVES; ++i)
+	{
+		HdcMountDrive(i);
 	}
 }
 
@@ -377,6 +440,8 @@ void HdcServiceTestCommand(void)
 //-----------------------------------------------------------------------------
 void HdcServiceStateMachine(void)
 {
+	HdcServiceFreHd();
+
 	if (Hdc.byActiveCommand != 0)
 	{
 		ProcessActiveCommand();
@@ -424,24 +489,437 @@ void HdcServiceStateMachine(void)
 	Hdc.byCommandRegister = 0;
 }
 
+//-----------------------------------------------------------------------------
+// FreHD extension.
+//
+// core1 collects the parameters and hands out the result, core0 carries out
+// the commands.  While a file is open for reading the block after the one
+// last read is loaded ahead, and a read command finds it waiting, so a file
+// streams at port speed.  File writes are collected into FREHD_STAGE_SIZE
+// blocks for the SD-Card.
+
+static volatile byte g_byFreCommand;
+static volatile byte g_byFrePending;		// command for core0 to carry out
+static volatile byte g_byFreError;
+
+static byte          g_byFreParam[FREHD_BLOCK_SIZE+1];
+static volatile int  g_nFreParamSize;
+static volatile int  g_nFreParamCount;
+
+static byte          g_byFreBuffers[2][FREHD_BLOCK_SIZE];
+static byte* volatile g_pbyFreResult = g_byFreBuffers[0];
+static byte* volatile g_pbyFreNext   = g_byFreBuffers[1];
+static volatile int  g_nFreResultSize;
+static volatile int  g_nFreResultPos;
+static volatile int  g_nFreNextSize = -1;	// bytes loaded ahead, -1 none
+
+static file*         g_fFre;
+static byte          g_byFreReadOnly;
+static byte          g_byFreEof;
+static byte          g_byFreStage[FREHD_STAGE_SIZE];
+static int           g_nFreStaged;
+
+// SET_TIME value and the time it was set
+static byte          g_byFreTime[6];		// second, minute, hour, year - 1900, month, day
+static uint64_t      g_nFreTimeSet;
+
+#ifndef MFC
+static DIR           g_djFre;
+static byte          g_byFreDirOpen;
+#endif
+
+//-----------------------------------------------------------------------------
+static bool __not_in_flash_func(FreHdHasParams)(byte byCommand)
+{
+	switch (byCommand)
+	{
+		case eFreSetTime:
+		case eFreOpenFile:
+		case eFreWriteFile:
+		case eFreOpenDir:
+		case eFreSeekFile:
+			return true;
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+static void __not_in_flash_func(FreHdCommand)(byte data)
+{
+	byte* pby;
+
+	g_byFreCommand   = data;
+	g_byFreError     = 0;
+	g_nFreParamSize  = 0;
+	g_nFreParamCount = 0;
+	g_nFreResultSize = 0;
+	g_nFreResultPos  = 0;
+
+	Hdc.byStatusRegister &= ~STATUS_MASK_ERROR;
+
+	// the next block of the file is already here, the end of the file is
+	// left to core0 so it is reported as an error rather than 0 bytes
+	if ((data == eFreReadFile) && (g_nFreNextSize > 0))
+	{
+		pby              = g_pbyFreResult;
+		g_pbyFreResult   = g_pbyFreNext;
+		g_pbyFreNext     = pby;
+		g_nFreResultSize = g_nFreNextSize;
+		g_nFreNextSize   = -1;
+		return;
+	}
+
+	Hdc.byStatusRegister |= STATUS_MASK_BUSY;
+
+	if (!FreHdHasParams(data))
+	{
+		g_byFrePending = true;
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void __not_in_flash_func(FreHdParam)(byte data)
+{
+	if (g_nFreParamCount >= g_nFreParamSize)
+	{
+		return;
+	}
+
+	g_byFreParam[g_nFreParamCount++] = data;
+
+	if (g_nFreParamCount == g_nFreParamSize)
+	{
+		g_byFreParam[g_nFreParamCount] = 0;
+		g_byFrePending = true;
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void FreHdFlush(void)
+{
+	if ((g_fFre != NULL) && (g_nFreStaged > 0))
+	{
+		if (FileWrite(g_fFre, g_byFreStage, g_nFreStaged) != g_nFreStaged)
+		{
+			g_byFreError = FR_DISK_ERR;
+		}
+	}
+
+	g_nFreStaged = 0;
+}
+
+//-----------------------------------------------------------------------------
+static void FreHdClose(void)
+{
+	FreHdFlush();
+
+	if (g_fFre != NULL)
+	{
+		FileClose(g_fFre);
+		g_fFre = NULL;
+	}
+
+	g_nFreNextSize = -1;
+}
+
+//-----------------------------------------------------------------------------
+// closes the FreHD file, any staged data is written first
+void HdcResetFreHd(void)
+{
+	FreHdClose();
+
+#ifndef MFC
+	if (g_byFreDirOpen)
+	{
+		f_closedir(&g_djFre);
+		g_byFreDirOpen = false;
+	}
+#endif
+
+	g_byFrePending   = false;
+	g_byFreError     = 0;
+	g_nFreResultSize = 0;
+}
+
+//-----------------------------------------------------------------------------
+// the time set by SET_TIME moved on by the time since
+static void FreHdGetTime(byte* pby)
+{
+	static const byte byDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+	uint32_t dwSecs = (uint32_t)((time_us_64() - g_nFreTimeSet) / 1000000);
+	uint32_t dwDays;
+	int      nYear, nMonth, nDay, nDaysMonth;
+
+	dwSecs += g_byFreTime[0] + g_byFreTime[1] * 60 + g_byFreTime[2] * 3600;
+	dwDays  = dwSecs / 86400;
+	dwSecs  = dwSecs % 86400;
+
+	pby[0] = dwSecs % 60;
+	pby[1] = (dwSecs / 60) % 60;
+	pby[2] = dwSecs / 3600;
+
+	nYear  = g_byFreTime[3] + 1900;
+	nMonth = (g_byFreTime[4] >= 1) && (g_byFreTime[4] <= 12) ? g_byFreTime[4] : 1;
+	nDay   = (g_byFreTime[5] >= 1) ? g_byFreTime[5] : 1;
+
+	while (dwDays > 0)
+	{
+		nDaysMonth = byDays[nMonth-1] + ((nMonth == 2) && ((nYear % 4) == 0) && (((nYear % 100) != 0) || ((nYear % 400) == 0)));
+
+		if (++nDay > nDaysMonth)
+		{
+			nDay = 1;
+
+			if (++nMonth > 12)
+			{
+				nMonth = 1;
+				++nYear;
+			}
+		}
+
+		--dwDays;
+	}
+
+	pby[3] = nYear - 1900;
+	pby[4] = nMonth;
+	pby[5] = nDay;
+}
+
+//-----------------------------------------------------------------------------
+static byte FreHdReadDir(byte* pby, int* pnSize)
+{
+#ifdef MFC
+	return FR_NOT_ENABLED;
+#else
+	FILINFO fno;
+	FRESULT fr;
+
+	if (!g_byFreDirOpen)
+	{
+		return FR_INVALID_OBJECT;
+	}
+
+	fr = f_readdir(&g_djFre, &fno);
+
+	if (fr != FR_OK)
+	{
+		return fr;
+	}
+
+	// size, date, time and attributes then the name
+	if (fno.fname[0] == 0)
+	{
+		f_closedir(&g_djFre);
+		g_byFreDirOpen = false;
+		return FREHD_EOF;
+	}
+
+	pby[0] = fno.fsize & 0xFF;
+	pby[1] = (fno.fsize >> 8) & 0xFF;
+	pby[2] = (fno.fsize >> 16) & 0xFF;
+	pby[3] = (fno.fsize >> 24) & 0xFF;
+	pby[4] = fno.fdate & 0xFF;
+	pby[5] = fno.fdate >> 8;
+	pby[6] = fno.ftime & 0xFF;
+	pby[7] = fno.ftime >> 8;
+	pby[8] = fno.fattrib;
+	strncpy((char*)pby + 9, fno.fname, FREHD_BLOCK_SIZE - 10);
+	pby[FREHD_BLOCK_SIZE-1] = 0;
+
+	*pnSize = 9 + strlen((char*)pby + 9) + 1;
+	return FR_OK;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// carries out a command on core0, and loads the next block of a file that is
+// being read
+void HdcServiceFreHd(void)
+{
+	byte* pby = g_pbyFreResult;
+	int   nSize = 0;
+	byte  byError = FR_OK;
+
+	if (!g_byFrePending)
+	{
+		if ((g_fFre != NULL) && g_byFreReadOnly && !g_byFreEof && (g_nFreNextSize < 0))
+		{
+			nSize = FileRead(g_fFre, g_pbyFreNext, FREHD_BLOCK_SIZE);
+			g_byFreEof = (nSize < FREHD_BLOCK_SIZE);
+			__dmb();
+			g_nFreNextSize = nSize;
+		}
+
+		return;
+	}
+
+	switch (g_byFreCommand)
+	{
+		case eFreGetVersion: // product, major and minor version
+			pby[0] = 0x80;
+			pby[1] = 1;
+			pby[2] = 0;
+			nSize  = 3;
+			break;
+
+		case eFreGetTime:
+			FreHdGetTime(pby);
+			nSize = 6;
+			break;
+
+		case eFreSetTime:
+			memcpy(g_byFreTime, g_byFreParam, sizeof(g_byFreTime));
+			g_nFreTimeSet = time_us_64();
+			break;
+
+		case eFreOpenFile: // mode (FatFs FA_ flags) then the file name
+			FreHdClose();
+			g_fFre = FileOpen((char*)g_byFreParam + 1, g_byFreParam[0]);
+
+			if (g_fFre == NULL)
+			{
+				byError = FR_NO_FILE;
+				break;
+			}
+
+			g_byFreReadOnly = !(g_byFreParam[0] & FA_WRITE);
+			g_byFreEof      = false;
+			break;
+
+		case eFreReadFile:
+			if (g_fFre == NULL)
+			{
+				byError = FR_INVALID_OBJECT;
+				break;
+			}
+
+			// the command came while the block was being loaded ahead
+			if (g_nFreNextSize > 0)
+			{
+				pby            = g_pbyFreNext;
+				g_pbyFreNext   = g_pbyFreResult;
+				g_pbyFreResult = pby;
+				nSize          = g_nFreNextSize;
+				g_nFreNextSize = -1;
+				break;
+			}
+
+			g_nFreNextSize = -1;
+
+			if (!g_byFreEof)
+			{
+				FreHdFlush();
+				nSize = FileRead(g_fFre, pby, FREHD_BLOCK_SIZE);
+				g_byFreEof = (nSize < FREHD_BLOCK_SIZE);
+			}
+
+			// a full block reads as 0 on port C3h, so the end needs an error
+			if (nSize == 0)
+			{
+				byError = FREHD_EOF;
+			}
+
+			break;
+
+		case eFreWriteFile:
+			if ((g_fFre == NULL) || g_byFreReadOnly)
+			{
+				byError = FR_INVALID_OBJECT;
+				break;
+			}
+
+			if (g_nFreStaged + g_nFreParamSize > sizeof(g_byFreStage))
+			{
+				FreHdFlush();
+			}
+
+			memcpy(g_byFreStage + g_nFreStaged, g_byFreParam, g_nFreParamSize);
+			g_nFreStaged += g_nFreParamSize;
+			byError = g_byFreError;
+			break;
+
+		case eFreCloseFile:
+			g_byFreError = FR_OK;
+			FreHdClose();
+			byError = g_byFreError;
+			break;
+
+		case eFreSeekFile: // 4 byte offset, low byte first
+			if (g_fFre == NULL)
+			{
+				byError = FR_INVALID_OBJECT;
+				break;
+			}
+
+			FreHdFlush();
+			FileSeek(g_fFre, g_byFreParam[0] | (g_byFreParam[1] << 8) | (g_byFreParam[2] << 16) | (g_byFreParam[3] << 24));
+			g_nFreNextSize = -1;
+			g_byFreEof     = false;
+			break;
+
+		case eFreOpenDir:
+#ifdef MFC
+			byError = FR_NOT_ENABLED;
+#else
+			if (g_byFreDirOpen)
+			{
+				f_closedir(&g_djFre);
+			}
+
+			byError = f_opendir(&g_djFre, (char*)g_byFreParam);
+			g_byFreDirOpen = (byError == FR_OK);
+#endif
+			break;
+
+		case eFreReadDir:
+			byError = FreHdReadDir(pby, &nSize);
+			break;
+
+		default:
+			byError = FR_INVALID_PARAMETER;
+			break;
+	}
+
+	g_byFreError     = byError;
+	g_nFreResultSize = nSize;
+	g_nFreResultPos  = 0;
+	g_byFrePending   = false;
+
+	if (byError != FR_OK)
+	{
+		Hdc.byStatusRegister |= STATUS_MASK_ERROR;
+	}
+
+	__dmb();
+	Hdc.byStatusRegister &= ~STATUS_MASK_BUSY;
+}
+
 //-----------------------------------------------------------------------------
 void __not_in_flash_func(hdc_port_out)(word addr, byte data)
 {
     addr = addr & 0xFF;
 
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = port_out;
-	fdc_log[log_head].val = data;
-    fdc_log[log_head].op1 = addr;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	LogEvent(LOG_CLASS_HDC, port_out, data, addr);
 
 	switch (addr)
 	{
 		case 0xC1: // Hard disk controller board control register (Read/Write).
 			break;
 
+		case 0xC2: // FreHD data
+			FreHdParam(data);
+			break;
+
+		case 0xC3: // FreHD parameter size
+			g_nFreParamSize  = (data == 0) ? FREHD_BLOCK_SIZE : data;
+			g_nFreParamCount = 0;
+			break;
+
+		case 0xC4: // FreHD command
+			FreHdCommand(data);
+			break;
+
 		case 0xC8: // Data Register
 			*Hdc.pbyWritePtr = data;
 
@@ -518,6 +996,22 @@ byte __not_in_flash_func(hdc_port_in)(word addr)
 			data = Hdc.byWriteProtectRegister;
 			break;
 
+		case 0xC2: // FreHD data
+			if (g_nFreResultPos < g_nFreResultSize)
+			{
+				data = g_pbyFreResult[g_nFreResultPos++];
+			}
+
+			break;
+
+		case 0xC3: // FreHD result size
+			data = g_nFreResultSize & 0xFF;
+			break;
+
+		case 0xC5: // FreHD error
+			data = g_byFreError;
+			break;
+
 		case 0xC8: // Data Register
 			data = *Hdc.pbyReadPtr;
 
@@ -563,13 +1057,7 @@ byte __not_in_flash_func(hdc_port_in)(word addr)
 			break;
 	}
 
-#ifdef ENABLE_LOGGING
-	fdc_log[log_head].type = port_in;
-	fdc_log[log_head].val = data;
-    fdc_log[log_head].op1 = addr;
-	++log_head;
-	log_head = log_head % LOG_SIZE;
-#endif
+	LogEvent(LOG_CLASS_HDC, port_in, data, addr);
 
 	return data;
 }
@@ -57,13 +57,36 @@ typedef struct {
 	int  nSectors;
 } VhdType;
 
+// FreHD extension commands (port C4h)
+enum {
+	eFreGetVersion = 0x00,
+	eFreGetTime    = 0x01,
+	eFreSetTime    = 0x02,
+	eFreOpenFile   = 0x03,
+	eFreReadFile   = 0x04,
+	eFreWriteFile  = 0x05,
+	eFreCloseFile  = 0x06,
+	eFreOpenDir    = 0x07,
+	eFreReadDir    = 0x08,
+	eFreSeekFile   = 0x0C,
+};
+
+#define FREHD_BLOCK_SIZE 256
+#define FREHD_STAGE_SIZE 0x1000		// file writes collected before they go to the SD-Card
+#define FREHD_EOF        0x20		// port C5h error past the end of a file or directory, above the FatFs codes
+
 extern HdcType Hdc;
 extern VhdType Vhd[MAX_VHD_DRIVES];
 
 void HdcInitFileName(int nDrive, char* pszFileName);
 void HdcInit(void);
+void HdcReset(void);
+void HdcMountDrive(int nDrive);
+void HdcUnmountDrive(int nDrive);
 void HdcCreateVhd(char* pszFileName, int nHeads, int nCylinders, int nSectors);
 void HdcServiceStateMachine(void);
+void HdcServiceFreHd(void);
+void HdcResetFreHd(void);
 void HdcDumpDisk(int nDrive);
 
 void hdc_port_out(word addr, byte data);
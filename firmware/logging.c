@@ -8,6 +8,7 @@
 #include "file.h"
 #include "fdc.h"
 #include "cli.h"
+#include "logging.h"
 
 #ifdef ENABLE_LOGGING
 
@@ -28,9 +29,25 @@ static uint16_t g_nPrevHdcStatusCount = 0;
 static BYTE     g_byPrevFdcStatus = 0;
 static uint16_t g_nPrevFdcStatusCount = 0;
 
-LogType fdc_log[LOG_SIZE];
-int log_head = 0;
-int log_tail = 0;
+static uint32_t g_dwLogData[LOG_SIZE];
+static uint32_t g_dwLogDropped = 0;
+static LogType  g_leLog;		// entry being reported
+
+RingType          g_rbLog = RING_INIT(g_dwLogData);
+volatile uint32_t g_dwLogClasses = 0;
+
+//----------------------------------------------------------------------------
+// selects the event classes the bus handlers record, 0 stops logging and
+// discards the entries not yet reported
+void LogEnable(uint32_t dwClasses)
+{
+	g_dwLogClasses = dwClasses & LOG_CLASSES;
+
+	if (g_dwLogClasses == 0)
+	{
+		RingFlush(&g_rbLog);
+	}
+}
 
 //----------------------------------------------------------------------------
 void PurgeRwBuffer(void)
@@ -606,15 +623,15 @@ void ServicePortOutLog(void)
 
 	PurgeHdcStatus();
 
-	if (fdc_log[log_tail].op1 != 0xC8)
+	if (g_leLog.op1 != 0xC8)
 	{
         PurgeRwBuffer();
 	}
 
-	switch (fdc_log[log_tail].op1)
+	switch (g_leLog.op1)
 	{
 		case 0xC1: // Hard disk controller board control register (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X ", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X ", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -626,12 +643,12 @@ void ServicePortOutLog(void)
 		case 0xC8: // Data Register
             if (g_byRwIndex == 0)
             {
-                sprintf_s(g_szRwBuf, sizeof(g_szRwBuf)-1, "OUT DATA %02X", fdc_log[log_tail].val);
+                sprintf_s(g_szRwBuf, sizeof(g_szRwBuf)-1, "OUT DATA %02X", g_leLog.val);
                 ++g_byRwIndex;
             }
             else if (g_byRwIndex == 15)
             {
-                sprintf_s(t, sizeof(t)-1, " %02X", fdc_log[log_tail].val);
+                sprintf_s(t, sizeof(t)-1, " %02X", g_leLog.val);
                 strcat_s(g_szRwBuf, sizeof(g_szRwBuf)-1, t);
                 g_byRwIndex = 0;
 
@@ -646,7 +663,7 @@ void ServicePortOutLog(void)
             }
             else
             {
-                sprintf_s(t, sizeof(t)-1, " %02X", fdc_log[log_tail].val);
+                sprintf_s(t, sizeof(t)-1, " %02X", g_leLog.val);
                 strcat_s(g_szRwBuf, sizeof(g_szRwBuf)-1, t);
                 ++g_byRwIndex;
             }
@@ -654,7 +671,7 @@ void ServicePortOutLog(void)
 			break;
 
 		case 0xC9: // Hard Disk Write Pre-Comp Cyl.
-			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X (Write Pre-Comp)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X (Write Pre-Comp)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -664,7 +681,7 @@ void ServicePortOutLog(void)
 			break;
 
 		case 0xCA: // Hard Disk Sector Count (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X (Sector Count)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X (Sector Count)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -674,7 +691,7 @@ void ServicePortOutLog(void)
 			break;
 
 		case 0xCB: // Hard Disk Sector Number (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X (Sector Number)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X (Sector Number)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -684,7 +701,7 @@ void ServicePortOutLog(void)
 			break;
 
 		case 0xCC: // Hard Disk Cylinder LSB (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X (Cylinder LSB)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X (Cylinder LSB)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -694,7 +711,7 @@ void ServicePortOutLog(void)
 			break;
 
 		case 0xCD: // Hard Disk Cylinder MSB (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X (Cylinder MSB)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X (Cylinder MSB)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -705,10 +722,10 @@ void ServicePortOutLog(void)
 
 		case 0xCE: // Hard Disk Sector Size / Drive # / Head # (Read/Write).
 			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X SDH: Sector Size %d, Drive Sel %d, Head Sel %d",
-					  fdc_log[log_tail].op1, fdc_log[log_tail].val,
-					  g_nSectorSizes[(fdc_log[log_tail].val >> 5) & 0x03],
-					  (fdc_log[log_tail].val >> 3) & 0x03,
-					  fdc_log[log_tail].val & 0x07);
+					  g_leLog.op1, g_leLog.val,
+					  g_nSectorSizes[(g_leLog.val >> 5) & 0x03],
+					  (g_leLog.val >> 3) & 0x03,
+					  g_leLog.val & 0x07);
 
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
@@ -719,8 +736,8 @@ void ServicePortOutLog(void)
 			break;
 
 		case 0xCF: // Command/Status Register for WD1010 Winchester Disk Controller Chip.
-			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X CMD: ", fdc_log[log_tail].op1, fdc_log[log_tail].val);
-			AppendHdcCommandString(buf, sizeof(buf)-1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X CMD: ", g_leLog.op1, g_leLog.val);
+			AppendHdcCommandString(buf, sizeof(buf)-1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -730,7 +747,7 @@ void ServicePortOutLog(void)
 			break;
 
 		default:
-			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X ", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "OUT %02X %02X ", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -746,20 +763,20 @@ void ServicePortInLog(void)
     char buf[64];
 	char t[8];
 
-	if (fdc_log[log_tail].op1 != 0xCF)
+	if (g_leLog.op1 != 0xCF)
 	{
 		PurgeHdcStatus();
 	}
 
-	if (fdc_log[log_tail].op1 != 0xC8)
+	if (g_leLog.op1 != 0xC8)
 	{
         PurgeRwBuffer();
 	}
 
-	switch (fdc_log[log_tail].op1)
+	switch (g_leLog.op1)
 	{
 		case 0xC1: // Hard disk controller board control register (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X ", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X ", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -771,12 +788,12 @@ void ServicePortInLog(void)
 		case 0xC8: // Data Register
             if (g_byRwIndex == 0)
             {
-                sprintf_s(g_szRwBuf, sizeof(g_szRwBuf)-1, "INP DATA %02X", fdc_log[log_tail].val);
+                sprintf_s(g_szRwBuf, sizeof(g_szRwBuf)-1, "INP DATA %02X", g_leLog.val);
                 ++g_byRwIndex;
             }
             else if (g_byRwIndex == 15)
             {
-                sprintf_s(t, sizeof(t)-1, " %02X", fdc_log[log_tail].val);
+                sprintf_s(t, sizeof(t)-1, " %02X", g_leLog.val);
                 strcat_s(g_szRwBuf, sizeof(g_szRwBuf)-1, t);
                 g_byRwIndex = 0;
 
@@ -791,7 +808,7 @@ void ServicePortInLog(void)
             }
             else
             {
-                sprintf_s(t, sizeof(t)-1, " %02X", fdc_log[log_tail].val);
+                sprintf_s(t, sizeof(t)-1, " %02X", g_leLog.val);
                 strcat_s(g_szRwBuf, sizeof(g_szRwBuf)-1, t);
                 ++g_byRwIndex;
             }
@@ -799,7 +816,7 @@ void ServicePortInLog(void)
 			break;
 
 		case 0xC9: // Hard Disk Write Pre-Comp Cyl.
-			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (Error Register)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (Error Register)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -809,7 +826,7 @@ void ServicePortInLog(void)
 			break;
 
 		case 0xCA: // Hard Disk Sector Count (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (Sector Count)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (Sector Count)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -819,7 +836,7 @@ void ServicePortInLog(void)
 			break;
 
 		case 0xCB: // Hard Disk Sector Number (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (Sector Number)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (Sector Number)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -829,7 +846,7 @@ void ServicePortInLog(void)
 			break;
 
 		case 0xCC: // Hard Disk Cylinder LSB (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (Cylinder LSB)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (Cylinder LSB)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -839,7 +856,7 @@ void ServicePortInLog(void)
 			break;
 
 		case 0xCD: // Hard Disk Cylinder MSB (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (Cylinder MSB)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (Cylinder MSB)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -849,7 +866,7 @@ void ServicePortInLog(void)
 			break;
 
 		case 0xCE: // Hard Disk Sector Size / Drive # / Head # (Read/Write).
-			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (SDH)", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X (SDH)", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -859,10 +876,10 @@ void ServicePortInLog(void)
 			break;
 
 		case 0xCF: // Command/Status Register for WD1010 Winchester Disk Controller Chip.
-            if (g_byPrevHdcStatus != fdc_log[log_tail].val)
+            if (g_byPrevHdcStatus != g_leLog.val)
 			{
 				PurgeHdcStatus();
-				g_byPrevHdcStatus = fdc_log[log_tail].val;
+				g_byPrevHdcStatus = g_leLog.val;
 				g_nPrevHdcStatusCount = 1;
 			}
 			else
@@ -873,7 +890,7 @@ void ServicePortInLog(void)
 			break;
 
 		default:
-			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X ", fdc_log[log_tail].op1, fdc_log[log_tail].val);
+			sprintf_s(buf, sizeof(buf)-1, "INP %02X %02X ", g_leLog.op1, g_leLog.val);
 			#ifdef MFC
 				strcat_s(buf2, sizeof(buf2)-1, "\r\n");
 				WriteLogFile(buf2);
@@ -892,22 +909,44 @@ void ServiceFdcLog(void)
     char buf[64];
 	char t[8];
 
-    if (log_head == log_tail)
-    {
-        return;
-    }
+	uint32_t dwEntry;
 
     if (tud_cdc_write_available() < 56)
 	{
 		return;
 	}
 
-    switch (fdc_log[log_tail].type)
+	if (g_rbLog.dwDropped != g_dwLogDropped)
+	{
+		PurgeRwBuffer();
+		sprintf_s(buf, sizeof(buf), "*** %lu log entries dropped", g_rbLog.dwDropped - g_dwLogDropped);
+		g_dwLogDropped = g_rbLog.dwDropped;
+
+		#ifdef MFC
+			strcat_s(buf, sizeof(buf)-1, "\r\n");
+			WriteLogFile(buf);
+		#else
+			puts(buf);
+		#endif
+
+		return;
+	}
+
+    if (!RingGet(&g_rbLog, &dwEntry))
+    {
+        return;
+    }
+
+	g_leLog.type = dwEntry & 0xFF;
+	g_leLog.val  = (dwEntry >> 8) & 0xFF;
+	g_leLog.op1  = (dwEntry >> 16) & 0xFF;
+
+    switch (g_leLog.type)
     {
         case write_drive_select:
-            if (g_nDriveSel != fdc_log[log_tail].val)
+            if (g_nDriveSel != g_leLog.val)
             {
-                sprintf_s(buf, sizeof(buf), "WR DRVSEL %02X", fdc_log[log_tail].val);
+                sprintf_s(buf, sizeof(buf), "WR DRVSEL %02X", g_leLog.val);
 
                 #ifdef MFC
                     strcat_s(buf, sizeof(buf)-1, "\r\n");
@@ -916,7 +955,7 @@ void ServiceFdcLog(void)
                     puts(buf);
                 #endif
 
-				g_nDriveSel = fdc_log[log_tail].val;
+				g_nDriveSel = g_leLog.val;
             }
 
 			break;
@@ -924,9 +963,9 @@ void ServiceFdcLog(void)
 		case read_drive_select:
 			++byDrvSelRdCount;
 
-			if ((fdc_log[log_tail].val != byPrevDrvSelRd) || (byDrvSelRdCount >= 40))
+			if ((g_leLog.val != byPrevDrvSelRd) || (byDrvSelRdCount >= 40))
 			{
-				sprintf_s(buf, sizeof(buf), "RD DRVSEL %02X x %d", fdc_log[log_tail].val, byDrvSelRdCount);
+				sprintf_s(buf, sizeof(buf), "RD DRVSEL %02X x %d", g_leLog.val, byDrvSelRdCount);
 
 				#ifdef MFC
 					strcat_s(buf, sizeof(buf)-1, "\r\n");
@@ -936,22 +975,22 @@ void ServiceFdcLog(void)
 				#endif
 
 				byDrvSelRdCount = 0;
-				byPrevDrvSelRd = fdc_log[log_tail].val;
+				byPrevDrvSelRd = g_leLog.val;
 			}
 
 			break;
 
         case write_data:
-			g_nData = fdc_log[log_tail].val;
+			g_nData = g_leLog.val;
 
             if (g_byRwIndex == 0)
             {
-                sprintf_s(g_szRwBuf, sizeof(g_szRwBuf)-1, "WR DATA %02X", fdc_log[log_tail].val);
+                sprintf_s(g_szRwBuf, sizeof(g_szRwBuf)-1, "WR DATA %02X", g_leLog.val);
                 ++g_byRwIndex;
             }
             else if (g_byRwIndex == 15)
             {
-                sprintf_s(t, sizeof(t)-1, " %02X", fdc_log[log_tail].val);
+                sprintf_s(t, sizeof(t)-1, " %02X", g_leLog.val);
                 strcat_s(g_szRwBuf, sizeof(g_szRwBuf)-1, t);
                 g_byRwIndex = 0;
 
@@ -966,7 +1005,7 @@ void ServiceFdcLog(void)
             }
             else
             {
-                sprintf_s(t, sizeof(t)-1, " %02X", fdc_log[log_tail].val);
+                sprintf_s(t, sizeof(t)-1, " %02X", g_leLog.val);
                 strcat_s(g_szRwBuf, sizeof(g_szRwBuf)-1, t);
                 ++g_byRwIndex;
             }
@@ -976,30 +1015,30 @@ void ServiceFdcLog(void)
         case write_sector:
         	PurgeRwBuffer();
 
-			g_nSector = fdc_log[log_tail].val;
-			sprintf_s(buf, sizeof(buf)-1, "WR SECTOR %02X ", fdc_log[log_tail].val);
+			g_nSector = g_leLog.val;
+			sprintf_s(buf, sizeof(buf)-1, "WR SECTOR %02X ", g_leLog.val);
 
-			if (fdc_log[log_tail].val >= 0xE0)
+			if (g_leLog.val >= 0xE0)
 			{
                 strcat_s(buf, sizeof(buf)-1, "Doubler Precomp = 1");
 			}
-			else if (fdc_log[log_tail].val >= 0xC0)
+			else if (g_leLog.val >= 0xC0)
 			{
                 strcat_s(buf, sizeof(buf)-1, "Doubler Precomp = 0");
 			}
-			else if (fdc_log[log_tail].val >= 0xA0)
+			else if (g_leLog.val >= 0xA0)
 			{
                 strcat_s(buf, sizeof(buf)-1, "Doubler Enable = 0, Doubler Density = 0");
 			}
-			else if (fdc_log[log_tail].val >= 0x80)
+			else if (g_leLog.val >= 0x80)
 			{
                 strcat_s(buf, sizeof(buf)-1, "Doubler Enable = 1, Doubler Density = 1");
 			}
-			else if (fdc_log[log_tail].val >= 0x60)
+			else if (g_leLog.val >= 0x60)
 			{
                 strcat_s(buf, sizeof(buf)-1, "Doubler Side = 1");
 			}
-			else if (fdc_log[log_tail].val >= 0x40)
+			else if (g_leLog.val >= 0x40)
 			{
                 strcat_s(buf, sizeof(buf)-1, "Doubler Side = 0");
 			}
@@ -1015,9 +1054,9 @@ void ServiceFdcLog(void)
         case write_track:
             PurgeRwBuffer();
 
-			g_nTrack = fdc_log[log_tail].val;
+			g_nTrack = g_leLog.val;
 
-            sprintf_s(buf, sizeof(buf)-1, "WR TRACK %02X", fdc_log[log_tail].val);
+            sprintf_s(buf, sizeof(buf)-1, "WR TRACK %02X", g_leLog.val);
 
             #ifdef MFC
                 strcat_s(buf, sizeof(buf)-1, "\r\n");
@@ -1031,8 +1070,8 @@ void ServiceFdcLog(void)
         	PurgeRwBuffer();
 			PurgeFdcStatus();
 
-			g_nCommand = fdc_log[log_tail].val;
-            GetCommandText(buf, sizeof(buf), fdc_log[log_tail].val);
+			g_nCommand = g_leLog.val;
+            GetCommandText(buf, sizeof(buf), g_leLog.val);
 
             #ifdef MFC
                 strcat_s(buf, sizeof(buf)-1, "\r\n");
@@ -1045,12 +1084,12 @@ void ServiceFdcLog(void)
         case read_data:
             if (g_byRwIndex == 0)
             {
-                sprintf_s(g_szRwBuf, sizeof(g_szRwBuf)-1, "RD DATA %02X", fdc_log[log_tail].val);
+                sprintf_s(g_szRwBuf, sizeof(g_szRwBuf)-1, "RD DATA %02X", g_leLog.val);
                 ++g_byRwIndex;
             }
             else if (g_byRwIndex == 15)
             {
-                sprintf_s(t, sizeof(t)-1, " %02X", fdc_log[log_tail].val);
+                sprintf_s(t, sizeof(t)-1, " %02X", g_leLog.val);
                 strcat_s(g_szRwBuf, sizeof(g_szRwBuf)-1, t);
 
                 #ifdef MFC
@@ -1065,7 +1104,7 @@ void ServiceFdcLog(void)
             }
             else
             {
-                sprintf_s(t, sizeof(t)-1, " %02X", fdc_log[log_tail].val);
+                sprintf_s(t, sizeof(t)-1, " %02X", g_leLog.val);
                 strcat_s(g_szRwBuf, sizeof(g_szRwBuf)-1, t);
                 ++g_byRwIndex;
             }
@@ -1074,7 +1113,7 @@ void ServiceFdcLog(void)
 
         case read_sector:
             PurgeRwBuffer();
-            sprintf_s(buf, sizeof(buf)-1, "RD SECTOR %02X", fdc_log[log_tail].val);
+            sprintf_s(buf, sizeof(buf)-1, "RD SECTOR %02X", g_leLog.val);
 
             #ifdef MFC
                 strcat_s(buf, sizeof(buf)-1, "\r\n");
@@ -1086,7 +1125,7 @@ void ServiceFdcLog(void)
 
         case read_track:
             PurgeRwBuffer();
-            sprintf_s(buf, sizeof(buf)-1, "RD TRACK %02X", fdc_log[log_tail].val);
+            sprintf_s(buf, sizeof(buf)-1, "RD TRACK %02X", g_leLog.val);
 
             #ifdef MFC
                 strcat_s(buf, sizeof(buf)-1, "\r\n");
@@ -1097,10 +1136,10 @@ void ServiceFdcLog(void)
             break;
 
         case read_status:
-			if (g_byPrevFdcStatus != fdc_log[log_tail].val)
+			if (g_byPrevFdcStatus != g_leLog.val)
             {
 				PurgeFdcStatus();
-                g_byPrevFdcStatus = fdc_log[log_tail].val;
+                g_byPrevFdcStatus = g_leLog.val;
 				g_nPrevFdcStatusCount = 1;
             }
 			else
@@ -1118,9 +1157,6 @@ void ServiceFdcLog(void)
 			ServicePortInLog();
 			break;
     }
-
-    ++log_tail;
-	log_tail = log_tail % LOG_SIZE;
 }
 
 #endif
@@ -0,0 +1,59 @@
+#ifndef _H_LOGGING_
+#define _H_LOGGING_
+
+#include "defines.h"
+#include "ring.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// FDC logging
+
+// event classes, LOG_CLASSES selects the ones compiled into the bus handlers
+// and g_dwLogClasses (logon/logoff) the ones recorded at run time
+#define LOG_CLASS_DRVSEL	0x01	// drive select latch
+#define LOG_CLASS_FDC		0x02	// command, status, track and sector registers
+#define LOG_CLASS_DATA		0x04	// FDC data register
+#define LOG_CLASS_HDC		0x08	// hard disk ports
+#define LOG_CLASS_ALL		0x0F
+
+#define LOG_CLASSES			LOG_CLASS_ALL
+
+#define LOG_SIZE 4096		// entries, must be a power of 2
+
+typedef struct {
+	uint8_t type;
+	uint8_t val;
+	uint8_t op1;
+} LogType;
+
+enum {
+	write_drive_select = 0,
+	write_data,
+	write_sector,
+	write_track,
+	write_cmd,
+	read_drive_select,
+	read_data,
+	read_sector,
+	read_track,
+	read_status,
+	port_out,
+	port_in
+};
+
+// a log entry is packed into one ring entry as type | val << 8 | op1 << 16
+#define LOG_ENTRY(type, val, op1) ((uint32_t)(type) | ((uint32_t)(byte)(val) << 8) | ((uint32_t)(byte)(op1) << 16))
+
+#ifdef ENABLE_LOGGING
+	extern RingType          g_rbLog;
+	extern volatile uint32_t g_dwLogClasses;
+
+	#define LogEvent(cls, type, val, op1) \
+		do { if ((LOG_CLASSES & (cls)) && (g_dwLogClasses & (cls))) RingPut(&g_rbLog, LOG_ENTRY(type, val, op1)); } while (0)
+#else
+	#define LogEvent(cls, type, val, op1)
+#endif
+
+void ServiceFdcLog(void);
+void LogEnable(uint32_t dwClasses);
+
+#endif
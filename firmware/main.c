@@ -17,6 +17,7 @@
 #include "system.h"
 #include "cli.h"
 #include "memory.h"
+#include "ramdisk.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // API documentions is located at
@@ -188,8 +189,10 @@ int main()
     SysInit();
     FdcInit();
     HdcInit();
+    RamDiskInit();
     InitCli();
 
+    BusMapInit();
     multicore_launch_core1(service_memory);
 
     // wait for reset to be released
@@ -204,6 +207,7 @@ int main()
         UpdateCounters();
         FdcServiceStateMachine();
         HdcServiceStateMachine();
+        RamDiskService();
         ServiceCli();
     }
 }
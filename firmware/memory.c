@@ -8,33 +8,189 @@
 #include "defines.h"
 #include "fdc.h"
 #include "hdc.h"
+#include "memory.h"
+#include "ramdisk.h"
+
+#if ENABLE_PIO_BUS
+    #include "hardware/pio.h"
+    #include "bus.pio.h"
+#endif
 
 #define NopDelay() __nop(); __nop(); __nop(); __nop(); __nop(); __nop();
 
 extern BufferType g_bFdcRequest;
 extern BufferType g_bFdcResponse;
+extern byte       g_byWindow[FDC_WINDOW_SIZE];
 
 static byte by_memory[0x8000];
 
+// a flag for each 256 byte page of by_memory, set by core1 on a write so core0
+// can take a consistent copy of a memory that is changing
+static volatile byte g_byMemDirty[0x80];
+
 volatile byte g_byFdcIntrActive;
 volatile byte g_byRtcIntrActive;
+volatile byte g_byMbIntrActive;
 volatile byte g_byResetActive;
+volatile uint32_t g_dwResetRelease;		// time_us_32() when SYSRES went inactive
 volatile byte g_byEnableIntr;
 volatile byte g_byEnableUpperMem;
 volatile byte g_byEnableWaitStates;
 volatile byte g_byEnableVhd = true;
 
+volatile byte     g_byWaitRequest;
+volatile uint32_t g_dwWaitCycles;
+volatile uint32_t g_dwWaitTime;
+
+static volatile uint32_t g_dwDataValid;	// SysTick when the data was put on the bus
+
+//-----------------------------------------------------------------------------
+// WAIT=2, holds the Z80 while core0 has not yet acted on the last command
+// written to the FDC (e.g. the track of a read sector command is still being
+// loaded).  Core0 lets it go with ReleaseWait() once the command has been set
+// up.  The WAIT pin is released by FinishReadOperation().
+void __not_in_flash_func(WaitForFdc)(void)
+{
+    uint32_t dwStart;
+
+    if ((g_byEnableWaitStates != eWaitDemand) || !FdcCommandPending())
+    {
+        return;
+    }
+
+    g_byWaitRequest = true;
+    __dmb();
+
+    // core0 may have finished in the meantime
+    if (!FdcCommandPending())
+    {
+        g_byWaitRequest = false;
+        return;
+    }
+
+    set_gpio(WAIT_PIN);
+    dwStart = time_us_32();
+
+    while (g_byWaitRequest && ((time_us_32() - dwStart) < WAIT_MAX_TIME));
+
+    g_byWaitRequest = false;
+    g_dwWaitTime += time_us_32() - dwStart;
+    ++g_dwWaitCycles;
+}
+
+//-----------------------------------------------------------------------------
+// called by core0 once the state core1 is waiting for is in place
+void ReleaseWait(void)
+{
+    __dmb();
+    g_byWaitRequest = false;
+}
+
+#if ENABLE_PIO_BUS
+
+#define BUS_PIO pio0
+
+static uint     g_nBusSm;
+static uint     g_nBusOffset;
+static uint32_t g_dwBusEvent;	// an event PioBusGetData() found in place of the data
+static bool     g_bBusEvent;
+
+//-----------------------------------------------------------------------------
+void __not_in_flash_func(PioBusRespond)(uint nPc, byte data)
+{
+    pio_sm_put(BUS_PIO, g_nBusSm, (g_nBusOffset + nPc) | (data << 5) | (0xFF << 13));
+    clr_gpio(WAIT_PIN);
+}
+
+//-----------------------------------------------------------------------------
+// hands the write cycle back to the state machine and waits for the data
+// byte, returns false if the cycle ended without WR going active
+bool __not_in_flash_func(PioBusGetData)(uint nPc, byte* pby)
+{
+    uint32_t dw;
+
+    pio_sm_put(BUS_PIO, g_nBusSm, g_nBusOffset + nPc);
+    clr_gpio(WAIT_PIN);
+
+    while (pio_sm_is_rx_fifo_empty(BUS_PIO, g_nBusSm))
+    {
+        if (get_gpio(MREQ_PIN) && get_gpio(OUT_PIN) && pio_sm_is_rx_fifo_empty(BUS_PIO, g_nBusSm))
+        {
+            return false;
+        }
+    }
+
+    dw = pio_sm_get(BUS_PIO, g_nBusSm);
+
+    // nothing is pushed for a write that had ended before the state machine
+    // got here, the next cycle may then already have pushed its event, which
+    // unlike the data has the strobes and A0-A7 above bit 12
+    if (dw >> 13)
+    {
+        g_dwBusEvent = dw;
+        g_bBusEvent  = true;
+        return false;
+    }
+
+    *pby = (dw >> 5) & 0xFF;
+    return true;
+}
+
+#endif
+
 //-----------------------------------------------------------------------------
 void __not_in_flash_func(FinishReadOperation)(byte data)
 {
+#if ENABLE_PIO_BUS
+    PioBusRespond(z80_bus_offset_drive, data);
+    g_dwDataValid = systick_hw->cvr;
+#else
     clr_gpio(DIR_PIN);      // B to A direction
     set_bus_as_output();    // make data pins (D0-D7) outputs
     clr_gpio(DATAB_OE_PIN); // enable data bus transciever
 
     // put byte on data bus
     put_byte_on_bus(data);
+    g_dwDataValid = systick_hw->cvr;
 
     clr_gpio(WAIT_PIN);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// the byte of a memory write, returns false if the cycle ended without WR
+// going active
+bool __not_in_flash_func(GetWriteData)(byte* pby)
+{
+#if ENABLE_PIO_BUS
+    return PioBusGetData(z80_bus_offset_write_wait, pby);
+#else
+    clr_gpio(DATAB_OE_PIN);
+    NopDelay();
+    *pby = get_gpio_data_byte();
+    set_gpio(DATAB_OE_PIN);
+
+    // wait for WR to go active or MREQ to go inactive
+    while (get_gpio(WR_PIN) && !get_gpio(MREQ_PIN));
+
+    return !get_gpio(WR_PIN);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// the byte of a port write, it is valid as soon as OUT is active
+bool __not_in_flash_func(GetPortData)(byte* pby)
+{
+#if ENABLE_PIO_BUS
+    return PioBusGetData(z80_bus_offset_write_now, pby);
+#else
+    clr_gpio(DATAB_OE_PIN);
+    NopDelay();
+    *pby = get_gpio_data_byte();
+    set_gpio(DATAB_OE_PIN);
+
+    return true;
+#endif
 }
 
 //-----------------------------------------------------------------------------
@@ -60,15 +216,25 @@ void __not_in_flash_func(ServiceFdcResponseOperation)(word addr)
         return;
     }
 
-    clr_gpio(DATAB_OE_PIN);
-    NopDelay();
-    data = get_gpio_data_byte();
-    set_gpio(DATAB_OE_PIN);
+    if (GetWriteData(&data))
+    {
+        *pby = data;
+    }
+}
 
-    // wait for RD or WR to go active or MREQ to go inactive
-    while (get_gpio(WR_PIN) && !get_gpio(MREQ_PIN));
+//-----------------------------------------------------------------------------
+void __not_in_flash_func(ServiceFdcWindowOperation)(word addr)
+{
+    byte  data;
+    byte* pby = &g_byWindow[addr-FDC_WINDOW_ADDR_START];
 
-    if (!get_gpio(WR_PIN))
+    if (!get_gpio(RD_PIN))
+    {
+        FinishReadOperation(*pby);
+        return;
+    }
+
+    if (GetWriteData(&data))
     {
         *pby = data;
     }
@@ -97,15 +263,7 @@ void __not_in_flash_func(ServiceFdcRequestOperation)(word addr)
         return;
     }
 
-    clr_gpio(DATAB_OE_PIN);
-    NopDelay();
-    data = get_gpio_data_byte();
-    set_gpio(DATAB_OE_PIN);
-
-    // wait for RD or WR to go active or MREQ to go inactive
-    while (get_gpio(WR_PIN) && !get_gpio(MREQ_PIN));
-
-    if (!get_gpio(WR_PIN))
+    if (GetWriteData(&data))
     {
         *pby = data;
     }    
@@ -123,22 +281,16 @@ void __not_in_flash_func(ServiceHighMemoryOperation)(word addr)
         return;
     }
 
-    clr_gpio(DATAB_OE_PIN);
-    NopDelay();
-    data = get_gpio_data_byte();
-    set_gpio(DATAB_OE_PIN);
-
-    // wait for RD or WR to go active or MREQ to go inactive
-    while (get_gpio(WR_PIN) && !get_gpio(MREQ_PIN));
-
-    if (!get_gpio(WR_PIN))
+    if (GetWriteData(&data))
     {
         *pby = data;
+        __dmb();
+        g_byMemDirty[(addr >> 8) & 0x7F] = true;	// after the data, see BusCopyHighMemory()
     }
 }
 
 //-----------------------------------------------------------------------------
-void __not_in_flash_func(ServiceFdcDriveSelectOperation)(void)
+void __not_in_flash_func(ServiceFdcDriveSelectOperation)(word addr)
 {
     byte data;
     
@@ -151,11 +303,17 @@ void __not_in_flash_func(ServiceFdcDriveSelectOperation)(void)
             data |= 0x80;
         }
 
+        if (g_byMbIntrActive)
+        {
+            data &= ~0x20;
+        }
+
         FinishReadOperation(data);
 
-        if (g_byRtcIntrActive)
+        if (g_byRtcIntrActive || g_byMbIntrActive)
         {
             g_byRtcIntrActive = false;
+            g_byMbIntrActive  = false;
 
             if (!g_byFdcIntrActive)
             {
@@ -167,30 +325,23 @@ void __not_in_flash_func(ServiceFdcDriveSelectOperation)(void)
         return;
     }
 
-    clr_gpio(DATAB_OE_PIN);
-    NopDelay();
-    data = get_gpio_data_byte();
-    set_gpio(DATAB_OE_PIN);
-
-    // wait for WR to go active or MREQ to go inactive
-    while (get_gpio(WR_PIN) && !get_gpio(MREQ_PIN));
-
-    if (!get_gpio(WR_PIN))
+    if (GetWriteData(&data))
     {
         fdc_write_drive_select(data);
     }
 }
 
 //-----------------------------------------------------------------------------
-void __not_in_flash_func(ServiceFdcCmdStatusOperation)(void)
+void __not_in_flash_func(ServiceFdcCmdStatusOperation)(word addr)
 {
     byte data;
 
     if (!get_gpio(RD_PIN))
     {
+        WaitForFdc();
         FinishReadOperation(fdc_read_status());
 
-        if (!g_byRtcIntrActive) // then caused by WD controller, so clear it
+        if (!g_byRtcIntrActive && !g_byMbIntrActive) // then caused by WD controller, so clear it
         {
             clr_gpio(INT_PIN);
         }
@@ -198,22 +349,14 @@ void __not_in_flash_func(ServiceFdcCmdStatusOperation)(void)
         return;
     }
 
-    clr_gpio(DATAB_OE_PIN);
-    NopDelay();
-    data = get_gpio_data_byte();
-    set_gpio(DATAB_OE_PIN);
-
-    // wait for WR to go active or MREQ to go inactive
-    while (get_gpio(WR_PIN) && !get_gpio(MREQ_PIN));
-
-    if (!get_gpio(WR_PIN))
+    if (GetWriteData(&data))
     {
         fdc_write_cmd(data);
     }
 }
 
 //-----------------------------------------------------------------------------
-void __not_in_flash_func(ServiceFdcTrackOperation)(void)
+void __not_in_flash_func(ServiceFdcTrackOperation)(word addr)
 {
     byte data;
     
@@ -223,22 +366,14 @@ void __not_in_flash_func(ServiceFdcTrackOperation)(void)
         return;
     }
 
-    clr_gpio(DATAB_OE_PIN);
-    NopDelay();
-    data = get_gpio_data_byte();
-    set_gpio(DATAB_OE_PIN);
-
-    // wait for WR to go active or MREQ to go inactive
-    while (get_gpio(WR_PIN) && !get_gpio(MREQ_PIN));
-
-    if (!get_gpio(WR_PIN))
+    if (GetWriteData(&data))
     {
         fdc_write_track(data);
     }
 }
 
 //-----------------------------------------------------------------------------
-void __not_in_flash_func(ServiceFdcSectorOperation)(void)
+void __not_in_flash_func(ServiceFdcSectorOperation)(word addr)
 {
     byte data;
     
@@ -248,40 +383,27 @@ void __not_in_flash_func(ServiceFdcSectorOperation)(void)
         return;
     }
 
-    clr_gpio(DATAB_OE_PIN);
-    NopDelay();
-    data = get_gpio_data_byte();
-    set_gpio(DATAB_OE_PIN);
-
-    // wait for WR to go active or MREQ to go inactive
-    while (get_gpio(WR_PIN) && !get_gpio(MREQ_PIN));
-
-    if (!get_gpio(WR_PIN))
+    if (GetWriteData(&data))
     {
         fdc_write_sector(data);
     }
 }
 
 //-----------------------------------------------------------------------------
-void __not_in_flash_func(ServiceFdcDataOperation)(void)
+void __not_in_flash_func(ServiceFdcDataOperation)(word addr)
 {
     byte data;
 
+    set_gpio(WAIT_PIN);
+
     if (!get_gpio(RD_PIN))
     {
+        WaitForFdc();
         FinishReadOperation(fdc_read_data());
         return;
     }
 
-    clr_gpio(DATAB_OE_PIN);
-    NopDelay();
-    data = get_gpio_data_byte();
-    set_gpio(DATAB_OE_PIN);
-
-    // wait for WR to go active or MREQ to go inactive
-    while (get_gpio(WR_PIN) && !get_gpio(MREQ_PIN));
-
-    if (!get_gpio(WR_PIN))
+    if (GetWriteData(&data))
     {
         fdc_write_data(data);
     }
@@ -292,54 +414,697 @@ void __not_in_flash_func(ServicePortIn)(word addr)
 {
     byte data;
 
-    if (get_gpio(IN_PIN))
+    FinishReadOperation(hdc_port_in(addr));
+}
+
+//-----------------------------------------------------------------------------
+void __not_in_flash_func(ServicePortOut)(word addr)
+{
+    byte data;
+
+    if (GetPortData(&data))
     {
-        return;
+        hdc_port_out(addr, data);
     }
+}
 
-    addr = addr & 0xFF;
+//-----------------------------------------------------------------------------
+void __not_in_flash_func(ServiceRamDiskIn)(word addr)
+{
+    FinishReadOperation(ramdisk_port_in(addr));
+}
 
-    if ((addr < 0xC0) || (addr > 0xCF) || (g_byEnableVhd == 0))
+//-----------------------------------------------------------------------------
+void __not_in_flash_func(ServiceRamDiskOut)(word addr)
+{
+    byte data;
+
+    if (GetPortData(&data))
     {
-        return;
+        ramdisk_port_out(addr, data);
     }
+}
 
-    FinishReadOperation(hdc_port_in(addr));
+//-----------------------------------------------------------------------------
+// Address decode
+//
+// Each memory cycle is dispatched through g_pbyPage[high byte][low byte] and
+// each port cycle through g_byPortIn/Out[low byte].  The entries are indexes
+// into g_pfnHandler[], 0 means the cycle is not for us.  The index also
+// identifies the handler in the latency statistics.
+//
+// Pages without any handler share g_byNullPage and a page that has the same
+// handler for every address shares one table with all the other pages mapped
+// to that handler (upper memory), so only pages with a mix of handlers need a
+// table of their own.
+//
+// The map can be changed from core0 while the Z80 is running, a table is
+// filled in completely before it is linked into g_pbyPage.
+
+#define BUS_PAGE_TABLES 8
+
+static byte        g_byNullPage[256];
+static byte        g_byPagePool[BUS_PAGE_TABLES][256];
+static byte        g_byPoolUniform[BUS_PAGE_TABLES];	// handler of a shared table
+static int         g_nPoolRefs[BUS_PAGE_TABLES];
+
+byte*       g_pbyPage[256];
+byte        g_byPortIn[256];
+byte        g_byPortOut[256];
+BusHandler  g_pfnHandler[BUS_HANDLERS];
+const char* g_pszHandler[BUS_HANDLERS];
+int         g_nHandlers;
+
+//-----------------------------------------------------------------------------
+// returns the index of the handler, adding it to g_pfnHandler[] if needed
+int BusAddHandler(BusHandler pfn, const char* pszName)
+{
+    int i;
+
+    if (pfn == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 1; i < g_nHandlers; ++i)
+    {
+        if (g_pfnHandler[i] == pfn)
+        {
+            return i;
+        }
+    }
+
+    if (g_nHandlers >= BUS_HANDLERS)
+    {
+        return -1;
+    }
+
+    g_pfnHandler[g_nHandlers] = pfn;
+    g_pszHandler[g_nHandlers] = pszName;
+
+    return g_nHandlers++;
 }
 
 //-----------------------------------------------------------------------------
-void __not_in_flash_func(ServicePortOut)(word addr)
+static int BusGetPoolIndex(byte* pby)
 {
-    byte data;
+    int i;
 
-    if (get_gpio(OUT_PIN))
+    for (i = 0; i < BUS_PAGE_TABLES; ++i)
     {
-        return;
+        if (pby == g_byPagePool[i])
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+static void BusReleasePage(byte* pby)
+{
+    int i = BusGetPoolIndex(pby);
+
+    if ((i >= 0) && (g_nPoolRefs[i] > 0))
+    {
+        --g_nPoolRefs[i];
     }
+}
 
-    addr = addr & 0xFF;
+//-----------------------------------------------------------------------------
+static int BusAllocPage(byte byUniform)
+{
+    int i;
 
-    if ((addr < 0xC0) || (addr > 0xCF) || (g_byEnableVhd == 0))
+    for (i = 0; i < BUS_PAGE_TABLES; ++i)
     {
+        if (g_nPoolRefs[i] == 0)
+        {
+            g_nPoolRefs[i]     = 1;
+            g_byPoolUniform[i] = byUniform;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+// maps a whole page to one handler, sharing the table with other pages
+static bool BusMapPage(int nPage, byte byId)
+{
+    byte* pbyOld = g_pbyPage[nPage];
+    int i;
+
+    if (byId == 0)
+    {
+        g_pbyPage[nPage] = g_byNullPage;
+        BusReleasePage(pbyOld);
+        return true;
+    }
+
+    for (i = 0; i < BUS_PAGE_TABLES; ++i)
+    {
+        if ((g_nPoolRefs[i] > 0) && (g_byPoolUniform[i] == byId))
+        {
+            if (pbyOld != g_byPagePool[i])
+            {
+                ++g_nPoolRefs[i];
+                g_pbyPage[nPage] = g_byPagePool[i];
+                BusReleasePage(pbyOld);
+            }
+
+            return true;
+        }
+    }
+
+    i = BusAllocPage(byId);
+
+    if (i < 0)
+    {
+        return false;
+    }
+
+    memset(g_byPagePool[i], byId, sizeof(g_byPagePool[i]));
+    g_pbyPage[nPage] = g_byPagePool[i];
+    BusReleasePage(pbyOld);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// makes sure the page has a table of its own, that can be changed per address
+static byte* BusGetPrivatePage(int nPage)
+{
+    byte* pbyOld = g_pbyPage[nPage];
+    int i;
+
+    i = BusGetPoolIndex(pbyOld);
+
+    if ((i >= 0) && (g_byPoolUniform[i] == 0))
+    {
+        return pbyOld;
+    }
+
+    i = BusAllocPage(0);
+
+    if (i < 0)
+    {
+        return NULL;
+    }
+
+    memcpy(g_byPagePool[i], pbyOld, sizeof(g_byPagePool[i]));
+    g_pbyPage[nPage] = g_byPagePool[i];
+    BusReleasePage(pbyOld);
+
+    return g_byPagePool[i];
+}
+
+//-----------------------------------------------------------------------------
+// maps wStart to wStop (inclusive) to pfn, NULL unmaps the range.  Returns
+// false if there are no page tables or handler slots left.
+bool BusMapMemory(word wStart, word wStop, BusHandler pfn)
+{
+    byte* pby;
+    int   nId, nPage, nFirst, nLast, i;
+
+    nId = BusAddHandler(pfn, "?");
+
+    if (nId < 0)
+    {
+        return false;
+    }
+
+    for (nPage = wStart >> 8; nPage <= (wStop >> 8); ++nPage)
+    {
+        nFirst = (nPage == (wStart >> 8)) ? (wStart & 0xFF) : 0;
+        nLast  = (nPage == (wStop >> 8))  ? (wStop & 0xFF)  : 0xFF;
+
+        if ((nFirst == 0) && (nLast == 0xFF))
+        {
+            if (!BusMapPage(nPage, nId))
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        pby = BusGetPrivatePage(nPage);
+
+        if (pby == NULL)
+        {
+            return false;
+        }
+
+        for (i = nFirst; i <= nLast; ++i)
+        {
+            pby[i] = nId;
+        }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool BusMapPorts(byte byStart, byte byStop, BusHandler pfnIn, BusHandler pfnOut)
+{
+    int nIn, nOut, i;
+
+    nIn  = BusAddHandler(pfnIn, "?");
+    nOut = BusAddHandler(pfnOut, "?");
+
+    if ((nIn < 0) || (nOut < 0))
+    {
+        return false;
+    }
+
+    for (i = byStart; i <= byStop; ++i)
+    {
+        g_byPortIn[i]  = nIn;
+        g_byPortOut[i] = nOut;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// the upper 32K the Pico provides to the Z80, NULL if the range is not all in
+// it or the memory is disabled (MEM=0)
+byte* BusGetHighMemory(word wStart, int nSize)
+{
+    if (!g_byEnableUpperMem || (wStart < 0x8000) || (nSize < 0) || ((int)wStart + nSize > 0x10000))
+    {
+        return NULL;
+    }
+
+    return &by_memory[wStart-0x8000];
+}
+
+//-----------------------------------------------------------------------------
+// copies the upper 32K to pbyDest while the Z80 keeps running.  Each pass
+// copies the pages written since their last copy, clearing a page's flag
+// before copying it.  core1 sets the flag after the byte is stored, so a
+// write the copy may have missed always leaves its page flagged for the next
+// pass, and once a pass finds no page written the copy is the memory as it
+// was when that pass began.
+// Returns the number of passes, -1 if the memory kept changing.
+int BusCopyHighMemory(byte* pbyDest)
+{
+    int nPass, nCopied, i;
+
+    memset((void*)g_byMemDirty, true, sizeof(g_byMemDirty));
+
+    for (nPass = 1; nPass <= 16; ++nPass)
+    {
+        nCopied = 0;
+
+        for (i = 0; i < sizeof(g_byMemDirty); ++i)
+        {
+            if (g_byMemDirty[i])
+            {
+                g_byMemDirty[i] = false;
+                __dmb();
+                memcpy(pbyDest + i * 256, &by_memory[i * 256], 256);
+                ++nCopied;
+            }
+        }
+
+        __dmb();
+
+        if (nCopied == 0)
+        {
+            return nPass;
+        }
+    }
+
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+// replaces the upper 32K in one go
+void BusLoadHighMemory(byte* pbySrc)
+{
+    memcpy(by_memory, pbySrc, sizeof(by_memory));
+}
+
+//-----------------------------------------------------------------------------
+// default map, from the system.cfg settings
+void BusMapInit(void)
+{
+    int i;
+
+    memset(g_nPoolRefs, 0, sizeof(g_nPoolRefs));
+    memset(g_byPortIn, 0, sizeof(g_byPortIn));
+    memset(g_byPortOut, 0, sizeof(g_byPortOut));
+    memset(g_pfnHandler, 0, sizeof(g_pfnHandler));
+
+    for (i = 0; i < 256; ++i)
+    {
+        g_pbyPage[i] = g_byNullPage;
+    }
+
+    g_nHandlers = 1;
+    BusAddHandler(ServiceFdcRequestOperation, "REQUEST");
+    BusAddHandler(ServiceFdcResponseOperation, "RESPONSE");
+    BusAddHandler(ServiceFdcWindowOperation, "WINDOW");
+    BusAddHandler(ServiceFdcDriveSelectOperation, "DRVSEL");
+    BusAddHandler(ServiceFdcCmdStatusOperation, "CMD/STA");
+    BusAddHandler(ServiceFdcTrackOperation, "TRACK");
+    BusAddHandler(ServiceFdcSectorOperation, "SECTOR");
+    BusAddHandler(ServiceFdcDataOperation, "DATA");
+    BusAddHandler(ServiceHighMemoryOperation, "MEMORY");
+    BusAddHandler(ServicePortIn, "PORT IN");
+    BusAddHandler(ServicePortOut, "PORT OUT");
+    BusAddHandler(ServiceRamDiskIn, "RAMDISK IN");
+    BusAddHandler(ServiceRamDiskOut, "RAMDISK OUT");
+
+    BusMapMemory(FDC_REQUEST_ADDR_START, FDC_REQUEST_ADDR_STOP, ServiceFdcRequestOperation);
+    BusMapMemory(FDC_RESPONSE_ADDR_START, FDC_RESPONSE_ADDR_STOP, ServiceFdcResponseOperation);
+    BusMapMemory(FDC_WINDOW_ADDR_START, FDC_WINDOW_ADDR_STOP, ServiceFdcWindowOperation);
+    BusMapMemory(0x37E0, 0x37E3, ServiceFdcDriveSelectOperation);
+    BusMapMemory(0x37EC, 0x37EC, ServiceFdcCmdStatusOperation);
+    BusMapMemory(0x37ED, 0x37ED, ServiceFdcTrackOperation);
+    BusMapMemory(0x37EE, 0x37EE, ServiceFdcSectorOperation);
+    BusMapMemory(0x37EF, 0x37EF, ServiceFdcDataOperation);
+
+    if (g_byEnableUpperMem)
+    {
+        BusMapMemory(0x8000, 0xFFFF, ServiceHighMemoryOperation);
+    }
+
+    if (g_byEnableVhd)
+    {
+        BusMapPorts(0xC0, 0xCF, ServicePortIn, ServicePortOut);
+    }
+
+    if (g_byRamDiskBanks)
+    {
+        BusMapPorts(RAMDISK_PORT_FIRST, RAMDISK_PORT_LAST, ServiceRamDiskIn, ServiceRamDiskOut);
+    }
+
+    BusClearStats();
+}
+
+//-----------------------------------------------------------------------------
+// Latency statistics
+//
+// For every cycle that is dispatched the number of core1 clock cycles from
+// the strobe being seen to the data being put on the bus (reads), or to the
+// handler returning (writes), is recorded per handler, measured with the
+// core1 SysTick counter.  With ENABLE_PIO_BUS core1 sees the strobe when it
+// takes the event from the state machine, the time bus.pio takes to push it
+// is not included.  Only core1 writes the statistics, a clear request from
+// core0 is carried out by core1 before the next cycle is recorded.
+
+BusStatType        g_bsStats[BUS_HANDLERS];
+volatile byte      g_byClearStats;
+
+//-----------------------------------------------------------------------------
+void BusClearStats(void)
+{
+    g_byClearStats = true;
+}
+
+//-----------------------------------------------------------------------------
+// one line per handler that has been used: id, name, count, min and max cycles
+void BusFormatStats(char* psz, int nMaxLen, char* pszLineEnd)
+{
+    char szLine[48];
+    int  i;
+
+    snprintf(psz, nMaxLen, "ID HANDLER      COUNT   MIN   MAX%s", pszLineEnd);
+
+    for (i = 1; i < g_nHandlers; ++i)
+    {
+        if (g_bsStats[i].dwCount == 0)
+        {
+            continue;
+        }
+
+        snprintf(szLine, sizeof(szLine), "%2d %-8s%10lu%6lu%6lu%s", i, g_pszHandler[i], g_bsStats[i].dwCount, g_bsStats[i].dwMin, g_bsStats[i].dwMax, pszLineEnd);
+
+        if (strlen(psz) + strlen(szLine) >= nMaxLen)
+        {
+            break;
+        }
+
+        strcat(psz, szLine);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// the histogram of one handler, a line per bucket with the fewest cycles that
+// fall in it and the number of bus cycles that did
+void BusFormatHistogram(int nId, char* psz, int nMaxLen, char* pszLineEnd)
+{
+    char szLine[32];
+    int  i;
+
+    if ((nId < 1) || (nId >= g_nHandlers))
+    {
+        snprintf(psz, nMaxLen, "No handler %d%s", nId, pszLineEnd);
         return;
     }
 
-    clr_gpio(DATAB_OE_PIN);
-    NopDelay();
-    data = get_gpio_data_byte();
-    set_gpio(DATAB_OE_PIN);
+    snprintf(psz, nMaxLen, "%s CYCLES%s", g_pszHandler[nId], pszLineEnd);
+
+    for (i = 0; i < BUS_STAT_BUCKETS; ++i)
+    {
+        snprintf(szLine, sizeof(szLine), "%5d%s%10lu%s", i ? (1 << i) : 0, (i == BUS_STAT_BUCKETS-1) ? "+" : " ", g_bsStats[nId].dwHist[i], pszLineEnd);
+
+        if (strlen(psz) + strlen(szLine) >= nMaxLen)
+        {
+            break;
+        }
 
-    hdc_port_out(addr, data);
+        strcat(psz, szLine);
+    }
+}
+
+//-----------------------------------------------------------------------------
+void __not_in_flash_func(BusRecordStat)(int nId, uint32_t dwCycles)
+{
+    BusStatType* pbs;
+    volatile uint32_t* pdw;
+    int nBucket, i;
+
+    // not memset(), core1 must not call into flash while it is being programmed
+    if (g_byClearStats)
+    {
+        pdw = (volatile uint32_t*)g_bsStats;
+
+        for (i = 0; i < BUS_HANDLERS * (int)(sizeof(BusStatType) / sizeof(uint32_t)); ++i)
+        {
+            pdw[i] = 0;
+        }
+
+        g_byClearStats = false;
+    }
+
+    pbs = &g_bsStats[nId];
+
+    if ((pbs->dwCount == 0) || (dwCycles < pbs->dwMin))
+    {
+        pbs->dwMin = dwCycles;
+    }
+
+    if (dwCycles > pbs->dwMax)
+    {
+        pbs->dwMax = dwCycles;
+    }
+
+    nBucket = 31 - __builtin_clz(dwCycles | 1);
+
+    if (nBucket >= BUS_STAT_BUCKETS)
+    {
+        nBucket = BUS_STAT_BUCKETS - 1;
+    }
+
+    ++pbs->dwHist[nBucket];
+    ++pbs->dwCount;
 }
 
+//-----------------------------------------------------------------------------
+// calls the handler of a cycle that is for us and records its latency, start
+// is the SysTick count when the strobe was seen
+static inline void __not_in_flash_func(BusDispatch)(int id, word addr, uint32_t start)
+{
+    g_dwDataValid = start;
+    g_pfnHandler[id](addr);
+
+    if (g_dwDataValid == start) // not a read, time to the end of the handler
+    {
+        g_dwDataValid = systick_hw->cvr;
+    }
+
+    BusRecordStat(id, (start - g_dwDataValid) & 0x00FFFFFF);
+}
+
+#if ENABLE_PIO_BUS
+
+//-----------------------------------------------------------------------------
+void PioBusInit(void)
+{
+    pio_sm_config c;
+    uint i;
+
+    g_nBusOffset = pio_add_program_at_offset(BUS_PIO, &z80_bus_program, 0);
+    g_nBusSm     = pio_claim_unused_sm(BUS_PIO, true);
+
+    // transceiver enables inactive (high), A to B direction
+    pio_sm_set_pins_with_mask(BUS_PIO, g_nBusSm, (7u << ADDRL_OE_PIN) | (1u << DIR_PIN), (7u << ADDRL_OE_PIN) | (1u << DIR_PIN));
+    pio_sm_set_pindirs_with_mask(BUS_PIO, g_nBusSm, (7u << ADDRL_OE_PIN) | (1u << DIR_PIN), (7u << ADDRL_OE_PIN) | (1u << DIR_PIN) | (0xFFu << D0_PIN));
+
+    c = z80_bus_program_get_default_config(g_nBusOffset);
+    sm_config_set_in_pins(&c, IN_PIN);
+    sm_config_set_out_pins(&c, D0_PIN, 8);
+    sm_config_set_set_pins(&c, DIR_PIN, 1);
+    sm_config_set_sideset_pins(&c, ADDRL_OE_PIN);
+    sm_config_set_jmp_pin(&c, WR_PIN);
+    sm_config_set_in_shift(&c, false, false, 32);
+    sm_config_set_out_shift(&c, true, false, 32);
+    sm_config_set_clkdiv(&c, 1.0f);
+
+    // an exec'd instruction applies its side-set like any other, the jmp
+    // pio_sm_init() execs has 0 there and enables all three transceivers at
+    // once, so the pins are only handed to the PIO after it, and y is set with
+    // the enables kept inactive
+    pio_sm_init(BUS_PIO, g_nBusSm, g_nBusOffset + z80_bus_offset_wait_end, &c);
+    pio_sm_exec(BUS_PIO, g_nBusSm, pio_encode_set(pio_y, 31) | pio_encode_sideset(3, 0b111));
+
+    for (i = ADDRL_OE_PIN; i <= ADDRH_OE_PIN; ++i)
+    {
+        pio_gpio_init(BUS_PIO, i);
+    }
+
+    for (i = D0_PIN; i <= D7_PIN; ++i)
+    {
+        pio_gpio_init(BUS_PIO, i);
+    }
+
+    pio_gpio_init(BUS_PIO, DIR_PIN);
+
+    pio_sm_set_enabled(BUS_PIO, g_nBusSm, true);
+}
+
+//-----------------------------------------------------------------------------
+// answers the next event of the state machine, false if there is none.  Every
+// event must be answered as the state machine holds the cycle until it is.
+bool __not_in_flash_func(PioBusService)(void)
+{
+    uint32_t event;
+    uint32_t start;
+    word     addr;
+    byte     bus;
+    int      id;
+
+    if (g_bBusEvent)
+    {
+        event       = g_dwBusEvent;
+        g_bBusEvent = false;
+    }
+    else if (pio_sm_is_rx_fifo_empty(BUS_PIO, g_nBusSm))
+    {
+        return false;
+    }
+    else
+    {
+        event = pio_sm_get(BUS_PIO, g_nBusSm);
+    }
+
+    start = systick_hw->cvr;
+    bus   = event & 0x1F;
+    addr  = ((event >> 18) & 0xFF) | (((event >> 5) & 0xFF) << 8);
+
+    // RD and WR can both lag MREQ, so a memory cycle is only known to be
+    // a read or a write once one of them is active.  A refresh cycle has
+    // neither and ends with MREQ going inactive.
+    while ((bus & 0x16) == 0x06)
+    {
+        bus = get_gpio_read_bus() & 0x1F;
+    }
+
+    if (g_byEnableWaitStates == eWaitAlways)
+    {
+        set_gpio(WAIT_PIN);
+    }
+
+    if (g_byEnableIntr)
+    {
+        g_byEnableIntr = false;
+    	set_gpio(INT_PIN); // activate intr
+    }
+
+    // ports are decoded on the low address byte alone, a memory cycle that
+    // ended without RD or WR is a refresh and not for us
+    if ((bus & 0x09) != 0x09)
+    {
+        addr = addr & 0xFF;
+        id   = (bus & 0x01) ? g_byPortOut[addr] : g_byPortIn[addr];
+    }
+    else if (!(bus & 0x10))
+    {
+        id = g_pbyPage[addr >> 8][addr & 0xFF];
+    }
+    else
+    {
+        id = 0;
+    }
+
+    if (id != 0)
+    {
+        BusDispatch(id, addr, start);
+    }
+    else
+    {
+        PioBusRespond(z80_bus_offset_wait_end, 0);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// core1 loop when the state machine runs the bus
+void __not_in_flash_func(service_memory_pio)(void)
+{
+    while (1)
+    {
+        while (!get_gpio(SYSRES_PIN))
+        {
+           	g_byResetActive = true;
+        }
+
+        if (g_byResetActive)
+        {
+            g_dwResetRelease = time_us_32();
+           	g_byResetActive  = false;
+        }
+
+        PioBusService();
+    }
+}
+
+#endif
+
 //-----------------------------------------------------------------------------
 void __not_in_flash_func(service_memory)(void)
 {
     register word bus;
     register word addr;
+    uint32_t      start;
+    int           id;
 
-    // systick_hw->csr = 0x5;
-    // systick_hw->rvr = 0x00FFFFFF;
+    // SysTick as a free running 24 bit down counter of core1 clock cycles
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;
+
+#if ENABLE_PIO_BUS
+    PioBusInit();
+    service_memory_pio();
+#endif
 
     while (1)
     {
@@ -350,7 +1115,11 @@ void __not_in_flash_func(service_memory)(void)
            	g_byResetActive = true;
         }
 
-       	g_byResetActive = false;
+        if (g_byResetActive)
+        {
+            g_dwResetRelease = time_us_32();
+           	g_byResetActive  = false;
+        }
 
         // wait for MREQ, IN, RD, WR and OUT to go inactive
         do {
@@ -373,7 +1142,9 @@ void __not_in_flash_func(service_memory)(void)
             bus = get_gpio_read_bus();
         } while ((bus & 0x1F) == 0x1F);
 
-        if (g_byEnableWaitStates)
+        start = systick_hw->cvr;
+
+        if (g_byEnableWaitStates == eWaitAlways)
         {
             set_gpio(WAIT_PIN);
         }
@@ -386,76 +1157,30 @@ void __not_in_flash_func(service_memory)(void)
         set_gpio(WAIT_PIN);
 #endif
 
-        // start = systick_hw->cvr;
-
         if (g_byEnableIntr)
         {
             g_byEnableIntr = false;
         	set_gpio(INT_PIN); // activate intr
         }
 
-        // read high address byte
-        addr = addr + ((get_gpio_data_byte() & 0xFF) << 8);
-        set_gpio(ADDRH_OE_PIN);
-
-        if (!(bus & 0x01))
-        {
-            ServicePortIn(addr);
-        }
-        else if (!(bus & 0x08))
-        {
-            ServicePortOut(addr);
-        }
-        else if (addr >= 0x8000)
+        // ports are decoded on the low address byte alone
+        if ((bus & 0x09) != 0x09)
         {
-            if (g_byEnableUpperMem)
-            {
-                ServiceHighMemoryOperation(addr);
-            }
+            set_gpio(ADDRH_OE_PIN);
+            id = (bus & 0x01) ? g_byPortOut[addr] : g_byPortIn[addr];
         }
         else
         {
-            switch (addr)
-            {
-                case 0x37E0:
-                case 0x37E1:
-                case 0x37E2:
-                case 0x37E3:
-                    ServiceFdcDriveSelectOperation();
-                    break;
-
-                case 0x37EC:
-                    ServiceFdcCmdStatusOperation();
-                    break;
-
-                case 0x37ED:
-                    ServiceFdcTrackOperation();
-                    break;
-
-                case 0x37EE:
-                    ServiceFdcSectorOperation();
-                    break;
-
-                case 0x37EF:
-                    set_gpio(WAIT_PIN);
-                    ServiceFdcDataOperation();
-                    break;
-
-                default:
-                    if ((addr >= FDC_REQUEST_ADDR_START) && (addr <= FDC_REQUEST_ADDR_STOP))
-                    {
-                        ServiceFdcRequestOperation(addr);
-                    }
-                    else if ((addr >= FDC_RESPONSE_ADDR_START) && (addr <= FDC_RESPONSE_ADDR_STOP))
-                    {
-                        ServiceFdcResponseOperation(addr);
-                    }
-
-                    break;
-            }
+            // read high address byte
+            addr = addr + ((get_gpio_data_byte() & 0xFF) << 8);
+            set_gpio(ADDRH_OE_PIN);
+
+            id = g_pbyPage[addr >> 8][addr & 0xFF];
         }
 
-        // end = systick_hw->cvr;
-        // duration = (start & 0x00FFFFFF) - (end & 0x00FFFFFF);
+        if (id != 0)
+        {
+            BusDispatch(id, addr, start);
+        }
     }
 }
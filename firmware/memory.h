@@ -1,2 +1,37 @@
 
+typedef void (*BusHandler)(word addr);
+
+#define BUS_HANDLERS     16
+#define BUS_STAT_BUCKETS 12		// log2 of the cycle count, the last one is 2048 and up
+
+typedef struct {
+	uint32_t dwCount;
+	uint32_t dwMin;
+	uint32_t dwMax;
+	uint32_t dwHist[BUS_STAT_BUCKETS];
+} BusStatType;
+
+extern byte*       g_pbyPage[256];
+extern byte        g_byPortIn[256];
+extern byte        g_byPortOut[256];
+extern BusHandler  g_pfnHandler[BUS_HANDLERS];
+extern const char* g_pszHandler[BUS_HANDLERS];
+extern int         g_nHandlers;
+extern BusStatType g_bsStats[BUS_HANDLERS];
+
 void __not_in_flash_func(service_memory)(void);
+void BusMapInit(void);
+int  BusAddHandler(BusHandler pfn, const char* pszName);
+bool BusMapMemory(word wStart, word wStop, BusHandler pfn);
+bool BusMapPorts(byte byStart, byte byStop, BusHandler pfnIn, BusHandler pfnOut);
+byte* BusGetHighMemory(word wStart, int nSize);
+int  BusCopyHighMemory(byte* pbyDest);
+void BusLoadHighMemory(byte* pbySrc);
+void BusClearStats(void);
+void BusFormatStats(char* psz, int nMaxLen, char* pszLineEnd);
+void BusFormatHistogram(int nId, char* psz, int nMaxLen, char* pszLineEnd);
+
+#if ENABLE_PIO_BUS
+void PioBusInit(void);
+bool __not_in_flash_func(PioBusService)(void);
+#endif
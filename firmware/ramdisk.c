@@ -0,0 +1,247 @@
+#include <string.h>
+
+#ifndef MFC
+	#include "pico/stdlib.h"
+#endif
+
+#include "defines.h"
+#include "file.h"
+#include "ramdisk.h"
+
+//-----------------------------------------------------------------------------
+// RAM disk.
+//
+// core1 serves the ports straight from g_byRamDisk, the position (offset,
+// sector and bank) is one counter so the data port only has to step it.  The
+// image file is read and written by core0 when the Z80 asks for it through
+// the command port, and read when the Floppy80 starts.  A disk written since
+// it was last saved or loaded is saved again before a reset.
+
+volatile byte g_byRamDiskBanks;
+char          g_szRamDiskImage[64];
+
+static byte              g_byRamDisk[RAMDISK_MAX_BANKS * RAMDISK_BANK_SIZE];
+static volatile uint32_t g_dwRamPos;		// bank << 16 | sector << 8 | offset
+static volatile uint32_t g_dwRamSize;
+static volatile byte     g_byRamRequest;	// eRamSave ...
+static volatile byte     g_byRamStatus;
+static volatile byte     g_byRamDirty;		// written since the last save or load
+
+//-----------------------------------------------------------------------------
+void __not_in_flash_func(ramdisk_port_out)(word addr, byte data)
+{
+	switch (addr & 0xFF)
+	{
+		case 0xD0: // data
+			if (g_dwRamPos < g_dwRamSize)
+			{
+				g_byRamDisk[g_dwRamPos] = data;
+				g_byRamDirty = true;
+			}
+
+			g_dwRamPos = (g_dwRamPos + 1) & 0xFFFFFF;
+			break;
+
+		case 0xD1: // offset
+			g_dwRamPos = (g_dwRamPos & 0xFFFF00) | data;
+			break;
+
+		case 0xD2: // sector
+			g_dwRamPos = (g_dwRamPos & 0xFF0000) | (data << 8);
+			break;
+
+		case 0xD3: // bank
+			g_dwRamPos = data << 16;
+			break;
+
+		case 0xD5: // command
+			if (!(g_byRamStatus & RAMDISK_BUSY) && ((data == eRamSave) || (data == eRamLoad)))
+			{
+				g_byRamStatus  = RAMDISK_BUSY;
+				g_byRamRequest = data;
+			}
+
+			break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+byte __not_in_flash_func(ramdisk_port_in)(word addr)
+{
+	byte data = 0xFF;
+
+	switch (addr & 0xFF)
+	{
+		case 0xD0: // data
+			if (g_dwRamPos < g_dwRamSize)
+			{
+				data = g_byRamDisk[g_dwRamPos];
+			}
+
+			g_dwRamPos = (g_dwRamPos + 1) & 0xFFFFFF;
+			break;
+
+		case 0xD1: // offset
+			data = g_dwRamPos & 0xFF;
+			break;
+
+		case 0xD2: // sector
+			data = (g_dwRamPos >> 8) & 0xFF;
+			break;
+
+		case 0xD3: // bank
+			data = (g_dwRamPos >> 16) & 0xFF;
+			break;
+
+		case 0xD4: // size
+			data = g_byRamDiskBanks;
+			break;
+
+		case 0xD5: // status
+			data = g_byRamStatus;
+			break;
+	}
+
+	return data;
+}
+
+//-----------------------------------------------------------------------------
+// writes the RAM disk to its image file, returns false if it could not
+int RamDiskSave(void)
+{
+	uint32_t dwSize = g_byRamDiskBanks * RAMDISK_BANK_SIZE;
+	file*    f;
+	int      bOk;
+
+	if ((dwSize == 0) || (g_szRamDiskImage[0] == 0))
+	{
+		return false;
+	}
+
+	f = FileOpen(g_szRamDiskImage, FA_WRITE | FA_CREATE_ALWAYS);
+
+	if (f == NULL)
+	{
+		return false;
+	}
+
+	// cleared first, so a write during the save marks the disk again
+	g_byRamDirty = false;
+
+	bOk = (FileWrite(f, g_byRamDisk, dwSize) == dwSize);
+	FileClose(f);
+
+	if (!bOk)
+	{
+		g_byRamDirty = true;
+	}
+
+	return bOk;
+}
+
+//-----------------------------------------------------------------------------
+// reads the image file into the RAM disk, a shorter file leaves the rest of
+// the disk empty
+int RamDiskLoad(void)
+{
+	uint32_t dwSize = g_byRamDiskBanks * RAMDISK_BANK_SIZE;
+	uint32_t dwRead;
+	file*    f;
+
+	memset(g_byRamDisk, 0, dwSize);
+	g_byRamDirty = false;
+
+	if ((dwSize == 0) || (g_szRamDiskImage[0] == 0))
+	{
+		return false;
+	}
+
+	f = FileOpen(g_szRamDiskImage, FA_READ);
+
+	if (f == NULL)
+	{
+		return false;
+	}
+
+	dwRead = FileRead(f, g_byRamDisk, dwSize);
+	FileClose(f);
+
+	return dwRead > 0;
+}
+
+//-----------------------------------------------------------------------------
+// the banks RAMDISK= leaves unused, the track cache takes them over
+byte* RamDiskSpare(uint32_t* pdwSize)
+{
+	if (g_byRamDiskBanks > RAMDISK_MAX_BANKS)
+	{
+		g_byRamDiskBanks = RAMDISK_MAX_BANKS;
+	}
+
+	*pdwSize = (RAMDISK_MAX_BANKS - g_byRamDiskBanks) * RAMDISK_BANK_SIZE;
+	return g_byRamDisk + g_byRamDiskBanks * RAMDISK_BANK_SIZE;
+}
+
+//-----------------------------------------------------------------------------
+// the number of banks has already been limited by RamDiskSpare() when the
+// track cache was set up
+void RamDiskInit(void)
+{
+	g_dwRamSize    = g_byRamDiskBanks * RAMDISK_BANK_SIZE;
+	g_dwRamPos     = 0;
+	g_byRamRequest = eRamNone;
+	g_byRamStatus  = 0;
+	g_byRamDirty   = false;
+
+	RamDiskLoad();
+}
+
+//-----------------------------------------------------------------------------
+// saves the disk now if it has been written since the last save or load, for
+// a cold reset which reads system.cfg and the image again
+void RamDiskFlush(void)
+{
+	if (g_byRamDirty && (g_szRamDiskImage[0] != 0))
+	{
+		RamDiskSave();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// a warm reset keeps the disk in memory but queues a save, core0 carries it
+// out from RamDiskService() and the Z80 sees the busy bit until it is done
+void RamDiskReset(void)
+{
+	g_dwRamPos = 0;
+
+	// without RAMIMG= there is nothing to save to
+	if (g_byRamDirty && (g_szRamDiskImage[0] != 0) && (g_byRamRequest == eRamNone))
+	{
+		g_byRamStatus  = RAMDISK_BUSY;
+		g_byRamRequest = eRamSave;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// carries out a command written to the command port
+void RamDiskService(void)
+{
+	int bOk;
+
+	switch (g_byRamRequest)
+	{
+		case eRamSave:
+			bOk = RamDiskSave();
+			break;
+
+		case eRamLoad:
+			bOk = RamDiskLoad();
+			break;
+
+		default:
+			return;
+	}
+
+	g_byRamRequest = eRamNone;
+	g_byRamStatus  = bOk ? 0 : RAMDISK_FAILED;
+}
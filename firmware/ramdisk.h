@@ -0,0 +1,44 @@
+#ifndef _H_RAMDISK_
+#define _H_RAMDISK_
+
+#include "defines.h"
+
+// RAM disk in Pico SRAM, on the ports after the hard disk ones.  The disk is
+// addressed as banks of 256 sectors of 256 bytes.
+//
+//   D0 - data, reads and writes step to the next byte (and sector and bank)
+//   D1 - byte offset in the sector
+//   D2 - sector in the bank, writing it clears the offset
+//   D3 - bank, writing it clears the sector and offset
+//   D4 - number of banks (read only)
+//   D5 - command: 1 save the image file, 2 reload it.  status: bit 0 busy,
+//        bit 1 the last command failed
+
+#define RAMDISK_PORT_FIRST 0xD0
+#define RAMDISK_PORT_LAST  0xD5
+#define RAMDISK_BANK_SIZE  0x10000
+#define RAMDISK_MAX_BANKS  2
+
+#define RAMDISK_BUSY       0x01
+#define RAMDISK_FAILED     0x02
+
+enum {
+	eRamNone = 0,
+	eRamSave,
+	eRamLoad,
+};
+
+extern volatile byte g_byRamDiskBanks;		// RAMDISK= in system.cfg, 0 => off
+extern char          g_szRamDiskImage[64];	// RAMIMG= in system.cfg
+
+byte* RamDiskSpare(uint32_t* pdwSize);
+void  RamDiskInit(void);
+void RamDiskService(void);
+void RamDiskFlush(void);
+void RamDiskReset(void);
+int  RamDiskSave(void);
+int  RamDiskLoad(void);
+void ramdisk_port_out(word addr, byte data);
+byte ramdisk_port_in(word addr);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef _H_RING_
+#define _H_RING_
+
+#include "defines.h"
+
+#ifdef MFC
+	#define __dmb()
+#else
+	#include "hardware/sync.h"
+#endif
+
+// single producer (core1) / single consumer (core0) ring of 32 bit entries.
+// The head is only written by the producer and the tail only by the consumer,
+// both run freely and are masked on use so the size must be a power of 2.
+// A full ring drops the new entry and counts it rather than overwriting
+// entries the consumer has not read yet.
+
+typedef struct {
+	volatile uint32_t nHead;		// next entry to write
+	volatile uint32_t nTail;		// next entry to read
+	volatile uint32_t dwDropped;	// entries lost to a full ring
+	uint32_t  nMask;				// size - 1
+	uint32_t* pdwData;
+} RingType;
+
+#define RING_INIT(data) {0, 0, 0, SizeOfArray(data)-1, data}
+
+//-----------------------------------------------------------------------------
+// producer side
+static inline bool RingPut(RingType* prb, uint32_t dwEntry)
+{
+	uint32_t nHead = prb->nHead;
+
+	if (nHead - prb->nTail > prb->nMask)
+	{
+		++prb->dwDropped;
+		return false;
+	}
+
+	prb->pdwData[nHead & prb->nMask] = dwEntry;
+	__dmb();	// entry visible before the head moves over it
+	prb->nHead = nHead + 1;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// consumer side, returns the oldest entry without removing it
+static inline bool RingPeek(RingType* prb, uint32_t* pdwEntry)
+{
+	uint32_t nTail = prb->nTail;
+
+	if (nTail == prb->nHead)
+	{
+		return false;
+	}
+
+	__dmb();	// head read before the entry
+	*pdwEntry = prb->pdwData[nTail & prb->nMask];
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// consumer side, removes the oldest entry
+static inline void RingSkip(RingType* prb)
+{
+	__dmb();	// entry read before the slot is handed back
+	prb->nTail = prb->nTail + 1;
+}
+
+//-----------------------------------------------------------------------------
+static inline bool RingGet(RingType* prb, uint32_t* pdwEntry)
+{
+	if (!RingPeek(prb, pdwEntry))
+	{
+		return false;
+	}
+
+	RingSkip(prb);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// consumer side, discards everything written so far
+static inline void RingFlush(RingType* prb)
+{
+	prb->nTail = prb->nHead;
+}
+
+//-----------------------------------------------------------------------------
+static inline uint32_t RingCount(RingType* prb)
+{
+	return prb->nHead - prb->nTail;
+}
+
+#endif
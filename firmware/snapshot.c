@@ -0,0 +1,266 @@
+#include <string.h>
+
+#ifndef MFC
+	#include "pico/stdlib.h"
+#endif
+
+#include "defines.h"
+#include "file.h"
+#include "memory.h"
+#include "snapshot.h"
+
+//-----------------------------------------------------------------------------
+// Upper memory snapshots.
+//
+// The memory is copied to g_bySnapMem while the Z80 keeps running (see
+// BusCopyHighMemory()) and written to the SD-Card from there, so core1 is not
+// held up.  The run length encoding is a byte n then, for n < 80h, n+1 bytes
+// as they are or, for n >= 80h, one byte repeated n-7Dh (3 to 130) times.
+
+static BYTE g_bySnapMem[SNAP_MEM_SIZE];
+static BYTE g_bySnapOut[512];
+static int  g_nSnapOut;
+
+//-----------------------------------------------------------------------------
+const char* SnapErrorText(int nError)
+{
+	switch (nError)
+	{
+		case eSnapOk:       return "OK";
+		case eSnapNoMemory: return "Upper memory not enabled (MEM=0)";
+		case eSnapBusy:     return "Memory changing too fast to copy";
+		case eSnapFile:     return "SD-Card file error";
+		case eSnapFormat:   return "Not a memory snapshot";
+	}
+
+	return "?";
+}
+
+//-----------------------------------------------------------------------------
+static bool SnapPut(file* f, BYTE* pby, int nSize)
+{
+	while (nSize > 0)
+	{
+		if (g_nSnapOut == sizeof(g_bySnapOut))
+		{
+			if (FileWrite(f, g_bySnapOut, g_nSnapOut) != g_nSnapOut)
+			{
+				return false;
+			}
+
+			g_nSnapOut = 0;
+		}
+
+		g_bySnapOut[g_nSnapOut++] = *pby++;
+		--nSize;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+static bool SnapFlush(file* f)
+{
+	bool bOk = (FileWrite(f, g_bySnapOut, g_nSnapOut) == g_nSnapOut);
+
+	g_nSnapOut = 0;
+	return bOk;
+}
+
+//-----------------------------------------------------------------------------
+static bool SnapCompress(file* f, BYTE* pby, int nSize)
+{
+	BYTE byCode;
+	int  nPos = 0;
+	int  nRun, nLit;
+
+	while (nPos < nSize)
+	{
+		for (nRun = 1; (nPos + nRun < nSize) && (nRun < 130) && (pby[nPos+nRun] == pby[nPos]); ++nRun);
+
+		if (nRun >= 3)
+		{
+			byCode = nRun + 0x7D;
+
+			if (!SnapPut(f, &byCode, 1) || !SnapPut(f, pby + nPos, 1))
+			{
+				return false;
+			}
+
+			nPos += nRun;
+			continue;
+		}
+
+		// bytes as they are, up to the next run of 3
+		for (nLit = 1; (nPos + nLit < nSize) && (nLit < 128); ++nLit)
+		{
+			if ((nPos + nLit + 2 < nSize) && (pby[nPos+nLit] == pby[nPos+nLit+1]) && (pby[nPos+nLit] == pby[nPos+nLit+2]))
+			{
+				break;
+			}
+		}
+
+		byCode = nLit - 1;
+
+		if (!SnapPut(f, &byCode, 1) || !SnapPut(f, pby + nPos, nLit))
+		{
+			return false;
+		}
+
+		nPos += nLit;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+static bool SnapExpand(file* f, BYTE* pby, int nSize)
+{
+	BYTE byCode, byData;
+	int  nPos = 0;
+	int  nCount;
+
+	while (nPos < nSize)
+	{
+		if (FileRead(f, &byCode, 1) != 1)
+		{
+			return false;
+		}
+
+		if (byCode < 0x80)
+		{
+			nCount = byCode + 1;
+
+			if ((nPos + nCount > nSize) || (FileRead(f, pby + nPos, nCount) != nCount))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			nCount = byCode - 0x7D;
+
+			if ((nPos + nCount > nSize) || (FileRead(f, &byData, 1) != 1))
+			{
+				return false;
+			}
+
+			memset(pby + nPos, byData, nCount);
+		}
+
+		nPos += nCount;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// writes the upper 32K to a file, *pdwSize is the size of the file
+int SnapSave(char* pszFile, byte byCompress, uint32_t* pdwSize)
+{
+	BYTE     byHeader[SNAP_HEADER_SIZE];
+	file*    f;
+	bool     bOk;
+	uint32_t dwTime;
+
+	*pdwSize = 0;
+
+	if (BusGetHighMemory(0x8000, SNAP_MEM_SIZE) == NULL)
+	{
+		return eSnapNoMemory;
+	}
+
+	if (BusCopyHighMemory(g_bySnapMem) < 0)
+	{
+		return eSnapBusy;
+	}
+
+	memset(byHeader, 0, sizeof(byHeader));
+	memcpy(byHeader, SNAP_MAGIC, 4);
+	byHeader[4] = SNAP_VERSION;
+	byHeader[5] = byCompress ? SNAP_FLAG_RLE : 0;
+	byHeader[6] = 0x00;		// start address
+	byHeader[7] = 0x80;
+	byHeader[8] = SNAP_MEM_SIZE & 0xFF;
+	byHeader[9] = SNAP_MEM_SIZE >> 8;
+
+	f = FileOpen(pszFile, FA_WRITE | FA_CREATE_ALWAYS);
+
+	if (f == NULL)
+	{
+		return eSnapFile;
+	}
+
+	g_nSnapOut = 0;
+	bOk = SnapPut(f, byHeader, sizeof(byHeader));
+
+	if (byCompress)
+	{
+		bOk = bOk && SnapCompress(f, g_bySnapMem, SNAP_MEM_SIZE);
+	}
+	else
+	{
+		bOk = bOk && SnapPut(f, g_bySnapMem, SNAP_MEM_SIZE);
+	}
+
+	bOk = SnapFlush(f) && bOk;
+	FileClose(f);
+
+	if (!bOk)
+	{
+		return eSnapFile;
+	}
+
+	FileStat(pszFile, pdwSize, &dwTime);
+
+	return eSnapOk;
+}
+
+//-----------------------------------------------------------------------------
+// replaces the upper 32K with the contents of a snapshot file.  The file is
+// read in full before the memory is changed.
+int SnapLoad(char* pszFile)
+{
+	BYTE  byHeader[SNAP_HEADER_SIZE];
+	file* f;
+	bool  bOk;
+
+	if (BusGetHighMemory(0x8000, SNAP_MEM_SIZE) == NULL)
+	{
+		return eSnapNoMemory;
+	}
+
+	f = FileOpen(pszFile, FA_READ);
+
+	if (f == NULL)
+	{
+		return eSnapFile;
+	}
+
+	if ((FileRead(f, byHeader, sizeof(byHeader)) != sizeof(byHeader)) || (memcmp(byHeader, SNAP_MAGIC, 4) != 0) ||
+		(byHeader[4] != SNAP_VERSION) || (byHeader[6] != 0x00) || (byHeader[7] != 0x80) ||
+		(byHeader[8] != (SNAP_MEM_SIZE & 0xFF)) || (byHeader[9] != (SNAP_MEM_SIZE >> 8)))
+	{
+		FileClose(f);
+		return eSnapFormat;
+	}
+
+	if (byHeader[5] & SNAP_FLAG_RLE)
+	{
+		bOk = SnapExpand(f, g_bySnapMem, SNAP_MEM_SIZE);
+	}
+	else
+	{
+		bOk = (FileRead(f, g_bySnapMem, SNAP_MEM_SIZE) == SNAP_MEM_SIZE);
+	}
+
+	FileClose(f);
+
+	if (!bOk)
+	{
+		return eSnapFormat;
+	}
+
+	BusLoadHighMemory(g_bySnapMem);
+	return eSnapOk;
+}
@@ -0,0 +1,26 @@
+#ifndef _H_SNAPSHOT_
+#define _H_SNAPSHOT_
+
+#include "defines.h"
+
+// a snapshot file is a 16 byte header followed by the 32K of the upper memory,
+// run length encoded when the header says so
+#define SNAP_MAGIC       "F80M"
+#define SNAP_VERSION     1
+#define SNAP_HEADER_SIZE 16
+#define SNAP_MEM_SIZE    0x8000
+#define SNAP_FLAG_RLE    0x01
+
+enum {
+	eSnapOk = 0,
+	eSnapNoMemory,		// upper memory disabled (MEM=0)
+	eSnapBusy,			// the memory kept changing while it was copied
+	eSnapFile,			// file could not be opened, read or written
+	eSnapFormat,		// not a snapshot file
+};
+
+int         SnapSave(char* pszFile, byte byCompress, uint32_t* pdwSize);
+int         SnapLoad(char* pszFile);
+const char* SnapErrorText(int nError);
+
+#endif
@@ -2,6 +2,8 @@
 #include "system.h"
 #include "fdc.h"
 #include "hdc.h"
+#include "cache.h"
+#include "ramdisk.h"
 #include "file.h"
 #include "stdlib.h"
 #include "ctype.h"
@@ -38,6 +40,15 @@ static uint64_t g_nPrevTime;
 
 static uint32_t g_nRtcIntrCount;
 
+//-----------------------------------------------------------------------------
+// Z80 reset handling
+
+static byte g_byWarmResetDone;		// latency is measured when the Z80 leaves reset
+
+uint8_t  g_byResetMode;
+uint32_t g_dwResetLatency;
+uint32_t g_dwWarmResetCount;
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void __not_in_flash_func(reset_system)(void)
 {
@@ -62,6 +73,9 @@ void InitVars(void)
 	g_byEnableUpperMem   = true;
 	g_byEnableWaitStates = false;
 	g_dwLedCount         = 0;
+	g_byResetMode        = eWarmReset;
+	g_dwResetLatency     = 0;
+	g_dwWarmResetCount   = 0;
 
 	memset(&Hdc, 0, sizeof(Hdc));
 	memset(Vhd, 0, sizeof(Vhd));
@@ -304,6 +318,40 @@ void strcpy_s(char* pszDst, int nDstSize, char* pszSrc)
 
 #endif
 
+///////////////////////////////////////////////////////////////////////////////
+// full restart of the Pico, all images are closed and the configuration is
+// read again from the SD-Card, so an unsaved RAM disk is written out first
+void SysColdReset(void)
+{
+	RamDiskFlush();
+	FileCloseAll();
+	FileSystemInit();
+	FdcInit();
+	multicore_reset_core1();
+	reset_system();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// returns the FDC and HDC to their power on register state.  Mounted images
+// stay open, the track buffer remains valid and core1 keeps servicing the bus,
+// so the Z80 can access the drives again as soon as it leaves reset.
+void SysWarmReset(void)
+{
+	g_byRtcIntrActive = false;
+	g_byFdcIntrActive = false;
+	g_byMbIntrActive  = false;
+	g_byIntrRequest   = 0;
+	g_byEnableIntr    = false;
+	clr_gpio(INT_PIN);
+
+	FdcWarmReset();
+	HdcReset();
+	RamDiskReset();
+
+	g_byWarmResetDone = true;
+	++g_dwWarmResetCount;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 void UpdateCounters(void)
 {
@@ -341,15 +389,32 @@ void UpdateCounters(void)
 		if ((g_dwResetCount >= 1000) && g_byMonitorReset) // 1ms
 		{
 			g_byMonitorReset = FALSE;
-			FileCloseAll();
-			FileSystemInit();
-			FdcInit();
-			multicore_reset_core1();
-			reset_system();
+
+			// a new boot.cfg can only be picked up by a full restart
+			if ((g_byResetMode == eColdReset) || g_byBootConfigModified)
+			{
+				SysColdReset();
+			}
+			else
+			{
+				SysWarmReset();
+			}
 		}
 	}
 	else
 	{
+		if (!g_byMonitorReset) // reset has just been released
+		{
+			FdcBootStart();
+
+			// from core1 seeing SYSRES go inactive to the controllers being ready
+			if (g_byWarmResetDone)
+			{
+				g_dwResetLatency  = time_us_32() - g_dwResetRelease;
+				g_byWarmResetDone = false;
+			}
+		}
+
 		g_dwResetCount   = 0;
 		g_byMonitorReset = TRUE;
 	}
@@ -380,6 +445,34 @@ void SysProcessConfigEntry(char szLabel[], char* psz)
 	{
 		g_byEnableVhd = atoi(psz);
 	}
+	else if (strcmp(szLabel, "RESET") == 0)
+	{
+		g_byResetMode = atoi(psz);
+	}
+	else if (strcmp(szLabel, "FLASH") == 0)
+	{
+		g_byEnableFlashCache = atoi(psz);
+	}
+	else if (strcmp(szLabel, "PROFILE") == 0)
+	{
+		g_byEnableBootProfile = atoi(psz);
+	}
+	else if (strcmp(szLabel, "DRQ") == 0)
+	{
+		g_byDrqTiming = atoi(psz);
+	}
+	else if (strcmp(szLabel, "STREAM") == 0)
+	{
+		g_byEnableStream = atoi(psz);
+	}
+	else if (strcmp(szLabel, "RAMDISK") == 0)
+	{
+		g_byRamDiskBanks = atoi(psz);
+	}
+	else if (strcmp(szLabel, "RAMIMG") == 0)
+	{
+		CopyString(psz, g_szRamDiskImage, sizeof(g_szRamDiskImage)-2);
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -9,15 +9,26 @@
 // structures
 //-----------------------------------------------------------------------------
 
+enum {
+	eWarmReset = 0,		// reset FDC/HDC registers, keep images mounted
+	eColdReset = 1,		// reboot the Pico and reload the configuration
+};
+
 // unions
 //-----------------------------------------------------------------------------
 
 // variables
 
+extern uint8_t  g_byResetMode;
+extern uint32_t g_dwResetLatency;		// us from SYSRES release to FDC/HDC ready
+extern uint32_t g_dwWarmResetCount;
+
 // function definitions
 //-----------------------------------------------------------------------------
 
 void reset_system(void);
+void SysColdReset(void);
+void SysWarmReset(void);
 
 void SysInit(void);
 
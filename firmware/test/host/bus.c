@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "defines.h"
+#include "host.h"
+
+//-----------------------------------------------------------------------------
+// The board around the Pico for the host tests: a Z80 running a list of bus
+// cycles with the datasheet timing, the strobes as the Model I bus has them
+// (IN and OUT are the decoded I/O read and write), the three transceivers
+// between the bus and D0-D7, and the WAIT line.  Time is counted in system
+// clock cycles and moves on with core1's accesses (HostCore1Access()), the
+// PIO state machine (pio.c) runs a step per cycle.
+//
+// Every cycle is checked for two drivers on D0-D7 or on the Z80 data bus, and
+// for the Floppy80 driving the data bus outside a read it answers.
+
+#define HOST_BUS_RD_LAG  8			// cycles from MREQ to RD, they have different delays
+#define HOST_BUS_HOLD    20			// cycles the data may still be driven after the read ended
+#define HOST_BUS_TIMEOUT 50000000	// cycles a list of bus cycles may take
+
+typedef struct {
+	uint32_t dwLevels;		// the pins the Pico drives and their levels
+	uint32_t dwDirs;
+	bool     bAddrL;		// transceivers enabled
+	bool     bAddrH;
+	bool     bDataB;
+	bool     bToPico;		// data transceiver direction
+	bool     bWait;			// the Z80 is held
+	byte     byPico;		// D0-D7 as the Pico drives them
+} HostBoardType;
+
+static HostZ80CycleType* g_pcyList;
+static int      g_nListCount;
+static int      g_nCycle;			// the one running
+static int      g_nHalfT;			// system clock cycles per half T state
+static int      g_nHalf;			// next half T state of the cycle
+static int      g_nSub;				// system clock cycle in the half T state
+static uint64_t g_nClock;
+static uint64_t g_nStart;
+static bool     g_bPowered;
+static bool     g_bMreq, g_bRd, g_bWr, g_bIn, g_bOut;
+static int      g_nRdDelay;			// cycles until RD goes active, 0 none
+static word     g_wAddr;
+static bool     g_bZ80Drive;
+static byte     g_byZ80Data;
+static int      g_nSinceRead;		// cycles since the read strobe of a cycle for us
+
+int g_nHostBusErrors;
+
+//-----------------------------------------------------------------------------
+static void HostBusError(char* pszError, byte by1, byte by2)
+{
+	if (g_nHostBusErrors++ < 10)
+	{
+		printf("bus: ");
+		printf(pszError, by1, by2);
+		printf(" (cycle %d of %d, T state %d, clock %llu)\n", g_nCycle, g_nListCount, g_nHalf / 2, (unsigned long long)g_nClock);
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void HostBusBoard(HostBoardType* pbd)
+{
+	uint32_t dwOwned, dwPio, dwPioDirs, dwSio, dwSioDirs, dwPins;
+
+	HostPioOutputs(&dwOwned, &dwPio, &dwPioDirs);
+	HostSioOutputs(&dwSio, &dwSioDirs);
+
+	pbd->dwLevels = (dwSio & ~dwOwned) | (dwPio & dwOwned);
+	pbd->dwDirs   = (dwSioDirs & ~dwOwned) | (dwPioDirs & dwOwned);
+
+	// the control lines have pull ups
+	dwPins = pbd->dwLevels | ~pbd->dwDirs;
+
+	pbd->bAddrL  = !(dwPins & (1u << ADDRL_OE_PIN));
+	pbd->bAddrH  = !(dwPins & (1u << ADDRH_OE_PIN));
+	pbd->bDataB  = !(dwPins & (1u << DATAB_OE_PIN));
+	pbd->bToPico = (dwPins >> DIR_PIN) & 1;
+	pbd->bWait   = (pbd->dwLevels >> WAIT_PIN) & (pbd->dwDirs >> WAIT_PIN) & 1;
+	pbd->byPico  = (dwPins >> D0_PIN) & 0xFF;
+}
+
+//-----------------------------------------------------------------------------
+// the levels of the Pico's pins
+uint32_t HostBusPins(void)
+{
+	HostBoardType bd;
+	uint32_t      dw;
+	byte          by = 0xFF;
+
+	HostBusBoard(&bd);
+
+	// D0-D7 the Pico does not drive come from the transceivers, or float high
+	if (bd.bAddrL)
+	{
+		by &= g_wAddr & 0xFF;
+	}
+
+	if (bd.bAddrH)
+	{
+		by &= g_wAddr >> 8;
+	}
+
+	if (bd.bDataB && bd.bToPico && g_bZ80Drive)
+	{
+		by &= g_byZ80Data;
+	}
+
+	// the pins the Pico drives read back as driven, the others float high
+	dw  = bd.dwLevels | ~bd.dwDirs;
+	dw &= ~((~(uint32_t)by & 0xFF) << D0_PIN & ~bd.dwDirs);
+
+	dw &= ~((g_bIn ? (1u << IN_PIN) : 0) | (g_bRd ? (1u << RD_PIN) : 0) | (g_bWr ? (1u << WR_PIN) : 0) |
+	        (g_bOut ? (1u << OUT_PIN) : 0) | (g_bMreq ? (1u << MREQ_PIN) : 0));
+
+	return dw;
+}
+
+//-----------------------------------------------------------------------------
+static bool HostBusIsRead(HostZ80CycleType* pcy)
+{
+	return (pcy->nType == eZ80Read) || (pcy->nType == eZ80Fetch) || (pcy->nType == eZ80In);
+}
+
+//-----------------------------------------------------------------------------
+static void HostBusCheck(void)
+{
+	HostBoardType     bd;
+	HostZ80CycleType* pcy = (g_nCycle < g_nListCount) ? &g_pcyList[g_nCycle] : NULL;
+	int               nToPico;
+
+	HostBusBoard(&bd);
+
+	nToPico = bd.bAddrL + bd.bAddrH + (bd.bDataB && bd.bToPico) + ((bd.dwDirs & (0xFFu << D0_PIN)) != 0);
+
+	if (nToPico > 1)
+	{
+		HostBusError("D0-D7 driven by %d at once", nToPico, 0);
+	}
+
+	if ((pcy != NULL) && pcy->bOurs && HostBusIsRead(pcy) && (g_bRd || g_bIn))
+	{
+		g_nSinceRead = 0;
+	}
+	else if (g_nSinceRead <= HOST_BUS_HOLD)
+	{
+		++g_nSinceRead;
+	}
+
+	if (bd.bDataB && !bd.bToPico)
+	{
+		if (g_bZ80Drive)
+		{
+			HostBusError("data bus driven by the Z80 and the Floppy80", 0, 0);
+		}
+		else if (g_nSinceRead > HOST_BUS_HOLD)
+		{
+			HostBusError("data bus driven outside a read for the Floppy80", 0, 0);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void HostZ80Sample(HostZ80CycleType* pcy)
+{
+	HostBoardType bd;
+
+	HostBusBoard(&bd);
+	pcy->byRead = (bd.bDataB && !bd.bToPico) ? bd.byPico : 0xFF;
+
+	if (pcy->bOurs && (pcy->byRead != pcy->byData))
+	{
+		HostBusError("read %02X, expected %02X", pcy->byRead, pcy->byData);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the strobes at the start of half T state h (T1 rising is 0), returns the
+// next one, the same T state again for a wait state
+static int HostZ80Edge(HostZ80CycleType* pcy, int h)
+{
+	HostBoardType bd;
+
+	HostBusBoard(&bd);
+
+	if (h == 0)
+	{
+		g_wAddr = pcy->wAddr;
+		return 1;
+	}
+
+	switch (pcy->nType)
+	{
+		case eZ80Read:
+		case eZ80Fetch:
+			if (h == 1)
+			{
+				g_bMreq    = true;
+				g_nRdDelay = HOST_BUS_RD_LAG;
+			}
+			else if ((h == 3) && bd.bWait)
+			{
+				++pcy->nWaits;
+				return 2;
+			}
+			else if (h == ((pcy->nType == eZ80Read) ? 5 : 4))
+			{
+				HostZ80Sample(pcy);
+				g_bMreq    = false;
+				g_bRd      = false;
+				g_nRdDelay = 0;
+				g_wAddr    = (pcy->nType == eZ80Fetch) ? pcy->wRefresh : g_wAddr;
+			}
+			else if (h == 5)
+			{
+				g_bMreq = true;
+			}
+			else if (h == 7)
+			{
+				g_bMreq = false;
+			}
+
+			break;
+
+		case eZ80Write:
+			if (h == 1)
+			{
+				g_bMreq     = true;
+				g_bZ80Drive = true;
+				g_byZ80Data = pcy->byData;
+			}
+			else if (h == 3)
+			{
+				g_bWr = true;
+
+				if (bd.bWait)
+				{
+					++pcy->nWaits;
+					return 2;
+				}
+			}
+			else if (h == 5)
+			{
+				g_bWr   = false;
+				g_bMreq = false;
+			}
+
+			break;
+
+		case eZ80In:
+		case eZ80Out:
+			if ((h == 1) && (pcy->nType == eZ80Out))
+			{
+				g_bZ80Drive = true;
+				g_byZ80Data = pcy->byData;
+			}
+			else if (h == 2)
+			{
+				g_bIn  = (pcy->nType == eZ80In);
+				g_bOut = (pcy->nType == eZ80Out);
+			}
+			else if ((h == 5) && bd.bWait)
+			{
+				++pcy->nWaits;
+				return 4;
+			}
+			else if (h == 7)
+			{
+				if (g_bIn)
+				{
+					HostZ80Sample(pcy);
+				}
+
+				g_bIn  = false;
+				g_bOut = false;
+			}
+
+			break;
+	}
+
+	return h + 1;
+}
+
+//-----------------------------------------------------------------------------
+static int HostZ80Length(HostZ80CycleType* pcy)
+{
+	return ((pcy->nType == eZ80Read) || (pcy->nType == eZ80Write)) ? 6 : 8;
+}
+
+//-----------------------------------------------------------------------------
+static void HostZ80Step(void)
+{
+	if ((g_nRdDelay > 0) && (--g_nRdDelay == 0))
+	{
+		g_bRd = true;
+	}
+
+	if (g_nCycle >= g_nListCount)
+	{
+		return;
+	}
+
+	if (g_nSub == 0)
+	{
+		if (g_nHalf >= HostZ80Length(&g_pcyList[g_nCycle]))
+		{
+			g_bZ80Drive = false;
+			g_nHalf     = 0;
+
+			if (++g_nCycle >= g_nListCount)
+			{
+				return;
+			}
+		}
+
+		g_nHalf = HostZ80Edge(&g_pcyList[g_nCycle], g_nHalf);
+	}
+
+	g_nSub = (g_nSub + 1) % g_nHalfT;
+}
+
+//-----------------------------------------------------------------------------
+// runs the board for nCycles system clock cycles, false if it is not powered
+int HostBusRun(int nCycles)
+{
+	if (!g_bPowered)
+	{
+		return false;
+	}
+
+	while (nCycles-- > 0)
+	{
+		HostPioStep();
+		HostZ80Step();
+		HostBusCheck();
+		++g_nClock;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// the pins as main.c sets them up, the Z80 idle
+void HostBusPowerOn(void)
+{
+	gpio_set_dir(INT_PIN, GPIO_OUT);
+	gpio_put(INT_PIN, 0);
+	gpio_set_dir(WAIT_PIN, GPIO_OUT);
+	gpio_put(WAIT_PIN, 0);
+	gpio_set_dir(ADDRL_OE_PIN, GPIO_OUT);
+	gpio_put(ADDRL_OE_PIN, 1);
+	gpio_set_dir(DATAB_OE_PIN, GPIO_OUT);
+	gpio_put(DATAB_OE_PIN, 1);
+	gpio_set_dir(ADDRH_OE_PIN, GPIO_OUT);
+	gpio_put(ADDRH_OE_PIN, 1);
+	gpio_set_dir(DIR_PIN, GPIO_OUT);
+	gpio_put(DIR_PIN, A_TO_B_DIR);
+
+	g_pcyList    = NULL;
+	g_nListCount = 0;
+	g_nCycle     = 0;
+	g_nSinceRead = HOST_BUS_HOLD + 1;
+	g_bPowered   = true;
+}
+
+//-----------------------------------------------------------------------------
+// the Z80 runs the cycles in pcy, a T state is 2 * nHalfT system clock cycles
+void HostBusStart(HostZ80CycleType* pcy, int nCount, int nHalfT)
+{
+	g_pcyList    = pcy;
+	g_nListCount = nCount;
+	g_nCycle     = 0;
+	g_nHalf      = 0;
+	g_nSub       = 0;
+	g_nHalfT     = nHalfT;
+	g_nStart     = g_nClock;
+}
+
+//-----------------------------------------------------------------------------
+int HostBusDone(void)
+{
+	if ((g_nCycle < g_nListCount) && (g_nClock - g_nStart > HOST_BUS_TIMEOUT))
+	{
+		HostBusError("timeout", 0, 0);
+		g_nCycle = g_nListCount;
+	}
+
+	return g_nCycle >= g_nListCount;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "hardware/pio.h"
+
+// in place of the header pioasm makes from bus.pio, the host tests assemble
+// bus.pio itself when they start (HostPioAssemble() in host/pio.c)
+extern pio_program_t z80_bus_program;
+extern uint z80_bus_offset_drive;
+extern uint z80_bus_offset_write_wait;
+extern uint z80_bus_offset_write_now;
+extern uint z80_bus_offset_wait_end;
+
+pio_sm_config z80_bus_program_get_default_config(uint offset);
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ff.h"
+#include "diskio.h"
+
+//-----------------------------------------------------------------------------
+// FatFs disk for the host tests, a volume in RAM that HostInit() formats.
+
+#define HOST_DISK_SECTORS (32 * 1024)		// 16MB of 512 byte sectors
+
+static BYTE* g_pbyDisk;
+
+uint32_t g_dwHostFatTime = ((2024 - 1980) << 25) | (1 << 21) | (1 << 16);
+
+//-----------------------------------------------------------------------------
+DSTATUS disk_initialize(BYTE pdrv)
+{
+	if (g_pbyDisk == NULL)
+	{
+		g_pbyDisk = calloc(HOST_DISK_SECTORS, FF_MAX_SS);
+	}
+
+	return (g_pbyDisk != NULL) ? 0 : STA_NOINIT;
+}
+
+//-----------------------------------------------------------------------------
+DSTATUS disk_status(BYTE pdrv)
+{
+	return (g_pbyDisk != NULL) ? 0 : STA_NOINIT;
+}
+
+//-----------------------------------------------------------------------------
+DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count)
+{
+	if ((g_pbyDisk == NULL) || (sector + count > HOST_DISK_SECTORS))
+	{
+		return RES_PARERR;
+	}
+
+	memcpy(buff, g_pbyDisk + sector * FF_MAX_SS, count * FF_MAX_SS);
+	return RES_OK;
+}
+
+//-----------------------------------------------------------------------------
+DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count)
+{
+	if ((g_pbyDisk == NULL) || (sector + count > HOST_DISK_SECTORS))
+	{
+		return RES_PARERR;
+	}
+
+	memcpy(g_pbyDisk + sector * FF_MAX_SS, buff, count * FF_MAX_SS);
+	return RES_OK;
+}
+
+//-----------------------------------------------------------------------------
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff)
+{
+	switch (cmd)
+	{
+		case CTRL_SYNC:
+			return RES_OK;
+
+		case GET_SECTOR_COUNT:
+			*(LBA_t*)buff = HOST_DISK_SECTORS;
+			return RES_OK;
+
+		case GET_SECTOR_SIZE:
+			*(WORD*)buff = FF_MAX_SS;
+			return RES_OK;
+
+		case GET_BLOCK_SIZE:
+			*(DWORD*)buff = 1;
+			return RES_OK;
+	}
+
+	return RES_PARERR;
+}
+
+//-----------------------------------------------------------------------------
+DWORD get_fattime(void)
+{
+	return g_dwHostFatTime;
+}
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "crc.h"
+#include "fdc.h"
+#include "host.h"
+
+//-----------------------------------------------------------------------------
+// DMK images for the host tests, IBM format with 256 byte sectors numbered
+// from 0 as the Model I DOSes use them.  Single density images are written
+// one byte per byte (header flag 40h), as most Model I images are.
+
+#define HOST_DMK_IDAMS 128			// bytes of IDAM pointers at the start of a track
+
+//-----------------------------------------------------------------------------
+static int HostDmkTrackSize(int nDensity, int nSectors)
+{
+	// gap, ID, gap, data mark, data, CRC per sector
+	int nSector = (nDensity == eDD) ? (12 + 3 + 7 + 22 + 12 + 3 + 1 + 256 + 2 + 24) : (6 + 7 + 11 + 6 + 1 + 256 + 2 + 12);
+
+	return HOST_DMK_IDAMS + 16 + nSectors * nSector + 16;
+}
+
+//-----------------------------------------------------------------------------
+static BYTE* HostDmkFill(BYTE* pby, BYTE by, int nCount)
+{
+	memset(pby, by, nCount);
+	return pby + nCount;
+}
+
+//-----------------------------------------------------------------------------
+static void HostDmkTrack(BYTE* pbyTrack, int nSide, int nTrack, int nDensity, int nSectors, HostSectorFunc pfnFill)
+{
+	BYTE* pby = pbyTrack + HOST_DMK_IDAMS;
+	BYTE* pbyMark;
+	WORD  wCrc;
+	int   nSector;
+
+	pby = HostDmkFill(pby, (nDensity == eDD) ? 0x4E : 0xFF, 16);
+
+	for (nSector = 0; nSector < nSectors; ++nSector)
+	{
+		// ID field
+		if (nDensity == eDD)
+		{
+			pby = HostDmkFill(pby, 0x00, 12);
+			pby = HostDmkFill(pby, 0xA1, 3);
+		}
+		else
+		{
+			pby = HostDmkFill(pby, 0x00, 6);
+		}
+
+		pbyMark = pby;
+		pbyTrack[nSector*2]   = (pbyMark - pbyTrack) & 0xFF;
+		pbyTrack[nSector*2+1] = ((pbyMark - pbyTrack) >> 8) | ((nDensity == eDD) ? 0x80 : 0x00);
+
+		*pby++ = 0xFE;
+		*pby++ = nTrack;
+		*pby++ = nSide;
+		*pby++ = nSector;
+		*pby++ = 1;		// 256 bytes
+
+		wCrc   = (nDensity == eDD) ? Calculate_CRC_CCITT(pbyMark-3, 8, 1) : Calculate_CRC_CCITT(pbyMark, 5, 1);
+		*pby++ = wCrc >> 8;
+		*pby++ = wCrc & 0xFF;
+
+		// data field
+		if (nDensity == eDD)
+		{
+			pby = HostDmkFill(pby, 0x4E, 22);
+			pby = HostDmkFill(pby, 0x00, 12);
+			pby = HostDmkFill(pby, 0xA1, 3);
+		}
+		else
+		{
+			pby = HostDmkFill(pby, 0xFF, 11);
+			pby = HostDmkFill(pby, 0x00, 6);
+		}
+
+		pbyMark = pby;
+		*pby++  = 0xFB;
+
+		memset(pby, 0xE5, 256);
+		pfnFill(nSide, nTrack, nSector, pby);
+		pby += 256;
+
+		wCrc   = (nDensity == eDD) ? Calculate_CRC_CCITT(pbyMark-3, 256+4, 1) : Calculate_CRC_CCITT(pbyMark, 256+1, 1);
+		*pby++ = wCrc >> 8;
+		*pby++ = wCrc & 0xFF;
+
+		pby = HostDmkFill(pby, (nDensity == eDD) ? 0x4E : 0xFF, (nDensity == eDD) ? 24 : 12);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// writes a formatted image, pfnFill gives the data of each sector
+int HostWriteDmk(char* pszName, int nTracks, int nSides, int nDensity, int nSectors, HostSectorFunc pfnFill)
+{
+	int   nTrackSize = HostDmkTrackSize(nDensity, nSectors);
+	int   nSize      = DMK_HEADER_SIZE + nTracks * nSides * nTrackSize;
+	BYTE* pbyImage   = calloc(1, nSize);
+	int   nTrack, nSide, bOk;
+
+	if (pbyImage == NULL)
+	{
+		return false;
+	}
+
+	pbyImage[1] = nTracks;
+	pbyImage[2] = nTrackSize & 0xFF;
+	pbyImage[3] = nTrackSize >> 8;
+	pbyImage[4] = ((nSides == 1) ? 0x10 : 0x00) | ((nDensity == eSD) ? 0x40 : 0x00);
+
+	for (nTrack = 0; nTrack < nTracks; ++nTrack)
+	{
+		for (nSide = 0; nSide < nSides; ++nSide)
+		{
+			HostDmkTrack(pbyImage + DMK_HEADER_SIZE + (nTrack * nSides + nSide) * nTrackSize, nSide, nTrack, nDensity, nSectors, pfnFill);
+		}
+	}
+
+	bOk = HostWriteFile(pszName, pbyImage, nSize);
+	free(pbyImage);
+
+	return bOk;
+}
@@ -0,0 +1,3 @@
+#pragma once
+#include "pico/stdlib.h"
+void flash_range_erase(uint32_t, size_t); void flash_range_program(uint32_t, const uint8_t*, size_t);
@@ -0,0 +1,41 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// the PIO API memory.c uses, for one state machine run by host/pio.c
+typedef struct { int nIndex; } pio_hw_t;
+typedef pio_hw_t* PIO;
+extern pio_hw_t* pio0;
+
+typedef struct {
+	uint nInBase, nOutBase, nOutCount, nSetBase, nSetCount;
+	uint nSideBase, nSideCount, nJmpPin, nWrapBottom, nWrapTop;
+	bool bSideOpt, bSidePindirs, bInRight, bOutRight;
+} pio_sm_config;
+
+typedef struct { const uint16_t* instructions; uint8_t length; int8_t origin; } pio_program_t;
+enum pio_src_dest { pio_pins=0, pio_x=1, pio_y=2 };
+
+int  pio_add_program_at_offset(PIO, const pio_program_t*, uint);
+int  pio_claim_unused_sm(PIO, bool);
+void pio_sm_set_pins_with_mask(PIO, uint, uint32_t, uint32_t);
+void pio_sm_set_pindirs_with_mask(PIO, uint, uint32_t, uint32_t);
+void pio_gpio_init(PIO, uint);
+void sm_config_set_in_pins(pio_sm_config*, uint);
+void sm_config_set_out_pins(pio_sm_config*, uint, uint);
+void sm_config_set_set_pins(pio_sm_config*, uint, uint);
+void sm_config_set_sideset_pins(pio_sm_config*, uint);
+void sm_config_set_sideset(pio_sm_config*, uint, bool, bool);
+void sm_config_set_jmp_pin(pio_sm_config*, uint);
+void sm_config_set_wrap(pio_sm_config*, uint, uint);
+void sm_config_set_in_shift(pio_sm_config*, bool, bool, uint);
+void sm_config_set_out_shift(pio_sm_config*, bool, bool, uint);
+void sm_config_set_clkdiv(pio_sm_config*, float);
+pio_sm_config pio_get_default_sm_config(void);
+int  pio_sm_init(PIO, uint, uint, const pio_sm_config*);
+void pio_sm_exec(PIO, uint, uint);
+uint pio_encode_set(enum pio_src_dest, uint);
+uint pio_encode_sideset(uint, uint);
+void pio_sm_set_enabled(PIO, uint, bool);
+bool pio_sm_is_rx_fifo_empty(PIO, uint);
+void pio_sm_put(PIO, uint, uint32_t);
+uint32_t pio_sm_get(PIO, uint);
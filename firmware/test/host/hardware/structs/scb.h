@@ -0,0 +1,3 @@
+#pragma once
+#include "pico/stdlib.h"
+typedef struct { volatile uint32_t aircr; } scb_hw_t; extern scb_hw_t* scb_hw;
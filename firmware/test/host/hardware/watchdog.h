@@ -0,0 +1,3 @@
+#pragma once
+#include "pico/stdlib.h"
+void watchdog_enable(uint32_t, bool); void watchdog_reboot(uint32_t,uint32_t,uint32_t);
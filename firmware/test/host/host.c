@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/watchdog.h"
+#include "tusb.h"
+
+#include "defines.h"
+#include "file.h"
+#include "sd_core.h"
+#include "host.h"
+
+//-----------------------------------------------------------------------------
+// The parts of the Pico SDK and of sd_core.c the firmware sources use, for the
+// host tests.  Nothing runs on its own: the time moves with HostAdvance() and
+// core1 is whatever code a test calls in its place.
+
+static sio_hw_t     g_sioHost;
+static systick_hw_t g_systickHost;
+static FATFS        g_fsHost;
+
+int g_nHostAccessCycles = 4;
+
+volatile BYTE  sd_byCardInialized;
+volatile DWORD g_dwSdCardPresenceCount;
+volatile DWORD g_dwSdCardMaxPresenceCount;
+
+uint64_t g_nHostTime;
+int      g_nHostFailures;
+
+//-----------------------------------------------------------------------------
+uint64_t time_us_64(void)
+{
+	return g_nHostTime;
+}
+
+//-----------------------------------------------------------------------------
+uint32_t time_us_32(void)
+{
+	return (uint32_t)g_nHostTime;
+}
+
+//-----------------------------------------------------------------------------
+void sleep_ms(uint32_t dwMilliseconds)
+{
+	g_nHostTime += dwMilliseconds * 1000ull;
+}
+
+//-----------------------------------------------------------------------------
+void HostAdvance(uint64_t nMicroseconds)
+{
+	g_nHostTime += nMicroseconds;
+}
+
+//-----------------------------------------------------------------------------
+// every access of core1 code to the SIO, the SysTick or a PIO: the register
+// writes of the previous access take effect, and the board (bus.c) runs on
+// for the time the access takes
+void HostCore1Access(void)
+{
+	g_sioHost.gpio_out   |= g_sioHost.gpio_set;
+	g_sioHost.gpio_out   &= ~g_sioHost.gpio_clr;
+	g_sioHost.gpio_out   ^= g_sioHost.gpio_togl;
+	g_sioHost.gpio_oe    |= g_sioHost.gpio_oe_set;
+	g_sioHost.gpio_oe    &= ~g_sioHost.gpio_oe_clr;
+	g_sioHost.gpio_set    = 0;
+	g_sioHost.gpio_clr    = 0;
+	g_sioHost.gpio_togl   = 0;
+	g_sioHost.gpio_oe_set = 0;
+	g_sioHost.gpio_oe_clr = 0;
+
+	// a down counter of system clock cycles
+	g_systickHost.cvr = (g_systickHost.cvr - g_nHostAccessCycles) & 0x00FFFFFF;
+
+	if (HostBusRun(g_nHostAccessCycles))
+	{
+		g_sioHost.gpio_in = HostBusPins();
+	}
+}
+
+//-----------------------------------------------------------------------------
+sio_hw_t* HostSio(void)
+{
+	HostCore1Access();
+	return &g_sioHost;
+}
+
+//-----------------------------------------------------------------------------
+systick_hw_t* HostSysTick(void)
+{
+	HostCore1Access();
+	return &g_systickHost;
+}
+
+//-----------------------------------------------------------------------------
+// the SIO outputs as the board sees them
+void HostSioOutputs(uint32_t* pdwLevels, uint32_t* pdwDirs)
+{
+	*pdwLevels = g_sioHost.gpio_out;
+	*pdwDirs   = g_sioHost.gpio_oe;
+}
+
+//-----------------------------------------------------------------------------
+void gpio_put(uint nPin, bool bValue)
+{
+	g_sioHost.gpio_out = (g_sioHost.gpio_out & ~(1u << nPin)) | ((uint32_t)bValue << nPin);
+}
+
+//-----------------------------------------------------------------------------
+void gpio_set_dir(uint nPin, bool bOut)
+{
+	g_sioHost.gpio_oe = (g_sioHost.gpio_oe & ~(1u << nPin)) | ((uint32_t)bOut << nPin);
+}
+
+//-----------------------------------------------------------------------------
+int getchar_timeout_us(uint32_t dwTimeout)
+{
+	return PICO_ERROR_TIMEOUT;
+}
+
+//-----------------------------------------------------------------------------
+uint32_t tud_cdc_write_available(void)
+{
+	return 64;
+}
+
+//-----------------------------------------------------------------------------
+bool tud_cdc_connected(void)
+{
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+void multicore_reset_core1(void)
+{
+}
+
+//-----------------------------------------------------------------------------
+void watchdog_enable(uint32_t dwDelay, bool bPause)
+{
+}
+
+//-----------------------------------------------------------------------------
+void watchdog_reboot(uint32_t dwPc, uint32_t dwSp, uint32_t dwDelay)
+{
+}
+
+//-----------------------------------------------------------------------------
+unsigned char get_cd(void)
+{
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+void TestSdCardInsertion(void)
+{
+}
+
+//-----------------------------------------------------------------------------
+// formats the RAM disk and mounts it as the SD-Card, all SYSRES, RD, WR ...
+// inputs inactive (high)
+void HostInit(void)
+{
+	static BYTE byWork[FF_MAX_SS * 4];
+	MKFS_PARM   parm = {FM_FAT, 1, 0, 0, 0};
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+
+	g_nHostTime         = 1000000;
+	g_sioHost.gpio_in   = 0xFFFFFFFF;
+	sd_byCardInialized  = FALSE;
+
+	if ((f_mkfs("0:", &parm, byWork, sizeof(byWork)) != FR_OK) || (f_mount(&g_fsHost, "0:", 1) != FR_OK))
+	{
+		printf("unable to create the host SD-Card volume\n");
+		++g_nHostFailures;
+		return;
+	}
+
+	sd_byCardInialized = TRUE;
+	FileSystemInit();
+}
+
+//-----------------------------------------------------------------------------
+int HostWriteFile(char* pszName, BYTE* pby, uint32_t dwSize)
+{
+	file* f = FileOpen(pszName, FA_WRITE | FA_CREATE_ALWAYS);
+	int   bOk;
+
+	if (f == NULL)
+	{
+		return false;
+	}
+
+	bOk = (FileWrite(f, pby, dwSize) == dwSize);
+	FileClose(f);
+
+	return bOk;
+}
+
+//-----------------------------------------------------------------------------
+// returns the number of bytes read, -1 if the file can not be opened
+int HostReadFile(char* pszName, BYTE* pby, uint32_t dwMaxSize)
+{
+	file* f = FileOpen(pszName, FA_READ);
+	int   nRead;
+
+	if (f == NULL)
+	{
+		return -1;
+	}
+
+	nRead = FileRead(f, pby, dwMaxSize);
+	FileClose(f);
+
+	return nRead;
+}
+
+//-----------------------------------------------------------------------------
+int HostResult(char* pszTest)
+{
+	printf("%s: %s\n", pszTest, (g_nHostFailures == 0) ? "passed" : "FAILED");
+	return (g_nHostFailures == 0) ? 0 : 1;
+}
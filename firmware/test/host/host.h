@@ -0,0 +1,89 @@
+#ifndef _H_HOST_
+#define _H_HOST_
+
+#include <stdio.h>
+
+#include "defines.h"
+#include "ff.h"
+
+// Host side of the firmware tests.  The firmware sources are built for Linux
+// against the SDK declarations in this directory, the SD-Card is a FAT volume
+// in RAM (diskio.c) and the clocks only move when a test moves them.
+
+extern uint64_t g_nHostTime;		// us, returned by time_us_64()
+extern uint32_t g_dwHostFatTime;	// FatFs time stamp of files written, the board has no clock
+extern int      g_nHostFailures;
+
+void HostInit(void);
+void HostAdvance(uint64_t nMicroseconds);
+int  HostWriteFile(char* pszName, BYTE* pby, uint32_t dwSize);
+int  HostReadFile(char* pszName, BYTE* pby, uint32_t dwMaxSize);
+int  HostResult(char* pszTest);
+
+// dmk.c, fills in the 256 bytes of a sector (E5h on entry)
+typedef void (*HostSectorFunc)(int nSide, int nTrack, int nSector, BYTE* pby);
+
+int  HostWriteDmk(char* pszName, int nTracks, int nSides, int nDensity, int nSectors, HostSectorFunc pfnFill);
+
+// core1 side of the bus: every access to the SIO, the SysTick or a PIO takes
+// g_nHostAccessCycles system clock cycles (4 unless a test changes it), the
+// code between them none
+extern int g_nHostAccessCycles;
+
+void HostCore1Access(void);
+void HostSioOutputs(uint32_t* pdwLevels, uint32_t* pdwDirs);
+
+// pio.c, the state machine
+int      HostPioAssemble(char* pszFile);
+void     HostPioStep(void);
+void     HostPioOutputs(uint32_t* pdwOwned, uint32_t* pdwLevels, uint32_t* pdwDirs);
+unsigned HostPioPc(void);
+
+// bus.c, the Z80 and the board around the Pico
+enum {
+	eZ80Read,
+	eZ80Fetch,		// M1, a read followed by a refresh
+	eZ80Write,
+	eZ80In,
+	eZ80Out
+};
+
+typedef struct {
+	int  nType;
+	word wAddr;
+	word wRefresh;	// eZ80Fetch, address of the refresh
+	byte byData;	// written, or to be read when bOurs
+	int  bOurs;		// the Floppy80 is to answer it
+	byte byRead;	// what the Z80 read
+	int  nWaits;	// wait states it was held for
+} HostZ80CycleType;
+
+extern int g_nHostBusErrors;
+
+void     HostBusPowerOn(void);
+void     HostBusStart(HostZ80CycleType* pcy, int nCount, int nHalfT);
+int      HostBusDone(void);
+int      HostBusRun(int nCycles);
+uint32_t HostBusPins(void);
+
+#define CHECK(x) \
+	do { \
+		if (!(x)) \
+		{ \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #x); \
+			++g_nHostFailures; \
+		} \
+	} while (0)
+
+#define CHECK_EQ(a, b) \
+	do { \
+		long long nA_ = (long long)(a); \
+		long long nB_ = (long long)(b); \
+		if (nA_ != nB_) \
+		{ \
+			printf("%s:%d: CHECK_EQ(%s, %s) failed, %lld != %lld\n", __FILE__, __LINE__, #a, #b, nA_, nB_); \
+			++g_nHostFailures; \
+		} \
+	} while (0)
+
+#endif
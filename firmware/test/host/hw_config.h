@@ -0,0 +1,2 @@
+#pragma once
+#include "sd_card.h"
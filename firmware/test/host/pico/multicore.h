@@ -0,0 +1,4 @@
+#pragma once
+#include "pico/stdlib.h"
+void multicore_launch_core1(void (*)(void));
+void multicore_reset_core1(void);
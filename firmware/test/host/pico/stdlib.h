@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+typedef unsigned int uint;
+#define __not_in_flash_func(x) x
+#define __nop() __asm__ volatile("nop")
+#define PICO_ERROR_TIMEOUT -1
+#define SRAM_END 0x20082000
+#define GPIO_OUT 1
+#define GPIO_IN 0
+#define GPIO_SLEW_RATE_FAST 1
+#define GPIO_SLEW_RATE_SLOW 0
+#define GPIO_DRIVE_STRENGTH_2MA 0
+#define GPIO_DRIVE_STRENGTH_12MA 3
+typedef struct { volatile uint32_t gpio_in, gpio_out, gpio_set, gpio_clr, gpio_togl, gpio_oe_set, gpio_oe_clr, fifo_st, gpio_oe; } sio_hw_t;
+typedef struct { volatile uint32_t csr, rvr, cvr, calib; } systick_hw_t;
+// each access goes through host.c, see HostCore1Access()
+sio_hw_t* HostSio(void);
+systick_hw_t* HostSysTick(void);
+#define sio_hw     HostSio()
+#define systick_hw HostSysTick()
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void sleep_ms(uint32_t);
+void sleep_us(uint64_t);
+void stdio_init_all(void);
+int getchar_timeout_us(uint32_t);
+void gpio_init(uint); void gpio_set_dir(uint, bool); void gpio_put(uint, bool); bool gpio_get(uint);
+void gpio_set_slew_rate(uint,int); void gpio_set_drive_strength(uint,int); void gpio_set_pulls(uint,bool,bool);
+static inline void tight_loop_contents(void) {}
+static inline void __dmb(void) { __sync_synchronize(); }
+static inline void __dsb(void) { __sync_synchronize(); }
+typedef uint64_t absolute_time_t;
+#define XIP_BASE 0x10000000
+#define PICO_FLASH_SIZE_BYTES (4*1024*1024)
+#define FLASH_SECTOR_SIZE 4096
+#define FLASH_PAGE_SIZE 256
+#define __not_in_flash(group)
@@ -0,0 +1,991 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#include "defines.h"
+#include "host.h"
+#include "bus.pio.h"
+
+//-----------------------------------------------------------------------------
+// One PIO state machine for the host tests.  HostPioAssemble() assembles the
+// part of the PIO language bus.pio uses, so a test runs the program as it is
+// in the tree, and HostPioStep() runs the machine one system clock cycle at a
+// time.  Instruction encoding and behaviour as in the RP2040/RP2350
+// datasheets: side-set is applied with the instruction (also one that stalls
+// or is executed with pio_sm_exec()), the delay follows it, and the pins are
+// read through the two stage input synchronisers, two cycles late.
+
+#define HOST_PIO_SIZE   32
+#define HOST_PIO_LABELS 32
+#define HOST_PIO_LINE   256
+
+typedef struct {
+	char szName[32];
+	int  nAddr;
+	bool bPublic;
+} HostPioLabelType;
+
+typedef struct {
+	uint16_t      wMem[HOST_PIO_SIZE];
+	pio_sm_config c;
+	bool          bEnabled;
+	uint          nPc;
+	uint32_t      dwX, dwY, dwIsr, dwOsr;
+	int           nIsrCount, nOsrCount, nDelay;
+	uint32_t      dwTx[4], dwRx[4];
+	int           nTx, nRx;
+	uint32_t      dwPins, dwDirs;		// output latches
+	uint32_t      dwOwned;				// pins given to the PIO
+	uint32_t      dwSync[2];			// the pins in the input synchronisers
+} HostSmType;
+
+static pio_hw_t         g_pioHost0;
+static HostSmType       g_smHost;
+static uint16_t         g_wProgram[HOST_PIO_SIZE];
+static HostPioLabelType g_plLabels[HOST_PIO_LABELS];
+static int              g_nLabels;
+static int              g_nWrapTarget;
+static int              g_nWrap;
+static int              g_nSideCount;
+static bool             g_bSideOpt;
+static bool             g_bSidePindirs;
+
+pio_hw_t* pio0 = &g_pioHost0;
+
+pio_program_t z80_bus_program = {g_wProgram, 0, -1};
+uint z80_bus_offset_drive;
+uint z80_bus_offset_write_wait;
+uint z80_bus_offset_write_now;
+uint z80_bus_offset_wait_end;
+
+// operand names by their encoding, NULL where there is none
+static const char* g_pszJmpCond[8] = {"", "!x", "x--", "!y", "y--", "x!=y", "pin", "!osre"};
+static const char* g_pszInSrc[8]   = {"pins", "x", "y", "null", NULL, NULL, "isr", "osr"};
+static const char* g_pszOutDest[8] = {"pins", "x", "y", "null", "pindirs", "pc", "isr", "exec"};
+static const char* g_pszMovDest[8] = {"pins", "x", "y", NULL, "exec", "pc", "isr", "osr"};
+static const char* g_pszMovSrc[8]  = {"pins", "x", "y", "null", NULL, "status", "isr", "osr"};
+static const char* g_pszSetDest[8] = {"pins", "x", "y", NULL, "pindirs", NULL, NULL, NULL};
+
+//-----------------------------------------------------------------------------
+static int HostPioLookup(const char** ppszTable, char* psz)
+{
+	int i;
+
+	for (i = 0; i < 8; ++i)
+	{
+		if ((ppszTable[i] != NULL) && (strcmp(ppszTable[i], psz) == 0))
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// decimal, 0x hex or 0b binary, -1 if it is not a number
+static int HostPioNumber(char* psz)
+{
+	char* pszEnd;
+	long  n;
+
+	if (strncmp(psz, "0b", 2) == 0)
+	{
+		n = strtol(psz + 2, &pszEnd, 2);
+	}
+	else
+	{
+		n = strtol(psz, &pszEnd, 0);
+	}
+
+	if ((pszEnd == psz) || (*pszEnd != 0) || (n < 0))
+	{
+		return -1;
+	}
+
+	return n;
+}
+
+//-----------------------------------------------------------------------------
+static int HostPioFindLabel(char* psz)
+{
+	int i;
+
+	for (i = 0; i < g_nLabels; ++i)
+	{
+		if (strcmp(g_plLabels[i].szName, psz) == 0)
+		{
+			return g_plLabels[i].nAddr;
+		}
+	}
+
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// splits a line at blanks and commas, drops the comment
+static int HostPioTokens(char* pszLine, char** ppszTokens, int nMax)
+{
+	char* psz = strchr(pszLine, ';');
+	int   n = 0;
+
+	if (psz != NULL)
+	{
+		*psz = 0;
+	}
+
+	for (psz = strtok(pszLine, " \t\r\n,"); (psz != NULL) && (n < nMax); psz = strtok(NULL, " \t\r\n,"))
+	{
+		ppszTokens[n++] = psz;
+	}
+
+	return n;
+}
+
+//-----------------------------------------------------------------------------
+// one instruction, -1 on an error
+static int HostPioEncode(char** ppszTok, int nTok)
+{
+	int nSide = -1, nDelay = 0, nEnd = nTok, nField, nMaxDelay, nInstr, n, i;
+	char* psz;
+
+	// side and delay come last
+	for (i = 1; i < nTok; ++i)
+	{
+		if ((strcmp(ppszTok[i], "side") == 0) && (i + 1 < nTok))
+		{
+			nSide = HostPioNumber(ppszTok[i+1]);
+			nEnd  = (i < nEnd) ? i : nEnd;
+			++i;
+		}
+		else if (ppszTok[i][0] == '[')
+		{
+			ppszTok[i][strlen(ppszTok[i])-1] = 0;
+			nDelay = HostPioNumber(ppszTok[i] + 1);
+			nEnd   = (i < nEnd) ? i : nEnd;
+		}
+	}
+
+	nTok = nEnd;
+
+	nMaxDelay = (1 << (5 - g_nSideCount)) - 1;
+
+	if ((nDelay < 0) || (nDelay > nMaxDelay) || ((nSide < 0) && (g_nSideCount > 0) && !g_bSideOpt))
+	{
+		return -1;
+	}
+
+	nField = nDelay;
+
+	if (nSide >= 0)
+	{
+		if (g_bSideOpt)
+		{
+			nField |= (0x10 | (nSide << (5 - g_nSideCount))) & 0x1F;
+		}
+		else
+		{
+			nField |= nSide << (5 - g_nSideCount);
+		}
+	}
+
+	nField <<= 8;
+
+	if (strcmp(ppszTok[0], "nop") == 0)
+	{
+		return 0xA042 | nField;		// mov y, y
+	}
+
+	if (strcmp(ppszTok[0], "jmp") == 0)
+	{
+		n = (nTok == 3) ? HostPioLookup(g_pszJmpCond, ppszTok[1]) : 0;
+		i = HostPioFindLabel(ppszTok[nTok-1]);
+
+		if ((nTok < 2) || (nTok > 3) || (n < 0))
+		{
+			return -1;
+		}
+
+		i = (i >= 0) ? i : HostPioNumber(ppszTok[nTok-1]);
+		return (i < 0) ? -1 : (0x0000 | nField | (n << 5) | i);
+	}
+
+	if ((strcmp(ppszTok[0], "in") == 0) || (strcmp(ppszTok[0], "out") == 0))
+	{
+		nInstr = (ppszTok[0][0] == 'i') ? 0x4000 : 0x6000;
+		n      = (nTok == 3) ? HostPioLookup((nInstr == 0x4000) ? g_pszInSrc : g_pszOutDest, ppszTok[1]) : -1;
+		i      = (nTok == 3) ? HostPioNumber(ppszTok[2]) : -1;
+
+		if ((n < 0) || (i < 1) || (i > 32))
+		{
+			return -1;
+		}
+
+		return nInstr | nField | (n << 5) | (i & 0x1F);
+	}
+
+	if ((strcmp(ppszTok[0], "push") == 0) || (strcmp(ppszTok[0], "pull") == 0))
+	{
+		nInstr = (strcmp(ppszTok[0], "push") == 0) ? 0x8000 : 0x8080;
+		n      = 0x20;	// block
+
+		for (i = 1; i < nTok; ++i)
+		{
+			if (strcmp(ppszTok[i], "noblock") == 0)
+			{
+				n &= ~0x20;
+			}
+			else if ((strcmp(ppszTok[i], "iffull") == 0) || (strcmp(ppszTok[i], "ifempty") == 0))
+			{
+				n |= 0x40;
+			}
+			else if (strcmp(ppszTok[i], "block") != 0)
+			{
+				return -1;
+			}
+		}
+
+		return nInstr | nField | n;
+	}
+
+	if (strcmp(ppszTok[0], "mov") == 0)
+	{
+		if (nTok != 3)
+		{
+			return -1;
+		}
+
+		psz = ppszTok[2];
+		i   = 0;
+
+		if ((psz[0] == '!') || (psz[0] == '~'))
+		{
+			i = 1;
+			++psz;
+		}
+		else if (strncmp(psz, "::", 2) == 0)
+		{
+			i = 2;
+			psz += 2;
+		}
+
+		n = HostPioLookup(g_pszMovDest, ppszTok[1]);
+
+		if ((n < 0) || (HostPioLookup(g_pszMovSrc, psz) < 0))
+		{
+			return -1;
+		}
+
+		return 0xA000 | nField | (n << 5) | (i << 3) | HostPioLookup(g_pszMovSrc, psz);
+	}
+
+	if (strcmp(ppszTok[0], "set") == 0)
+	{
+		n = (nTok == 3) ? HostPioLookup(g_pszSetDest, ppszTok[1]) : -1;
+		i = (nTok == 3) ? HostPioNumber(ppszTok[2]) : -1;
+
+		if ((n < 0) || (i < 0) || (i > 31))
+		{
+			return -1;
+		}
+
+		return 0xE000 | nField | (n << 5) | i;
+	}
+
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// one pass over the source: the labels on the first, the code on the second
+static bool HostPioPass(FILE* pf, char* pszFile, bool bCode)
+{
+	char  szLine[HOST_PIO_LINE];
+	char* pszTok[16];
+	int   nLine = 0, nAddr = 0, nTok, nInstr, i;
+
+	rewind(pf);
+
+	while (fgets(szLine, sizeof(szLine), pf) != NULL)
+	{
+		++nLine;
+		nTok = HostPioTokens(szLine, pszTok, SizeOfArray(pszTok));
+		i    = 0;
+
+		if (nTok == 0)
+		{
+			continue;
+		}
+
+		if (strcmp(pszTok[0], ".program") == 0)
+		{
+			continue;
+		}
+		else if (strcmp(pszTok[0], ".side_set") == 0)
+		{
+			g_nSideCount   = (nTok > 1) ? HostPioNumber(pszTok[1]) : -1;
+			g_bSideOpt     = false;
+			g_bSidePindirs = false;
+
+			for (i = 2; i < nTok; ++i)
+			{
+				g_bSideOpt     |= (strcmp(pszTok[i], "opt") == 0);
+				g_bSidePindirs |= (strcmp(pszTok[i], "pindirs") == 0);
+			}
+
+			// the count set in the configuration includes the enable bit
+			g_nSideCount += g_bSideOpt ? 1 : 0;
+
+			if ((g_nSideCount < 0) || (g_nSideCount > 5))
+			{
+				printf("%s:%d: bad .side_set\n", pszFile, nLine);
+				return false;
+			}
+
+			continue;
+		}
+		else if (strcmp(pszTok[0], ".wrap_target") == 0)
+		{
+			g_nWrapTarget = nAddr;
+			continue;
+		}
+		else if (strcmp(pszTok[0], ".wrap") == 0)
+		{
+			g_nWrap = nAddr - 1;
+			continue;
+		}
+		else if (pszTok[0][0] == '.')
+		{
+			printf("%s:%d: %s is not supported\n", pszFile, nLine, pszTok[0]);
+			return false;
+		}
+
+		if ((strcmp(pszTok[0], "public") == 0) && (nTok > 1))
+		{
+			i = 1;
+		}
+
+		if (pszTok[i][strlen(pszTok[i])-1] == ':')
+		{
+			if (!bCode)
+			{
+				if (g_nLabels >= HOST_PIO_LABELS)
+				{
+					return false;
+				}
+
+				pszTok[i][strlen(pszTok[i])-1] = 0;
+				strncpy(g_plLabels[g_nLabels].szName, pszTok[i], sizeof(g_plLabels[0].szName) - 1);
+				g_plLabels[g_nLabels].nAddr   = nAddr;
+				g_plLabels[g_nLabels].bPublic = (i == 1);
+				++g_nLabels;
+			}
+
+			++i;
+		}
+
+		if (i >= nTok)
+		{
+			continue;
+		}
+
+		if (nAddr >= HOST_PIO_SIZE)
+		{
+			printf("%s:%d: program too long\n", pszFile, nLine);
+			return false;
+		}
+
+		if (bCode)
+		{
+			nInstr = HostPioEncode(pszTok + i, nTok - i);
+
+			if (nInstr < 0)
+			{
+				printf("%s:%d: unable to assemble %s\n", pszFile, nLine, pszTok[i]);
+				return false;
+			}
+
+			g_wProgram[nAddr] = nInstr;
+		}
+
+		++nAddr;
+	}
+
+	z80_bus_program.length = nAddr;
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// assembles bus.pio into z80_bus_program and its z80_bus_offset_ values
+int HostPioAssemble(char* pszFile)
+{
+	FILE* pf = fopen(pszFile, "r");
+	bool  bOk;
+
+	if (pf == NULL)
+	{
+		printf("unable to open %s\n", pszFile);
+		return false;
+	}
+
+	g_nLabels     = 0;
+	g_nWrapTarget = 0;
+	g_nWrap       = -1;
+	g_nSideCount  = 0;
+
+	bOk = HostPioPass(pf, pszFile, false) && HostPioPass(pf, pszFile, true);
+	fclose(pf);
+
+	if (g_nWrap < 0)
+	{
+		g_nWrap = z80_bus_program.length - 1;
+	}
+
+	z80_bus_offset_drive      = HostPioFindLabel("drive");
+	z80_bus_offset_write_wait = HostPioFindLabel("write_wait");
+	z80_bus_offset_write_now  = HostPioFindLabel("write_now");
+	z80_bus_offset_wait_end   = HostPioFindLabel("wait_end");
+
+	return bOk && ((int)z80_bus_offset_drive >= 0) && ((int)z80_bus_offset_write_wait >= 0) &&
+	       ((int)z80_bus_offset_write_now >= 0) && ((int)z80_bus_offset_wait_end >= 0);
+}
+
+//-----------------------------------------------------------------------------
+static void HostPioFail(char* pszReason, uint16_t wInstr)
+{
+	printf("PIO: %s (%04X at %u)\n", pszReason, wInstr, g_smHost.nPc);
+	++g_nHostFailures;
+	g_smHost.bEnabled = false;
+}
+
+//-----------------------------------------------------------------------------
+static void HostPioWritePins(uint nBase, uint nCount, uint32_t dwValue, bool bDirs)
+{
+	uint32_t* pdw = bDirs ? &g_smHost.dwDirs : &g_smHost.dwPins;
+	uint i;
+
+	for (i = 0; i < nCount; ++i)
+	{
+		*pdw &= ~(1u << ((nBase + i) & 31));
+		*pdw |= ((dwValue >> i) & 1) << ((nBase + i) & 31);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the pins from in_base up
+static uint32_t HostPioReadPins(void)
+{
+	uint32_t dw = g_smHost.dwSync[1];
+	uint     n  = g_smHost.c.nInBase;
+
+	return n ? ((dw >> n) | (dw << (32 - n))) : dw;
+}
+
+//-----------------------------------------------------------------------------
+// runs one instruction, returns false if it stalled
+static bool HostPioExecute(uint16_t wInstr, bool bExec)
+{
+	HostSmType* psm    = &g_smHost;
+	uint        nField = (wInstr >> 8) & 0x1F;
+	uint        nIndex = wInstr & 0x1F;
+	uint        nOp    = (wInstr >> 5) & 7;
+	uint        nCount = nIndex ? nIndex : 32;
+	uint32_t    dwMask = (nCount == 32) ? 0xFFFFFFFF : ((1u << nCount) - 1);
+	uint        nBits;
+	uint32_t    dw = 0;
+	bool        bJump = false;
+	bool        bCond = false;
+	int         i;
+
+	if (psm->c.nSideCount > 0)
+	{
+		nBits = psm->c.nSideCount - (psm->c.bSideOpt ? 1 : 0);
+
+		if (!psm->c.bSideOpt || (nField & 0x10))
+		{
+			HostPioWritePins(psm->c.nSideBase, nBits, nField >> (5 - psm->c.nSideCount), psm->c.bSidePindirs);
+		}
+	}
+
+	switch (wInstr >> 13)
+	{
+		case 0: // jmp
+			switch (nOp)
+			{
+				case 0: bCond = true; break;
+				case 1: bCond = (psm->dwX == 0); break;
+				case 2: bCond = (psm->dwX-- != 0); break;
+				case 3: bCond = (psm->dwY == 0); break;
+				case 4: bCond = (psm->dwY-- != 0); break;
+				case 5: bCond = (psm->dwX != psm->dwY); break;
+				case 6: bCond = (psm->dwSync[1] >> psm->c.nJmpPin) & 1; break;
+				case 7: bCond = (psm->nOsrCount < 32); break;
+			}
+
+			if (bCond)
+			{
+				psm->nPc = nIndex;
+				bJump    = true;
+			}
+
+			break;
+
+		case 2: // in
+			switch (nOp)
+			{
+				case 0: dw = HostPioReadPins(); break;
+				case 1: dw = psm->dwX; break;
+				case 2: dw = psm->dwY; break;
+				case 6: dw = psm->dwIsr; break;
+				case 7: dw = psm->dwOsr; break;
+			}
+
+			dw &= dwMask;
+
+			if (nCount == 32)
+			{
+				psm->dwIsr = dw;
+			}
+			else if (psm->c.bInRight)
+			{
+				psm->dwIsr = (psm->dwIsr >> nCount) | (dw << (32 - nCount));
+			}
+			else
+			{
+				psm->dwIsr = (psm->dwIsr << nCount) | dw;
+			}
+
+			psm->nIsrCount = (psm->nIsrCount + nCount > 32) ? 32 : psm->nIsrCount + nCount;
+			break;
+
+		case 3: // out
+			if (psm->c.bOutRight)
+			{
+				dw         = psm->dwOsr & dwMask;
+				psm->dwOsr = (nCount == 32) ? 0 : (psm->dwOsr >> nCount);
+			}
+			else
+			{
+				dw         = (nCount == 32) ? psm->dwOsr : (psm->dwOsr >> (32 - nCount));
+				psm->dwOsr = (nCount == 32) ? 0 : (psm->dwOsr << nCount);
+			}
+
+			psm->nOsrCount = (psm->nOsrCount + nCount > 32) ? 32 : psm->nOsrCount + nCount;
+
+			switch (nOp)
+			{
+				case 0: HostPioWritePins(psm->c.nOutBase, psm->c.nOutCount, dw, false); break;
+				case 1: psm->dwX = dw; break;
+				case 2: psm->dwY = dw; break;
+				case 3: break;
+				case 4: HostPioWritePins(psm->c.nOutBase, psm->c.nOutCount, dw, true); break;
+				case 5: psm->nPc = dw & 0x1F; bJump = true; break;
+				case 6: psm->dwIsr = dw; psm->nIsrCount = nCount; break;
+				case 7: HostPioFail("out exec is not supported", wInstr); return true;
+			}
+
+			break;
+
+		case 4: // push, pull
+			if (wInstr & 0x40)
+			{
+				HostPioFail("iffull/ifempty is not supported", wInstr);
+				return true;
+			}
+
+			if (!(wInstr & 0x80))
+			{
+				if (psm->nRx == 4)
+				{
+					if (wInstr & 0x20)
+					{
+						return false;
+					}
+				}
+				else
+				{
+					psm->dwRx[psm->nRx++] = psm->dwIsr;
+				}
+
+				psm->dwIsr     = 0;
+				psm->nIsrCount = 0;
+			}
+			else if (psm->nTx == 0)
+			{
+				if (wInstr & 0x20)
+				{
+					return false;
+				}
+
+				psm->dwOsr     = psm->dwX;
+				psm->nOsrCount = 0;
+			}
+			else
+			{
+				psm->dwOsr     = psm->dwTx[0];
+				psm->nOsrCount = 0;
+
+				for (i = 1; i < psm->nTx; ++i)
+				{
+					psm->dwTx[i-1] = psm->dwTx[i];
+				}
+
+				--psm->nTx;
+			}
+
+			break;
+
+		case 5: // mov
+			switch (wInstr & 7)
+			{
+				case 0: dw = HostPioReadPins(); break;
+				case 1: dw = psm->dwX; break;
+				case 2: dw = psm->dwY; break;
+				case 3: dw = 0; break;
+				case 6: dw = psm->dwIsr; break;
+				case 7: dw = psm->dwOsr; break;
+				default: HostPioFail("mov source is not supported", wInstr); return true;
+			}
+
+			if (((wInstr >> 3) & 3) == 1)
+			{
+				dw = ~dw;
+			}
+			else if (((wInstr >> 3) & 3) == 2)
+			{
+				dw = ((dw >> 1) & 0x55555555) | ((dw & 0x55555555) << 1);
+				dw = ((dw >> 2) & 0x33333333) | ((dw & 0x33333333) << 2);
+				dw = ((dw >> 4) & 0x0F0F0F0F) | ((dw & 0x0F0F0F0F) << 4);
+				dw = __builtin_bswap32(dw);
+			}
+
+			switch (nOp)
+			{
+				case 0: HostPioWritePins(psm->c.nOutBase, psm->c.nOutCount, dw, false); break;
+				case 1: psm->dwX = dw; break;
+				case 2: psm->dwY = dw; break;
+				case 5: psm->nPc = dw & 0x1F; bJump = true; break;
+				case 6: psm->dwIsr = dw; psm->nIsrCount = 0; break;
+				case 7: psm->dwOsr = dw; psm->nOsrCount = 0; break;
+				default: HostPioFail("mov destination is not supported", wInstr); return true;
+			}
+
+			break;
+
+		case 7: // set
+			switch (nOp)
+			{
+				case 0: HostPioWritePins(psm->c.nSetBase, psm->c.nSetCount, nIndex, false); break;
+				case 1: psm->dwX = nIndex; break;
+				case 2: psm->dwY = nIndex; break;
+				case 4: HostPioWritePins(psm->c.nSetBase, psm->c.nSetCount, nIndex, true); break;
+				default: HostPioFail("set destination is not supported", wInstr); return true;
+			}
+
+			break;
+
+		default:
+			HostPioFail("wait and irq are not supported", wInstr);
+			return true;
+	}
+
+	if (!bExec)
+	{
+		psm->nDelay = nField & ((1 << (5 - psm->c.nSideCount)) - 1);
+
+		if (!bJump)
+		{
+			psm->nPc = (psm->nPc == psm->c.nWrapTop) ? psm->c.nWrapBottom : ((psm->nPc + 1) & 0x1F);
+		}
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// one system clock cycle
+void HostPioStep(void)
+{
+	if (g_smHost.bEnabled)
+	{
+		if (g_smHost.nDelay > 0)
+		{
+			--g_smHost.nDelay;
+		}
+		else
+		{
+			HostPioExecute(g_smHost.wMem[g_smHost.nPc], false);
+		}
+	}
+
+	g_smHost.dwSync[1] = g_smHost.dwSync[0];
+	g_smHost.dwSync[0] = HostBusPins();
+}
+
+//-----------------------------------------------------------------------------
+void HostPioOutputs(uint32_t* pdwOwned, uint32_t* pdwLevels, uint32_t* pdwDirs)
+{
+	*pdwOwned  = g_smHost.dwOwned;
+	*pdwLevels = g_smHost.dwPins;
+	*pdwDirs   = g_smHost.dwDirs;
+}
+
+//-----------------------------------------------------------------------------
+// the program counter relative to the program, for the tests
+uint HostPioPc(void)
+{
+	return g_smHost.nPc;
+}
+
+//-----------------------------------------------------------------------------
+// the SDK
+
+//-----------------------------------------------------------------------------
+int pio_add_program_at_offset(PIO pio, const pio_program_t* pprog, uint nOffset)
+{
+	uint16_t w;
+	int      i;
+
+	if ((pprog->length == 0) || (nOffset + pprog->length > HOST_PIO_SIZE))
+	{
+		printf("PIO: no program to load, see HostPioAssemble()\n");
+		++g_nHostFailures;
+		return -1;
+	}
+
+	for (i = 0; i < pprog->length; ++i)
+	{
+		w = pprog->instructions[i];
+		g_smHost.wMem[nOffset+i] = ((w & 0xE000) == 0) ? (w + nOffset) : w;
+	}
+
+	return nOffset;
+}
+
+//-----------------------------------------------------------------------------
+int pio_claim_unused_sm(PIO pio, bool bRequired)
+{
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+void pio_sm_set_pins_with_mask(PIO pio, uint nSm, uint32_t dwValues, uint32_t dwMask)
+{
+	HostCore1Access();
+	g_smHost.dwPins = (g_smHost.dwPins & ~dwMask) | (dwValues & dwMask);
+}
+
+//-----------------------------------------------------------------------------
+void pio_sm_set_pindirs_with_mask(PIO pio, uint nSm, uint32_t dwDirs, uint32_t dwMask)
+{
+	HostCore1Access();
+	g_smHost.dwDirs = (g_smHost.dwDirs & ~dwMask) | (dwDirs & dwMask);
+}
+
+//-----------------------------------------------------------------------------
+void pio_gpio_init(PIO pio, uint nPin)
+{
+	HostCore1Access();
+	g_smHost.dwOwned |= 1u << nPin;
+}
+
+//-----------------------------------------------------------------------------
+pio_sm_config pio_get_default_sm_config(void)
+{
+	pio_sm_config c;
+
+	memset(&c, 0, sizeof(c));
+	c.nWrapTop  = HOST_PIO_SIZE - 1;
+	c.bInRight  = true;
+	c.bOutRight = true;
+
+	return c;
+}
+
+//-----------------------------------------------------------------------------
+pio_sm_config z80_bus_program_get_default_config(uint nOffset)
+{
+	pio_sm_config c = pio_get_default_sm_config();
+
+	sm_config_set_wrap(&c, nOffset + g_nWrapTarget, nOffset + g_nWrap);
+	sm_config_set_sideset(&c, g_nSideCount, g_bSideOpt, g_bSidePindirs);
+
+	return c;
+}
+
+//-----------------------------------------------------------------------------
+void sm_config_set_in_pins(pio_sm_config* pc, uint nBase)
+{
+	pc->nInBase = nBase;
+}
+
+//-----------------------------------------------------------------------------
+void sm_config_set_out_pins(pio_sm_config* pc, uint nBase, uint nCount)
+{
+	pc->nOutBase  = nBase;
+	pc->nOutCount = nCount;
+}
+
+//-----------------------------------------------------------------------------
+void sm_config_set_set_pins(pio_sm_config* pc, uint nBase, uint nCount)
+{
+	pc->nSetBase  = nBase;
+	pc->nSetCount = nCount;
+}
+
+//-----------------------------------------------------------------------------
+void sm_config_set_sideset_pins(pio_sm_config* pc, uint nBase)
+{
+	pc->nSideBase = nBase;
+}
+
+//-----------------------------------------------------------------------------
+void sm_config_set_sideset(pio_sm_config* pc, uint nCount, bool bOptional, bool bPindirs)
+{
+	pc->nSideCount   = nCount;
+	pc->bSideOpt     = bOptional;
+	pc->bSidePindirs = bPindirs;
+}
+
+//-----------------------------------------------------------------------------
+void sm_config_set_jmp_pin(pio_sm_config* pc, uint nPin)
+{
+	pc->nJmpPin = nPin;
+}
+
+//-----------------------------------------------------------------------------
+void sm_config_set_wrap(pio_sm_config* pc, uint nBottom, uint nTop)
+{
+	pc->nWrapBottom = nBottom;
+	pc->nWrapTop    = nTop;
+}
+
+//-----------------------------------------------------------------------------
+void sm_config_set_in_shift(pio_sm_config* pc, bool bRight, bool bAutoPush, uint nThreshold)
+{
+	pc->bInRight = bRight;
+
+	if (bAutoPush)
+	{
+		printf("PIO: autopush is not supported\n");
+		++g_nHostFailures;
+	}
+}
+
+//-----------------------------------------------------------------------------
+void sm_config_set_out_shift(pio_sm_config* pc, bool bRight, bool bAutoPull, uint nThreshold)
+{
+	pc->bOutRight = bRight;
+
+	if (bAutoPull)
+	{
+		printf("PIO: autopull is not supported\n");
+		++g_nHostFailures;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the state machine runs at the system clock, one step per cycle
+void sm_config_set_clkdiv(pio_sm_config* pc, float fDiv)
+{
+	if (fDiv != 1.0f)
+	{
+		printf("PIO: only a clock divider of 1 is supported\n");
+		++g_nHostFailures;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// as the SDK does it: the configuration, FIFOs and shift counters, and then a
+// jmp to the start executed on the machine (with side-set 0)
+int pio_sm_init(PIO pio, uint nSm, uint nPc, const pio_sm_config* pc)
+{
+	HostCore1Access();
+
+	g_smHost.bEnabled  = false;
+	g_smHost.c         = *pc;
+	g_smHost.nTx       = 0;
+	g_smHost.nRx       = 0;
+	g_smHost.dwIsr     = 0;
+	g_smHost.nIsrCount = 0;
+	g_smHost.dwOsr     = 0;
+	g_smHost.nOsrCount = 32;
+	g_smHost.nDelay    = 0;
+
+	HostPioExecute(nPc & 0x1F, true);
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+void pio_sm_exec(PIO pio, uint nSm, uint nInstr)
+{
+	HostCore1Access();
+	HostPioExecute(nInstr, true);
+}
+
+//-----------------------------------------------------------------------------
+uint pio_encode_set(enum pio_src_dest dest, uint nValue)
+{
+	return 0xE000 | (dest << 5) | (nValue & 0x1F);
+}
+
+//-----------------------------------------------------------------------------
+uint pio_encode_sideset(uint nCount, uint nValue)
+{
+	return nValue << (13 - nCount);
+}
+
+//-----------------------------------------------------------------------------
+void pio_sm_set_enabled(PIO pio, uint nSm, bool bEnabled)
+{
+	HostCore1Access();
+	g_smHost.bEnabled = bEnabled;
+}
+
+//-----------------------------------------------------------------------------
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint nSm)
+{
+	HostCore1Access();
+	return g_smHost.nRx == 0;
+}
+
+//-----------------------------------------------------------------------------
+// a write to a full FIFO is lost, as on the chip
+void pio_sm_put(PIO pio, uint nSm, uint32_t dw)
+{
+	HostCore1Access();
+
+	if (g_smHost.nTx < 4)
+	{
+		g_smHost.dwTx[g_smHost.nTx++] = dw;
+	}
+}
+
+//-----------------------------------------------------------------------------
+uint32_t pio_sm_get(PIO pio, uint nSm)
+{
+	uint32_t dw;
+	int      i;
+
+	HostCore1Access();
+
+	if (g_smHost.nRx == 0)
+	{
+		return 0xFFFFFFFF;
+	}
+
+	dw = g_smHost.dwRx[0];
+
+	for (i = 1; i < g_smHost.nRx; ++i)
+	{
+		g_smHost.dwRx[i-1] = g_smHost.dwRx[i];
+	}
+
+	--g_smHost.nRx;
+
+	return dw;
+}
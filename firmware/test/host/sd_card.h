@@ -0,0 +1,4 @@
+#pragma once
+#include "ff.h"
+typedef struct { const char* pcName; FATFS fatfs; } sd_card_t;
+size_t sd_get_num(void); sd_card_t* sd_get_by_num(size_t); bool sd_init_driver(void);
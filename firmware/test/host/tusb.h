@@ -0,0 +1,4 @@
+#pragma once
+#include "pico/stdlib.h"
+#include <stdbool.h>
+uint32_t tud_cdc_write_available(void); bool tud_cdc_connected(void);
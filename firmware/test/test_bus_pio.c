@@ -0,0 +1,298 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "defines.h"
+#include "fdc.h"
+#include "memory.h"
+#include "ramdisk.h"
+#include "host.h"
+
+//-----------------------------------------------------------------------------
+// The PIO bus front-end: bus.pio, assembled from the tree, runs against the
+// Z80 of host/bus.c while memory.c (built with ENABLE_PIO_BUS) answers its
+// events with PioBusService().  Every cycle for the Floppy80 has to read what
+// was put there or store what the Z80 wrote, every other cycle has to be left
+// alone, and the board model flags any two drivers on the same bus.
+
+extern BufferType g_bFdcRequest;
+extern BufferType g_bFdcResponse;
+extern byte       g_byWindow[FDC_WINDOW_SIZE];
+
+#define HALF_T_1M77 42		// system clock cycles (150MHz) per half T state
+#define HALF_T_4M   19
+
+#define TEST_CYCLES 3000
+#define TEST_MEMORY 0x8000	// the part of the upper 32K the random test uses
+#define TEST_SIZE   0x100
+
+static HostZ80CycleType g_cyList[TEST_CYCLES];
+static int              g_nCycles;
+static uint32_t         g_dwRandom = 4711;
+static byte             g_byShadow[TEST_SIZE];
+static int              g_nWaits;			// wait states of the runs
+
+//-----------------------------------------------------------------------------
+static int Random(int nRange)
+{
+	g_dwRandom = g_dwRandom * 1103515245 + 12345;
+	return (g_dwRandom >> 16) % nRange;
+}
+
+//-----------------------------------------------------------------------------
+static void Cycle(int nType, word wAddr, word wRefresh, byte byData, int bOurs)
+{
+	HostZ80CycleType* pcy = &g_cyList[g_nCycles++];
+
+	memset(pcy, 0, sizeof(*pcy));
+	pcy->nType    = nType;
+	pcy->wAddr    = wAddr;
+	pcy->wRefresh = wRefresh;
+	pcy->byData   = byData;
+	pcy->bOurs    = bOurs;
+}
+
+//-----------------------------------------------------------------------------
+// runs the cycles listed with core1 answering the events, until the state
+// machine is back waiting for the next strobe
+static void Run(int nHalfT)
+{
+	int nWaits = 0;
+	int i;
+
+	HostBusStart(g_cyList, g_nCycles, nHalfT);
+
+	while (!HostBusDone())
+	{
+		PioBusService();
+	}
+
+	// a slow core1 may still have events to answer, then none may be left
+	for (i = 0; (i < 10) && PioBusService(); ++i);
+
+	for (i = 0; i < 100; ++i)
+	{
+		CHECK(!PioBusService());
+	}
+
+	CHECK((HostPioPc() >= 3) && (HostPioPc() <= 7));
+
+	for (i = 0; i < g_nCycles; ++i)
+	{
+		nWaits += g_cyList[i].nWaits;
+
+		if (!g_cyList[i].bOurs && ((g_cyList[i].nType == eZ80Read) || (g_cyList[i].nType == eZ80In)))
+		{
+			CHECK_EQ(g_cyList[i].byRead, 0xFF);
+		}
+	}
+
+	// core1 only holds the Z80 when told to
+	if (g_byEnableWaitStates == eWaitOff)
+	{
+		CHECK_EQ(nWaits, 0);
+	}
+
+	g_nWaits += nWaits;
+
+	CHECK_EQ(g_nHostBusErrors, 0);
+	g_nCycles = 0;
+}
+
+//-----------------------------------------------------------------------------
+// latency statistics of the handler of a memory address or of a port
+static BusStatType* MemoryStats(word wAddr)
+{
+	return &g_bsStats[g_pbyPage[wAddr >> 8][wAddr & 0xFF]];
+}
+
+static BusStatType* PortStats(byte byPort, bool bIn)
+{
+	return &g_bsStats[bIn ? g_byPortIn[byPort] : g_byPortOut[byPort]];
+}
+
+//-----------------------------------------------------------------------------
+// one cycle of each kind the Floppy80 answers, and the ones it must not
+static void TestDirected(int nHalfT)
+{
+	byte* pby = BusGetHighMemory(0x8000, 0x8000);
+
+	BusClearStats();
+
+	g_byDriveStatus = 0x15;
+	g_bFdcResponse.cmd[1] = 0x33;
+	g_bFdcResponse.buf[0] = 0x44;
+
+	Cycle(eZ80Write, 0x8123, 0, 0x5A, true);
+	Cycle(eZ80Write, 0xFFFF, 0, 0xA5, true);
+	Cycle(eZ80Read,  0x8123, 0, 0x5A, true);
+	Cycle(eZ80Read,  0xFFFF, 0, 0xA5, true);
+	Cycle(eZ80Write, 0x37ED, 0, 0x12, true);
+	Cycle(eZ80Read,  0x37ED, 0, 0x12, true);
+	Cycle(eZ80Write, 0x37EE, 0, 0x05, true);
+	Cycle(eZ80Read,  0x37EE, 0, 0x05, true);
+	Cycle(eZ80Read,  0x37E1, 0, 0x15, true);
+	Cycle(eZ80Write, FDC_REQUEST_ADDR_START, 0, 0x11, true);
+	Cycle(eZ80Write, FDC_REQUEST_ADDR_START + 5, 0, 0x22, true);
+	Cycle(eZ80Read,  FDC_RESPONSE_ADDR_START + 1, 0, 0x33, true);
+	Cycle(eZ80Read,  FDC_RESPONSE_ADDR_START + FDC_CMD_SIZE, 0, 0x44, true);
+	Cycle(eZ80Write, FDC_WINDOW_ADDR_START + 7, 0, 0x66, true);
+	Cycle(eZ80Read,  FDC_WINDOW_ADDR_START + 7, 0, 0x66, true);
+	Cycle(eZ80Out,   0xD1, 0, 0x77, true);
+	Cycle(eZ80In,    0xD1, 0, 0x77, true);
+	Cycle(eZ80In,    0xD4, 0, 2, true);
+	Cycle(eZ80Read,  0x0000, 0, 0, false);
+	Cycle(eZ80Write, 0x4000, 0, 0x99, false);
+	Cycle(eZ80In,    0xFF, 0, 0, false);
+	Cycle(eZ80Out,   0xFF, 0, 0x98, false);
+	Cycle(eZ80In,    0xC0, 0, 0, false);		// VHD is off
+	Cycle(eZ80Fetch, 0x8123, 0x37ED, 0x5A, true);
+	Cycle(eZ80Fetch, 0x0100, 0x8123, 0, false);
+	Cycle(eZ80Fetch, 0x0101, FDC_REQUEST_ADDR_START, 0, false);
+	Run(nHalfT);
+
+	CHECK_EQ(pby[0x0123], 0x5A);
+	CHECK_EQ(pby[0x7FFF], 0xA5);
+	CHECK_EQ(fdc_read_track(), 0x12);
+	CHECK_EQ(fdc_read_sector(), 0x05);
+	CHECK_EQ(g_bFdcRequest.cmd[0], 0x11);
+	CHECK_EQ(g_bFdcRequest.buf[3], 0x22);
+	CHECK_EQ(g_byWindow[7], 0x66);
+
+	// every cycle dispatched is recorded with its handler, refreshes and
+	// the cycles for others are not
+	CHECK_EQ(MemoryStats(0x8000)->dwCount, 5);
+	CHECK_EQ(MemoryStats(0x37ED)->dwCount, 2);
+	CHECK_EQ(MemoryStats(0x37EE)->dwCount, 2);
+	CHECK_EQ(MemoryStats(0x37E1)->dwCount, 1);
+	CHECK_EQ(MemoryStats(FDC_REQUEST_ADDR_START)->dwCount, 2);
+	CHECK_EQ(MemoryStats(FDC_RESPONSE_ADDR_START)->dwCount, 2);
+	CHECK_EQ(MemoryStats(FDC_WINDOW_ADDR_START)->dwCount, 2);
+	CHECK_EQ(PortStats(0xD1, true)->dwCount, 2);
+	CHECK_EQ(PortStats(0xD1, false)->dwCount, 1);
+	CHECK_EQ(g_bsStats[0].dwCount, 0);
+	CHECK(MemoryStats(0x8000)->dwMin > 0);
+	CHECK(MemoryStats(0x8000)->dwMin <= MemoryStats(0x8000)->dwMax);
+}
+
+//-----------------------------------------------------------------------------
+// a pseudo random mix of cycles over part of the upper 32K, the RAM disk
+// offset port and addresses that are not the Floppy80's
+static void TestRandom(int nHalfT)
+{
+	byte* pby = BusGetHighMemory(TEST_MEMORY, TEST_SIZE);
+	byte  byOffset = 0x77;
+	word  wAddr;
+	int   i;
+
+	memcpy(g_byShadow, pby, TEST_SIZE);
+	Cycle(eZ80Out, 0xD1, 0, byOffset, true);
+
+	for (i = 1; i < TEST_CYCLES; ++i)
+	{
+		wAddr = Random(TEST_SIZE);
+
+		switch (Random(8))
+		{
+			case 0:
+				g_byShadow[wAddr] = Random(256);
+				Cycle(eZ80Write, TEST_MEMORY + wAddr, 0, g_byShadow[wAddr], true);
+				break;
+
+			case 1:
+				Cycle(eZ80Read, TEST_MEMORY + wAddr, 0, g_byShadow[wAddr], true);
+				break;
+
+			case 2:
+				Cycle(eZ80Fetch, TEST_MEMORY + wAddr, Random(0x10000), g_byShadow[wAddr], true);
+				break;
+
+			case 3:
+				Cycle(eZ80Fetch, Random(0x3000), TEST_MEMORY + Random(TEST_SIZE), 0, false);
+				break;
+
+			case 4:
+				Cycle(eZ80Read, 0x4000 + Random(0x4000), 0, 0, false);
+				break;
+
+			case 5:
+				Cycle(eZ80Write, 0x4000 + Random(0x4000), 0, Random(256), false);
+				break;
+
+			case 6:
+				byOffset = Random(256);
+				Cycle(eZ80Out, 0xD1, 0, byOffset, true);
+				break;
+
+			case 7:
+				Cycle(eZ80In, 0xD1, 0, byOffset, true);
+				break;
+		}
+	}
+
+	Run(nHalfT);
+
+	CHECK(memcmp(pby, g_byShadow, TEST_SIZE) == 0);
+}
+
+//-----------------------------------------------------------------------------
+// core1 far too slow for a write: the state machine pushes no data once the
+// cycle has ended, the event of the next cycle must not be taken for it
+static void TestLateWrite(void)
+{
+	byte* pby = BusGetHighMemory(0x8000, 0x8000);
+
+	pby[0x0200] = 0x24;
+
+	g_nHostAccessCycles = 64;
+	Cycle(eZ80Write, 0x8200, 0, 0x42, false);
+	Cycle(eZ80Read,  0x0000, 0, 0, false);
+	Cycle(eZ80Read,  0x0001, 0, 0, false);
+	Run(HALF_T_1M77);
+
+	CHECK((pby[0x0200] == 0x24) || (pby[0x0200] == 0x42));
+
+	g_nHostAccessCycles = 4;
+	Cycle(eZ80Read, 0x8200, 0, pby[0x0200], true);
+	Run(HALF_T_1M77);
+}
+
+//-----------------------------------------------------------------------------
+int main(void)
+{
+	HostInit();
+
+	CHECK(HostPioAssemble(HOST_BUS_PIO));
+
+	g_byEnableUpperMem   = true;
+	g_byEnableVhd        = false;
+	g_byRamDiskBanks     = 2;
+	g_byEnableWaitStates = eWaitOff;
+	BusMapInit();
+
+	// the transceivers have to stay off while the pins are handed to the PIO
+	HostBusPowerOn();
+	PioBusInit();
+	HostBusRun(100);
+	CHECK_EQ(g_nHostBusErrors, 0);
+
+	TestDirected(HALF_T_1M77);
+	TestRandom(HALF_T_1M77);
+
+	TestDirected(HALF_T_4M);
+	TestRandom(HALF_T_4M);
+
+	// core1 four times slower, it still raises WAIT before T2 and the Z80 is
+	// held until the answer is there
+	g_nHostAccessCycles  = 16;
+	g_byEnableWaitStates = eWaitAlways;
+	g_nWaits             = 0;
+	TestDirected(HALF_T_1M77);
+	TestRandom(HALF_T_1M77);
+	CHECK(g_nWaits > 0);
+
+	g_byEnableWaitStates = eWaitOff;
+	TestLateWrite();
+
+	return HostResult("test_bus_pio");
+}
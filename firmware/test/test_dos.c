@@ -0,0 +1,580 @@
+#include <string.h>
+
+#include "defines.h"
+#include "file.h"
+#include "fdc.h"
+#include "cache.h"
+#include "dos.h"
+#include "host.h"
+
+//-----------------------------------------------------------------------------
+// DOS files on DMK images (dos.c).  The disks are laid out as the DOSes
+// themselves lay them out: the boot sector gives the directory track, the GAT
+// has the granules a track does not have set along with those in use (and the
+// same in the lockout table), BOOT/SYS and DIR/SYS are DECs 0 and 1, LDOS
+// keeps its version at CBh of the GAT, and a file with more extents than its
+// entry holds carries on in an extended (FXDE) entry.
+
+extern FdcDriveType g_dtDives[MAX_DRIVES];
+
+#define DISK_MAX_TRACKS  40
+#define DISK_MAX_SECTORS 18
+
+typedef struct {
+	int  nType;
+	int  nDensity;
+	int  nTracks;
+	int  nSectors;
+	int  nDirTrack;
+	int  nGranSectors;
+	int  nGransTrack;
+	int  nEntrySize;
+	BYTE bySector[DISK_MAX_TRACKS][DISK_MAX_SECTORS][DOS_SECTOR_SIZE];
+} TestDiskType;
+
+static TestDiskType g_tdDisk;
+static BYTE         g_byData[600000];
+static BYTE         g_byRead[600000];
+
+//-----------------------------------------------------------------------------
+static void FillSector(int nSide, int nTrack, int nSector, BYTE* pby)
+{
+	if ((nSide == 0) && (nTrack < g_tdDisk.nTracks) && (nSector < g_tdDisk.nSectors))
+	{
+		memcpy(pby, g_tdDisk.bySector[nTrack][nSector], DOS_SECTOR_SIZE);
+	}
+}
+
+//-----------------------------------------------------------------------------
+static BYTE* Gat(void)
+{
+	return g_tdDisk.bySector[g_tdDisk.nDirTrack][0];
+}
+
+//-----------------------------------------------------------------------------
+static BYTE* Hit(void)
+{
+	return g_tdDisk.bySector[g_tdDisk.nDirTrack][1];
+}
+
+//-----------------------------------------------------------------------------
+static BYTE* Entry(int nDec)
+{
+	return g_tdDisk.bySector[g_tdDisk.nDirTrack][(nDec & 0x1F) + 2] + (nDec >> 5) * g_tdDisk.nEntrySize;
+}
+
+//-----------------------------------------------------------------------------
+static void MakeData(BYTE* pby, int nSize, int nSeed)
+{
+	int i;
+
+	for (i = 0; i < nSize; ++i)
+	{
+		pby[i] = (i * 7 + nSeed + (i >> 8)) & 0xFF;
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void UseGranules(int nTrack, BYTE byRun)
+{
+	int i;
+
+	for (i = byRun >> 5; i <= (byRun >> 5) + (byRun & 0x1F); ++i)
+	{
+		Gat()[nTrack + i / g_tdDisk.nGransTrack] |= 1 << (i % g_tdDisk.nGransTrack);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// byExtents ends with FFh, the entries of the file are pnDecs[] in order.
+// pbyData NULL leaves the sectors as they are (the system files).
+static void AddFile(int* pnDecs, char* pszName, BYTE byAttrib, BYTE* pbyData, int nSize, BYTE* pbyExtents)
+{
+	int   nPerEntry = (g_tdDisk.nEntrySize - DOS_DIR_EXTENTS) / 2 - 1;
+	int   nSectors  = (nSize + DOS_SECTOR_SIZE - 1) / DOS_SECTOR_SIZE;
+	int   nSector   = 0;
+	int   nEntry    = 0;
+	int   nExtent   = 0;
+	BYTE* pby;
+	BYTE  byName[DOS_NAME_SIZE];
+	int   nGran, i, j, k;
+
+	DosMakeName(pszName, byName);
+
+	// the data, granule by granule
+	for (i = 0; pbyExtents[i*2] != 0xFF; ++i)
+	{
+		UseGranules(pbyExtents[i*2], pbyExtents[i*2+1]);
+
+		for (j = 0; j <= (pbyExtents[i*2+1] & 0x1F); ++j)
+		{
+			nGran = pbyExtents[i*2] * g_tdDisk.nGransTrack + (pbyExtents[i*2+1] >> 5) + j;
+
+			for (k = 0; k < g_tdDisk.nGranSectors; ++k, ++nSector)
+			{
+				pby = g_tdDisk.bySector[nGran / g_tdDisk.nGransTrack][(nGran % g_tdDisk.nGransTrack) * g_tdDisk.nGranSectors + k];
+
+				if ((pbyData != NULL) && (nSector < nSectors))
+				{
+					memset(pby, 0, DOS_SECTOR_SIZE);
+					memcpy(pby, pbyData + nSector * DOS_SECTOR_SIZE, (nSize - nSector * DOS_SECTOR_SIZE < DOS_SECTOR_SIZE) ? nSize - nSector * DOS_SECTOR_SIZE : DOS_SECTOR_SIZE);
+				}
+			}
+		}
+	}
+
+	// the entries
+	do
+	{
+		pby = Entry(pnDecs[nEntry]);
+		memset(pby, 0, g_tdDisk.nEntrySize);
+		memset(pby + DOS_DIR_EXTENTS, 0xFF, g_tdDisk.nEntrySize - DOS_DIR_EXTENTS);
+
+		pby[DOS_DIR_ATTRIB] = (nEntry == 0) ? byAttrib : (DOS_ATTRIB_USED | DOS_ATTRIB_FXDE);
+		memcpy(pby + DOS_DIR_NAME, byName, DOS_NAME_SIZE);
+		pby[DOS_DIR_UPDATEPW]   = DOS_BLANK_PW & 0xFF;
+		pby[DOS_DIR_UPDATEPW+1] = DOS_BLANK_PW >> 8;
+		pby[DOS_DIR_ACCESSPW]   = DOS_BLANK_PW & 0xFF;
+		pby[DOS_DIR_ACCESSPW+1] = DOS_BLANK_PW >> 8;
+
+		if (nEntry == 0)
+		{
+			// LDOS counts the whole sectors before the end of file, TRSDOS 2.3 the sectors
+			i = (g_tdDisk.nType == eDosLdos) ? (nSize / DOS_SECTOR_SIZE) : nSectors;
+
+			pby[DOS_DIR_EOF]     = nSize % DOS_SECTOR_SIZE;
+			pby[DOS_DIR_ERN]     = i & 0xFF;
+			pby[DOS_DIR_ERN+1]   = i >> 8;
+		}
+		else
+		{
+			pby[1] = pnDecs[0];		// back to the primary entry
+		}
+
+		for (i = 0; (i < nPerEntry) && (pbyExtents[nExtent*2] != 0xFF); ++i, ++nExtent)
+		{
+			pby[DOS_DIR_EXTENTS+i*2]   = pbyExtents[nExtent*2];
+			pby[DOS_DIR_EXTENTS+i*2+1] = pbyExtents[nExtent*2+1];
+		}
+
+		Hit()[pnDecs[nEntry]] = DosHash(byName);
+
+		if (pbyExtents[nExtent*2] != 0xFF)
+		{
+			pby[DOS_DIR_EXTENTS+i*2]   = 0xFE;
+			pby[DOS_DIR_EXTENTS+i*2+1] = pnDecs[nEntry+1];
+		}
+
+		++nEntry;
+	}
+	while (pbyExtents[nExtent*2] != 0xFF);
+}
+
+//-----------------------------------------------------------------------------
+// a freshly formatted system disk: BOOT/SYS on track 0, DIR/SYS the directory
+// track
+static void NewDisk(int nType, int nDensity)
+{
+	int   nDecs[1];
+	BYTE  byExtents[4];
+	BYTE  byUnused;
+	BYTE* pby;
+	int   i;
+
+	memset(&g_tdDisk, 0, sizeof(g_tdDisk));
+	memset(g_tdDisk.bySector, 0xE5, sizeof(g_tdDisk.bySector));
+
+	g_tdDisk.nType        = nType;
+	g_tdDisk.nDensity     = nDensity;
+	g_tdDisk.nTracks      = (nType == eDosTrsdos23) ? 35 : 40;
+	g_tdDisk.nSectors     = (nDensity == eDD) ? 18 : 10;
+	g_tdDisk.nDirTrack    = (nType == eDosTrsdos23) ? 17 : 20;
+	g_tdDisk.nGranSectors = (nDensity == eDD) ? 6 : 5;
+	g_tdDisk.nGransTrack  = g_tdDisk.nSectors / g_tdDisk.nGranSectors;
+	g_tdDisk.nEntrySize   = (nType == eDosTrsdos23) ? 48 : 32;
+
+	// boot sector
+	pby = g_tdDisk.bySector[0][0];
+	pby[0] = 0x00;
+	pby[1] = 0xFE;
+	pby[2] = g_tdDisk.nDirTrack;
+
+	// GAT and lockout table, the granules a track does not have are set
+	pby = Gat();
+	memset(pby, 0xFF, DOS_SECTOR_SIZE);
+	byUnused = 0xFF << g_tdDisk.nGransTrack;
+
+	for (i = 0; i < g_tdDisk.nTracks; ++i)
+	{
+		pby[i]             = byUnused;
+		pby[DOS_LOCKOUT+i] = byUnused;
+	}
+
+	if (nType == eDosLdos)
+	{
+		pby[0xCB] = 0x51;
+		pby[0xCC] = 0x00;
+		memcpy(pby + 0xD0, "LDOSDISK01/01/87", 16);
+	}
+	else
+	{
+		memcpy(pby + 0xD0, "TRSDOS  09/01/80", 16);
+	}
+
+	// HIT and directory sectors
+	memset(Hit(), 0, DOS_SECTOR_SIZE);
+
+	for (i = 2; i < g_tdDisk.nSectors; ++i)
+	{
+		memset(g_tdDisk.bySector[g_tdDisk.nDirTrack][i], 0, DOS_SECTOR_SIZE);
+	}
+
+	byExtents[0] = 0;
+	byExtents[1] = g_tdDisk.nGransTrack - 1;
+	byExtents[2] = 0xFF;
+	byExtents[3] = 0xFF;
+	nDecs[0]     = 0x00;
+	AddFile(nDecs, "BOOT/SYS", 0x5F, NULL, DOS_SECTOR_SIZE, byExtents);
+
+	byExtents[0] = g_tdDisk.nDirTrack;
+	nDecs[0]     = 0x01;
+	AddFile(nDecs, "DIR/SYS", 0x5F, NULL, g_tdDisk.nSectors * DOS_SECTOR_SIZE, byExtents);
+}
+
+//-----------------------------------------------------------------------------
+static void Unmount(int nDrive)
+{
+	FdcFlushImageSectors();
+	FdcInvalidateTracks(nDrive);
+	FlashCacheDetach(nDrive);
+	FileClose(g_dtDives[nDrive].f);
+	memset(&g_dtDives[nDrive], 0, sizeof(FdcDriveType));
+}
+
+//-----------------------------------------------------------------------------
+// the image may be the one in drive 0 (same name as the test before)
+static void WriteDisk(char* pszName, int nSides)
+{
+	Unmount(0);
+	CHECK(HostWriteDmk(pszName, g_tdDisk.nTracks, nSides, g_tdDisk.nDensity, g_tdDisk.nSectors, FillSector));
+}
+
+//-----------------------------------------------------------------------------
+static void Mount(int nDrive, char* pszName)
+{
+	Unmount(nDrive);
+	strcpy(g_dtDives[nDrive].szFileName, pszName);
+	FdcMountDrive(nDrive);
+	CHECK(g_dtDives[nDrive].f != NULL);
+}
+
+//-----------------------------------------------------------------------------
+// reads a whole file through DosOpenRead() / DosRead(), nChunk bytes a call
+static int ReadFile(int nDrive, char* pszName, int nChunk)
+{
+	uint32_t dwSize;
+	int      nRead, nTotal = 0;
+
+	if (DosOpenRead(nDrive, pszName, &dwSize) != eDosOk)
+	{
+		return -1;
+	}
+
+	while ((nRead = DosRead(g_byRead + nTotal, nChunk)) > 0)
+	{
+		nTotal += nRead;
+	}
+
+	CHECK_EQ(nTotal, dwSize);
+	return nTotal;
+}
+
+//-----------------------------------------------------------------------------
+static int UsedGranules(void)
+{
+	DosDiskType dd;
+	int nUsed = 0;
+	int i, j;
+
+	if (DosOpen(&dd, 0) != eDosOk)
+	{
+		return -1;
+	}
+
+	for (i = 0; i < dd.nTracks; ++i)
+	{
+		for (j = 0; j < dd.nGransTrack; ++j)
+		{
+			nUsed += (dd.byGat[i] >> j) & 1;
+		}
+	}
+
+	return nUsed;
+}
+
+//-----------------------------------------------------------------------------
+// the files of the disk in drive 0 in DEC order, as NAME/EXT:size
+static void ListFiles(char* pszPattern, char* pszList)
+{
+	DosFileType df;
+	int nResult;
+
+	*pszList = 0;
+	nResult  = DosFindFirst(0, pszPattern, &df);
+
+	while (nResult == eDosOk)
+	{
+		sprintf(pszList + strlen(pszList), "%s%s:%u", (*pszList != 0) ? " " : "", df.szName, df.dwSize);
+		nResult = DosFindNext(&df);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// import of a new file and over an existing one, checked by reading it back
+// and from the granules in use
+static void CheckImport(int nGranSize)
+{
+	char     szImage[128];
+	int      nUsed = UsedGranules();
+	uint32_t dwSize;
+
+	strcpy(szImage, g_dtDives[0].szFileName);
+
+	MakeData(g_byData, 1500, 21);
+	CHECK(HostWriteFile("IN.TXT", g_byData, 1500));
+	CHECK_EQ(DosImport(0, "IN.TXT", NULL, &dwSize), eDosOk);
+	CHECK_EQ(dwSize, 1500);
+	CHECK_EQ(UsedGranules(), nUsed + (1500 + nGranSize - 1) / nGranSize);
+
+	// the image on the SD-Card has it once mounted again
+	Mount(0, szImage);
+	CHECK_EQ(ReadFile(0, "IN/TXT", 512), 1500);
+	CHECK(memcmp(g_byRead, g_byData, 1500) == 0);
+
+	MakeData(g_byData, 300, 33);
+	CHECK(HostWriteFile("IN.TXT", g_byData, 300));
+	CHECK_EQ(DosImport(0, "IN.TXT", "IN/TXT", &dwSize), eDosOk);
+	CHECK_EQ(UsedGranules(), nUsed + 1);
+	CHECK_EQ(ReadFile(0, "IN/TXT", 77), 300);
+	CHECK(memcmp(g_byRead, g_byData, 300) == 0);
+}
+
+//-----------------------------------------------------------------------------
+static void TestTrsdos23(void)
+{
+	static BYTE byHello[] = {5, 0x00, 0xFF, 0xFF};
+	static BYTE byBig[]   = {7, 0x01, 9, 0x21, 0xFF, 0xFF};	// track 7 both, track 9 granule 1 and track 10 granule 0
+	char szList[256];
+	int  nDec, nFiles;
+
+	NewDisk(eDosTrsdos23, eSD);
+
+	MakeData(g_byData, 600, 1);
+	nDec = 0x40;
+	AddFile(&nDec, "HELLO/BAS", DOS_ATTRIB_USED, g_byData, 600, byHello);
+
+	MakeData(g_byData + 600, 4000, 2);
+	nDec = 0x41;
+	AddFile(&nDec, "BIG/DAT", DOS_ATTRIB_USED, g_byData + 600, 4000, byBig);
+
+	WriteDisk("trsdos.dmk", 1);
+	Mount(0, "trsdos.dmk");
+
+	ListFiles("", szList);
+	CHECK(strcmp(szList, "BOOT/SYS:256 DIR/SYS:2560 HELLO/BAS:600 BIG/DAT:4000") == 0);
+	ListFiles("*/DAT", szList);
+	CHECK(strcmp(szList, "BIG/DAT:4000") == 0);
+	ListFiles("H*", szList);
+	CHECK(strcmp(szList, "HELLO/BAS:600") == 0);
+
+	CHECK_EQ(ReadFile(0, "HELLO/BAS", 1000), 600);
+	CHECK(memcmp(g_byRead, g_byData, 600) == 0);
+	CHECK_EQ(ReadFile(0, "BIG/DAT", 100), 4000);
+	CHECK(memcmp(g_byRead, g_byData + 600, 4000) == 0);
+	CHECK_EQ(ReadFile(0, "NONE/DAT", 100), -1);
+
+	CHECK_EQ(DosExport(0, "BIG/DAT", &nFiles), eDosOk);
+	CHECK_EQ(nFiles, 1);
+	CHECK_EQ(HostReadFile("BIG.DAT", g_byRead, sizeof(g_byRead)), 4000);
+	CHECK(memcmp(g_byRead, g_byData + 600, 4000) == 0);
+
+	CheckImport(5 * DOS_SECTOR_SIZE);
+}
+
+//-----------------------------------------------------------------------------
+// nDensity eSD or eDD, with a file whose extents carry on in an extended entry
+static void TestLdos(int nDensity)
+{
+	static BYTE byLong[] = {3, 0x20, 5, 0x20, 7, 0x20, 9, 0x20, 11, 0x20, 0xFF, 0xFF};
+	static BYTE byNote[] = {13, 0x00, 0xFF, 0xFF};
+	char szList[256];
+	char szExpect[256];
+	int  nGranSize = ((nDensity == eDD) ? 6 : 5) * DOS_SECTOR_SIZE;
+	int  nDecs[2], nFiles;
+
+	NewDisk(eDosLdos, nDensity);
+
+	MakeData(g_byData, 5 * nGranSize - 100, 3);
+	nDecs[0] = 0x42;
+	nDecs[1] = 0x63;
+	AddFile(nDecs, "LONG/DAT", DOS_ATTRIB_USED, g_byData, 5 * nGranSize - 100, byLong);
+
+	MakeData(g_byData + 5 * nGranSize, 256, 4);
+	nDecs[0] = 0x45;
+	AddFile(nDecs, "NOTE/TXT", DOS_ATTRIB_USED, g_byData + 5 * nGranSize, 256, byNote);
+
+	WriteDisk("ldos.dmk", 1);
+	Mount(0, "ldos.dmk");
+
+	// the extended entry is not a file of its own
+	ListFiles("", szList);
+	sprintf(szExpect, "BOOT/SYS:256 DIR/SYS:%d LONG/DAT:%d NOTE/TXT:256", g_tdDisk.nSectors * DOS_SECTOR_SIZE, 5 * nGranSize - 100);
+	CHECK(strcmp(szList, szExpect) == 0);
+
+	CHECK_EQ(ReadFile(0, "LONG/DAT", 333), 5 * nGranSize - 100);
+	CHECK(memcmp(g_byRead, g_byData, 5 * nGranSize - 100) == 0);
+	CHECK_EQ(ReadFile(0, "NOTE/TXT", 256), 256);
+	CHECK(memcmp(g_byRead, g_byData + 5 * nGranSize, 256) == 0);
+
+	CHECK_EQ(DosExport(0, "*/*", &nFiles), eDosOk);
+	CHECK_EQ(nFiles, 4);
+	CHECK_EQ(HostReadFile("LONG.DAT", g_byRead, sizeof(g_byRead)), 5 * nGranSize - 100);
+	CHECK(memcmp(g_byRead, g_byData, 5 * nGranSize - 100) == 0);
+
+	CheckImport(nGranSize);
+}
+
+//-----------------------------------------------------------------------------
+static void TestNotDos(void)
+{
+	DosFileType df;
+	uint32_t    dwSize;
+	int         nSize;
+
+	// only side 0 would be read of a double sided disk
+	NewDisk(eDosLdos, eDD);
+	WriteDisk("ds.dmk", 2);
+	nSize = HostReadFile("ds.dmk", g_byData, sizeof(g_byData));
+	Mount(0, "ds.dmk");
+
+	CHECK_EQ(DosFindFirst(0, "", &df), eDosFormat);
+	CHECK(HostWriteFile("IN.TXT", g_byRead, 300));
+	CHECK_EQ(DosImport(0, "IN.TXT", NULL, &dwSize), eDosFormat);
+	Unmount(0);
+	CHECK_EQ(HostReadFile("ds.dmk", g_byRead, sizeof(g_byRead)), nSize);
+	CHECK(memcmp(g_byRead, g_byData, nSize) == 0);
+
+	// a disk that was never formatted by a DOS
+	NewDisk(eDosLdos, eDD);
+	memset(g_tdDisk.bySector, 0xE5, sizeof(g_tdDisk.bySector));
+	WriteDisk("blank.dmk", 1);
+	Mount(0, "blank.dmk");
+	CHECK_EQ(DosFindFirst(0, "", &df), eDosFormat);
+
+	// an LDOS directory with a HIT entry whose directory entry is free
+	NewDisk(eDosLdos, eDD);
+	Hit()[0x44] = 0x55;
+	WriteDisk("badhit.dmk", 1);
+	Mount(0, "badhit.dmk");
+	CHECK_EQ(DosFindFirst(0, "", &df), eDosFormat);
+
+	// nothing mounted
+	Unmount(0);
+	CHECK_EQ(DosFindFirst(0, "", &df), eDosNoDisk);
+}
+
+//-----------------------------------------------------------------------------
+// BAD/DAT has the extents given (FFh ended) in place of its own, OK/DAT beside
+// it is left alone.  Returns what DosOpenRead() makes of BAD/DAT.
+static int CheckExtents(int nType, int nDensity, BYTE* pbyExtents)
+{
+	static BYTE byBad[] = {3, 0x00, 0xFF, 0xFF};
+	static BYTE byOk[]  = {4, 0x00, 0xFF, 0xFF};
+	uint32_t dwSize;
+	BYTE*    pby;
+	int      nDec, nUsed, nFiles, nResult, i;
+
+	NewDisk(nType, nDensity);
+
+	MakeData(g_byData, 1000, 5);
+	nDec = 0x42;
+	AddFile(&nDec, "BAD/DAT", DOS_ATTRIB_USED, g_byData, 1000, byBad);
+	nDec = 0x43;
+	AddFile(&nDec, "OK/DAT", DOS_ATTRIB_USED, g_byData, 1000, byOk);
+
+	pby = Entry(0x42) + DOS_DIR_EXTENTS;
+
+	for (i = 0; (i + DOS_DIR_EXTENTS < g_tdDisk.nEntrySize) && (pbyExtents[i] != 0xFF); ++i)
+	{
+		pby[i] = pbyExtents[i];
+	}
+
+	WriteDisk("extents.dmk", 1);
+	Mount(0, "extents.dmk");
+	nUsed = UsedGranules();
+
+	nResult = DosOpenRead(0, "BAD/DAT", &dwSize);
+
+	if (nResult != eDosOk)
+	{
+		// not copied out, and not freed by an import over it
+		FileDelete("BAD.DAT");
+		CHECK_EQ(DosExport(0, "BAD/DAT", &nFiles), eDosFormat);
+		CHECK_EQ(HostReadFile("BAD.DAT", g_byRead, sizeof(g_byRead)), -1);
+
+		CHECK(HostWriteFile("IN.TXT", g_byData, 100));
+		CHECK_EQ(DosImport(0, "IN.TXT", "BAD/DAT", &dwSize), eDosFormat);
+		CHECK_EQ(UsedGranules(), nUsed);
+	}
+
+	CHECK_EQ(ReadFile(0, "OK/DAT", 256), 1000);
+	CHECK(memcmp(g_byRead, g_byData, 1000) == 0);
+
+	return nResult;
+}
+
+//-----------------------------------------------------------------------------
+// extents that point outside the disk, the reads must not wrap into granules
+// of the next track or of another file
+static void TestBadExtents(void)
+{
+	static BYTE byGran3[]    = {3, 0x60, 0xFF};			// granule 3 of a 3 granule track
+	static BYTE byGran7[]    = {3, 0xE0, 0xFF};
+	static BYTE bySecond[]   = {3, 0x00, 5, 0x60, 0xFF};	// after a good one
+	static BYTE byPastEnd[]  = {39, 0x22, 0xFF};			// granules 1 to 3 of the last track
+	static BYTE byTrack[]    = {40, 0x00, 0xFF};			// a track the disk does not have
+	static BYTE byLink[]     = {3, 0x00, 0xFE, 0xFF, 0xFF};	// to a DEC with no directory entry
+	static BYTE byLast[]     = {39, 0x40, 0xFF};			// the last granule of the disk
+	static BYTE bySdGran2[]  = {5, 0x40, 0xFF};			// granule 2 of a 2 granule track
+	static BYTE bySdLast[]   = {34, 0x20, 0xFF};
+
+	CHECK_EQ(CheckExtents(eDosLdos, eDD, byGran3), eDosIoError);
+	CHECK_EQ(CheckExtents(eDosLdos, eDD, byGran7), eDosIoError);
+	CHECK_EQ(CheckExtents(eDosLdos, eDD, bySecond), eDosIoError);
+	CHECK_EQ(CheckExtents(eDosLdos, eDD, byPastEnd), eDosIoError);
+	CHECK_EQ(CheckExtents(eDosLdos, eDD, byTrack), eDosIoError);
+	CHECK_EQ(CheckExtents(eDosLdos, eDD, byLink), eDosIoError);
+	CHECK_EQ(CheckExtents(eDosLdos, eDD, byLast), eDosOk);
+
+	CHECK_EQ(CheckExtents(eDosLdos, eSD, bySdGran2), eDosIoError);
+	CHECK_EQ(CheckExtents(eDosTrsdos23, eSD, bySdGran2), eDosIoError);
+	CHECK_EQ(CheckExtents(eDosTrsdos23, eSD, bySdLast), eDosOk);
+}
+
+//-----------------------------------------------------------------------------
+int main(void)
+{
+	HostInit();
+	CacheInit();
+	FlashCacheInit();
+	FdcInvalidateTracks(-1);
+
+	TestTrsdos23();
+	TestLdos(eSD);
+	TestLdos(eDD);
+	TestNotDos();
+	TestBadExtents();
+
+	Unmount(0);
+	return HostResult("test_dos");
+}
@@ -0,0 +1,330 @@
+#include <string.h>
+
+#include "defines.h"
+#include "file.h"
+#include "fdc.h"
+#include "cache.h"
+#include "host.h"
+
+//-----------------------------------------------------------------------------
+// Flash tier of the track cache (cache.c): attach, rebuild, the signature
+// check on the next mount, stale tracks, and the cases the signature can not
+// see as the board has no clock (a power loss before the disk was quiet, an
+// image recreated with the same size).
+
+#define TEST_TRACK_SIZE 0x1900
+#define TEST_SIDES      1
+#define TEST_TRACKS     10
+#define TEST_IMAGE_SIZE (DMK_HEADER_SIZE + TEST_TRACK_SIZE * TEST_SIDES * TEST_TRACKS)
+
+static BYTE g_byImage[TEST_IMAGE_SIZE];
+static BYTE g_byTrack[MAX_TRACK_SIZE];
+static BYTE g_byScratch[MAX_TRACK_SIZE];
+
+//-----------------------------------------------------------------------------
+// every byte of a track holds its number plus byBase
+static void MakeImage(char* pszName, BYTE byBase)
+{
+	int i;
+
+	memset(g_byImage, 0, DMK_HEADER_SIZE);
+	g_byImage[1] = TEST_TRACKS;
+	g_byImage[2] = TEST_TRACK_SIZE & 0xFF;
+	g_byImage[3] = TEST_TRACK_SIZE >> 8;
+	g_byImage[4] = 0x10;
+
+	for (i = 0; i < TEST_TRACKS; ++i)
+	{
+		memset(g_byImage + DMK_HEADER_SIZE + i * TEST_TRACK_SIZE, byBase + i, TEST_TRACK_SIZE);
+	}
+
+	CHECK(HostWriteFile(pszName, g_byImage, sizeof(g_byImage)));
+}
+
+//-----------------------------------------------------------------------------
+static file* Attach(int nPart, char* pszName)
+{
+	file* f = FileOpen(pszName, FA_READ | FA_WRITE);
+
+	CHECK(f != NULL);
+	FlashCacheAttach(nPart, f, pszName, TEST_TRACK_SIZE, TEST_SIDES, TEST_TRACKS);
+
+	return f;
+}
+
+//-----------------------------------------------------------------------------
+static void Detach(int nPart, file* f)
+{
+	FlashCacheDetach(nPart);
+	FileClose(f);
+}
+
+//-----------------------------------------------------------------------------
+// runs the idle processing until it has nothing left to do
+static void ServiceUntilDone(void)
+{
+	int i;
+
+	for (i = 0; i < 4 * FLASH_CACHE_SLOTS; ++i)
+	{
+		HostAdvance(FLASH_CACHE_QUIET + 1);
+		FlashCacheService(g_byScratch);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// TRUE if the track came from flash and holds byValue
+static int ReadHit(file* f, int nTrack, BYTE byValue)
+{
+	int i;
+
+	memset(g_byTrack, 0xEE, sizeof(g_byTrack));
+
+	if (!FlashCacheRead(f, 0, nTrack, g_byTrack, TEST_TRACK_SIZE))
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < TEST_TRACK_SIZE; ++i)
+	{
+		if (g_byTrack[i] != byValue)
+		{
+			printf("track %d byte %d is %02X, expected %02X\n", nTrack, i, g_byTrack[i], byValue);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// write through to the image as fdc.c does for a track write
+static void WriteTrack(file* f, int nTrack, BYTE byValue)
+{
+	memset(g_byTrack, byValue, TEST_TRACK_SIZE);
+	FileSeek(f, DMK_HEADER_SIZE + nTrack * TEST_TRACK_SIZE);
+	CHECK_EQ(FileWrite(f, g_byTrack, TEST_TRACK_SIZE), TEST_TRACK_SIZE);
+	FileFlush(f);
+	FlashCacheInvalidate(f, 0, nTrack);
+}
+
+//-----------------------------------------------------------------------------
+// power cycle: RAM state lost, flash kept
+static void Reboot(void)
+{
+	FileCloseAll();
+	FlashCacheInit();
+}
+
+//-----------------------------------------------------------------------------
+static void TestAttachAndRebuild(void)
+{
+	file* f;
+
+	MakeImage("a.dmk", 0x10);
+	f = Attach(0, "a.dmk");
+
+	// nothing in flash until the partition has been built in idle time
+	CHECK(!ReadHit(f, 0, 0x10));
+	ServiceUntilDone();
+	CHECK(ReadHit(f, 0, 0x10));
+	CHECK(ReadHit(f, TEST_TRACKS-1, 0x10 + TEST_TRACKS-1));
+	CHECK(!FlashCacheRead(f, 0, TEST_TRACKS, g_byTrack, TEST_TRACK_SIZE));
+	CHECK(!FlashCacheRead(f, 0, 0, g_byTrack, TEST_TRACK_SIZE / 2));
+
+	Detach(0, f);
+}
+
+//-----------------------------------------------------------------------------
+static void TestSignature(void)
+{
+	file* f;
+
+	// unchanged image: flash is used straight away after a reboot
+	Reboot();
+	f = Attach(0, "a.dmk");
+	CHECK(ReadHit(f, 3, 0x13));
+	Detach(0, f);
+
+	// changed elsewhere (different size): the partition is rebuilt
+	MakeImage("a.dmk", 0x10);
+	f = FileOpen("a.dmk", FA_READ | FA_WRITE);
+	FileSeek(f, TEST_IMAGE_SIZE);
+	CHECK_EQ(FileWrite(f, g_byImage, 16), 16);
+	FileClose(f);
+
+	f = Attach(0, "a.dmk");
+	CHECK(!ReadHit(f, 3, 0x13));
+	ServiceUntilDone();
+	CHECK(ReadHit(f, 3, 0x13));
+	Detach(0, f);
+
+	// changed elsewhere (different time stamp)
+	MakeImage("a.dmk", 0x10);
+	ServiceUntilDone();
+	g_dwHostFatTime += 2;
+	MakeImage("a.dmk", 0x20);
+	f = Attach(0, "a.dmk");
+	CHECK(!ReadHit(f, 3, 0x13));
+	ServiceUntilDone();
+	CHECK(ReadHit(f, 3, 0x23));
+	Detach(0, f);
+}
+
+//-----------------------------------------------------------------------------
+static void TestInvalidate(void)
+{
+	file* f;
+
+	Reboot();
+	f = Attach(0, "a.dmk");
+	CHECK(ReadHit(f, 4, 0x24));
+
+	// the written track is not used again, the others still are
+	WriteTrack(f, 4, 0x55);
+	CHECK(!ReadHit(f, 4, 0x24));
+	CHECK(!ReadHit(f, 4, 0x55));
+	CHECK(ReadHit(f, 5, 0x25));
+
+	// power lost before the disk was quiet: same size and time stamp, the
+	// stale mark has to be in flash already
+	Reboot();
+	f = Attach(0, "a.dmk");
+	CHECK(!ReadHit(f, 4, 0x24));
+	CHECK(ReadHit(f, 5, 0x25));
+
+	// stale tracks are not filled again until the partition is rebuilt
+	ServiceUntilDone();
+	CHECK(!ReadHit(f, 4, 0x55));
+	CHECK(ReadHit(f, 6, 0x26));
+
+	// and a write of a track already stale
+	WriteTrack(f, 4, 0x56);
+	WriteTrack(f, 6, 0x66);
+	ServiceUntilDone();
+	CHECK(!ReadHit(f, 6, 0x26));
+	Detach(0, f);
+
+	Reboot();
+	f = Attach(0, "a.dmk");
+	CHECK(!ReadHit(f, 4, 0x24));
+	CHECK(!ReadHit(f, 6, 0x26));
+	CHECK(ReadHit(f, 7, 0x27));
+	Detach(0, f);
+}
+
+//-----------------------------------------------------------------------------
+// the board has no clock, so the new image has the same time stamp and size
+static void TestRecreate(void)
+{
+	file* f;
+
+	Reboot();
+	MakeImage("b.dmk", 0x30);
+	f = Attach(1, "b.dmk");
+	ServiceUntilDone();
+	CHECK(ReadHit(f, 2, 0x32));
+
+	// as FdcFormatDrive() does
+	Detach(1, f);
+	FlashCacheForget("b.dmk");
+	MakeImage("b.dmk", 0x40);
+
+	f = Attach(1, "b.dmk");
+	CHECK(!ReadHit(f, 2, 0x32));
+	ServiceUntilDone();
+	CHECK(ReadHit(f, 2, 0x42));
+
+	// as FdcStartDiskCopy() does, power lost before the copy is mounted
+	Detach(1, f);
+	FlashCacheForget("b.dmk");
+	MakeImage("b.dmk", 0x50);
+
+	Reboot();
+	f = Attach(1, "b.dmk");
+	CHECK(!ReadHit(f, 2, 0x42));
+	ServiceUntilDone();
+	CHECK(ReadHit(f, 2, 0x52));
+
+	// forgotten while still attached
+	FlashCacheForget("b.dmk");
+	CHECK(!ReadHit(f, 2, 0x52));
+	Detach(1, f);
+
+	f = Attach(1, "b.dmk");
+	CHECK(!ReadHit(f, 2, 0x52));
+	Detach(1, f);
+}
+
+//-----------------------------------------------------------------------------
+static void TestOtherPartition(void)
+{
+	file* f;
+
+	Reboot();
+	MakeImage("c.dmk", 0x60);
+	f = Attach(0, "c.dmk");
+	ServiceUntilDone();
+	CHECK(ReadHit(f, 1, 0x61));
+	Detach(0, f);
+
+	// mounted in another drive and written there
+	f = Attach(2, "c.dmk");
+	ServiceUntilDone();
+	CHECK(ReadHit(f, 1, 0x61));
+	WriteTrack(f, 1, 0x77);
+	Detach(2, f);
+
+	// back in the first drive, its old copy of track 1 must not be used
+	f = Attach(0, "c.dmk");
+	CHECK(!ReadHit(f, 1, 0x61));
+	Detach(0, f);
+}
+
+//-----------------------------------------------------------------------------
+// writes made with FLASH=0 are not followed
+static void TestDisabled(void)
+{
+	file* f;
+
+	Reboot();
+	MakeImage("d.dmk", 0x80);
+	f = Attach(0, "d.dmk");
+	ServiceUntilDone();
+	CHECK(ReadHit(f, 1, 0x81));
+	Detach(0, f);
+
+	g_byEnableFlashCache = 0;
+	Reboot();
+	f = FileOpen("d.dmk", FA_READ | FA_WRITE);
+	FileSeek(f, DMK_HEADER_SIZE + TEST_TRACK_SIZE);
+	memset(g_byTrack, 0x99, TEST_TRACK_SIZE);
+	FileWrite(f, g_byTrack, TEST_TRACK_SIZE);
+	FileClose(f);
+
+	g_byEnableFlashCache = 1;
+	Reboot();
+	f = Attach(0, "d.dmk");
+	CHECK(!ReadHit(f, 1, 0x81));
+	ServiceUntilDone();
+	CHECK(ReadHit(f, 1, 0x99));
+	Detach(0, f);
+}
+
+//-----------------------------------------------------------------------------
+int main(void)
+{
+	HostInit();
+
+	g_byEnableFlashCache = 1;
+	FlashCacheInit();
+
+	TestAttachAndRebuild();
+	TestSignature();
+	TestInvalidate();
+	TestRecreate();
+	TestOtherPartition();
+	TestDisabled();
+
+	return HostResult("test_flash_cache");
+}
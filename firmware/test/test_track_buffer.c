@@ -0,0 +1,289 @@
+#include <string.h>
+
+#include "defines.h"
+#include "file.h"
+#include "fdc.h"
+#include "cache.h"
+#include "host.h"
+
+//-----------------------------------------------------------------------------
+// The two track buffers (fdc.c): core1 (fdc_read_data() and fdc_read_status()
+// for the Z80) reads through g_ptdTrack while core0 (FdcServiceStateMachine())
+// prefetches the next track into the other buffer and hands it over with
+// FdcSwapTrack() when a command needs it.  The two are interleaved here in a
+// pseudo random order, every byte the Z80 reads has to be that of the sector
+// it asked for.
+
+extern FdcDriveType g_dtDives[MAX_DRIVES];
+extern uint32_t     g_dwTrackLoads;
+extern uint32_t     g_dwTrackPrefetchHits;
+
+void FdcReadDmkTrack(int nDrive, int nSide, int nTrack);
+
+#define TEST_TRACKS  20
+#define TEST_SECTORS 10
+
+#define STATUS_BUSY     0x01
+#define STATUS_DRQ      0x02
+#define STATUS_NOTFOUND 0x10
+
+static uint32_t g_dwRandom = 12345;
+static BYTE     g_bySector[4 * TEST_SECTORS * 256];
+
+//-----------------------------------------------------------------------------
+static int Random(int nRange)
+{
+	g_dwRandom = g_dwRandom * 1103515245 + 12345;
+	return (g_dwRandom >> 16) % nRange;
+}
+
+//-----------------------------------------------------------------------------
+static BYTE Expected(int nDrive, int nTrack, int nSector, int i)
+{
+	return (nDrive * 101 + nTrack * 31 + nSector * 7 + i) & 0xFF;
+}
+
+//-----------------------------------------------------------------------------
+static void FillDrive0(int nSide, int nTrack, int nSector, BYTE* pby)
+{
+	int i;
+
+	for (i = 0; i < 256; ++i)
+	{
+		pby[i] = Expected(0, nTrack, nSector, i);
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void FillDrive1(int nSide, int nTrack, int nSector, BYTE* pby)
+{
+	int i;
+
+	for (i = 0; i < 256; ++i)
+	{
+		pby[i] = Expected(1, nTrack, nSector, i);
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void Core0Step(void)
+{
+	HostAdvance(20 + Random(200));
+	FdcServiceStateMachine();
+}
+
+//-----------------------------------------------------------------------------
+// the Z80 side of a read sector command (cmd 88h, or 98h to read on to the end
+// of the track), with core0 run between its accesses.  Returns the number of
+// bytes read into g_bySector and the final status in *pbyStatus.
+static int Z80ReadSector(int nDrive, int nTrack, int nSector, byte byCmd, byte* pbyStatus)
+{
+	byte byStatus = 0;
+	int  nRead = 0;
+	int  i;
+
+	fdc_write_drive_select(1 << nDrive);
+	fdc_write_track(nTrack);
+	fdc_write_sector(nSector);
+	fdc_write_cmd(byCmd);
+
+	for (i = 0; i < 1000000; ++i)
+	{
+		if (Random(3) == 0)
+		{
+			Core0Step();
+			continue;
+		}
+
+		byStatus = fdc_read_status();
+
+		if ((byStatus & STATUS_DRQ) && (nRead < (int)sizeof(g_bySector)))
+		{
+			g_bySector[nRead++] = fdc_read_data();
+		}
+		else if (!(byStatus & STATUS_BUSY) && !FdcCommandPending())
+		{
+			break;
+		}
+	}
+
+	*pbyStatus = byStatus;
+	return nRead;
+}
+
+//-----------------------------------------------------------------------------
+static int CheckSectors(int nDrive, int nTrack, int nSector, int nCount)
+{
+	int nErrors = 0;
+	int i, j;
+
+	for (i = 0; i < nCount; ++i)
+	{
+		for (j = 0; j < 256; ++j)
+		{
+			if (g_bySector[i*256+j] != Expected(nDrive, nTrack, nSector + i, j))
+			{
+				++nErrors;
+			}
+		}
+	}
+
+	return nErrors;
+}
+
+//-----------------------------------------------------------------------------
+static void Mount(int nDrive, char* pszName)
+{
+	strcpy(g_dtDives[nDrive].szFileName, pszName);
+	FdcMountDrive(nDrive);
+	CHECK(g_dtDives[nDrive].f != NULL);
+}
+
+//-----------------------------------------------------------------------------
+// every sector of every track in order, as a BACKUP does, the next track is
+// prefetched while the Z80 reads the current one
+static void TestSequential(void)
+{
+	uint32_t dwHits = g_dwTrackPrefetchHits;
+	byte     byStatus;
+	int      nErrors = 0;
+	int      nTrack, nSector;
+
+	for (nTrack = 0; nTrack < TEST_TRACKS; ++nTrack)
+	{
+		for (nSector = 0; nSector < TEST_SECTORS; ++nSector)
+		{
+			CHECK_EQ(Z80ReadSector(0, nTrack, nSector, 0x88, &byStatus), 256);
+			CHECK_EQ(byStatus & (STATUS_BUSY | STATUS_NOTFOUND), 0);
+			nErrors += CheckSectors(0, nTrack, nSector, 1);
+		}
+	}
+
+	CHECK_EQ(nErrors, 0);
+	CHECK(g_dwTrackPrefetchHits - dwHits >= TEST_TRACKS - 2);
+}
+
+//-----------------------------------------------------------------------------
+// read multiple, core0 resolves the next sector while core1 sends the current
+// one and core1 carries on with it
+static void TestMultiple(void)
+{
+	byte byStatus;
+	int  nErrors = 0;
+	int  nTrack, nRead;
+
+	for (nTrack = 0; nTrack < TEST_TRACKS; nTrack += 3)
+	{
+		nRead = Z80ReadSector(0, nTrack, 2, 0x98, &byStatus);
+		CHECK_EQ(nRead, (TEST_SECTORS - 2) * 256);
+		CHECK(byStatus & STATUS_NOTFOUND);
+		nErrors += CheckSectors(0, nTrack, 2, nRead / 256);
+	}
+
+	CHECK_EQ(nErrors, 0);
+}
+
+//-----------------------------------------------------------------------------
+// sectors of two drives in turn, as a copy between them: each command swaps
+// in a track of the other drive, and the prefetch has to leave a buffer that
+// holds the other drive's track alone
+static void TestTwoDrives(void)
+{
+	byte byStatus;
+	int  nErrors = 0;
+	int  i, nTrack, nSector;
+
+	for (i = 0; i < 60; ++i)
+	{
+		nTrack  = Random(TEST_TRACKS);
+		nSector = Random(TEST_SECTORS);
+
+		CHECK_EQ(Z80ReadSector(i & 1, nTrack, nSector, 0x88, &byStatus), 256);
+		nErrors += CheckSectors(i & 1, nTrack, nSector, 1);
+	}
+
+	CHECK_EQ(nErrors, 0);
+}
+
+//-----------------------------------------------------------------------------
+// a track handed over while core1 is part way through a sector of the old one:
+// the old buffer is left as it was and has no transfer left in it, and core1
+// gets nothing more from either buffer until the next command
+static void TestHandover(void)
+{
+	TrackType* ptdOld;
+	BYTE*      pbyOld;
+	BYTE       byOld[16];
+	byte       byStatus;
+	int        i;
+
+	fdc_write_drive_select(1);
+	fdc_write_track(4);
+	fdc_write_sector(3);
+	fdc_write_cmd(0x88);
+
+	for (i = 0; (i < 10000) && !(fdc_read_status() & STATUS_DRQ); ++i)
+	{
+		Core0Step();
+	}
+
+	for (i = 0; i < 100; ++i)
+	{
+		CHECK_EQ(fdc_read_data(), Expected(0, 4, 3, i));
+	}
+
+	// what core1 would read next, had it loaded g_ptdTrack just before
+	ptdOld = g_ptdTrack;
+	pbyOld = ptdOld->pbyReadPtr;
+	memcpy(byOld, pbyOld, sizeof(byOld));
+
+	FdcReadDmkTrack(0, 0, 9);
+
+	CHECK(g_ptdTrack != ptdOld);
+	CHECK(memcmp(pbyOld, byOld, sizeof(byOld)) == 0);
+	CHECK_EQ(ptdOld->nReadCount, 0);
+	CHECK_EQ(ptdOld->nWriteCount, 0);
+	CHECK_EQ(g_ptdTrack->nReadCount, 0);
+	CHECK_EQ(g_ptdTrack->nWriteCount, 0);
+
+	fdc_read_data();
+	CHECK(!(fdc_read_status() & STATUS_DRQ));
+
+	// the controller carries on as usual
+	fdc_write_cmd(0xD0);
+
+	for (i = 0; i < 100; ++i)
+	{
+		Core0Step();
+	}
+
+	CHECK_EQ(Z80ReadSector(0, 9, 5, 0x88, &byStatus), 256);
+	CHECK_EQ(CheckSectors(0, 9, 5, 1), 0);
+}
+
+//-----------------------------------------------------------------------------
+int main(void)
+{
+	int i;
+
+	HostInit();
+
+	CHECK(HostWriteDmk("d0.dmk", TEST_TRACKS, 1, eSD, TEST_SECTORS, FillDrive0));
+	CHECK(HostWriteDmk("d1.dmk", TEST_TRACKS, 1, eSD, TEST_SECTORS, FillDrive1));
+
+	FdcInit();
+	Mount(0, "d0.dmk");
+	Mount(1, "d1.dmk");
+
+	for (i = 0; i < 100; ++i)
+	{
+		Core0Step();
+	}
+
+	TestSequential();
+	TestMultiple();
+	TestTwoDrives();
+	TestHandover();
+
+	return HostResult("test_track_buffer");
+}